@@ -0,0 +1,110 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+
+//==============================================================================
+// Which stage of the pipeline the calling thread is in, for a build with
+// LOOP4R_ALLOCATION_STAGES defined to charge each heap allocation to, count
+// and bytes, from the malloc() stand-ins in Benchmark.h. A Scope sets the
+// stage until it ends, nested scopes restore the outer one. Without the
+// option a Scope is empty and nothing is counted.
+struct AllocationStages
+{
+    enum Stage
+    {
+        Other,
+        Receive,        // the receiver thread handing packets on
+        Parse,          // decoding a packet
+        Dispatch,       // routing a message to its handler
+        Handler,        // the handlers
+        MidiOutput,     // flushing to the boards
+        numStages
+    };
+
+    static const char* getName(int stage)
+    {
+        static const char* const names[numStages] = { "other", "receive", "parse", "dispatch", "handler", "midi" };
+        return isPositiveAndBelow(stage, (int)numStages) ? names[stage] : "other";
+    }
+
+   #ifdef LOOP4R_ALLOCATION_STAGES
+    static const bool enabled = true;
+
+    static int& current()
+    {
+        static thread_local int stage = Other;
+        return stage;
+    }
+
+    // from the malloc() stand-ins, so nothing here may allocate
+    static void allocated(size_t size)
+    {
+        const int stage = current();
+        counts()[stage].fetch_add(1, std::memory_order_relaxed);
+        bytes()[stage].fetch_add((int64)size, std::memory_order_relaxed);
+    }
+
+    static int64 getCount(int stage)    { return counts()[stage].load(std::memory_order_relaxed); }
+    static int64 getBytes(int stage)    { return bytes()[stage].load(std::memory_order_relaxed); }
+
+    struct Scope
+    {
+        Scope(Stage stage)
+            : previous_(current())
+        {
+            current() = stage;
+        }
+
+        ~Scope()
+        {
+            current() = previous_;
+        }
+
+        int previous_;
+    };
+
+private:
+    // zero before anything runs, without a guard that could allocate
+    static std::atomic<int64>* counts()
+    {
+        static std::atomic<int64> values[numStages];
+        return values;
+    }
+
+    static std::atomic<int64>* bytes()
+    {
+        static std::atomic<int64> values[numStages];
+        return values;
+    }
+   #else
+    static const bool enabled = false;
+
+    static int64 getCount(int)          { return 0; }
+    static int64 getBytes(int)          { return 0; }
+
+    struct Scope
+    {
+        Scope(Stage) {}
+    };
+   #endif
+};
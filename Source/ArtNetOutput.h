@@ -0,0 +1,247 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "OscOutput.h"
+
+//==============================================================================
+// Mirrors the looper LEDs onto DMX fixtures over Art-Net, for lighting that
+// follows the loops: three channels (red, green, blue) per LED in the colour
+// of its state from channel 1 of the first universe on, 170 LEDs to a
+// universe, and optionally a wash fixture of three channels merging every
+// looper's LEDs into one colour, that of the highest state any of them is
+// in (highest takes precedence, as DMX merges do). A blinking LED's
+// fixture blinks with it, the wash stays on the state's colour.
+//
+// The bridge's fan-out hands over the LED state on a thread of its own,
+// which only renders the channels. A thread of its own sends ArtDmx packets
+// at the frame rate, only for the universes that changed since the last
+// frame. It also sends each universe once a second, so a node that missed a
+// packet or came up late catches up. Each universe's packet numbers go from
+// 1 to 255 and around again.
+class ArtNetOutput : private Thread
+{
+public:
+    static const int port = 6454;
+    static const int maxLeds = 128;
+    static const int numStates = 4;
+    static const int ledsPerUniverse = 170;
+    static const int maxUniverses = (maxLeds + ledsPerUniverse - 1) / ledsPerUniverse;
+
+    ArtNetOutput()
+        : Thread("loop4r artnet")
+    {
+        // dark, lit, blinking, blinking fast
+        const uint32 defaults[numStates] = { 0x000000, 0x00ff00, 0xffa000, 0xff0000 };
+        for (int state = 0; state < numStates; ++state)
+            colours_[state] = defaults[state];
+    }
+
+    ~ArtNetOutput()
+    {
+        close();
+    }
+
+    // host may be a broadcast address; universe is the 15 bit port-address
+    // of the first universe
+    bool open(const String& host, int universe, int framesPerSecond)
+    {
+        close();
+        output_.setBroadcast(true);
+        if (! output_.connect(host, port))
+            return false;
+
+        firstUniverse_ = universe & 0x7fff;
+        frameMs_ = 1000.0 / jlimit(1, 44, framesPerSecond);
+        startThread();
+        return true;
+    }
+
+    void close()
+    {
+        stopThread(1000);
+        output_.disconnect();
+    }
+
+    bool isOpen() const
+    {
+        return output_.isConnected();
+    }
+
+    // 0xrrggbb for one of the LED states
+    void setColour(int state, uint32 rgb)
+    {
+        const ScopedLock sl(lock_);
+        if (isPositiveAndBelow(state, numStates))
+            colours_[state] = rgb & 0xffffff;
+    }
+
+    // the first of the wash's three channels in the first universe, 0 for
+    // none; the LEDs shown keep their channels if they reach into it
+    void setWashChannel(int channel)
+    {
+        const ScopedLock sl(lock_);
+        washChannel_ = jlimit(0, dmxSize - 2, channel);
+    }
+
+    // whether a wash from channel would share channels with the first
+    // numLeds LEDs
+    static bool overlapsLeds(int channel, int numLeds)
+    {
+        return channel > 0 && channel <= 3 * jmin(numLeds, ledsPerUniverse);
+    }
+
+    // staged by the thread that shows the frames, until it calls commit()
+    void setLed(int index, int state, bool on)
+    {
+        if (isPositiveAndBelow(index, maxLeds))
+        {
+            states_[index] = (uint8)jlimit(0, numStates - 1, state);
+            on_[index] = on;
+        }
+    }
+
+    // LEDs past the looper's count go dark
+    void setNumLeds(int numLeds)
+    {
+        const ScopedLock sl(lock_);
+        numLeds_ = jlimit(0, maxLeds, numLeds);
+    }
+
+    // renders what was staged into the channels the thread sends
+    void commit()
+    {
+        const ScopedLock sl(lock_);
+        int washState = 0;
+        for (int i = 0; i < maxLeds; ++i)
+        {
+            const bool shown = i < numLeds_;
+            const uint32 rgb = shown && on_[i] ? colours_[states_[i]] : colours_[0];
+            uint8* channels = dmx_[i / ledsPerUniverse] + 3 * (i % ledsPerUniverse);
+            channels[0] = (uint8)(rgb >> 16);
+            channels[1] = (uint8)(rgb >> 8);
+            channels[2] = (uint8)rgb;
+            if (shown)
+                washState = jmax(washState, (int)states_[i]);
+        }
+
+        if (washChannel_ > 0 && ! overlapsLeds(washChannel_, numLeds_))
+        {
+            const uint32 rgb = colours_[washState];
+            uint8* channels = dmx_[0] + washChannel_ - 1;
+            channels[0] = (uint8)(rgb >> 16);
+            channels[1] = (uint8)(rgb >> 8);
+            channels[2] = (uint8)rgb;
+        }
+    }
+
+    int64 getPacketsSent() const    { return packetsSent_.get(); }
+    int64 getFailedSends() const    { return failedSends_.get(); }
+
+private:
+    static const int dmxSize = 512;
+    static const int headerSize = 18;
+    static const int refreshMs = 1000;
+
+    void run() override
+    {
+        double nextMs = Time::getMillisecondCounterHiRes();
+        double refreshedMs[maxUniverses] = {};
+        uint8 packet[headerSize + dmxSize];
+        while (! threadShouldExit())
+        {
+            const double nowMs = Time::getMillisecondCounterHiRes();
+            for (int universe = 0; universe < getNumUniverses(); ++universe)
+            {
+                {
+                    const ScopedLock sl(lock_);
+                    if (memcmp(dmx_[universe], sent_[universe], dmxSize) == 0 && nowMs - refreshedMs[universe] < refreshMs)
+                        continue;
+                    memcpy(sent_[universe], dmx_[universe], dmxSize);
+                }
+
+                refreshedMs[universe] = nowMs;
+                const int size = makePacket(packet, universe);
+                if (output_.send(packet, (size_t)size))
+                    ++packetsSent_;
+                else
+                    ++failedSends_;
+            }
+
+            // the frames keep to the rate however long a send took
+            nextMs += frameMs_;
+            const double waitMs = nextMs - Time::getMillisecondCounterHiRes();
+            if (waitMs < -frameMs_)
+                nextMs = Time::getMillisecondCounterHiRes();
+            else if (waitMs > 0.0)
+                wait(jmax(1, (int)waitMs));
+        }
+    }
+
+    // the universes the LEDs reach, the wash's included
+    int getNumUniverses() const
+    {
+        const ScopedLock sl(lock_);
+        return jmax(1, (numLeds_ + ledsPerUniverse - 1) / ledsPerUniverse);
+    }
+
+    // ArtDmx: the id, the opcode little endian, protocol version 14, the
+    // sequence, the physical port, the port-address low byte then high,
+    // the channel count big endian and the channels
+    int makePacket(uint8* packet, int universe)
+    {
+        static const char id[8] = { 'A', 'r', 't', '-', 'N', 'e', 't', 0 };
+        const int address = (firstUniverse_ + universe) & 0x7fff;
+        uint8& sequence = sequences_[universe];
+        sequence = (uint8)(sequence == 255 ? 1 : sequence + 1);
+
+        memcpy(packet, id, sizeof(id));
+        packet[8] = 0x00;
+        packet[9] = 0x50;
+        packet[10] = 0;
+        packet[11] = 14;
+        packet[12] = sequence;
+        packet[13] = 0;
+        packet[14] = (uint8)(address & 0xff);
+        packet[15] = (uint8)(address >> 8);
+        packet[16] = (uint8)(dmxSize >> 8);
+        packet[17] = (uint8)(dmxSize & 0xff);
+        memcpy(packet + headerSize, sent_[universe], dmxSize);
+        return headerSize + dmxSize;
+    }
+
+    OscOutput output_;
+    int firstUniverse_ = 0;
+    double frameMs_ = 1000.0 / 30.0;
+    uint32 colours_[numStates];     // with lock_ held
+    int washChannel_ = 0;           // with lock_ held
+    int numLeds_ = 0;               // with lock_ held
+
+    // staged by the thread showing the frames
+    uint8 states_[maxLeds] = {};
+    bool on_[maxLeds] = {};
+
+    CriticalSection lock_;
+    uint8 dmx_[maxUniverses][dmxSize] = {};
+    uint8 sent_[maxUniverses][dmxSize] = {};   // by the thread only
+    uint8 sequences_[maxUniverses] = {};
+    Atomic<int64> packetsSent_ { 0 };
+    Atomic<int64> failedSends_ { 0 };
+};
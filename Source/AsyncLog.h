@@ -0,0 +1,195 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "FutexEvent.h"
+
+//==============================================================================
+// Log lines are copied into a fixed ring of slots and written to stdout and
+// stderr by a background thread, so a slow pipe (journald) never blocks the
+// thread that logs. Callers check wants() before formatting anything, so
+// lines above the configured level cost a compare.
+class AsyncLog : private Thread
+{
+public:
+    enum Level
+    {
+        Error,
+        Info,
+        Debug
+    };
+
+    AsyncLog(int numSlots = 256)
+        : Thread("loop4r log"),
+          fifo_(numSlots)
+    {
+        slots_.calloc((size_t)numSlots);
+    }
+
+    ~AsyncLog()
+    {
+        stop();
+    }
+
+    void start()
+    {
+        startThread(0);
+    }
+
+    // writes out whatever is still queued, then stops
+    void stop()
+    {
+        signalThreadShouldExit();
+        wakeup_.signal();
+        stopThread(1000);
+        writeQueued();
+    }
+
+    void setLevel(int level)
+    {
+        level_ = jlimit((int)Error, (int)Debug, level);
+    }
+
+    bool wants(Level level) const
+    {
+        return level <= level_;
+    }
+
+    void write(Level level, const String& text)
+    {
+        if (! wants(level))
+            return;
+
+        // several threads log, the fifo wants a single producer
+        const SpinLock::ScopedLockType sl(producerLock_);
+        int start1, size1, start2, size2;
+        fifo_.prepareToWrite(1, start1, size1, start2, size2);
+        if (size1 == 0)
+        {
+            ++dropped_;
+            return;
+        }
+
+        Slot& slot = slots_[start1];
+        slot.level = level;
+        text.copyToUTF8(slot.text, sizeof(slot.text));
+        fifo_.finishedWrite(1);
+
+        if (isThreadRunning())
+            wakeup_.signal();
+        else
+            writeQueued();
+    }
+
+private:
+    struct Slot
+    {
+        int level;
+        char text[248];
+    };
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            wakeup_.wait(-1);
+            writeQueued();
+        }
+    }
+
+    void writeQueued()
+    {
+        int start1, size1, start2, size2;
+        fifo_.prepareToRead(fifo_.getNumReady(), start1, size1, start2, size2);
+        for (int i = 0; i < size1; ++i)
+            writeSlot(slots_[start1 + i]);
+        for (int i = 0; i < size2; ++i)
+            writeSlot(slots_[start2 + i]);
+        fifo_.finishedRead(size1 + size2);
+
+        int dropped = dropped_.exchange(0);
+        if (dropped > 0)
+            std::cerr << dropped << " log lines dropped" << std::endl;
+    }
+
+    void writeSlot(const Slot& slot)
+    {
+        if (slot.level == Error)
+            std::cerr << slot.text << std::endl;
+        else
+            std::cout << slot.text << std::endl;
+    }
+
+    AbstractFifo fifo_;
+    HeapBlock<Slot> slots_;
+    FutexEvent wakeup_;
+    SpinLock producerLock_;
+    Atomic<int> dropped_ { 0 };
+    int level_ = Info;
+};
+
+//==============================================================================
+// Lets the first few of a kind of error through each interval and counts the
+// rest, so a stray sender can't keep the thread that handles its packets
+// busy formatting log lines. takeSuppressed() starts each interval and is to
+// be called before note(), and now and then to report the last one once the
+// errors stop. Not thread safe, the caller guards it.
+class LogThrottle
+{
+public:
+    LogThrottle(double intervalMs = 1000.0, int perInterval = 4)
+        : intervalMs_(intervalMs),
+          perInterval_(perInterval)
+    {
+    }
+
+    // counts an error, true if it is one to log
+    bool note()
+    {
+        if (logged_ < perInterval_)
+        {
+            ++logged_;
+            return true;
+        }
+        ++suppressed_;
+        return false;
+    }
+
+    // once the interval is over, starts the next and returns how many
+    // errors of it were not logged; 0 until then or if all were
+    int takeSuppressed(double nowMs)
+    {
+        if (nowMs - startMs_ < intervalMs_)
+            return 0;
+
+        int suppressed = suppressed_;
+        suppressed_ = 0;
+        startMs_ = nowMs;
+        logged_ = 0;
+        return suppressed;
+    }
+
+private:
+    double intervalMs_;
+    int perInterval_;
+    double startMs_ = -1.0e9;
+    int logged_ = 0;
+    int suppressed_ = 0;
+};
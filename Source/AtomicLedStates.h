@@ -0,0 +1,121 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "LedState.h"
+#include <atomic>
+
+//==============================================================================
+// The LED states for threads other than the one keeping them, without a
+// lock: each LED is one 32 bit word, so a reader sees all of an update or
+// none of it, never the state of one and the timer of another. Every change
+// bumps the LED's generation and sets its bit in a dirty mask, which a
+// consumer swaps for an empty one to learn what changed since it last
+// looked. One thread publishes, any number read; takeDirty() is for one
+// consumer at a time.
+class AtomicLedStates
+{
+public:
+    static const int capacity = 128;
+
+    struct Led
+    {
+        bool on = false;
+        int state = 0;              // 0..3, dark, lit, blink and fast blink
+        bool litAtOrigin = false;   // the blink phase
+        int timer = 0;              // in ticks, up to 4095
+        int generation = 0;         // counts changes, wrapping at 16 bits
+
+        static uint32 pack(bool on, int state, bool litAtOrigin, int timer)
+        {
+            return (on ? 1u : 0u)
+                 | ((uint32)(state & 3) << 1)
+                 | (litAtOrigin ? 8u : 0u)
+                 | ((uint32)jlimit(0, 0xfff, timer) << 4);
+        }
+
+        static Led unpack(uint32 word)
+        {
+            Led led;
+            led.on = (word & 1) != 0;
+            led.state = (int)((word >> 1) & 3);
+            led.litAtOrigin = (word & 8) != 0;
+            led.timer = (int)((word >> 4) & 0xfff);
+            led.generation = (int)(word >> 16);
+            return led;
+        }
+    };
+
+    // the publishing thread; returns false if the LED already showed this
+    bool set(int index, bool on, int state, bool litAtOrigin, int timer)
+    {
+        if (! isPositiveAndBelow(index, capacity))
+            return false;
+
+        const uint32 previous = words_[index].load(std::memory_order_relaxed);
+        const uint32 state16 = Led::pack(on, state, litAtOrigin, timer);
+        if ((previous & 0xffff) == state16)
+            return false;
+
+        words_[index].store((previous & 0xffff0000) + 0x10000 + state16, std::memory_order_release);
+        dirty_[index >> 6].fetch_or((uint64)1 << (index & 63), std::memory_order_release);
+        changes_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // the publishing thread; LEDs from numLeds on count as dark
+    void setNumLeds(int numLeds)
+    {
+        numLeds = jlimit(0, capacity, numLeds);
+        for (int i = numLeds; i < numLeds_.load(std::memory_order_relaxed); ++i)
+            set(i, false, 0, false, 0);
+        numLeds_.store(numLeds, std::memory_order_release);
+    }
+
+    int getNumLeds() const
+    {
+        return numLeds_.load(std::memory_order_acquire);
+    }
+
+    Led get(int index) const
+    {
+        return isPositiveAndBelow(index, capacity) ? Led::unpack(words_[index].load(std::memory_order_acquire)) : Led();
+    }
+
+    // what changed since the last call, as LED indices
+    LedBits takeDirty()
+    {
+        LedBits dirty;
+        for (int i = 0; i < 2; ++i)
+            dirty.words[i] = dirty_[i].exchange(0, std::memory_order_acq_rel);
+        return dirty;
+    }
+
+    int64 getNumChanges() const
+    {
+        return changes_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint32> words_[capacity] {};
+    std::atomic<uint64> dirty_[2] {};
+    std::atomic<int> numLeds_ { 0 };
+    std::atomic<int64> changes_ { 0 };
+};
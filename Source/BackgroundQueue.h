@@ -0,0 +1,155 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <functional>
+
+//==============================================================================
+// Housekeeping for the message thread (command lines, config reloads,
+// writing out traces) queued behind what the performer sees. Juce dispatches
+// its messages in the order they were posted, so a reload posted just
+// before a burst of LED packets would hold all of them up. Here only one
+// message is ever in juce's queue for these tasks, and it runs exactly one
+// task, after running the urgent callback (draining the packet queue) if it
+// has anything waiting, and then posts itself again for the next one. LED
+// messages posted meanwhile thus go first. So that a steady stream of
+// packets can't starve them, runOverdue() lets tasks that waited longer than
+// maxWaitMs run between two batches of urgent work. post() is safe from any
+// thread, the tasks run on the message thread.
+class BackgroundQueue
+{
+public:
+    typedef std::function<void()> Task;
+
+    BackgroundQueue(double maxWaitMs = 100.0)
+        : maxWaitMs_(maxWaitMs)
+    {
+    }
+
+    // what goes first, both called on the message thread
+    void setUrgent(std::function<bool()> hasUrgent, Task urgent)
+    {
+        hasUrgent_ = hasUrgent;
+        urgent_ = urgent;
+    }
+
+    void post(Task task)
+    {
+        bool wake;
+        {
+            const ScopedLock sl(lock_);
+            tasks_.add({ task, Time::getMillisecondCounterHiRes() });
+            wake = ! messagePosted_;
+            messagePosted_ = true;
+        }
+        if (wake)
+            (new Message(*this))->post();
+    }
+
+    // from within urgent work on the message thread, runs the tasks that
+    // waited too long; returns how many
+    int runOverdue()
+    {
+        int run = 0;
+        while (runNext(Time::getMillisecondCounterHiRes() - maxWaitMs_))
+            ++run;
+        return run;
+    }
+
+    int getNumQueued() const
+    {
+        const ScopedLock sl(lock_);
+        return tasks_.size();
+    }
+
+    // tasks that had to wait for urgent work first
+    int64 getNumDeferred() const   { return deferred_.get(); }
+    int64 getNumOverdue() const    { return overdue_.get(); }
+
+private:
+    struct Queued
+    {
+        Task task;
+        double postedMs;
+    };
+
+    struct Message : public CallbackMessage
+    {
+        Message(BackgroundQueue& owner)
+            : owner_(owner)
+        {
+        }
+
+        void messageCallback() override
+        {
+            owner_.dispatch();
+        }
+
+        BackgroundQueue& owner_;
+    };
+
+    void dispatch()
+    {
+        if (hasUrgent_ != nullptr && hasUrgent_())
+        {
+            ++deferred_;
+            urgent_();
+        }
+
+        runNext(-1.0);
+
+        bool more;
+        {
+            const ScopedLock sl(lock_);
+            more = ! tasks_.isEmpty();
+            messagePosted_ = more;
+        }
+        if (more)
+            (new Message(*this))->post();
+    }
+
+    // the oldest task if it was posted before postedBeforeMs, any with a
+    // negative time
+    bool runNext(double postedBeforeMs)
+    {
+        Task task;
+        {
+            const ScopedLock sl(lock_);
+            if (tasks_.isEmpty() || (postedBeforeMs >= 0.0 && tasks_.getReference(0).postedMs > postedBeforeMs))
+                return false;
+            if (postedBeforeMs >= 0.0)
+                ++overdue_;
+            task = tasks_.getReference(0).task;
+            tasks_.remove(0);
+        }
+        task();
+        return true;
+    }
+
+    CriticalSection lock_;
+    Array<Queued> tasks_;
+    bool messagePosted_ = false;
+    double maxWaitMs_;
+    std::function<bool()> hasUrgent_;
+    Task urgent_;
+    Atomic<int64> deferred_ { 0 };
+    Atomic<int64> overdue_ { 0 };
+};
@@ -0,0 +1,240 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "AllocationStages.h"
+#include "PerfCounters.h"
+#include <time.h>
+
+//==============================================================================
+// Counts the heap allocations made on each thread, by standing in for
+// glibc's malloc(), calloc() and realloc() and passing the calls on. Costs a
+// thread local increment per allocation. Defines the functions themselves,
+// so only Main.cpp may include it. Only built in for measuring: without
+// LOOP4R_ALLOCATION_COUNT malloc is left alone and the count stays at 0;
+// LOOP4R_ALLOCATION_STAGES implies it, and also charges each allocation to
+// the stage in AllocationStages.h.
+#if defined (LOOP4R_ALLOCATION_STAGES) && ! defined (LOOP4R_ALLOCATION_COUNT)
+ #define LOOP4R_ALLOCATION_COUNT 1
+#endif
+
+#ifdef LOOP4R_ALLOCATION_COUNT
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* pointer, size_t size);
+
+static thread_local int64 loop4rAllocations = 0;
+
+extern "C" void* malloc(size_t size)
+{
+    ++loop4rAllocations;
+   #ifdef LOOP4R_ALLOCATION_STAGES
+    AllocationStages::allocated(size);
+   #endif
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size)
+{
+    ++loop4rAllocations;
+   #ifdef LOOP4R_ALLOCATION_STAGES
+    AllocationStages::allocated(count * size);
+   #endif
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size)
+{
+    if (size > 0)
+        ++loop4rAllocations;
+   #ifdef LOOP4R_ALLOCATION_STAGES
+    if (size > 0)
+        AllocationStages::allocated(size);
+   #endif
+    return __libc_realloc(pointer, size);
+}
+
+#endif
+
+//==============================================================================
+// Times a piece of code over many iterations after a warm up, in ns per
+// iteration on CLOCK_MONOTONIC, and counts what it allocated, and with
+// hardware counters the cycles, instructions, branch and cache misses per
+// iteration too; the results come out as JSON to compare between versions.
+// With repeats the iterations are timed that many times over and the median
+// and 95th percentile of the runs reported, the median as ns_per_op. Given
+// the JSON of an earlier run as a baseline, each benchmark whose median is
+// more than a tolerance slower than there, or that allocates more, is
+// marked as a regression.
+class Benchmark
+{
+public:
+    static int64 getAllocations()
+    {
+       #ifdef LOOP4R_ALLOCATION_COUNT
+        return loop4rAllocations;
+       #else
+        return 0;
+       #endif
+    }
+
+    // before the runs; returns false if the kernel gave us no counters
+    bool enableCounters()
+    {
+        return counters_.open();
+    }
+
+    // before the runs, how many times to time the iterations
+    void setRepeats(int repeats)
+    {
+        repeats_ = jlimit(1, 1000, repeats);
+    }
+
+    // before the runs: the JSON toJson() gave for an earlier version, and
+    // how many percent slower than there a median may be
+    bool setBaseline(const String& json, double tolerancePercent)
+    {
+        var baseline = JSON::parse(json);
+        if (! baseline.getProperty("benchmarks", var()).isArray())
+            return false;
+
+        baseline_ = baseline.getProperty("benchmarks", var());
+        tolerance_ = jmax(0.0, tolerancePercent) / 100.0;
+        return true;
+    }
+
+    int getNumRegressions() const
+    {
+        return numRegressions_;
+    }
+
+    // the median of the benchmark of that name, 0 if it hasn't run
+    double getNsPerOp(const String& name) const
+    {
+        for (auto& result : results_)
+            if (result.getProperty("name", var()).toString() == name)
+                return result.getProperty("ns_per_op", 0.0);
+        return 0.0;
+    }
+
+    const Array<var>& getResults() const
+    {
+        return results_;
+    }
+
+    template <typename Function>
+    void run(const String& name, int iterations, Function function)
+    {
+        iterations = jmax(1, iterations);
+        for (int i = 0; i < jmax(1, iterations / 10); ++i)
+            function(i);
+
+        Array<double> runs;
+        runs.ensureStorageAllocated(repeats_);
+        const int64 allocations = getAllocations();
+        counters_.start();
+        for (int repeat = 0; repeat < repeats_; ++repeat)
+        {
+            const int64 startNs = now();
+            for (int i = 0; i < iterations; ++i)
+                function(i);
+            runs.add((double)(now() - startNs) / iterations);
+        }
+        counters_.stop();
+        runs.sort();
+
+        const int64 total = (int64)iterations * repeats_;
+        const double nsPerOp = runs[(runs.size() - 1) / 2];
+        const double allocsPerOp = (double)(getAllocations() - allocations) / (double)total;
+        auto* result = new DynamicObject();
+        result->setProperty("name", name);
+        result->setProperty("iterations", iterations);
+        result->setProperty("ns_per_op", nsPerOp);
+        if (repeats_ > 1)
+        {
+            result->setProperty("repeats", repeats_);
+            result->setProperty("p95_ns_per_op", runs[jmin(runs.size() - 1, (int)std::ceil(0.95 * runs.size()) - 1)]);
+            result->setProperty("min_ns_per_op", runs.getFirst());
+        }
+        result->setProperty("allocs_per_op", allocsPerOp);
+        for (int counter = 0; counter < PerfCounters::numCounters; ++counter)
+        {
+            const int64 count = counters_.read(counter);
+            if (count >= 0)
+                result->setProperty(String(PerfCounters::getName(counter)) + "_per_op", (double)count / (double)total);
+        }
+        compareWithBaseline(*result, name, nsPerOp, allocsPerOp);
+        results_.add(var(result));
+    }
+
+    String toJson() const
+    {
+        auto* root = new DynamicObject();
+        root->setProperty("version", ProjectInfo::versionString);
+       #ifdef LOOP4R_ALLOCATION_COUNT
+        root->setProperty("allocations_counted", true);
+       #else
+        root->setProperty("allocations_counted", false);
+       #endif
+        root->setProperty("benchmarks", results_);
+        if (baseline_.isArray())
+            root->setProperty("regressions", numRegressions_);
+        return JSON::toString(var(root));
+    }
+
+private:
+    // a benchmark the baseline doesn't have passes
+    void compareWithBaseline(DynamicObject& result, const String& name, double nsPerOp, double allocsPerOp)
+    {
+        if (! baseline_.isArray())
+            return;
+
+        for (auto& earlier : *baseline_.getArray())
+        {
+            if (earlier.getProperty("name", var()).toString() != name)
+                continue;
+
+            const double baselineNs = earlier.getProperty("ns_per_op", 0.0);
+            const double baselineAllocs = earlier.getProperty("allocs_per_op", 0.0);
+            const bool regressed = nsPerOp > baselineNs * (1.0 + tolerance_) || allocsPerOp > baselineAllocs + 0.001;
+            result.setProperty("baseline_ns_per_op", baselineNs);
+            result.setProperty("regressed", regressed);
+            if (regressed)
+                ++numRegressions_;
+            return;
+        }
+    }
+
+    static int64 now()
+    {
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return (int64)time.tv_sec * 1000000000 + time.tv_nsec;
+    }
+
+    PerfCounters counters_;
+    Array<var> results_;
+    int repeats_ = 1;
+    var baseline_;
+    double tolerance_ = 0.0;
+    int numRegressions_ = 0;
+};
@@ -0,0 +1,182 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "ThreadTuning.h"
+#include <functional>
+
+//==============================================================================
+// A blinking LED as a function of time: lit as litAtOrigin for the first
+// half period from originMs, then flipping every half period. Nothing is
+// counted down per tick, so whoever drives the blinking only needs to wake
+// when the next LED flips, and LEDs sharing a phase flip in the same write.
+struct BlinkPhase
+{
+    double originMs = 0.0;
+    bool litAtOrigin = false;
+
+    bool isLit(double halfPeriodMs, double nowMs) const
+    {
+        return litAtOrigin != ((getHalfPeriods(halfPeriodMs, nowMs) & 1) != 0);
+    }
+
+    double getNextFlipMs(double halfPeriodMs, double nowMs) const
+    {
+        return originMs + (double)(getHalfPeriods(halfPeriodMs, nowMs) + 1) * halfPeriodMs;
+    }
+
+private:
+    int64 getHalfPeriods(double halfPeriodMs, double nowMs) const
+    {
+        return nowMs <= originMs ? 0 : (int64)std::floor((nowMs - originMs) / jmax(1.0, halfPeriodMs));
+    }
+};
+
+//==============================================================================
+// Drives blinking from a HighResolutionTimer instead of the 200 ms message
+// thread timer. The timer ticks at the greatest common divisor of the two
+// blink periods, so every toggle lands exactly on a tick, and the tick
+// callback runs on the timer's own thread with the current time in ms, unless
+// an event loop drives it, calling tick() every getTickMs() itself. It also
+// gets what the stamp function returned just before the time was read, so
+// the caller can tell changes made before the tick from those after it.
+class BlinkEngine : private HighResolutionTimer
+{
+public:
+    typedef std::function<uint32()> Stamp;
+    typedef std::function<void(double nowMs, uint32 stamp)> Callback;
+
+    BlinkEngine(Stamp stamp, Callback callback)
+        : stamp_(stamp),
+          callback_(callback)
+    {
+    }
+
+    ~BlinkEngine()
+    {
+        stop();
+    }
+
+    void start(int blinkMs, int fastBlinkMs)
+    {
+        blinkMs_ = jmax(1, blinkMs);
+        fastBlinkMs_ = jmax(1, fastBlinkMs);
+
+        int tick = gcd(blinkMs_, fastBlinkMs_);
+        if (maxTickMs_ > 0)
+            tick = gcd(tick, maxTickMs_);
+        tickMs_ = tick;
+        running_ = true;
+        if (! externallyDriven_)
+            startTimer(tick);
+    }
+
+    // the timer's thread is JUCE's, so it tunes itself on its next tick
+    void setThreadTuning(const ThreadTuning& tuning)
+    {
+        tuning_ = tuning;
+        tuned_ = 0;
+    }
+
+    void setExternallyDriven(bool external)
+    {
+        externallyDriven_ = external;
+        if (running_)
+            start(blinkMs_, fastBlinkMs_);
+        if (external)
+            stopTimer();
+    }
+
+    void tick()
+    {
+        hiResTimerCallback();
+    }
+
+    // ticks at least this often, for callers that need a finer time base
+    // than the blink periods themselves
+    void setMaxTickMs(int ms)
+    {
+        maxTickMs_ = jmax(0, ms);
+        if (isRunning())
+            start(blinkMs_, fastBlinkMs_);
+    }
+
+    // ticks on multiples of ms too, e.g. for an animation's steps
+    void addTickMs(int ms)
+    {
+        if (ms <= 0)
+            return;
+        setMaxTickMs(maxTickMs_ > 0 ? gcd(maxTickMs_, ms) : ms);
+    }
+
+    void stop()
+    {
+        running_ = false;
+        stopTimer();
+    }
+
+    bool isRunning() const
+    {
+        return running_;
+    }
+
+    int getTickMs() const
+    {
+        return tickMs_;
+    }
+
+    // how long a blinking LED stays in each state
+    double getHalfPeriodMs(bool fast) const
+    {
+        return fast ? fastBlinkMs_ : blinkMs_;
+    }
+
+private:
+    static int gcd(int a, int b)
+    {
+        while (b != 0)
+        {
+            int t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    void hiResTimerCallback() override
+    {
+        if (! externallyDriven_ && tuned_.exchange(1) == 0 && ! tuning_.applyToCurrentThread())
+            std::cerr << "Could not set SCHED_FIFO priority " << tuning_.realtimePriority << " for blinking" << std::endl;
+
+        const uint32 stamp = stamp_();
+        callback_(Time::getMillisecondCounterHiRes(), stamp);
+    }
+
+    Stamp stamp_;
+    Callback callback_;
+    int blinkMs_ = 800;
+    int fastBlinkMs_ = 400;
+    int maxTickMs_ = 0;
+    int tickMs_ = 0;
+    bool running_ = false;
+    bool externallyDriven_ = false;
+    ThreadTuning tuning_;
+    Atomic<int> tuned_ { 1 };
+};
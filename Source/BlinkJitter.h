@@ -0,0 +1,124 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "LatencyHistogram.h"
+
+//==============================================================================
+// How regular the blinking is: every blink toggle written to MIDI is timed,
+// and the time since the LED's previous toggle compared with the half
+// period it should have been. The deviations are kept per LED and for all
+// of them together. A new blink phase, as when the looper sends the LED
+// again, starts counting afresh. Only one thread at a time, with the state
+// lock held.
+class BlinkJitter
+{
+public:
+    static const int maxLeds = 128;
+
+    void restart(int index)
+    {
+        if (isPositiveAndBelow(index, maxLeds))
+            leds_[index].lastMs = -1.0;
+    }
+
+    // a toggle in the batch about to be written
+    void noteToggle(int index, double halfPeriodMs)
+    {
+        if (isPositiveAndBelow(index, maxLeds) && numPending_ < maxLeds)
+            pending_[numPending_++] = { index, halfPeriodMs };
+    }
+
+    // the batch with the noted toggles went out at writtenMs
+    void written(double writtenMs)
+    {
+        for (int i = 0; i < numPending_; ++i)
+            record(pending_[i].index, pending_[i].halfPeriodMs, writtenMs);
+        numPending_ = 0;
+    }
+
+    void discard()
+    {
+        numPending_ = 0;
+    }
+
+    // a toggle that goes out at writtenMs, such as one queued in the sink
+    void record(int index, double halfPeriodMs, double writtenMs)
+    {
+        if (! isPositiveAndBelow(index, maxLeds))
+            return;
+
+        Led& led = leds_[index];
+        double lastMs = led.lastMs;
+        led.lastMs = writtenMs;
+        if (lastMs < 0.0)
+            return;
+
+        double deviationMs = std::abs(writtenMs - lastMs - halfPeriodMs);
+        if (led.deviation == nullptr)
+            led.deviation.reset(new LatencyHistogram("blink " + String(index)));
+        led.deviation->record(deviationMs);
+        led.sumUs += (int64)(deviationMs * 1000.0);
+        all_.record(deviationMs);
+        allSumUs_ += (int64)(deviationMs * 1000.0);
+    }
+
+    // nullptr for an LED without a measured toggle yet
+    const LatencyHistogram* getLed(int index) const
+    {
+        return isPositiveAndBelow(index, maxLeds) ? leds_[index].deviation.get() : nullptr;
+    }
+
+    int64 getMeanUs(int index) const
+    {
+        auto* deviation = getLed(index);
+        return deviation != nullptr && deviation->getCount() > 0 ? leds_[index].sumUs / deviation->getCount() : 0;
+    }
+
+    const LatencyHistogram& getAll() const
+    {
+        return all_;
+    }
+
+    int64 getAllMeanUs() const
+    {
+        return all_.getCount() > 0 ? allSumUs_ / all_.getCount() : 0;
+    }
+
+private:
+    struct Led
+    {
+        double lastMs = -1.0;
+        int64 sumUs = 0;
+        std::unique_ptr<LatencyHistogram> deviation;
+    };
+
+    struct Pending
+    {
+        int index;
+        double halfPeriodMs;
+    };
+
+    Led leds_[maxLeds];
+    Pending pending_[maxLeds];
+    int numPending_ = 0;
+    LatencyHistogram all_ { "blink" };
+    int64 allSumUs_ = 0;
+};
@@ -0,0 +1,138 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "LedState.h"
+
+// EurekaProm I/O mode controllers
+static const uint8 CC_LED_ON = 106;
+static const uint8 CC_LED_OFF = 107;
+static const uint8 CC_DISPLAY_TENS = 113;
+static const uint8 CC_DISPLAY_ONES = 114;
+static const uint8 HEARTBEAT_LED = 23;
+
+//==============================================================================
+// How a board's firmware numbers its LEDs and which messages light them,
+// from the program or session file, defaulting to the FCB1010's in
+// EurekaProm I/O mode. It's turned into tables when set: the LED number
+// for each pedal, and for each LED number the two data bytes that turn it
+// on and the two that turn it off, so output only copies bytes. All of
+// them share a status byte, so with running status each costs two bytes on
+// the wire.
+//
+// A profile sets up the whole layout for a kind of board:
+//   eurekaprom  the FCB1010 in EurekaProm I/O mode: controller 106 or 107
+//               with the LED number as its value
+//   cc          one controller per LED, 127 for on and 0 for off
+//   note        one note per LED, note on with velocity 127 or 0
+class BoardLayout
+{
+public:
+    BoardLayout()
+    {
+        setProfile("eurekaprom");
+    }
+
+    // returns false for a profile we don't know, keeping the layout there is
+    bool setProfile(StringRef name)
+    {
+        if (name == StringRef("eurekaprom"))
+        {
+            for (int pedal = 0; pedal < 128; ++pedal)
+                ledNumbers_[pedal] = PedalMap::ledNumber(pedal);
+            setLedControllers(CC_LED_ON, CC_LED_OFF);
+        }
+        else if (name == StringRef("cc") || name == StringRef("note"))
+        {
+            for (int number = 0; number < 128; ++number)
+            {
+                ledNumbers_[number] = (uint8)number;
+                events_[1][number][0] = events_[0][number][0] = (uint8)number;
+                events_[1][number][1] = 127;
+                events_[0][number][1] = 0;
+            }
+            status_ = name == StringRef("cc") ? controlStatus : noteOnStatus;
+        }
+        else
+            return false;
+
+        heartbeatLed_ = HEARTBEAT_LED;
+        return true;
+    }
+
+    void setLedControllers(uint8 on, uint8 off)
+    {
+        for (int number = 0; number < 128; ++number)
+        {
+            events_[1][number][0] = on & 0x7f;
+            events_[0][number][0] = off & 0x7f;
+            events_[1][number][1] = events_[0][number][1] = (uint8)number;
+        }
+        status_ = controlStatus;
+    }
+
+    // the LED number of each pedal from the first on, pedals past them
+    // keep their own; an empty map keeps the one there is
+    void setLedNumbers(const MemoryBlock& numbers)
+    {
+        if (numbers.getSize() == 0)
+            return;
+
+        for (int pedal = 0; pedal < 128; ++pedal)
+            ledNumbers_[pedal] = pedal < (int)numbers.getSize() ? (uint8)(numbers[(size_t)pedal] & 0x7f) : (uint8)pedal;
+    }
+
+    void setHeartbeatLed(uint8 number)
+    {
+        heartbeatLed_ = number & 0x7f;
+    }
+
+    uint8 getHeartbeatLed() const
+    {
+        return heartbeatLed_;
+    }
+
+    // the LED a pedal lights, or -1
+    int ledNumberFor(int pedal) const
+    {
+        return isPositiveAndBelow(pedal, 128) ? (int)ledNumbers_[pedal] : -1;
+    }
+
+    // the kind of message, without the channel
+    uint8 getStatus() const
+    {
+        return status_;
+    }
+
+    // the data bytes that show the LED
+    const uint8* getEvent(uint8 number, bool on) const
+    {
+        return events_[on ? 1 : 0][number & 0x7f];
+    }
+
+private:
+    static const uint8 controlStatus = 0xb0;
+    static const uint8 noteOnStatus = 0x90;
+
+    uint8 ledNumbers_[128];
+    uint8 events_[2][128][2];
+    uint8 status_ = controlStatus;
+    uint8 heartbeatLed_ = HEARTBEAT_LED;
+};
@@ -0,0 +1,321 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "FlightRecorder.h"
+#include "JackMidiSink.h"
+#include "LedShadow.h"
+#include "MidiCapture.h"
+#include "MidiWriterThread.h"
+#include "PipelineStages.h"
+#include "Probes.h"
+#include "RawMidiPort.h"
+#include "ScheduledMidiSink.h"
+#include "SeqMidiSink.h"
+#include "Reconnector.h"
+#include "WirePacer.h"
+#include "TraceSpans.h"
+
+//==============================================================================
+// One pedalboard: its MIDI sink, optionally with a writer thread, the shadow
+// of what it shows and the batch being built for it. A board shows the looper
+// LEDs from firstLed on, its pedal p lighting the looper's LED firstLed + p,
+// so several boards can split the loops between them or all show the same.
+class BoardOutput
+{
+public:
+    BoardOutput(const String& name, int firstLed, RawMidiResolver* resolver = nullptr)
+        : name_(name),
+          firstLed_(jmax(0, firstLed)),
+          sink_(createSink(name, resolver))
+    {
+    }
+
+    // on a sink of the caller's, which the board takes over
+    BoardOutput(const String& name, int firstLed, MidiSink* sink)
+        : name_(name),
+          firstLed_(jmax(0, firstLed)),
+          sink_(sink)
+    {
+    }
+
+    ~BoardOutput()
+    {
+        // the writer goes before the sink it writes to
+        writer_ = nullptr;
+    }
+
+    // "null" and "file:" are for benchmarking without a pedalboard, "seq:"
+    // shares it with other sequencer clients, "jack:" puts it on the audio
+    // clock, anything else is a rawmidi device
+    static MidiSink* createSink(const String& name, RawMidiResolver* resolver)
+    {
+       #ifdef LOOP4R_HAS_JACK
+        if (name.startsWith("jack:"))
+            return new JackMidiSink(name.fromFirstOccurrenceOf("jack:", false, false));
+       #endif
+        if (name == "null")
+            return new NullMidiSink();
+        if (name.startsWith("file:"))
+            return new FileMidiSink(name.fromFirstOccurrenceOf("file:", false, false));
+        if (name.startsWith("seq:"))
+            return new SeqMidiSink(name.fromFirstOccurrenceOf("seq:", false, false));
+        return new RawMidiPort(name, resolver);
+    }
+
+    const String& getName() const       { return name_; }
+    int getFirstLed() const             { return firstLed_; }
+    MidiSink& getSink()                 { return *sink_; }
+    const MidiSink& getSink() const     { return *sink_; }
+    MidiBatch& getBatch()               { return batch_; }
+    LedShadow& getShadow()              { return shadow_; }
+    Reconnector& getLink()              { return link_; }
+    WirePacer& getPacer()               { return pacer_; }
+
+    // the number of the LED showing a looper LED on this board, or -1
+    int ledNumberFor(int looperIndex) const
+    {
+        return layout_.ledNumberFor(looperIndex - firstLed_);
+    }
+
+    void setLayout(const BoardLayout& layout)
+    {
+        layout_ = layout;
+        shadow_.setLayout(layout);
+    }
+
+    const BoardLayout& getLayout() const  { return layout_; }
+
+    // gives a sink without a queue of its own one in user space, so toggles
+    // can be queued for it too; not with a writer thread, which would keep
+    // the old sink
+    void addScheduler(const ThreadTuning& tuning)
+    {
+        if (writer_ != nullptr || name_.startsWith("seq:") || name_.startsWith("jack:") || dynamic_cast<ScheduledMidiSink*>(sink_.get()) != nullptr)
+            return;
+
+        sink_.reset(new ScheduledMidiSink(sink_.release(), tuning));
+    }
+
+    // notes every batch flushed
+    void setFlightRecorder(FlightRecorder* recorder)
+    {
+        recorder_ = recorder;
+    }
+
+    // counts what goes through the encode, pace and write stages
+    void setPipelineStages(PipelineStages* stages)
+    {
+        stages_ = stages;
+    }
+
+    // captures every batch flushed as the given board, nullptr stops it
+    void setMidiRecorder(MidiRecorder* capture, int index)
+    {
+        capture_ = capture;
+        captureIndex_ = index;
+    }
+
+    void startWriter(const ThreadTuning& tuning, LatencyHistogram* queueLatency)
+    {
+        if (writer_ != nullptr)
+            return;
+
+        writer_.reset(new MidiWriterThread(sink_.get(), queueLatency));
+        writer_->setMaxAgeMs(maxAgeMs_);
+        writer_->start(tuning);
+    }
+
+    void stopWriter()
+    {
+        if (writer_ != nullptr)
+            writer_->stop();
+    }
+
+    bool hasWriter() const
+    {
+        return writer_ != nullptr;
+    }
+
+    // bytes waiting for the writer thread
+    int getWriterQueued() const
+    {
+        return writer_ != nullptr ? writer_->getNumQueued() : 0;
+    }
+
+    // only without the writer thread, which would otherwise be writing to the
+    // sink concurrently
+    bool canSchedule() const
+    {
+        return writer_ == nullptr && sink_->canSchedule();
+    }
+
+    // bytes from an earlier flush still on the way to the port
+    bool isBacklogged() const
+    {
+        return writer_ != nullptr ? writer_->getNumQueued() > 0 : sink_->hasPending();
+    }
+
+    // bytes still on the way more than this long after the changes in them
+    // were received are dropped, and the current state written instead;
+    // 0 writes everything however late
+    void setMaxAgeMs(double maxAgeMs)
+    {
+        maxAgeMs_ = jmax(0.0, maxAgeMs);
+        if (writer_ != nullptr)
+            writer_->setMaxAgeMs(maxAgeMs_);
+    }
+
+    // how often that happened, and the bytes it dropped
+    int64 getStaleDrops() const
+    {
+        return staleDrops_ + (writer_ != nullptr ? writer_->getStaleDrops() : 0);
+    }
+
+    int64 getStaleBytes() const
+    {
+        return staleBytes_ + (writer_ != nullptr ? writer_->getStaleBytes() : 0);
+    }
+
+    // commits the shadow and writes the batch, returns true if there was
+    // anything to write. Behind a backlog only state changes join it, blink
+    // toggles and the cosmetic lane wait until it has gone out. While the
+    // wire is estimated to be busy nothing is committed at all, so an update
+    // superseded meanwhile is never written. receivedMs is when the oldest
+    // change in the batch was received, 0 for now.
+    bool flush(double receivedMs = 0.0)
+    {
+        double nowMs = Time::getMillisecondCounterHiRes();
+        if (! pacer_.isReady(nowMs))
+        {
+            if (shadow_.isHoldingBack())
+            {
+                pacer_.heldBack();
+                if (heldBackMs_ <= 0.0)
+                    heldBackMs_ = nowMs;
+            }
+            if (stages_ != nullptr)
+                stages_->setDepth(PipelineStages::Pace, pacer_.getQueuedBytes(nowMs));
+            return false;
+        }
+
+        if (stages_ != nullptr)
+        {
+            if (heldBackMs_ > 0.0)
+                stages_->passed(PipelineStages::Pace, 1, nowMs - heldBackMs_);
+            stages_->passed(PipelineStages::State, shadow_.getNumPending());
+        }
+        heldBackMs_ = 0.0;
+
+        dropStale(nowMs);
+        shadow_.commit(isBacklogged() ? LedShadow::StateLane : LedShadow::CosmeticLane);
+        pacer_.consume(batch_.getNumBytes(), nowMs);
+        const double encodedMs = Time::getMillisecondCounterHiRes();
+
+        bool written = ! batch_.isEmpty();
+        if (written && recorder_ != nullptr)
+            recorder_->recordMidi(name_, batch_.getData(), batch_.getNumBytes());
+        if (written && capture_ != nullptr)
+            capture_->record(captureIndex_, batch_.getData(), batch_.getNumBytes());
+        LOOP4R_PROBE3(midi_write, firstLed_, batch_.getNumBytes(), writer_ != nullptr);
+        TraceSpans::Scope span(! written ? nullptr : writer_ != nullptr ? "midi handoff" : "midi write");
+        bool ok;
+        if (writer_ != nullptr)
+        {
+            // the writer thread does the actual write, we only hear about
+            // failures on a later flush
+            ok = ! writer_->checkAndClearFailure();
+            if (! batch_.isEmpty())
+            {
+                ok = writer_->write(batch_.getData(), batch_.getNumBytes(), receivedMs) && ok;
+                batch_.clear();
+            }
+        }
+        else
+        {
+            ok = batch_.flush(*sink_);
+            if (! sink_->hasPending())
+                backlogSinceMs_ = 0.0;
+            else if (backlogSinceMs_ <= 0.0)
+                backlogSinceMs_ = receivedMs > 0.0 ? receivedMs : nowMs;
+        }
+
+        if (written && stages_ != nullptr)
+        {
+            const double doneMs = Time::getMillisecondCounterHiRes();
+            stages_->passed(PipelineStages::Encode, 1, encodedMs - nowMs);
+            stages_->passed(PipelineStages::Write, 1, doneMs - encodedMs);
+            stages_->setDepth(PipelineStages::Pace, pacer_.getQueuedBytes(doneMs));
+            stages_->setDepth(PipelineStages::Write, getWriterQueued());
+        }
+
+        if (! ok)
+        {
+            // we no longer know what the pedalboard shows
+            batch_.resetRunningStatus();
+            shadow_.invalidate();
+        }
+        return written;
+    }
+
+private:
+    // what the pedalboard was meant to show from the dropped bytes goes out
+    // again with the flush, as it is now
+    void dropStale(double nowMs)
+    {
+        bool stale = writer_ != nullptr && writer_->checkAndClearStale();
+        if (writer_ == nullptr && maxAgeMs_ > 0.0 && backlogSinceMs_ > 0.0 && nowMs - backlogSinceMs_ > maxAgeMs_)
+        {
+            const int numDropped = sink_->dropPending();
+            backlogSinceMs_ = 0.0;
+            if (numDropped > 0)
+            {
+                ++staleDrops_;
+                staleBytes_ += numDropped;
+                stale = true;
+            }
+        }
+
+        if (stale)
+        {
+            // the dropped bytes may have held the status the next ones run on
+            batch_.resetRunningStatus();
+            shadow_.rewriteShown();
+        }
+    }
+
+    String name_;
+    int firstLed_;
+    std::unique_ptr<MidiSink> sink_;
+    MidiBatch batch_;
+    LedShadow shadow_ { batch_ };
+    BoardLayout layout_;
+    std::unique_ptr<MidiWriterThread> writer_;
+    Reconnector link_;
+    WirePacer pacer_;
+    FlightRecorder* recorder_ = nullptr;
+    PipelineStages* stages_ = nullptr;
+    double heldBackMs_ = 0.0;       // when the pacing first held the batch back
+    MidiRecorder* capture_ = nullptr;
+    int captureIndex_ = 0;
+    double maxAgeMs_ = 0.0;
+    double backlogSinceMs_ = 0.0;   // when the oldest change still pending in the sink was received
+    int64 staleDrops_ = 0;
+    int64 staleBytes_ = 0;
+};
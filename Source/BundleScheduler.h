@@ -0,0 +1,191 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "FutexEvent.h"
+#include <functional>
+#include <memory>
+
+//==============================================================================
+// Holds on to OSC bundles whose time tag lies in the future and hands each
+// one back from its own thread when it is due, so the looper can send LED
+// changes ahead of the beat they belong to. A bundle is kept as the bytes it
+// came in, copied once here and parsed again when it is due. Entries go on a
+// free list once applied and keep their buffers, so when the queue has been
+// as deep and its bundles as long as they get, scheduling allocates nothing.
+class BundleScheduler : private Thread
+{
+public:
+    typedef std::function<void(const char* bundle, int size)> Callback;
+
+    BundleScheduler(Callback callback, int maxPending = 64)
+        : Thread("loop4r bundles"),
+          callback_(callback),
+          maxPending_(maxPending),
+          pending_((size_t)maxPending)
+    {
+    }
+
+    ~BundleScheduler()
+    {
+        stop();
+    }
+
+    void stop()
+    {
+        signalThreadShouldExit();
+        wakeup_.signal();
+        stopThread(1000);
+    }
+
+    // bundles waiting for their time
+    int getNumPending() const
+    {
+        const ScopedLock sl(lock_);
+        return numPending_;
+    }
+
+    // ms until the bundle is due, 0 or less for bundles that should be
+    // applied right away
+    static double getDelayMs(OSCTimeTag timeTag)
+    {
+        if (timeTag.isImmediately())
+            return 0.0;
+        return (double)(timeTag.toTime().toMilliseconds() - Time::currentTimeMillis());
+    }
+
+    // returns false if too many bundles are already waiting
+    bool schedule(const char* bundle, int size, double delayMs)
+    {
+        Pending* pending = takeSpare();
+        std::unique_ptr<Pending> created;
+        if (pending == nullptr)
+        {
+            created.reset(new Pending());
+            pending = created.get();
+        }
+        pending->dueMs = Time::getMillisecondCounterHiRes() + delayMs;
+        pending->assign(bundle, size);
+
+        {
+            const ScopedLock sl(lock_);
+            if (created != nullptr)
+                entries_.add(created.release());
+
+            if (numPending_ >= maxPending_)
+            {
+                pending->next = spare_;
+                spare_ = pending;
+                return false;
+            }
+
+            int i = 0;
+            while (i < numPending_ && pending_[i]->dueMs <= pending->dueMs)
+                ++i;
+            memmove(pending_ + i + 1, pending_ + i, sizeof(Pending*) * (size_t)(numPending_ - i));
+            pending_[i] = pending;
+            ++numPending_;
+        }
+
+        if (! isThreadRunning())
+            startThread();
+        wakeup_.signal();
+        return true;
+    }
+
+private:
+    struct Pending
+    {
+        // only grows, a MemoryBlock would reallocate on every change of size
+        void assign(const char* bytes, int numBytes)
+        {
+            if (numBytes > capacity)
+            {
+                data.realloc((size_t)numBytes);
+                capacity = numBytes;
+            }
+            memcpy(data, bytes, (size_t)numBytes);
+            size = numBytes;
+        }
+
+        double dueMs = 0.0;
+        HeapBlock<char> data;
+        int size = 0;
+        int capacity = 0;
+        Pending* next = nullptr;    // on the free list
+    };
+
+    Pending* takeSpare()
+    {
+        const ScopedLock sl(lock_);
+        Pending* spare = spare_;
+        if (spare != nullptr)
+            spare_ = spare->next;
+        return spare;
+    }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            int waitMs = -1;
+            {
+                const ScopedLock sl(lock_);
+                if (numPending_ > 0)
+                {
+                    double now = Time::getMillisecondCounterHiRes();
+                    double dueMs = pending_[0]->dueMs;
+                    if (dueMs <= now)
+                    {
+                        due_ = pending_[0];
+                        --numPending_;
+                        memmove(pending_, pending_ + 1, sizeof(Pending*) * (size_t)numPending_);
+                        waitMs = 0;
+                    }
+                    else
+                    {
+                        waitMs = jmax(1, (int)(dueMs - now));
+                    }
+                }
+            }
+
+            if (waitMs == 0)
+            {
+                callback_(due_->data, due_->size);
+                const ScopedLock sl(lock_);
+                due_->next = spare_;
+                spare_ = due_;
+                due_ = nullptr;
+            }
+            else
+                wakeup_.wait(waitMs);
+        }
+    }
+
+    Callback callback_;
+    int maxPending_;
+    CriticalSection lock_;
+    OwnedArray<Pending> entries_;   // every entry made, waiting or spare
+    HeapBlock<Pending*> pending_;   // by due time
+    int numPending_ = 0;
+    Pending* spare_ = nullptr;
+    Pending* due_ = nullptr;
+    FutexEvent wakeup_;
+};
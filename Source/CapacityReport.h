@@ -0,0 +1,191 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "BoardOutput.h"
+#include <time.h>
+
+//==============================================================================
+// What one host can take, worked out from the bench's microbenchmarks and
+// from timing writes to a real port, for deciding which box drives which
+// rig. The model is deliberately simple: every LED update costs the message
+// thread its dispatch and its update (which repeats the LED change, so the
+// sum errs on the high side) plus the CPU of writing it, every further
+// board a flush of its own per batch, and each port carries no more
+// updates a second than its wire took in the test. The loads are kept to
+// targetUtilisation of the message thread and of each wire, and the
+// latency is that of an M/D/1 queue on each of them, one after the other.
+namespace CapacityReport
+{
+    static const double targetUtilisation = 0.7;
+
+    struct Costs
+    {
+        double dispatchNs = 0.0;        // parsing and applying an /led
+        double updateNs = 0.0;          // applying it, the diff and the encoding
+        double boardFlushNs = 0.0;      // flushing a board with nothing to write
+        double writeCpuNs = 0.0;        // the CPU of a write to the port
+        double wireUpdatesPerSec = 0.0; // what the port took, 0 if unbounded
+        double bytesPerUpdate = 0.0;
+    };
+
+    // the CPU time of the calling thread
+    inline int64 threadCpuNs()
+    {
+        timespec time;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+        return (int64)time.tv_sec * 1000000000 + time.tv_nsec;
+    }
+
+    // Toggles one LED through the board's shadow and straight into its
+    // sink: as many updates as the kernel buffer holds first, so that the
+    // timed ones wait for the wire, then for at least minMs. Leaves the LED
+    // dark and the costs unset if the port fails.
+    inline void measureWrites(BoardOutput& board, uint8 ledNumber, int minMs, Costs& costs)
+    {
+        MidiSink& sink = board.getSink();
+        LedShadow& shadow = board.getShadow();
+        MidiBatch& batch = board.getBatch();
+        bool on = false;
+        auto writeOne = [&] () -> int
+        {
+            on = ! on;
+            shadow.setLed(ledNumber, on);
+            shadow.commit();
+            const int size = batch.getNumBytes();
+            const bool written = size > 0 && sink.write(batch.getData(), size);
+            batch.clear();
+            return written ? size : 0;
+        };
+
+        for (int filled = 0, bufferSize = jmax(4096, sink.getBufferSize()); filled < bufferSize;)
+        {
+            const int size = writeOne();
+            if (size == 0)
+                return;
+            filled += size;
+        }
+
+        const double startMs = Time::getMillisecondCounterHiRes();
+        const int64 startCpuNs = threadCpuNs();
+        int64 updates = 0, bytes = 0;
+        while (Time::getMillisecondCounterHiRes() - startMs < minMs)
+        {
+            const int size = writeOne();
+            if (size == 0)
+                break;
+            ++updates;
+            bytes += size;
+        }
+        const double elapsedMs = Time::getMillisecondCounterHiRes() - startMs;
+        const int64 cpuNs = threadCpuNs() - startCpuNs;
+
+        if (on)
+            writeOne();
+        sink.drain();
+        if (updates == 0)
+            return;
+
+        costs.wireUpdatesPerSec = (double)updates * 1000.0 / jmax(1.0, elapsedMs);
+        costs.bytesPerUpdate = (double)bytes / (double)updates;
+        costs.writeCpuNs = (double)cpuNs / (double)updates;
+    }
+
+    // the mean wait in an M/D/1 queue plus the service itself, -1 once the
+    // queue can't keep up
+    inline double queueLatencyNs(double serviceNs, double perSec)
+    {
+        const double utilisation = perSec * serviceNs / 1.0e9;
+        if (utilisation >= 1.0)
+            return -1.0;
+        return serviceNs + utilisation * serviceNs / (2.0 * (1.0 - utilisation));
+    }
+
+    // with rate LED updates a second from each looper
+    inline var estimate(const Costs& costs, int rate)
+    {
+        const double perUpdateNs = costs.dispatchNs + costs.updateNs + costs.writeCpuNs;
+        const double budgetNs = targetUtilisation * 1.0e9;
+        const double perSec = jmax(1.0, (double)rate);
+        const bool wireBounded = costs.wireUpdatesPerSec > 0.0;
+
+        auto* result = new DynamicObject();
+        result->setProperty("rate", rate);
+        result->setProperty("max_updates_per_s", (int64)(budgetNs / jmax(1.0, perUpdateNs)));
+        result->setProperty("max_engines", (int64)(budgetNs / (perSec * jmax(1.0, perUpdateNs))));
+
+        // the loopers a port can show by itself, and the boards one looper
+        // can be mirrored to before the flushes eat the message thread
+        if (wireBounded)
+            result->setProperty("engines_per_board", (int64)(targetUtilisation * costs.wireUpdatesPerSec / perSec));
+        const double leftNs = budgetNs / perSec - perUpdateNs;
+        result->setProperty("max_boards", leftNs < 0.0 ? (int64)0 : 1 + (int64)(leftNs / jmax(1.0, costs.boardFlushNs)));
+
+        // one looper at rate into one board
+        const double cpuNs = queueLatencyNs(perUpdateNs, perSec);
+        const double wireNs = wireBounded ? queueLatencyNs(1.0e9 / costs.wireUpdatesPerSec, perSec) : 0.0;
+        result->setProperty("expected_latency_us", cpuNs < 0.0 || wireNs < 0.0 ? (int64)-1 : (int64)((cpuNs + wireNs) / 1000.0));
+        result->setProperty("cpu_utilisation_percent", 100.0 * perSec * perUpdateNs / 1.0e9);
+        if (wireBounded)
+            result->setProperty("wire_utilisation_percent", 100.0 * perSec / costs.wireUpdatesPerSec);
+        return var(result);
+    }
+
+    // the Pi's model, or the first CPU's for anything else
+    inline String getMachine()
+    {
+        String model = File("/proc/device-tree/model").loadFileAsString().trimCharactersAtEnd(String::charToString(0)).trim();
+        if (model.isNotEmpty())
+            return model;
+
+        StringArray lines;
+        lines.addLines(File("/proc/cpuinfo").loadFileAsString());
+        for (auto& line : lines)
+            if (line.startsWith("model name"))
+                return line.fromFirstOccurrenceOf(":", false, false).trim();
+        return SystemStats::getCpuVendor();
+    }
+
+    inline String toJson(const Costs& costs, const String& device, int rate, const var& benchmarks)
+    {
+        auto* root = new DynamicObject();
+        root->setProperty("version", ProjectInfo::versionString);
+        root->setProperty("host", SystemStats::getComputerName());
+        root->setProperty("machine", getMachine());
+        root->setProperty("cores", SystemStats::getNumCpus());
+
+        auto* measured = new DynamicObject();
+        measured->setProperty("dispatch_ns", costs.dispatchNs);
+        measured->setProperty("update_ns", costs.updateNs);
+        measured->setProperty("board_flush_ns", costs.boardFlushNs);
+        measured->setProperty("device", device);
+        if (costs.wireUpdatesPerSec > 0.0)
+        {
+            measured->setProperty("write_cpu_ns", costs.writeCpuNs);
+            measured->setProperty("wire_updates_per_s", costs.wireUpdatesPerSec);
+            measured->setProperty("wire_bytes_per_s", costs.wireUpdatesPerSec * costs.bytesPerUpdate);
+            measured->setProperty("bytes_per_update", costs.bytesPerUpdate);
+        }
+        root->setProperty("costs", var(measured));
+        root->setProperty("capacity", estimate(costs, rate));
+        root->setProperty("benchmarks", benchmarks);
+        return JSON::toString(var(root));
+    }
+}
@@ -0,0 +1,138 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// Estimates how far a looper's clock is from ours the way NTP does, from the
+// time it puts on its heartbeats. A heartbeat answering our ping gives a
+// round trip: sent at t1 and heard at t4 here, stamped at t2 there, the
+// offset is t2 - (t1 + t4) / 2 and the delay t4 - t1. One that wasn't asked
+// for is taken to have been on the way for half the smoothed RTT, or no time
+// at all before there is one, and counts as delayed by the whole RTT. Of the
+// last few samples the one with the least delay is trusted, the newest of
+// equals, as queueing only ever adds to it, and the drift between the clocks is the smoothed slope of
+// those picks for when they are far enough apart.
+//
+// The remote clock is in ms like an OSC time tag, since 1900; ours is the
+// monotonic one bundles are scheduled on.
+class ClockOffset
+{
+public:
+    static double toMs(OSCTimeTag timeTag)
+    {
+        const uint64 raw = timeTag.getRawTimeTag();
+        return (double)(raw >> 32) * 1000.0 + (double)(raw & 0xffffffff) * (1000.0 / 4294967296.0);
+    }
+
+    void addRoundTrip(double sentMs, double remoteMs, double receivedMs)
+    {
+        if (receivedMs >= sentMs)
+            addSample(remoteMs - (sentMs + receivedMs) / 2.0, receivedMs - sentMs, receivedMs);
+    }
+
+    // rttMs is 0 while no round trip was timed yet
+    void addOneWay(double remoteMs, double receivedMs, double rttMs)
+    {
+        addSample(remoteMs - receivedMs + rttMs / 2.0, rttMs > 0.0 ? rttMs : unknownDelayMs, receivedMs);
+    }
+
+    void reset()
+    {
+        numSamples_ = 0;
+        valid_ = false;
+        drift_ = 0.0;
+        hasDrift_ = false;
+    }
+
+    bool isValid() const                { return valid_; }
+
+    // remote minus local, at nowMs on our clock
+    double getOffsetMs(double nowMs) const
+    {
+        return offsetMs_ + drift_ * (nowMs - offsetAtMs_);
+    }
+
+    // when a time on the looper's clock comes round on ours
+    double toLocalMs(double remoteMs, double nowMs) const
+    {
+        return remoteMs - getOffsetMs(nowMs);
+    }
+
+    double getDelayMs() const           { return delayMs_; }
+    double getDriftPpm() const          { return drift_ * 1.0e6; }
+    int64 getNumSamples() const         { return samplesSeen_; }
+
+private:
+    struct Sample
+    {
+        double offsetMs, delayMs, atMs;
+    };
+
+    static const int filterSize = 8;
+    static constexpr double minDriftIntervalMs = 10000.0;
+    static constexpr double maxDrift = 500.0e-6;      // crystals are off by far less
+    static constexpr double unknownDelayMs = 1000.0;
+
+    void addSample(double offsetMs, double delayMs, double atMs)
+    {
+        samples_[next_] = { offsetMs, delayMs, atMs };
+        next_ = (next_ + 1) % filterSize;
+        numSamples_ = jmin(filterSize, numSamples_ + 1);
+        ++samplesSeen_;
+
+        const Sample* best = &samples_[0];
+        for (int i = 1; i < numSamples_; ++i)
+            if (samples_[i].delayMs < best->delayMs
+                || (samples_[i].delayMs == best->delayMs && samples_[i].atMs > best->atMs))
+                best = &samples_[i];
+
+        if (valid_ && best->atMs == offsetAtMs_)
+            return;
+
+        if (! valid_)
+            driftBase_ = *best;
+        else if (best->atMs - driftBase_.atMs >= minDriftIntervalMs)
+        {
+            double drift = jlimit(-maxDrift, maxDrift, (best->offsetMs - driftBase_.offsetMs) / (best->atMs - driftBase_.atMs));
+            drift_ = hasDrift_ ? drift_ + (drift - drift_) / 8.0 : drift;
+            hasDrift_ = true;
+            driftBase_ = *best;
+        }
+
+        offsetMs_ = best->offsetMs;
+        delayMs_ = best->delayMs;
+        offsetAtMs_ = best->atMs;
+        valid_ = true;
+    }
+
+    Sample samples_[filterSize];
+    int next_ = 0;
+    int numSamples_ = 0;
+    int64 samplesSeen_ = 0;
+    bool valid_ = false;
+    double offsetMs_ = 0.0;
+    double delayMs_ = 0.0;
+    double offsetAtMs_ = 0.0;
+    Sample driftBase_ {};
+    double drift_ = 0.0;
+    bool hasDrift_ = false;
+};
@@ -0,0 +1,151 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <fcntl.h>
+#include <functional>
+#include <poll.h>
+#include <unistd.h>
+
+//==============================================================================
+// Reads commands from standard input without blocking, a line at a time as
+// they arrive, so the bridge keeps handling OSC while commands stream in.
+// Either an event loop watches getHandle() and calls readAvailable(), or
+// start() polls from a thread of its own for inputs it can't watch, such as
+// a redirected regular file.
+class CommandInput : private Thread
+{
+public:
+    typedef std::function<void(const String& line)> Callback;
+
+    CommandInput(Callback callback)
+        : Thread("loop4r commands"),
+          callback_(callback)
+    {
+    }
+
+    ~CommandInput()
+    {
+        stop();
+        restoreFlags();
+    }
+
+    int getHandle() const
+    {
+        return STDIN_FILENO;
+    }
+
+    // the terminal shares its flags with the shell, they're put back later
+    void setNonBlocking()
+    {
+        if (savedFlags_ < 0)
+            savedFlags_ = fcntl(STDIN_FILENO, F_GETFL);
+        if (savedFlags_ >= 0)
+            fcntl(STDIN_FILENO, F_SETFL, savedFlags_ | O_NONBLOCK);
+    }
+
+    void start()
+    {
+        setNonBlocking();
+        startThread();
+    }
+
+    void stop()
+    {
+        stopThread(1000);
+    }
+
+    bool isAtEnd() const
+    {
+        return atEnd_.get() != 0;
+    }
+
+    // calls back for every complete line read, keeping a partial one for
+    // next time; returns false once the input is closed
+    bool readAvailable()
+    {
+        char buffer[1024];
+        for (;;)
+        {
+            ssize_t size = ::read(STDIN_FILENO, buffer, sizeof(buffer));
+            if (size < 0 && errno == EINTR)
+                continue;
+            if (size < 0)
+                return true;        // nothing more for now
+            if (size == 0)
+                break;
+            pending_.write(buffer, (size_t)size);
+            emitLines();
+        }
+
+        // a last line without its newline still counts
+        if (pending_.getDataSize() > 0)
+            callback_(String::fromUTF8((const char*)pending_.getData(), (int)pending_.getDataSize()));
+        pending_.reset();
+        atEnd_ = 1;
+        return false;
+    }
+
+private:
+    void run() override
+    {
+        while (! threadShouldExit() && ! isAtEnd())
+        {
+            pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+            if (poll(&pfd, 1, 500) > 0)
+                readAvailable();
+        }
+    }
+
+    void emitLines()
+    {
+        const char* data = (const char*)pending_.getData();
+        const int size = (int)pending_.getDataSize();
+        int start = 0;
+        for (int i = 0; i < size; ++i)
+        {
+            if (data[i] != '\n')
+                continue;
+
+            int end = i > start && data[i - 1] == '\r' ? i - 1 : i;
+            callback_(String::fromUTF8(data + start, end - start));
+            start = i + 1;
+        }
+
+        if (start > 0)
+        {
+            MemoryBlock rest(data + start, (size_t)(size - start));
+            pending_.reset();
+            pending_.write(rest.getData(), rest.getSize());
+        }
+    }
+
+    void restoreFlags()
+    {
+        if (savedFlags_ >= 0)
+            fcntl(STDIN_FILENO, F_SETFL, savedFlags_);
+    }
+
+    Callback callback_;
+    MemoryOutputStream pending_;
+    int savedFlags_ = -1;
+    Atomic<int> atEnd_ { 0 };
+};
@@ -0,0 +1,82 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "FlatHashMap.h"
+
+//==============================================================================
+// Command names, short and long, looked up ignoring case. Each is hashed
+// folded to lower case once when added; a token is hashed the same way and
+// only compared with the names whose hash matches, in a flat hash map, so
+// looking one up neither scans every command nor allocates.
+class CommandNameTable
+{
+public:
+    CommandNameTable()
+        : names_(160)
+    {
+    }
+
+    // before adding them, room for this many names without growing
+    void reserve(int numNames)
+    {
+        names_.reserve(numNames);
+    }
+
+    // value is what find() returns for the name, empty names are skipped
+    void add(const String& name, int value)
+    {
+        if (name.isEmpty())
+            return;
+
+        jassert(find(name) < 0);
+        names_.set(name, value);
+    }
+
+    // the value added with the name, or -1
+    int find(StringRef name) const
+    {
+        const int* value = names_.find(name);
+        return value != nullptr ? *value : -1;
+    }
+
+private:
+    struct IgnoringCase
+    {
+        // FNV-1a over the name in lower case
+        static uint32 hash(StringRef name)
+        {
+            uint32 result = 2166136261u;
+            for (auto p = name.text; ! p.isEmpty();)
+            {
+                result ^= (uint32)CharacterFunctions::toLowerCase(p.getAndAdvance());
+                result *= 16777619u;
+            }
+            return result;
+        }
+
+        static bool equals(const String& name, StringRef lookup)
+        {
+            return name.equalsIgnoreCase(lookup);
+        }
+    };
+
+    FlatHashMap<String, int, IgnoringCase> names_;
+};
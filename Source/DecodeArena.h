@@ -0,0 +1,100 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// A bump allocator for what decoding a packet needs beyond the stack, such
+// as the arguments of a message longer than an OscMessageView holds inline.
+// Allocating moves an offset into one block reserved up front; a Scope puts
+// the offset back when the packet is done, so freeing everything decoded
+// for it is a single store and scopes nest for bundles within bundles.
+// Asking for more than is left returns nullptr and the caller falls back to
+// the heap. Used by one thread at a time.
+class DecodeArena
+{
+public:
+    DecodeArena(size_t capacity = 16384)
+    {
+        storage_.malloc(capacity);
+        capacity_ = capacity;
+    }
+
+    // aligned for anything a message holds
+    void* allocate(size_t bytes)
+    {
+        const size_t start = (used_ + alignment - 1) & ~(alignment - 1);
+        if (start + bytes > capacity_)
+        {
+            ++exhausted_;
+            return nullptr;
+        }
+
+        used_ = start + bytes;
+        peak_ = jmax(peak_, used_);
+        return storage_ + start;
+    }
+
+    // grows the last block allocated where it is, if there is room
+    bool extend(void* block, size_t bytes, size_t newBytes)
+    {
+        if (static_cast<char*>(block) + bytes != storage_ + used_ || used_ - bytes + newBytes > capacity_)
+            return false;
+
+        used_ = used_ - bytes + newBytes;
+        peak_ = jmax(peak_, used_);
+        return true;
+    }
+
+    class Scope
+    {
+    public:
+        Scope(DecodeArena* arena)
+            : arena_(arena),
+              mark_(arena != nullptr ? arena->used_ : 0)
+        {
+        }
+
+        ~Scope()
+        {
+            if (arena_ != nullptr)
+                arena_->used_ = mark_;
+        }
+
+    private:
+        DecodeArena* arena_;
+        size_t mark_;
+
+        JUCE_DECLARE_NON_COPYABLE(Scope)
+    };
+
+    size_t getPeak() const          { return peak_; }
+    int64 getExhausted() const      { return exhausted_; }
+
+private:
+    static const size_t alignment = 16;
+
+    HeapBlock<char> storage_;
+    size_t capacity_ = 0;
+    size_t used_ = 0;
+    size_t peak_ = 0;
+    int64 exhausted_ = 0;
+};
@@ -0,0 +1,123 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "TempoSync.h"
+
+//==============================================================================
+// Decides the number on the pedalboard's display: the selected loop as the
+// looper reports it, or something derived from the first looper's auto
+// updates (the cycle within the loop, the tempo, or the seconds left until
+// the loop comes round again). The derived ones change continuously, so they
+// are rendered from a timer no faster than the refresh interval, and with the
+// LedShadow only writing the digits that changed, most renders cost nothing
+// on the wire.
+class DisplayEngine
+{
+public:
+    enum Content
+    {
+        SelectedLoop,
+        CycleCount,
+        Tempo,
+        Countdown
+    };
+
+    static const int minRefreshMs = 50;
+
+    // "loop", "cycle", "tempo" or "count", false for anything else
+    bool setContent(const String& name)
+    {
+        static const char* const names[] = { "loop", "cycle", "tempo", "count" };
+        for (int i = 0; i < numElementsInArray(names); ++i)
+        {
+            if (name.equalsIgnoreCase(names[i]))
+            {
+                content_ = (Content)i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Content getContent() const
+    {
+        return content_;
+    }
+
+    // everything but the selected loop comes from the auto updates
+    bool needsTempo() const
+    {
+        return content_ != SelectedLoop;
+    }
+
+    void setRefreshMs(int ms)
+    {
+        refreshMs_ = jmax(minRefreshMs, ms);
+    }
+
+    int getRefreshMs() const
+    {
+        return refreshMs_;
+    }
+
+    // for the tempo, how many beats SooperLooper's cycle is long
+    void setBeatsPerCycle(int beats)
+    {
+        beatsPerCycle_ = jmax(1, beats);
+    }
+
+    void setLoopLength(float seconds)
+    {
+        loopLength_ = seconds;
+    }
+
+    // the number to show, or -1 while there is nothing to show yet
+    int render(int selectedLoop, const TempoSync& sync, double nowMs) const
+    {
+        if (content_ == SelectedLoop)
+            return selectedLoop;
+
+        float cycleLength = sync.getCycleLength();
+        if (! sync.isLocked(nowMs) || cycleLength <= 0.0f)
+            return -1;
+
+        double position = sync.getLoopPosition(nowMs);
+        if (loopLength_ > 0.0f)
+            position = std::fmod(jmax(0.0, position), (double)loopLength_);
+
+        switch (content_)
+        {
+            case CycleCount:
+                return (int)(position / cycleLength) + 1;
+            case Tempo:
+                return roundToInt(60.0 * beatsPerCycle_ / cycleLength);
+            case Countdown:
+                return loopLength_ > 0.0f ? (int)std::ceil(loopLength_ - position) : -1;
+            default:
+                return selectedLoop;
+        }
+    }
+
+private:
+    Content content_ = SelectedLoop;
+    int refreshMs_ = 250;
+    int beatsPerCycle_ = 4;
+    float loopLength_ = 0.0f;
+};
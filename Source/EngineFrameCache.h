@@ -0,0 +1,108 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// The LEDs each looper instance last showed, by the host URL and engine id
+// it answers with, so that switching back to a session shows its frame at
+// once instead of going dark until it has sent all of it again. A handful of
+// frames in fixed storage, the least recently used making room for a new
+// one; nothing is allocated storing or finding one.
+class EngineFrameCache
+{
+public:
+    static const int maxLeds = 128;
+    static const int numFrames = 8;
+
+    struct Led
+    {
+        uint8 on;
+        uint8 state;
+        int16 timer;
+    };
+
+    struct Frame
+    {
+        int64 host = 0;
+        int32 engineId = 0;
+        int32 ledCount = 0;     // 0 for a slot not in use
+        uint32 lastUsed = 0;
+        Led leds[maxLeds];
+    };
+
+    static int64 hostKey(const String& hostUrl)
+    {
+        return hostUrl.hashCode64();
+    }
+
+    // the frame to fill in for the instance, taking the place of whatever
+    // it had stored before or of the least recently used one
+    Frame& store(int64 host, int engineId, int ledCount)
+    {
+        Frame* frame = findSlot(host, engineId);
+        if (frame == nullptr)
+        {
+            frame = frames_;
+            for (auto& other : frames_)
+                if (other.lastUsed < frame->lastUsed)
+                    frame = &other;
+        }
+
+        frame->host = host;
+        frame->engineId = engineId;
+        frame->ledCount = jlimit(1, maxLeds, ledCount);
+        frame->lastUsed = ++clock_;
+        return *frame;
+    }
+
+    // only a frame with as many LEDs as the instance has now fits it
+    const Frame* find(int64 host, int engineId, int ledCount)
+    {
+        Frame* frame = findSlot(host, engineId);
+        if (frame == nullptr || frame->ledCount != ledCount)
+        {
+            ++misses_;
+            return nullptr;
+        }
+
+        frame->lastUsed = ++clock_;
+        ++hits_;
+        return frame;
+    }
+
+    int64 getHits() const       { return hits_.get(); }
+    int64 getMisses() const     { return misses_.get(); }
+
+private:
+    Frame* findSlot(int64 host, int engineId)
+    {
+        for (auto& frame : frames_)
+            if (frame.ledCount > 0 && frame.host == host && frame.engineId == engineId)
+                return &frame;
+        return nullptr;
+    }
+
+    Frame frames_[numFrames];
+    uint32 clock_ = 0;
+    Atomic<int64> hits_ { 0 };
+    Atomic<int64> misses_ { 0 };
+};
@@ -0,0 +1,407 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "IoUring.h"
+#include "ThreadTuning.h"
+#include <fcntl.h>
+#include <functional>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+//==============================================================================
+// One thread that epoll waits on file descriptors and timerfds and runs their
+// callbacks inline, for running the whole bridge without the message thread,
+// the Timer thread and the receiver thread handing work to each other.
+// Watches and timers may be changed from any thread, including from a
+// callback; a callback for a watch removed meanwhile is not called. With
+// io_uring the loop waits in io_uring_enter() instead of epoll_wait(): a
+// watch is a poll queued on the ring again after each callback, and the
+// timers and the wakeup are reads there, so a tick is one system call that
+// submits everything queued since and returns the timers' counts with the
+// other completions.
+class EventLoop : private Thread
+{
+public:
+    typedef std::function<void()> Callback;
+
+    EventLoop()
+        : Thread("loop4r el")
+    {
+    }
+
+    ~EventLoop()
+    {
+        stop();
+        for (auto& timer : timers_)
+            ::close(timer.fd);
+        if (wakeFd_ >= 0)
+            ::close(wakeFd_);
+        if (epollFd_ >= 0)
+            ::close(epollFd_);
+    }
+
+    // takes effect on the next start()
+    void setThreadTuning(const ThreadTuning& tuning)
+    {
+        tuning_ = tuning;
+    }
+
+    // before anything is watched; false if the kernel has no io_uring for
+    // us, epoll it is then
+    bool setUring(bool enabled)
+    {
+        const ScopedLock sl(lock_);
+        jassert(watches_.isEmpty());
+        if (! enabled)
+            uring_.close();
+        else if (! uring_.isOpen() && uring_.open(2 * maxUringSlots))
+            counters_.calloc(maxUringSlots);
+        return uring_.isOpen() == enabled;
+    }
+
+    bool isUsingUring() const
+    {
+        return uring_.isOpen();
+    }
+
+    bool start()
+    {
+        if (epollFd_ < 0)
+            epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (wakeFd_ < 0)
+            wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd_ < 0 || wakeFd_ < 0 || ! watchCounter(wakeFd_, [this] { drainUnlessRead(wakeFd_); }))
+            return false;
+
+        startThread();
+        return true;
+    }
+
+    void stop()
+    {
+        signalThreadShouldExit();
+        if (wakeFd_ >= 0)
+        {
+            uint64 one = 1;
+            ignoreUnused(::write(wakeFd_, &one, sizeof(one)));
+        }
+        stopThread(2000);
+    }
+
+    bool isRunning() const
+    {
+        return isThreadRunning();
+    }
+
+    // waits for events (EPOLLIN, EPOLLOUT) on fd, replacing any earlier watch
+    bool watch(int fd, uint32 events, Callback callback)
+    {
+        return watchFd(fd, events, callback, false);
+    }
+
+    void unwatch(int fd)
+    {
+        const ScopedLock sl(lock_);
+        int slot = findSlot(fd);
+        if (slot >= 0)
+        {
+            if (uring_.isOpen())
+            {
+                uring_.queueCancel(watches_.getReference(slot).tag, 0);
+                wakeFromOtherThread();
+            }
+            else
+            {
+                epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+            }
+            watches_.getReference(slot) = Watch();
+        }
+    }
+
+    bool isWatching(int fd) const
+    {
+        const ScopedLock sl(lock_);
+        return findSlot(fd) >= 0;
+    }
+
+    // a timerfd calling back every intervalMs, or once after it; returns the
+    // timer's id for setTimer(), or -1
+    int addTimer(Callback callback)
+    {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd < 0)
+            return -1;
+
+        if (! watchCounter(fd, [this, fd, callback] { drainUnlessRead(fd); callback(); }))
+        {
+            ::close(fd);
+            return -1;
+        }
+
+        const ScopedLock sl(lock_);
+        timers_.add({ fd, false });
+        return timers_.size() - 1;
+    }
+
+    // 0 disarms the timer
+    void setTimer(int id, double intervalMs, bool oneShot = false)
+    {
+        const ScopedLock sl(lock_);
+        if (! isPositiveAndBelow(id, timers_.size()))
+            return;
+
+        auto ns = (int64)(jmax(0.0, intervalMs) * 1000000.0);
+        itimerspec spec;
+        zerostruct(spec);
+        spec.it_value.tv_sec = (time_t)(ns / 1000000000);
+        spec.it_value.tv_nsec = (long)(ns % 1000000000);
+        if (! oneShot)
+            spec.it_interval = spec.it_value;
+        timerfd_settime(timers_.getReference(id).fd, 0, &spec, nullptr);
+        timers_.getReference(id).armed = ns > 0 && ! oneShot;
+        timers_.getReference(id).pendingShot = ns > 0 && oneShot;
+    }
+
+    // a one shot timer counts as armed until it fired
+    bool isTimerArmed(int id) const
+    {
+        const ScopedLock sl(lock_);
+        return isPositiveAndBelow(id, timers_.size())
+            && (timers_.getReference(id).armed || timers_.getReference(id).pendingShot);
+    }
+
+private:
+    struct Watch
+    {
+        int fd = -1;
+        uint64 tag = 0;
+        Callback callback;
+        uint32 events = 0;
+        bool counter = false;       // a timerfd or eventfd, read on the ring
+    };
+
+    struct TimerFd
+    {
+        int fd;
+        bool armed;
+        bool pendingShot = false;
+    };
+
+    void run() override
+    {
+        if (! tuning_.applyToCurrentThread())
+            std::cerr << "Could not set SCHED_FIFO priority " << tuning_.realtimePriority << " for the event loop" << std::endl;
+
+        if (uring_.isOpen())
+        {
+            runRing();
+            return;
+        }
+
+        epoll_event events[16];
+        while (! threadShouldExit())
+        {
+            int count = epoll_wait(epollFd_, events, numElementsInArray(events), -1);
+            for (int i = 0; i < count && ! threadShouldExit(); ++i)
+            {
+                Callback callback;
+                {
+                    const ScopedLock sl(lock_);
+                    int slot = (int)(events[i].data.u64 & 0xffffffff);
+                    if (! isPositiveAndBelow(slot, watches_.size()) || watches_.getReference(slot).tag != events[i].data.u64)
+                        continue;
+                    const Watch& w = watches_.getReference(slot);
+                    callback = w.callback;
+                    for (auto& timer : timers_)
+                        if (timer.fd == w.fd)
+                            timer.pendingShot = false;
+                }
+
+                if (callback)
+                    callback();
+            }
+        }
+    }
+
+    // completions go to the watch whose tag they carry, which is queued on
+    // the ring again afterwards unless it was replaced or went away
+    void runRing()
+    {
+        IoUring::Completion completions[16];
+        while (! threadShouldExit())
+        {
+            if (! uring_.enter())
+            {
+                std::cerr << "io_uring_enter failed for the event loop: " << strerror(errno) << std::endl;
+                wait(10);
+                continue;
+            }
+
+            int count = uring_.takeCompletions(completions, numElementsInArray(completions));
+            for (int i = 0; i < count && ! threadShouldExit(); ++i)
+            {
+                const uint64 tag = completions[i].userData;
+                const int32 result = completions[i].result;
+                const int slot = (int)(tag & 0xffffffff);
+                Callback callback;
+                {
+                    const ScopedLock sl(lock_);
+                    if (tag == 0 || ! isPositiveAndBelow(slot, watches_.size()) || watches_.getReference(slot).tag != tag)
+                        continue;
+                    const Watch& w = watches_.getReference(slot);
+                    if (result >= 0)
+                        callback = w.callback;
+                    for (auto& timer : timers_)
+                        if (timer.fd == w.fd && result >= 0)
+                            timer.pendingShot = false;
+                }
+
+                if (callback)
+                    callback();
+
+                // an error other than a spurious wakeup means the fd is gone
+                const ScopedLock sl(lock_);
+                if ((result >= 0 || result == -EAGAIN || result == -EINTR)
+                    && isPositiveAndBelow(slot, watches_.size()) && watches_.getReference(slot).tag == tag)
+                    queueOnRing(slot);
+            }
+        }
+    }
+
+    bool watchFd(int fd, uint32 events, Callback callback, bool counter)
+    {
+        const ScopedLock sl(lock_);
+        if (uring_.isOpen())
+            return watchOnRing(fd, events, callback, counter);
+
+        if (epollFd_ < 0)
+            epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+
+        int existing = findSlot(fd);
+        int slot = existing >= 0 ? existing : findFreeSlot();
+
+        epoll_event event;
+        zerostruct(event);
+        event.events = events;
+        event.data.u64 = ((uint64)++generation_ << 32) | (uint32)slot;
+
+        // a descriptor closed while watched left epoll by itself
+        bool added = existing >= 0 && epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &event) == 0;
+        if (! added && epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) != 0)
+            return false;
+
+        watches_.getReference(slot) = { fd, event.data.u64, callback, events, counter };
+        return true;
+    }
+
+    bool watchCounter(int fd, Callback callback)
+    {
+        // the ring's read waits for the count instead of failing
+        if (uring_.isOpen())
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        return watchFd(fd, EPOLLIN, callback, true);
+    }
+
+    bool watchOnRing(int fd, uint32 events, Callback callback, bool counter)
+    {
+        int existing = findSlot(fd);
+        int slot = existing >= 0 ? existing : findFreeSlot();
+        if (slot >= maxUringSlots)
+            return false;
+
+        if (existing >= 0)
+            uring_.queueCancel(watches_.getReference(slot).tag, 0);
+
+        watches_.getReference(slot) = { fd, ((uint64)++generation_ << 32) | (uint32)slot, callback, events, counter };
+        if (! queueOnRing(slot))
+        {
+            watches_.getReference(slot) = Watch();
+            return false;
+        }
+
+        wakeFromOtherThread();
+        return true;
+    }
+
+    // with lock_ held
+    bool queueOnRing(int slot)
+    {
+        const Watch& w = watches_.getReference(slot);
+        if (w.counter)
+            return uring_.queueRead(w.fd, counters_ + slot, sizeof(uint64), w.tag);
+        return uring_.queuePoll(w.fd, w.events, w.tag);
+    }
+
+    // what another thread queued waits for the loop's next enter()
+    void wakeFromOtherThread()
+    {
+        if (wakeFd_ >= 0 && isThreadRunning() && Thread::getCurrentThreadId() != getThreadId())
+        {
+            uint64 one = 1;
+            ignoreUnused(::write(wakeFd_, &one, sizeof(one)));
+        }
+    }
+
+    static void drain(int fd)
+    {
+        uint64 count;
+        ignoreUnused(::read(fd, &count, sizeof(count)));
+    }
+
+    // on the ring the count was read already
+    void drainUnlessRead(int fd)
+    {
+        if (! uring_.isOpen())
+            drain(fd);
+    }
+
+    int findSlot(int fd) const
+    {
+        for (int i = 0; i < watches_.size(); ++i)
+            if (watches_.getReference(i).fd == fd)
+                return i;
+        return -1;
+    }
+
+    int findFreeSlot()
+    {
+        for (int i = 0; i < watches_.size(); ++i)
+            if (watches_.getReference(i).fd < 0)
+                return i;
+        watches_.add(Watch());
+        return watches_.size() - 1;
+    }
+
+    static const int maxUringSlots = 64;
+
+    CriticalSection lock_;
+    IoUring uring_;
+    HeapBlock<uint64> counters_;    // a count per slot for the ring's reads
+    Array<Watch> watches_;
+    Array<TimerFd> timers_;
+    uint32 generation_ = 0;
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+    ThreadTuning tuning_;
+};
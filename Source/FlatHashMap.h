@@ -0,0 +1,239 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// How FlatHashMap hashes and compares its keys. A lookup may be of another
+// type than the key, a StringRef for String keys, so finding one doesn't
+// have to build a key first.
+struct FlatHashTraits
+{
+    static uint32 hash(int key)
+    {
+        uint32 mixed = (uint32)key * 0x9e3779b1u;
+        return mixed ^ (mixed >> 16);
+    }
+
+    static bool equals(int key, int lookup)
+    {
+        return key == lookup;
+    }
+
+    // FNV-1a
+    static uint32 hash(StringRef key)
+    {
+        uint32 result = 2166136261u;
+        for (const char* text = key; *text != 0; ++text)
+        {
+            result ^= (uint8)*text;
+            result *= 16777619u;
+        }
+        return result;
+    }
+
+    static bool equals(const String& key, StringRef lookup)
+    {
+        return key == lookup;
+    }
+};
+
+//==============================================================================
+// A hash map kept in one array of slots with open addressing, Robin Hood
+// style: an insert takes the slot of any key that is closer to its own home
+// slot than the new one, so every key stays only a few probes from where it
+// hashes to and a miss stops early. Nothing is allocated per insert, only
+// when the table doubles at 7/8 full. Like juce's HashMap it isn't thread
+// safe.
+template <typename Key, typename Value, typename Traits = FlatHashTraits>
+class FlatHashMap
+{
+public:
+    explicit FlatHashMap(int initialCapacity = 16)
+    {
+        reserve(initialCapacity);
+    }
+
+    int size() const
+    {
+        return size_;
+    }
+
+    // room for this many keys before the table grows
+    void reserve(int numKeys)
+    {
+        int capacity = 8;
+        while (capacity * 7 / 8 < numKeys)
+            capacity *= 2;
+        if (capacity > slots_.size())
+            rehash(capacity);
+    }
+
+    void clear()
+    {
+        for (auto& slot : slots_)
+            slot = Slot();
+        size_ = 0;
+    }
+
+    template <typename Lookup>
+    Value* find(const Lookup& key)
+    {
+        int pos = indexOf(key, Traits::hash(key));
+        return pos >= 0 ? &slots_.getReference(pos).value : nullptr;
+    }
+
+    template <typename Lookup>
+    const Value* find(const Lookup& key) const
+    {
+        int pos = indexOf(key, Traits::hash(key));
+        return pos >= 0 ? &slots_.getReference(pos).value : nullptr;
+    }
+
+    template <typename Lookup>
+    bool contains(const Lookup& key) const
+    {
+        return find(key) != nullptr;
+    }
+
+    // the key's value, or a default one if it isn't there
+    template <typename Lookup>
+    Value operator[](const Lookup& key) const
+    {
+        const Value* value = find(key);
+        return value != nullptr ? *value : Value();
+    }
+
+    // the key's value, added as a default one if it wasn't there
+    Value& getReference(const Key& key)
+    {
+        const uint32 keyHash = Traits::hash(key);
+        int pos = indexOf(key, keyHash);
+        return pos >= 0 ? slots_.getReference(pos).value : insert(key, keyHash);
+    }
+
+    void set(const Key& key, const Value& value)
+    {
+        getReference(key) = value;
+    }
+
+    // the keys after it move back into the gap, so there are no tombstones
+    template <typename Lookup>
+    bool remove(const Lookup& key)
+    {
+        int pos = indexOf(key, Traits::hash(key));
+        if (pos < 0)
+            return false;
+
+        for (int next = (pos + 1) & mask_; slots_.getReference(next).distance > 0; next = (next + 1) & mask_)
+        {
+            Slot& moved = slots_.getReference(pos);
+            moved = std::move(slots_.getReference(next));
+            --moved.distance;
+            pos = next;
+        }
+        slots_.getReference(pos) = Slot();
+        --size_;
+        return true;
+    }
+
+    // calls back with each key and its value, in no particular order
+    template <typename Callback>
+    void forEach(Callback callback) const
+    {
+        for (auto& slot : slots_)
+            if (slot.distance >= 0)
+                callback(slot.key, slot.value);
+    }
+
+private:
+    struct Slot
+    {
+        Key key {};
+        Value value {};
+        uint32 hash = 0;
+        int distance = -1;      // from the key's home slot, -1 for free
+    };
+
+    template <typename Lookup>
+    int indexOf(const Lookup& key, uint32 keyHash) const
+    {
+        for (int pos = (int)(keyHash & (uint32)mask_), distance = 0;; pos = (pos + 1) & mask_, ++distance)
+        {
+            const Slot& slot = slots_.getReference(pos);
+            // a key this far from home would have taken this slot
+            if (slot.distance < distance)
+                return -1;
+            if (slot.hash == keyHash && Traits::equals(slot.key, key))
+                return pos;
+        }
+    }
+
+    Value& insert(const Key& key, uint32 keyHash)
+    {
+        if ((size_ + 1) * 8 > slots_.size() * 7)
+            rehash(slots_.size() * 2);
+
+        Slot incoming;
+        incoming.key = key;
+        incoming.hash = keyHash;
+        incoming.distance = 0;
+
+        int inserted = -1;
+        for (int pos = (int)(keyHash & (uint32)mask_);; pos = (pos + 1) & mask_, ++incoming.distance)
+        {
+            Slot& slot = slots_.getReference(pos);
+            if (slot.distance < 0)
+            {
+                slot = std::move(incoming);
+                if (inserted < 0)
+                    inserted = pos;
+                break;
+            }
+            if (slot.distance < incoming.distance)
+            {
+                std::swap(slot, incoming);
+                if (inserted < 0)
+                    inserted = pos;
+            }
+        }
+
+        ++size_;
+        return slots_.getReference(inserted).value;
+    }
+
+    void rehash(int capacity)
+    {
+        Array<Slot> old;
+        old.swapWith(slots_);
+        slots_.resize(capacity);
+        mask_ = capacity - 1;
+        size_ = 0;
+
+        for (auto& slot : old)
+            if (slot.distance >= 0)
+                insert(slot.key, slot.hash) = std::move(slot.value);
+    }
+
+    Array<Slot> slots_;
+    int mask_ = 0;
+    int size_ = 0;
+};
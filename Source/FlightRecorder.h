@@ -0,0 +1,291 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "OscMessageView.h"
+#include <atomic>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+//==============================================================================
+// Always on: the last few thousand OSC messages received and MIDI batches
+// written, each summed up in a 64 byte record in a ring. Recording is a
+// clock_gettime() and a copy into the ring, no formatting and no locking.
+// Backed by a file the ring survives a crash and can be dumped afterwards,
+// otherwise it lives in anonymous memory and can only be dumped live.
+class FlightRecorder
+{
+public:
+    enum Type
+    {
+        OscIn = 1,
+        MidiOut = 2,
+        BadPacket = 3
+    };
+
+    static const int capacity = 8192;
+
+    FlightRecorder()
+    {
+        map(-1);
+    }
+
+    ~FlightRecorder()
+    {
+        unmap();
+    }
+
+    // what the file held goes to file.prev first, which keeps the record of
+    // a crash when the bridge is restarted straight away
+    bool open(const File& file)
+    {
+        if (file.existsAsFile())
+            file.moveFileTo(file.getSiblingFile(file.getFileName() + ".prev"));
+
+        int fd = ::open(file.getFullPathName().toRawUTF8(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return false;
+
+        bool ok = ftruncate(fd, (off_t)sizeof(Ring)) == 0;
+        ok = ok && map(fd);
+        ::close(fd);
+        return ok;
+    }
+
+    // the address, the type tags and the first arguments: ints as they
+    // are, floats by their bits, strings and blobs by their size
+    void recordOsc(const OscMessageView& message)
+    {
+        uint32 sequence;
+        Record* record = begin(sequence);
+        if (record == nullptr)
+            return;
+
+        record->type = OscIn;
+        record->count = (uint8)jmin(255, message.size());
+        record->total = 0;
+        copyText(record->text, message.getAddress());
+        zeromem(record->bytes, sizeof(record->bytes));
+        strncpy((char*)record->bytes, message.getTypeTags(), 8);
+        for (int i = 0; i < jmin(6, message.size()); ++i)
+        {
+            const OscValue& arg = message[i];
+            int32 value = arg.isInt32() ? arg.getInt32()
+                        : arg.isFloat32() ? floatBits(arg.getFloat32())
+                        : arg.isString() ? (int32)arg.getStringLength()
+                        : arg.isBlob() ? (int32)arg.getBlobSize() : 0;
+            memcpy(record->bytes + 8 + 4 * i, &value, 4);
+        }
+        end(record, sequence);
+    }
+
+    void recordMidi(const String& port, const uint8* data, int size)
+    {
+        uint32 sequence;
+        Record* record = begin(sequence);
+        if (record == nullptr)
+            return;
+
+        record->type = MidiOut;
+        record->count = (uint8)jmin((int)sizeof(record->bytes), size);
+        record->total = (uint16)jmin(65535, size);
+        copyText(record->text, port.toRawUTF8());
+        memcpy(record->bytes, data, record->count);
+        end(record, sequence);
+    }
+
+    // the first bytes of a packet that didn't decode
+    void recordBadPacket(const char* data, int size)
+    {
+        uint32 sequence;
+        Record* record = begin(sequence);
+        if (record == nullptr)
+            return;
+
+        record->type = BadPacket;
+        record->count = (uint8)jmin((int)sizeof(record->bytes), jmax(0, size));
+        record->total = (uint16)jlimit(0, 65535, size);
+        copyText(record->text, "");
+        memcpy(record->bytes, data, record->count);
+        end(record, sequence);
+    }
+
+    // the ring being recorded, oldest first
+    bool dump(OutputStream& out) const
+    {
+        return ring_ != nullptr && dump(*ring_, out);
+    }
+
+    // a ring file, e.g. the .prev of a bridge that crashed
+    static bool dumpFile(const File& file, OutputStream& out)
+    {
+        MemoryMappedFile mapped(file, MemoryMappedFile::readOnly);
+        if (mapped.getData() == nullptr || mapped.getSize() < sizeof(Ring))
+            return false;
+        return dump(*(const Ring*)mapped.getData(), out);
+    }
+
+private:
+    struct Record
+    {
+        int64 timeNs;           // CLOCK_MONOTONIC
+        uint32 sequence;        // 1 + the number of the record, once complete
+        uint8 type;
+        uint8 count;            // arguments, or MIDI bytes kept
+        uint16 total;           // MIDI bytes written
+        char text[16];          // the address or the port, cut short
+        uint8 bytes[32];
+    };
+
+    struct Ring
+    {
+        char magic[8];
+        uint32 capacity;
+        uint32 recordSize;
+        std::atomic<uint64> next;
+        char padding[40];
+        Record records[FlightRecorder::capacity];
+    };
+
+    Record* begin(uint32& sequence)
+    {
+        if (ring_ == nullptr)
+            return nullptr;
+
+        uint64 number = ring_->next.fetch_add(1, std::memory_order_relaxed);
+        Record* record = &ring_->records[number % capacity];
+        record->sequence = 0;
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        record->timeNs = (int64)time.tv_sec * 1000000000 + time.tv_nsec;
+        sequence = (uint32)(number + 1);
+        return record;
+    }
+
+    void end(Record* record, uint32 sequence)
+    {
+        std::atomic_thread_fence(std::memory_order_release);
+        record->sequence = sequence;
+    }
+
+    static void copyText(char* text, const char* from)
+    {
+        strncpy(text, from, 16);
+    }
+
+    static int32 floatBits(float value)
+    {
+        int32 bits;
+        memcpy(&bits, &value, 4);
+        return bits;
+    }
+
+    static bool dump(const Ring& ring, OutputStream& out)
+    {
+        if (memcmp(ring.magic, magic(), sizeof(ring.magic)) != 0 || ring.capacity != (uint32)capacity
+            || ring.recordSize != (uint32)sizeof(Record))
+            return false;
+
+        const uint64 next = ring.next.load(std::memory_order_acquire);
+        const uint64 first = next > (uint64)capacity ? next - (uint64)capacity : 0;
+        int64 lastNs = 0;
+        for (uint64 number = first; number < next; ++number)
+        {
+            const Record& record = ring.records[number % capacity];
+            if (record.sequence != (uint32)(number + 1))
+                continue;       // overwritten or cut short by a crash
+
+            // seconds on CLOCK_MONOTONIC, then since the record before
+            String line = String(record.timeNs / 1.0e9, 6) + " +" + String((record.timeNs - (lastNs != 0 ? lastNs : record.timeNs)) / 1000) + "us ";
+            lastNs = record.timeNs;
+            String text = String::fromUTF8(record.text, (int)strnlen(record.text, sizeof(record.text)));
+            if (record.type == OscIn)
+            {
+                String tags = String::fromUTF8((const char*)record.bytes, (int)strnlen((const char*)record.bytes, 8));
+                line << "osc  " << text << " ," << tags;
+                for (int i = 0; i < jmin(6, (int)record.count); ++i)
+                {
+                    int32 value;
+                    memcpy(&value, record.bytes + 8 + 4 * i, 4);
+                    if (i < tags.length() && tags[i] == 'f')
+                    {
+                        float f;
+                        memcpy(&f, &value, 4);
+                        line << " " << String(f);
+                    }
+                    else
+                    {
+                        line << " " << String(value);
+                    }
+                }
+            }
+            else if (record.type == BadPacket)
+            {
+                line << "bad  " << String(record.total) << " bytes:";
+                for (int i = 0; i < record.count; ++i)
+                    line << " " << String::toHexString(record.bytes[i]).paddedLeft('0', 2).toUpperCase();
+            }
+            else
+            {
+                line << "midi " << text << " " << String(record.total) << " bytes:";
+                for (int i = 0; i < record.count; ++i)
+                    line << " " << String::toHexString(record.bytes[i]).paddedLeft('0', 2).toUpperCase();
+            }
+
+            line << "\n";
+            if (! out.write(line.toRawUTF8(), line.getNumBytesAsUTF8()))
+                return false;
+        }
+        return true;
+    }
+
+    // a descriptor to map, or -1 for anonymous memory
+    bool map(int fd)
+    {
+        void* mapped = mmap(nullptr, sizeof(Ring), PROT_READ | PROT_WRITE,
+                            fd >= 0 ? MAP_SHARED : MAP_PRIVATE | MAP_ANONYMOUS, fd, 0);
+        if (mapped == MAP_FAILED)
+            return false;
+
+        unmap();
+        ring_ = (Ring*)mapped;
+        memcpy(ring_->magic, magic(), sizeof(ring_->magic));
+        ring_->capacity = (uint32)capacity;
+        ring_->recordSize = (uint32)sizeof(Record);
+        ring_->next.store(0);
+        return true;
+    }
+
+    void unmap()
+    {
+        if (ring_ != nullptr)
+            munmap(ring_, sizeof(Ring));
+        ring_ = nullptr;
+    }
+
+    static const char* magic()
+    {
+        return "L4RFLT01";
+    }
+
+    Ring* ring_ = nullptr;
+};
@@ -0,0 +1,284 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "LatencyHistogram.h"
+#include <functional>
+
+//==============================================================================
+// The LEDs as the outputs past the pedalboards see them after a flush: the
+// state of each and whether it is lit right now, and the selected loop.
+struct LedFrame
+{
+    static const int maxLeds = 128;
+
+    int numLeds = 0;
+    int display = 0;
+    uint8 states[maxLeds] = {};
+    bool on[maxLeds] = {};
+    double stampMs = 0.0;       // when it was published
+
+    bool sameAs(const LedFrame& other) const
+    {
+        return numLeds == other.numLeds && display == other.display
+            && memcmp(states, other.states, (size_t)numLeds) == 0
+            && memcmp(on, other.on, (size_t)numLeds) == 0;
+    }
+};
+
+//==============================================================================
+// Hands every new frame to the registered sinks, each on a thread of its own
+// behind a bounded queue, so a sink that takes long to write (a long strip,
+// a slow network) never holds back the bridge or the other sinks. publish()
+// only copies the frame into each queue. A full queue drops its oldest frame:
+// frames are whole states, so a newer one supersedes it. Sinks are added and
+// published to from the message thread with the bridge's state locked.
+class FrameFanout
+{
+public:
+    // at most one frame every minIntervalMs, with up to depth of them queued.
+    // A coalescing sink skips straight to the newest of those waiting, the
+    // others are shown each frame in turn.
+    struct Pacing
+    {
+        double minIntervalMs = 0.0;
+        int depth = 2;
+        bool coalesce = true;
+    };
+
+    typedef std::function<void(const LedFrame&)> Show;
+
+    ~FrameFanout()
+    {
+        stop();
+    }
+
+    // returns false if a sink of that name is there already
+    bool addSink(const String& name, Show show, const Pacing& pacing)
+    {
+        if (findSink(name) != nullptr)
+            return false;
+
+        auto* sink = sinks_.add(new Sink(name, show));
+        sink->setPacing(pacing);
+        sink->start();
+
+        // it starts out with what the others have
+        if (published_)
+            sink->push(last_);
+        return true;
+    }
+
+    bool setPacing(const String& name, const Pacing& pacing)
+    {
+        auto* sink = findSink(name);
+        if (sink == nullptr)
+            return false;
+        sink->setPacing(pacing);
+        return true;
+    }
+
+    bool isEmpty() const
+    {
+        return sinks_.isEmpty();
+    }
+
+    // queues the frame for every sink unless it is the one they had last,
+    // or always when forced, e.g. after a sink changed its colours
+    void publish(const LedFrame& frame, bool force)
+    {
+        if (! force && published_ && frame.sameAs(last_))
+            return;
+
+        last_ = frame;
+        last_.stampMs = Time::getMillisecondCounterHiRes();
+        published_ = true;
+        for (auto* sink : sinks_)
+            sink->push(last_);
+    }
+
+    // the last frame again, once the sinks are done with what is queued
+    void republish()
+    {
+        if (published_)
+            publish(last_, true);
+    }
+
+    void stop()
+    {
+        for (auto* sink : sinks_)
+            sink->stop();
+    }
+
+    struct SinkStats
+    {
+        String name;
+        int64 shown;
+        int64 dropped;          // superseded before they were shown
+        int64 lagP99Us;         // from publish() to the sink being done
+        int64 lagMaxUs;
+    };
+
+    Array<SinkStats> getStats() const
+    {
+        Array<SinkStats> stats;
+        for (auto* sink : sinks_)
+            stats.add({ sink->getName(), sink->getShown(), sink->getDropped(),
+                        sink->getLag().getPercentile(0.99), sink->getLag().getMax() });
+        return stats;
+    }
+
+private:
+    class Sink : private Thread
+    {
+    public:
+        Sink(const String& name, Show show)
+            : Thread("loop4r fanout"),
+              name_(name),
+              show_(show),
+              lag_(name)
+        {
+        }
+
+        ~Sink()
+        {
+            stop();
+        }
+
+        void start()
+        {
+            startThread();
+        }
+
+        void stop()
+        {
+            stopThread(1000);
+        }
+
+        const String& getName() const   { return name_; }
+
+        void setPacing(const Pacing& pacing)
+        {
+            const ScopedLock sl(lock_);
+            pacing_ = pacing;
+            pacing_.depth = jlimit(1, maxDepth, pacing.depth);
+            pacing_.minIntervalMs = jmax(0.0, pacing.minIntervalMs);
+            while (count_ > pacing_.depth)
+                dropOldest();
+        }
+
+        void push(const LedFrame& frame)
+        {
+            {
+                const ScopedLock sl(lock_);
+                if (count_ == pacing_.depth)
+                    dropOldest();
+                queue_[(head_ + count_) % maxDepth] = frame;
+                ++count_;
+            }
+            notify();
+        }
+
+        int64 getShown() const                  { return shown_.get(); }
+        int64 getDropped() const                { return dropped_.get(); }
+        const LatencyHistogram& getLag() const  { return lag_; }
+
+    private:
+        static const int maxDepth = 8;
+
+        void dropOldest()
+        {
+            head_ = (head_ + 1) % maxDepth;
+            --count_;
+            ++dropped_;
+        }
+
+        void run() override
+        {
+            double lastShownMs = 0.0;
+            while (! threadShouldExit())
+            {
+                double intervalMs;
+                {
+                    const ScopedLock sl(lock_);
+                    intervalMs = pacing_.minIntervalMs;
+                }
+
+                // the pacing comes first, so frames arriving meanwhile can
+                // still supersede each other
+                const double dueMs = lastShownMs + intervalMs;
+                double now = Time::getMillisecondCounterHiRes();
+                if (lastShownMs > 0.0 && now < dueMs)
+                {
+                    wait(jmax(1, (int)(dueMs - now)));
+                    continue;
+                }
+
+                bool popped = false;
+                {
+                    const ScopedLock sl(lock_);
+                    if (count_ > 0)
+                    {
+                        while (pacing_.coalesce && count_ > 1)
+                            dropOldest();
+                        frame_ = queue_[head_];
+                        head_ = (head_ + 1) % maxDepth;
+                        --count_;
+                        popped = true;
+                    }
+                }
+
+                if (! popped)
+                {
+                    wait(-1);
+                    continue;
+                }
+
+                show_(frame_);
+                lastShownMs = Time::getMillisecondCounterHiRes();
+                lag_.record(lastShownMs - frame_.stampMs);
+                ++shown_;
+            }
+        }
+
+        String name_;
+        Show show_;
+        CriticalSection lock_;
+        Pacing pacing_;
+        LedFrame queue_[maxDepth];
+        int head_ = 0;
+        int count_ = 0;
+        LedFrame frame_;            // the one being shown, only on the thread
+        LatencyHistogram lag_;
+        Atomic<int64> shown_ { 0 };
+        Atomic<int64> dropped_ { 0 };
+    };
+
+    Sink* findSink(const String& name) const
+    {
+        for (auto* sink : sinks_)
+            if (sink->getName() == name)
+                return sink;
+        return nullptr;
+    }
+
+    OwnedArray<Sink> sinks_;
+    LedFrame last_;
+    bool published_ = false;
+};
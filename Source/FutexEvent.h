@@ -0,0 +1,117 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//==============================================================================
+// What Thread::notify() and wait() do with juce's WaitableEvent, on a futex:
+// signalling takes no lock and makes no system call unless the waiting
+// thread is actually asleep, and a wait that finds the event already
+// signalled returns without one too. Resets itself when a wait returns
+// true. Any number of threads may signal, only one may wait at a time,
+// which is how every thread of ours waits for its own work.
+class FutexEvent
+{
+public:
+    void signal()
+    {
+        if (state_.exchange(signalled) == sleeping)
+            futex(FUTEX_WAKE_PRIVATE, INT_MAX, nullptr);
+    }
+
+    void reset()
+    {
+        int expected = signalled;
+        state_.compare_exchange_strong(expected, idle);
+    }
+
+    // a negative timeout waits for as long as it takes, returns false if it
+    // ran out first
+    bool wait(int timeoutMs = -1)
+    {
+        if (consume())
+            return true;
+        if (timeoutMs == 0)
+            return false;
+
+        const double endMs = Time::getMillisecondCounterHiRes() + timeoutMs;
+        for (;;)
+        {
+            // tell signal() there is someone to wake, unless it just came
+            int expected = idle;
+            if (! state_.compare_exchange_strong(expected, sleeping) && expected == signalled)
+            {
+                if (consume())
+                    return true;
+                continue;
+            }
+
+            timespec timeout, *relative = nullptr;
+            if (timeoutMs > 0)
+            {
+                const double leftMs = endMs - Time::getMillisecondCounterHiRes();
+                if (leftMs <= 0.0)
+                    break;
+
+                const int64 ns = (int64)(leftMs * 1000000.0);
+                timeout.tv_sec = (time_t)(ns / 1000000000);
+                timeout.tv_nsec = (long)(ns % 1000000000);
+                relative = &timeout;
+            }
+
+            futex(FUTEX_WAIT_PRIVATE, sleeping, relative);
+            if (consume())
+                return true;
+        }
+
+        // nobody left to wake
+        int expected = sleeping;
+        state_.compare_exchange_strong(expected, idle);
+        return consume();
+    }
+
+private:
+    enum
+    {
+        idle,
+        signalled,
+        sleeping
+    };
+
+    bool consume()
+    {
+        int expected = signalled;
+        return state_.compare_exchange_strong(expected, idle);
+    }
+
+    void futex(int op, int value, const timespec* timeout)
+    {
+        syscall(SYS_futex, reinterpret_cast<int*>(&state_), op, value, timeout, nullptr, 0);
+    }
+
+    std::atomic<int> state_ { idle };
+    static_assert(sizeof(std::atomic<int>) == sizeof(int), "the futex word is the atomic itself");
+};
@@ -0,0 +1,147 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+
+//==============================================================================
+// Status LEDs on the Pi's own GPIO lines, through the gpiochip character
+// device: the heartbeat, the OSC link being up and a pedalboard port being
+// down. All of them are requested as one line handle, so flush() sets them
+// together with a single ioctl, and only when one changed. Any thread may
+// set a line; flushing takes a lock of its own.
+class GpioStatus
+{
+public:
+    enum Line
+    {
+        Heartbeat,
+        Link,
+        Error,
+        numLines
+    };
+
+    ~GpioStatus()
+    {
+        close();
+    }
+
+    // the line offsets on the chip, negative for a status without a LED
+    bool open(const String& chip, const int (&offsets)[numLines])
+    {
+        close();
+
+        String path = chip.startsWithChar('/') ? chip : "/dev/" + chip;
+        int chipFd = ::open(path.toRawUTF8(), O_RDONLY | O_CLOEXEC);
+        if (chipFd < 0)
+            return false;
+
+        gpiohandle_request request;
+        zerostruct(request);
+        request.flags = GPIOHANDLE_REQUEST_OUTPUT;
+        strncpy(request.consumer_label, "loop4r_leds", sizeof(request.consumer_label) - 1);
+        for (int line = 0; line < numLines; ++line)
+        {
+            slots_[line] = -1;
+            if (offsets[line] >= 0)
+            {
+                slots_[line] = (int)request.lines;
+                request.lineoffsets[request.lines++] = (uint32)offsets[line];
+            }
+        }
+
+        bool requested = request.lines > 0 && ioctl(chipFd, GPIO_GET_LINEHANDLE_IOCTL, &request) >= 0;
+        ::close(chipFd);
+        if (! requested)
+            return false;
+
+        const SpinLock::ScopedLockType sl(lock_);
+        fd_ = request.fd;
+        values_ = 0;
+        shown_ = 0;
+        return true;
+    }
+
+    void close()
+    {
+        const SpinLock::ScopedLockType sl(lock_);
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = -1;
+    }
+
+    bool isOpen() const
+    {
+        return fd_ >= 0;
+    }
+
+    bool has(Line line) const
+    {
+        return isOpen() && slots_[line] >= 0;
+    }
+
+    void set(Line line, bool on)
+    {
+        int bit = 1 << line;
+        int values = values_.get();
+        while (! values_.compareAndSetBool(on ? (values | bit) : (values & ~bit), values))
+            values = values_.get();
+    }
+
+    // returns false if the lines couldn't be set
+    bool flush()
+    {
+        const SpinLock::ScopedLockType sl(lock_);
+        int values = values_.get();
+        if (fd_ < 0 || values == shown_)
+            return fd_ >= 0;
+
+        gpiohandle_data data;
+        zerostruct(data);
+        for (int line = 0; line < numLines; ++line)
+            if (slots_[line] >= 0)
+                data.values[slots_[line]] = (uint8)((values >> line) & 1);
+
+        if (ioctl(fd_, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data) < 0)
+        {
+            ++failedWrites_;
+            return false;
+        }
+        shown_ = values;
+        return true;
+    }
+
+    int64 getFailedWrites() const
+    {
+        return failedWrites_.get();
+    }
+
+private:
+    SpinLock lock_;
+    int fd_ = -1;
+    int slots_[numLines] = { -1, -1, -1 };
+    Atomic<int> values_ { 0 };
+    int shown_ = 0;
+    Atomic<int64> failedWrites_ { 0 };
+};
@@ -0,0 +1,300 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "LedStateCache.h"
+#include "UnixDatagram.h"
+#include <functional>
+#include <poll.h>
+
+//==============================================================================
+// Hands a running bridge over to a new instance started with the same path,
+// so an upgrade neither darkens the pedalboard nor loses an OSC packet. The
+// running instance listens on an AF_UNIX stream socket at path. The new one
+// connects on startup and asks with a 'T'. The old one stops reading the OSC
+// sockets before it takes its snapshot, so what the loopers send from then
+// on waits in them for the new one. It sends the LED state, the loopers'
+// ids and the sequence numbers, and the bound OSC sockets (SCM_RIGHTS), and
+// the new one answers 'A' once it has them. The old one then lets go of the
+// sockets and the pedalboard ports, says 'D' and quits, and the new one
+// opens the ports and listens at path itself. Anything going wrong before
+// the 'A' has the old instance read the sockets again and carry on.
+class Handoff : private Thread
+{
+public:
+    static const int maxSockets = 16;
+
+    struct State
+    {
+        char magic[8];
+        LedStateCache::Image image;             // what the LEDs and the display show
+        struct Sequence { uint32 sequence; int32 seen; };
+        Sequence ledSequences[LedStateCache::maxLeds];
+        Sequence engineSequences[LedStateCache::maxEngines];
+    };
+
+    // stops reading the sockets, then with the bridge's state locked fills
+    // in the state and the sockets to hand over
+    typedef std::function<void(State& state, Array<int>& sockets)> ExportCallback;
+
+    // stops using the sockets and closes the pedalboard ports, on the
+    // handoff's thread
+    typedef std::function<void()> ReleaseCallback;
+
+    // reads the sockets again after a handover that fell through
+    typedef std::function<void()> ResumeCallback;
+
+    Handoff(ExportCallback exportState, ReleaseCallback release, ResumeCallback resume)
+        : Thread("loop4r handoff"),
+          export_(exportState),
+          release_(release),
+          resume_(resume)
+    {
+    }
+
+    ~Handoff()
+    {
+        stop();
+    }
+
+    // the new instance: false if nothing answers at path, else true once
+    // the state and the sockets arrived and the old instance was told to let
+    // go, waiting up to timeoutMs for it to have done so
+    bool takeOver(const String& path, State& state, Array<int>& sockets, int timeoutMs)
+    {
+        sockaddr_un address;
+        if (! UnixDatagram::makeAddress(path, address))
+            return false;
+
+        int handle = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (handle < 0)
+            return false;
+        if (::connect(handle, (const sockaddr*)&address, sizeof(address)) != 0 || ! sendByte(handle, 'T')
+            || ! receiveState(handle, state, sockets, timeoutMs) || ! sendByte(handle, 'A'))
+        {
+            for (auto socket : sockets)
+                ::close(socket);
+            sockets.clearQuick();
+            ::close(handle);
+            return false;
+        }
+
+        // the ports are free once it said so, or gone with it
+        receiveByte(handle, timeoutMs);
+        ::close(handle);
+        return true;
+    }
+
+    // the running instance: hands over to whoever connects to path next
+    bool listen(const String& path)
+    {
+        stop();
+
+        sockaddr_un address;
+        if (! UnixDatagram::makeAddress(path, address))
+            return false;
+
+        // what an instance that quit without handing over left behind
+        ::unlink(path.toRawUTF8());
+        listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenFd_ < 0 || bind(listenFd_, (const sockaddr*)&address, sizeof(address)) != 0 || ::listen(listenFd_, 1) != 0)
+        {
+            closeListener();
+            return false;
+        }
+
+        path_ = path;
+        startThread();
+        return true;
+    }
+
+    // the path is left to the new instance after a handover
+    void stop()
+    {
+        stopThread(2000);
+        closeListener();
+        if (path_.isNotEmpty() && handedOver_.get() == 0)
+            ::unlink(path_.toRawUTF8());
+        path_.clear();
+    }
+
+    bool hasHandedOver() const
+    {
+        return handedOver_.get() != 0;
+    }
+
+private:
+    static const char* getMagic()
+    {
+        return "L4RHAND1";
+    }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            pollfd ready { listenFd_, POLLIN, 0 };
+            if (poll(&ready, 1, 100) <= 0)
+                continue;
+
+            int handle = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (handle < 0)
+                continue;
+
+            bool handedOver = handOver(handle);
+            ::close(handle);
+            if (handedOver)
+                return;
+        }
+    }
+
+    bool handOver(int handle)
+    {
+        if (receiveByte(handle, 1000) != 'T')
+            return false;
+
+        State state;
+        zerostruct(state);
+        memcpy(state.magic, getMagic(), sizeof(state.magic));
+        Array<int> sockets;
+        export_(state, sockets);
+        if (sockets.size() > maxSockets || ! sendState(handle, state, sockets) || receiveByte(handle, 2000) != 'A')
+        {
+            resume_();
+            return false;
+        }
+
+        handedOver_ = 1;
+        release_();
+        sendByte(handle, 'D');
+        return true;
+    }
+
+    bool sendState(int handle, const State& state, const Array<int>& sockets)
+    {
+        iovec data { (void*)&state, sizeof(state) };
+        msghdr message = {};
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+
+        char control[CMSG_SPACE(sizeof(int) * maxSockets)] = {};
+        if (! sockets.isEmpty())
+        {
+            message.msg_control = control;
+            message.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)sockets.size());
+            cmsghdr* header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)sockets.size());
+            memcpy(CMSG_DATA(header), sockets.begin(), sizeof(int) * (size_t)sockets.size());
+        }
+
+        // the sockets go with the first byte, the rest may take more sends
+        ssize_t sent = sendmsg(handle, &message, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return false;
+        return sendAll(handle, (const char*)&state + sent, sizeof(state) - (size_t)sent);
+    }
+
+    static bool receiveState(int handle, State& state, Array<int>& sockets, int timeoutMs)
+    {
+        if (! waitUntilReadable(handle, timeoutMs))
+            return false;
+
+        iovec data { (void*)&state, sizeof(state) };
+        char control[CMSG_SPACE(sizeof(int) * maxSockets)];
+        msghdr message = {};
+        message.msg_iov = &data;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t received = recvmsg(handle, &message, MSG_CMSG_CLOEXEC);
+        if (received <= 0)
+            return false;
+
+        for (cmsghdr* header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header))
+        {
+            if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+                continue;
+            const int numSockets = (int)((header->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            for (int i = 0; i < numSockets; ++i)
+            {
+                int socket;
+                memcpy(&socket, CMSG_DATA(header) + i * sizeof(int), sizeof(int));
+                sockets.add(socket);
+            }
+        }
+
+        for (size_t done = (size_t)received; done < sizeof(state);)
+        {
+            ssize_t more = waitUntilReadable(handle, timeoutMs) ? recv(handle, (char*)&state + done, sizeof(state) - done, 0) : -1;
+            if (more <= 0)
+                return false;
+            done += (size_t)more;
+        }
+        return memcmp(state.magic, getMagic(), sizeof(state.magic)) == 0;
+    }
+
+    static bool sendAll(int handle, const char* data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t sent = ::send(handle, data, size, MSG_NOSIGNAL);
+            if (sent <= 0)
+                return false;
+            data += sent;
+            size -= (size_t)sent;
+        }
+        return true;
+    }
+
+    static bool sendByte(int handle, char byte)
+    {
+        return sendAll(handle, &byte, 1);
+    }
+
+    // -1 on timeout or a closed connection
+    static int receiveByte(int handle, int timeoutMs)
+    {
+        char byte = 0;
+        return waitUntilReadable(handle, timeoutMs) && recv(handle, &byte, 1, 0) == 1 ? byte : -1;
+    }
+
+    static bool waitUntilReadable(int handle, int timeoutMs)
+    {
+        pollfd ready { handle, POLLIN, 0 };
+        return poll(&ready, 1, timeoutMs) > 0;
+    }
+
+    void closeListener()
+    {
+        if (listenFd_ >= 0)
+            ::close(listenFd_);
+        listenFd_ = -1;
+    }
+
+    ExportCallback export_;
+    ReleaseCallback release_;
+    ResumeCallback resume_;
+    String path_;
+    int listenFd_ = -1;
+    Atomic<int> handedOver_ { 0 };
+};
@@ -0,0 +1,111 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "ThreadTuning.h"
+#include <functional>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+//==============================================================================
+// Stands in for the message thread as the consumer of the packet queue. The
+// JUCE message loop wakes through a socketpair and select()s on every wait,
+// with its locked message queue in between; this one thread polls a single
+// eventfd and calls back once per wakeup, however many wakes came since.
+// wake() is safe from any thread and doesn't allocate. The eventfd is there
+// from construction, so wakes from before start() or while the thread is
+// restarted wait in it instead of being lost.
+class HeadlessDispatcher : private Thread
+{
+public:
+    typedef std::function<void()> Callback;
+
+    HeadlessDispatcher(Callback callback)
+        : Thread("loop4r dispatch"),
+          callback_(callback),
+          wakeFd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    {
+    }
+
+    ~HeadlessDispatcher()
+    {
+        stop();
+        if (wakeFd_ >= 0)
+            ::close(wakeFd_);
+    }
+
+    bool start(const ThreadTuning& tuning)
+    {
+        if (wakeFd_ < 0)
+            return false;
+
+        tuning_ = tuning;
+        startThread();
+        return true;
+    }
+
+    // the wakes that come meanwhile are kept for the next start()
+    void stop()
+    {
+        signalThreadShouldExit();
+        wake();
+        stopThread(1000);
+    }
+
+    bool isRunning() const
+    {
+        return isThreadRunning();
+    }
+
+    void wake()
+    {
+        if (wakeFd_ < 0)
+            return;
+
+        const uint64 one = 1;
+        ssize_t wrote = ::write(wakeFd_, &one, sizeof(one));
+        ignoreUnused(wrote);
+    }
+
+private:
+    void run() override
+    {
+        if (! tuning_.applyToCurrentThread())
+            std::cerr << "Could not set SCHED_FIFO priority " << tuning_.realtimePriority << " for the OSC dispatch" << std::endl;
+
+        while (! threadShouldExit())
+        {
+            pollfd pfd = { wakeFd_, POLLIN, 0 };
+            if (poll(&pfd, 1, -1) <= 0 || threadShouldExit())
+                continue;
+
+            uint64 count;
+            ssize_t got = ::read(wakeFd_, &count, sizeof(count));
+            if (got == (ssize_t)sizeof(count))
+                callback_();
+        }
+    }
+
+    Callback callback_;
+    ThreadTuning tuning_;
+    const int wakeFd_;
+};
@@ -0,0 +1,137 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// Decides when to ping the looper and when to give up on it. Anything heard
+// from the looper counts as a sign of life, so it is only pinged after
+// pingInterval ms of silence and declared lost after timeout ms. The round
+// trip of each answered ping is tracked as a smoothed RTT (1/8 gain) and a
+// jitter estimate of the change between consecutive RTTs (1/16 gain), the
+// way RTP does.
+class HeartbeatMonitor
+{
+public:
+    enum Action
+    {
+        Nothing,
+        SendPing,
+        ConnectionLost
+    };
+
+    void setTiming(int pingIntervalMs, int timeoutMs)
+    {
+        pingIntervalMs_ = jmax(1, pingIntervalMs);
+        timeoutMs_ = jmax(pingIntervalMs_, timeoutMs);
+    }
+
+    // how often poll() needs calling to keep to the timing
+    int getPollIntervalMs() const
+    {
+        return jmax(10, jmin(pingIntervalMs_, timeoutMs_) / 4);
+    }
+
+    // on (re)connecting, which counts as having heard from the looper
+    void reset(double nowMs)
+    {
+        lastHeardMs_ = nowMs;
+        pingSentMs_ = 0.0;
+        heard_ = false;
+    }
+
+    void heard(double nowMs)
+    {
+        lastHeardMs_ = nowMs;
+        heard_ = true;
+    }
+
+    // heard from since the last reset, and not quiet for the timeout
+    bool isAlive(double nowMs) const
+    {
+        return heard_ && nowMs - lastHeardMs_ < timeoutMs_;
+    }
+
+    // the looper answering our ping
+    void replyReceived(double nowMs)
+    {
+        heard(nowMs);
+        if (pingSentMs_ <= 0.0)
+            return;
+
+        double rttMs = nowMs - pingSentMs_;
+        pingSentMs_ = 0.0;
+        if (replies_++ == 0)
+            smoothedRttMs_ = rttMs;
+        else
+            jitterMs_ += (std::abs(rttMs - rttMs_) - jitterMs_) / 16.0;
+        smoothedRttMs_ += (rttMs - smoothedRttMs_) / 8.0;
+        rttMs_ = rttMs;
+    }
+
+    Action poll(double nowMs)
+    {
+        double quietMs = nowMs - lastHeardMs_;
+        if (quietMs >= timeoutMs_)
+        {
+            ++timeouts_;
+            reset(nowMs);
+            return ConnectionLost;
+        }
+
+        // ping again if the last one went unanswered for an interval
+        if (quietMs >= pingIntervalMs_ && (pingSentMs_ <= 0.0 || nowMs - pingSentMs_ >= pingIntervalMs_))
+        {
+            pingSentMs_ = nowMs;
+            return SendPing;
+        }
+        return Nothing;
+    }
+
+    // when poll() next has something to do, if nothing is heard meanwhile
+    double getNextPollMs() const
+    {
+        double pingMs = lastHeardMs_ + pingIntervalMs_;
+        if (pingSentMs_ > 0.0)
+            pingMs = jmax(pingMs, pingSentMs_ + pingIntervalMs_);
+        return jmin(pingMs, lastHeardMs_ + timeoutMs_);
+    }
+
+    double getLastHeardMs() const       { return lastHeardMs_; }
+    double getRttMs() const             { return rttMs_; }
+    double getPingSentMs() const        { return pingSentMs_; }     // 0 unless a ping is unanswered
+    double getSmoothedRttMs() const     { return smoothedRttMs_; }
+    double getJitterMs() const          { return jitterMs_; }
+    int64 getReplies() const            { return replies_; }
+    int64 getTimeouts() const           { return timeouts_; }
+
+private:
+    int pingIntervalMs_ = 200;
+    int timeoutMs_ = 450;
+    double lastHeardMs_ = 0.0;
+    bool heard_ = false;
+    double pingSentMs_ = 0.0;
+
+    double rttMs_ = 0.0;
+    double smoothedRttMs_ = 0.0;
+    double jitterMs_ = 0.0;
+    int64 replies_ = 0;
+    int64 timeouts_ = 0;
+};
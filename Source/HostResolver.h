@@ -0,0 +1,234 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <sys/socket.h>
+#include <netdb.h>
+#include <functional>
+
+//==============================================================================
+// Looks up the looper's host name on a thread of its own, so connecting
+// never waits on DNS, which with a broken resolver can take seconds. A name
+// asked for the first time isn't known yet: lookup() returns false and the
+// thread resolves it, telling the callback once it has. After that the
+// cached addresses are returned straight away and refreshed every
+// refreshMs, the callback being told again if they changed; a failed
+// refresh keeps the last ones that worked. Numeric addresses are parsed
+// in place. Names ending in .local are resolved by mDNS through the
+// system's resolver (nss-mdns), like any other.
+class HostResolver : private Thread
+{
+public:
+    struct Address
+    {
+        sockaddr_storage address;
+        socklen_t length;
+        int family;
+    };
+
+    typedef std::function<void(const String& host)> ChangedCallback;
+
+    HostResolver()
+        : Thread("loop4r resolve")
+    {
+    }
+
+    ~HostResolver()
+    {
+        stop();
+    }
+
+    // only before the first lookup()
+    void setChangedCallback(ChangedCallback changed)
+    {
+        changed_ = changed;
+    }
+
+    void setRefreshMs(int refreshMs)
+    {
+        const ScopedLock sl(lock_);
+        refreshMs_ = jmax(1000, refreshMs);
+    }
+
+    void stop()
+    {
+        signalThreadShouldExit();
+        notify();
+        stopThread(2000);
+    }
+
+    // the addresses of host for a datagram socket to port, false while it
+    // hasn't been resolved yet or never could be
+    bool lookup(const String& host, int port, Array<Address>& addresses)
+    {
+        addresses.clearQuick();
+        if (resolve(host, port, AI_NUMERICHOST, addresses))
+            return true;
+
+        const ScopedLock sl(lock_);
+        for (auto* entry : entries_)
+        {
+            if (entry->host == host && entry->port == port)
+            {
+                addresses.addArray(entry->addresses);
+                return ! addresses.isEmpty();
+            }
+        }
+
+        auto* entry = entries_.add(new Entry());
+        entry->host = host;
+        entry->port = port;
+        ++lookups_;
+        if (! isThreadRunning())
+            startThread();
+        notify();
+        return false;
+    }
+
+    // asked for but not tried yet, so a failed connect says nothing yet
+    bool isResolving(const String& host) const
+    {
+        const ScopedLock sl(lock_);
+        for (auto* entry : entries_)
+            if (entry->host == host && entry->dueMs == 0.0)
+                return true;
+        return false;
+    }
+
+    int64 getLookups() const        { return lookups_.get(); }
+    int64 getFailures() const       { return failures_.get(); }
+    int64 getChanges() const        { return changes_.get(); }
+
+private:
+    struct Entry
+    {
+        String host;
+        int port = 0;
+        Array<Address> addresses;
+        double dueMs = 0.0;         // resolved again from then on
+    };
+
+    static bool resolve(const String& host, int port, int flags, Array<Address>& addresses)
+    {
+        addrinfo hints;
+        zerostruct(hints);
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+        hints.ai_flags = flags;
+
+        addrinfo* info = nullptr;
+        if (getaddrinfo(host.toRawUTF8(), String(port).toRawUTF8(), &hints, &info) != 0)
+            return false;
+
+        for (addrinfo* i = info; i != nullptr; i = i->ai_next)
+        {
+            Address address;
+            zerostruct(address);
+            memcpy(&address.address, i->ai_addr, jmin((size_t)i->ai_addrlen, sizeof(address.address)));
+            address.length = (socklen_t)jmin((size_t)i->ai_addrlen, sizeof(address.address));
+            address.family = i->ai_family;
+            addresses.add(address);
+        }
+        freeaddrinfo(info);
+        return ! addresses.isEmpty();
+    }
+
+    static bool isSame(const Array<Address>& a, const Array<Address>& b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (int i = 0; i < a.size(); ++i)
+            if (a.getReference(i).length != b.getReference(i).length
+                || memcmp(&a.getReference(i).address, &b.getReference(i).address, a.getReference(i).length) != 0)
+                return false;
+        return true;
+    }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            // one name at a time, resolved without the lock held
+            String host;
+            int port = 0;
+            double nextMs = std::numeric_limits<double>::max();
+            {
+                const double nowMs = Time::getMillisecondCounterHiRes();
+                const ScopedLock sl(lock_);
+                for (auto* entry : entries_)
+                {
+                    if (entry->dueMs <= nowMs && host.isEmpty())
+                    {
+                        host = entry->host;
+                        port = entry->port;
+                    }
+                    nextMs = jmin(nextMs, entry->dueMs);
+                }
+                if (host.isEmpty())
+                {
+                    const ScopedUnlock su(lock_);
+                    wait(nextMs == std::numeric_limits<double>::max() ? -1 : jmax(1, (int)(nextMs - nowMs)));
+                    continue;
+                }
+            }
+
+            Array<Address> addresses;
+            const bool resolved = resolve(host, port, 0, addresses);
+            bool changed = false;
+            {
+                const ScopedLock sl(lock_);
+                for (auto* entry : entries_)
+                {
+                    if (entry->host != host || entry->port != port)
+                        continue;
+
+                    // a name that doesn't resolve is tried again soon, the
+                    // addresses it had are kept meanwhile
+                    entry->dueMs = Time::getMillisecondCounterHiRes() + (resolved ? refreshMs_ : retryMs);
+                    if (resolved && ! isSame(entry->addresses, addresses))
+                    {
+                        entry->addresses.swapWith(addresses);
+                        changed = true;
+                    }
+                }
+            }
+
+            if (! resolved)
+                ++failures_;
+            if (changed)
+            {
+                ++changes_;
+                if (changed_ != nullptr)
+                    changed_(host);
+            }
+        }
+    }
+
+    static const int retryMs = 1000;
+
+    CriticalSection lock_;
+    OwnedArray<Entry> entries_;
+    ChangedCallback changed_;
+    int refreshMs_ = 30000;
+    Atomic<int64> lookups_ { 0 };
+    Atomic<int64> failures_ { 0 };
+    Atomic<int64> changes_ { 0 };
+};
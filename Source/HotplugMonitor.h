@@ -0,0 +1,132 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <functional>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+//==============================================================================
+// Listens to the kernel's uevents and calls back, on its own thread, when a
+// sound device such as a USB MIDI interface is plugged in. This needs no udev
+// library, but note the callback may come before udev has set the device
+// node's permissions, so opening it can take another try.
+class HotplugMonitor : private Thread
+{
+public:
+    typedef std::function<void(const String& deviceName)> Callback;
+
+    HotplugMonitor(Callback callback)
+        : Thread("loop4r hotplug"),
+          callback_(callback)
+    {
+    }
+
+    ~HotplugMonitor()
+    {
+        stop();
+    }
+
+    bool start()
+    {
+        stop();
+
+        int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+        if (fd < 0)
+            return false;
+
+        sockaddr_nl address = {};
+        address.nl_family = AF_NETLINK;
+        address.nl_groups = 1; // the kernel's own events
+        if (bind(fd, (sockaddr*)&address, sizeof(address)) < 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        fd_ = fd;
+        startThread();
+        return true;
+    }
+
+    void stop()
+    {
+        stopThread(1000);
+        if (fd_ >= 0)
+        {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    bool isRunning() const
+    {
+        return isThreadRunning();
+    }
+
+private:
+    void run() override
+    {
+        char buffer[4096];
+        while (! threadShouldExit())
+        {
+            pollfd pfd = { fd_, POLLIN, 0 };
+            if (poll(&pfd, 1, 500) <= 0)
+                continue;
+
+            ssize_t size = recv(fd_, buffer, sizeof(buffer) - 1, 0);
+            if (size <= 0)
+                continue;
+
+            buffer[size] = 0;
+            String deviceName = getAddedSoundDevice(buffer, (int)size);
+            if (deviceName.isNotEmpty())
+                callback_(deviceName);
+        }
+    }
+
+    // An event is "action@devpath" followed by KEY=value pairs, all zero
+    // terminated. Only rawmidi and sequencer devices being added are of
+    // interest, by their name under /dev.
+    static String getAddedSoundDevice(const char* event, int size)
+    {
+        String action, subsystem, deviceName;
+        for (int pos = 0; pos < size; pos += (int)strlen(event + pos) + 1)
+        {
+            String entry(CharPointer_UTF8(event + pos));
+            if (entry.startsWith("ACTION="))
+                action = entry.substring(7);
+            else if (entry.startsWith("SUBSYSTEM="))
+                subsystem = entry.substring(10);
+            else if (entry.startsWith("DEVNAME="))
+                deviceName = entry.substring(8);
+        }
+
+        if (action != "add" || subsystem != "sound"
+            || ! (deviceName.startsWith("snd/midi") || deviceName.startsWith("snd/seq")))
+            return {};
+        return deviceName;
+    }
+
+    Callback callback_;
+    int fd_ = -1;
+};
@@ -0,0 +1,244 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if ! defined(LOOP4R_NO_IO_URING) && defined(__has_include)
+ #if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+  #include <linux/io_uring.h>
+  #define LOOP4R_HAS_IO_URING 1
+ #endif
+#endif
+
+//==============================================================================
+// Just enough of io_uring for the event loop, on the raw system calls so
+// there is no liburing to link: polls and reads are queued, then one
+// enter() submits all of them and waits for the first completion. Queueing
+// is for one thread at a time, enter() and the completions for the thread
+// that owns the ring. Without the kernel headers, with LOOP4R_NO_IO_URING or
+// on a kernel that refuses, open() fails and the caller keeps to epoll.
+class IoUring
+{
+public:
+    struct Completion
+    {
+        uint64 userData;
+        int32 result;
+    };
+
+    ~IoUring()
+    {
+        close();
+    }
+
+    bool isOpen() const
+    {
+        return fd_ >= 0;
+    }
+
+   #ifdef LOOP4R_HAS_IO_URING
+    bool open(unsigned entries)
+    {
+        close();
+
+        io_uring_params params;
+        zerostruct(params);
+        int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0)
+            return false;
+
+        // older kernels map the two rings separately
+        size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMmap)
+            sqSize = cqSize = jmax(sqSize, cqSize);
+
+        fd_ = fd;
+        sqRingSize_ = sqSize;
+        cqRingSize_ = cqSize;
+        sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqRing_ = mapRing(fd, sqSize, IORING_OFF_SQ_RING);
+        cqRing_ = singleMmap ? sqRing_ : mapRing(fd, cqSize, IORING_OFF_CQ_RING);
+        void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        sqes_ = sqes == MAP_FAILED ? nullptr : (io_uring_sqe*)sqes;
+        if (sqRing_ == nullptr || cqRing_ == nullptr || sqes_ == nullptr)
+        {
+            close();
+            return false;
+        }
+
+        char* sq = (char*)sqRing_;
+        sqHead_ = (unsigned*)(sq + params.sq_off.head);
+        sqTail_ = (unsigned*)(sq + params.sq_off.tail);
+        sqMask_ = *(unsigned*)(sq + params.sq_off.ring_mask);
+        sqEntries_ = params.sq_entries;
+        sqArray_ = (unsigned*)(sq + params.sq_off.array);
+
+        char* cq = (char*)cqRing_;
+        cqHead_ = (unsigned*)(cq + params.cq_off.head);
+        cqTail_ = (unsigned*)(cq + params.cq_off.tail);
+        cqMask_ = *(unsigned*)(cq + params.cq_off.ring_mask);
+        cqes_ = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+        localTail_ = *sqTail_;
+        return true;
+    }
+
+    void close()
+    {
+        if (sqes_ != nullptr)
+            munmap(sqes_, sqesSize_);
+        if (cqRing_ != nullptr && cqRing_ != sqRing_)
+            munmap(cqRing_, cqRingSize_);
+        if (sqRing_ != nullptr)
+            munmap(sqRing_, sqRingSize_);
+        if (fd_ >= 0)
+            ::close(fd_);
+        sqes_ = nullptr;
+        sqRing_ = cqRing_ = nullptr;
+        fd_ = -1;
+    }
+
+    // a one shot poll for events (POLLIN, POLLOUT), completing with the
+    // events that are ready; false if the submission queue is full
+    bool queuePoll(int fd, uint32 events, uint64 userData)
+    {
+        io_uring_sqe* sqe = getSqe();
+        if (sqe == nullptr)
+            return false;
+
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = events;
+        sqe->user_data = userData;
+        return commitSqe();
+    }
+
+    // buffer has to stay put until the read completes
+    bool queueRead(int fd, void* buffer, unsigned size, uint64 userData)
+    {
+        io_uring_sqe* sqe = getSqe();
+        if (sqe == nullptr)
+            return false;
+
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = (uint64)(pointer_sized_uint)buffer;
+        sqe->len = size;
+        sqe->off = (uint64)-1;      // the file position, as read() would
+        sqe->user_data = userData;
+        return commitSqe();
+    }
+
+    // the request queued with userData completes with -ECANCELED, unless
+    // it completed already; the cancel itself completes with cancelData
+    bool queueCancel(uint64 userData, uint64 cancelData)
+    {
+        io_uring_sqe* sqe = getSqe();
+        if (sqe == nullptr)
+            return false;
+
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = userData;
+        sqe->user_data = cancelData;
+        return commitSqe();
+    }
+
+    // submits everything queued so far and waits for a completion; returns
+    // false on an error other than an interrupted wait
+    bool enter()
+    {
+        const unsigned toSubmit = __atomic_load_n(sqTail_, __ATOMIC_ACQUIRE) - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        int result = (int)syscall(__NR_io_uring_enter, fd_, toSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        return result >= 0 || errno == EINTR || errno == EBUSY;
+    }
+
+    // up to max completions, each taken off the ring
+    int takeCompletions(Completion* completions, int max)
+    {
+        unsigned head = *cqHead_;
+        const unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+        int count = 0;
+        for (; head != tail && count < max; ++head, ++count)
+        {
+            const io_uring_cqe& cqe = cqes_[head & cqMask_];
+            completions[count] = { (uint64)cqe.user_data, (int32)cqe.res };
+        }
+        __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+private:
+    static void* mapRing(int fd, size_t size, off_t offset)
+    {
+        void* ring = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return ring == MAP_FAILED ? nullptr : ring;
+    }
+
+    io_uring_sqe* getSqe()
+    {
+        if (fd_ < 0 || localTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_)
+            return nullptr;
+
+        io_uring_sqe* sqe = sqes_ + (localTail_ & sqMask_);
+        zerostruct(*sqe);
+        return sqe;
+    }
+
+    bool commitSqe()
+    {
+        const unsigned index = localTail_ & sqMask_;
+        sqArray_[index] = index;
+        ++localTail_;
+        __atomic_store_n(sqTail_, localTail_, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    void* sqRing_ = nullptr;
+    void* cqRing_ = nullptr;
+    size_t sqRingSize_ = 0, cqRingSize_ = 0, sqesSize_ = 0;
+    unsigned* sqHead_ = nullptr;
+    unsigned* sqTail_ = nullptr;
+    unsigned* sqArray_ = nullptr;
+    unsigned sqMask_ = 0, sqEntries_ = 0, localTail_ = 0;
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+   #else
+    bool open(unsigned)                                 { return false; }
+    void close()                                        {}
+    bool queuePoll(int, uint32, uint64)                 { return false; }
+    bool queueRead(int, void*, unsigned, uint64)        { return false; }
+    bool queueCancel(uint64, uint64)                    { return false; }
+    bool enter()                                        { return false; }
+    int takeCompletions(Completion*, int)               { return 0; }
+   #endif
+
+private:
+    int fd_ = -1;
+};
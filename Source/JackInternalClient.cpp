@@ -0,0 +1,140 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "LedCore.h"
+#include "LedStateExport.h"
+
+#ifdef LOOP4R_HAS_JACK
+
+//==============================================================================
+// The bridge's MIDI end as a JACK internal client, loaded into jackd with
+//
+//     jack_load loop4r_leds loop4r_leds_jack "/loop4r_leds a2j:FCB1010..."
+//
+// A helper thread, not the RT one, follows the LED state in the shared
+// memory segment named first, in the layout of shm, sleeping until the
+// bridge writes it, and writes what changed through a JACK MIDI port on
+// jackd's own client, connected to the port named second if there is one.
+// The process callback only copies the queued events into the period, so
+// nothing crosses a process boundary or waits for another process to be
+// scheduled between the state and the pedalboard.
+class JackInternalClient : private Thread
+{
+public:
+    JackInternalClient(jack_client_t* client, const String& segment, const String& destination)
+        : Thread("loop4r jack"),
+          segment_(segment)
+    {
+        core_.addBoard("jack:" + destination, new JackMidiSink(client, destination));
+    }
+
+    ~JackInternalClient()
+    {
+        stopThread(1000);
+        core_.close();
+    }
+
+    bool start()
+    {
+        if (! core_.open())
+            return false;
+
+        startThread();
+        return true;
+    }
+
+private:
+    void run() override
+    {
+        LedStateSegment::Data data;
+        uint32 seen = 0;
+        int idle = 0;
+        while (! threadShouldExit())
+        {
+            if (! state_.isOpen() && ! state_.open(segment_))
+            {
+                wait(100);
+                continue;
+            }
+
+            const uint32 sequence = state_.getSequence();
+            if (sequence != seen && state_.read(data))
+            {
+                seen = sequence;
+                idle = 0;
+                apply(data);
+                core_.flush();
+            }
+            else if (++idle >= reopenAfterIdle)
+            {
+                // a writer that restarted made a new segment, this one is
+                // no longer written
+                state_.close();
+                idle = 0;
+            }
+            else
+            {
+                // woken by the bridge's next write, stopping waits for the
+                // timeout at worst
+                state_.waitForChange(sequence, idleWaitMs);
+            }
+        }
+    }
+
+    void apply(const LedStateSegment::Data& data)
+    {
+        for (int i = 0; i < jmin(data.numLeds, (int)LedStateSegment::maxLeds); ++i)
+            core_.setLed(i, data.leds[i].on != 0);
+        core_.setDisplay(data.selectedLoop);
+    }
+
+    static const int idleWaitMs = 100;
+    static const int reopenAfterIdle = 10;     // waits without a write, about a second
+
+    String segment_;
+    LedStateImport state_;
+    LedCore core_;
+};
+
+static JackInternalClient* internalClient = nullptr;
+
+// jackd's entry points for an internal client; loadInit is the segment and
+// the destination port, separated by white space
+extern "C" int jack_initialize(jack_client_t* client, const char* loadInit)
+{
+    StringArray args;
+    args.addTokens(loadInit != nullptr ? loadInit : "", " \t", "\"");
+    args.removeEmptyStrings();
+
+    std::unique_ptr<JackInternalClient> bridge(new JackInternalClient(client, args.size() > 0 ? args[0] : "/loop4r_leds",
+                                                                      args[1].unquoted()));
+    if (! bridge->start())
+        return 1;
+
+    internalClient = bridge.release();
+    return 0;
+}
+
+extern "C" void jack_finish(void*)
+{
+    delete internalClient;
+    internalClient = nullptr;
+}
+
+#endif
@@ -0,0 +1,367 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "MidiSink.h"
+
+#if JUCE_JACK && defined(__has_include)
+ #if __has_include(<jack/midiport.h>)
+  #include <jack/jack.h>
+  #include <jack/midiport.h>
+  #define LOOP4R_HAS_JACK 1
+ #endif
+#endif
+
+#ifdef LOOP4R_HAS_JACK
+
+//==============================================================================
+// Sends the LEDs through a JACK MIDI port, from the process callback, so
+// they are on the audio clock SooperLooper runs on: every event carries the
+// frame it is due at and is written at its offset into the period that
+// frame falls in. Bytes written now go out at the start of the next period,
+// scheduled ones at the frame delayMs from now. libjack is loaded at run
+// time like juce loads it for audio, so the bridge still starts without it.
+// The queue is kept sorted by frame under a spin lock that the process
+// callback only tries to take; when it can't, the events wait a period.
+class JackMidiSink : public MidiSink
+{
+public:
+    // the port to connect to, e.g. "a2j:FCB1010 [24] (playback): FCB1010",
+    // or empty to be connected from outside
+    JackMidiSink(const String& destination)
+        : destination_(destination)
+    {
+    }
+
+    // on a client jackd made for us as an internal client, which is jackd's
+    // to close; libjack's functions are then the server's own
+    JackMidiSink(jack_client_t* internalClient, const String& destination)
+        : destination_(destination),
+          internalClient_(internalClient)
+    {
+    }
+
+    ~JackMidiSink()
+    {
+        close();
+    }
+
+    bool open() override
+    {
+        close();
+        if (! loadJack())
+            return false;
+
+        jack_status_t status;
+        jack_client_t* client = internalClient_ != nullptr ? internalClient_
+                                                           : api_.clientOpen("loop4r_leds", JackNoStartServer, &status);
+        if (client == nullptr)
+            return false;
+
+        if (port_ == nullptr || internalClient_ == nullptr)
+            port_ = api_.portRegister(client, "leds", JACK_DEFAULT_MIDI_TYPE, JackPortIsOutput, 0);
+
+        // the callbacks can only be set on an inactive client, and jackd
+        // keeps an internal one active until it unloads it, so that one is
+        // only set up and activated once
+        if (port_ == nullptr || (! activated_ && ! activate(client)))
+        {
+            if (internalClient_ == nullptr)
+                api_.clientClose(client);
+            return false;
+        }
+        activated_ = internalClient_ != nullptr;
+
+        if (destination_.isNotEmpty())
+            api_.connect(client, api_.portName(port_), destination_.toRawUTF8());
+
+        sampleRate_ = (double)api_.getSampleRate(client);
+        status_ = 0;
+        numEvents_ = 0;
+        client_ = client;
+        connected_ = 1;
+        return true;
+    }
+
+    void close() override
+    {
+        jack_client_t* client = client_.exchange(nullptr);
+        connected_ = 0;
+        if (client != nullptr && internalClient_ == nullptr)
+            api_.clientClose(client);
+    }
+
+    // false once the server went away, until reopened
+    bool isOpen() const override
+    {
+        return connected_.get() != 0;
+    }
+
+    bool write(const uint8* data, int size) override
+    {
+        return queue(data, size, true, 0, 0);
+    }
+
+    bool canSchedule() const override
+    {
+        return isOpen();
+    }
+
+    bool writeScheduled(const uint8* data, int size, double delayMs, int tag) override
+    {
+        jack_client_t* client = client_.get();
+        if (client == nullptr)
+        {
+            bytesDropped_ += size;
+            return false;
+        }
+
+        return queue(data, size, false, api_.frameTime(client) + (jack_nframes_t)(jmax(0.0, delayMs) * sampleRate_ / 1000.0), tag);
+    }
+
+    void cancelScheduled(int tag) override
+    {
+        const SpinLock::ScopedLockType sl(queueLock_);
+        int kept = 0;
+        for (int i = 0; i < numEvents_; ++i)
+            if (events_[i].immediate || (tag >= 0 && events_[i].tag != tag))
+                events_[kept++] = events_[i];
+        numEvents_ = kept;
+    }
+
+private:
+    static const int capacity = 512;
+    static const int maxEventSize = 60;
+
+    struct Event
+    {
+        bool immediate;     // as soon as possible, whatever the frame
+        jack_nframes_t frame;
+        int tag;
+        int size;
+        uint8 data[maxEventSize];
+    };
+
+    // JACK wants whole messages, so the byte stream is split up again with
+    // running status filled back in
+    bool queue(const uint8* data, int size, bool immediate, jack_nframes_t frame, int tag)
+    {
+        const SpinLock::ScopedLockType sl(queueLock_);
+        bool ok = true;
+        for (int i = 0; i < size; ++i)
+        {
+            const uint8 byte = data[i];
+            if (byte >= 0x80 && byte != 0xf7)
+            {
+                status_ = byte;
+                pending_.size = 0;
+                pending_.data[pending_.size++] = byte;
+            }
+            else if (status_ == 0)
+            {
+                continue;
+            }
+            else
+            {
+                // running status starts the next message with the last one's
+                if (pending_.size == 0)
+                    pending_.data[pending_.size++] = status_;
+                if (pending_.size < maxEventSize)
+                    pending_.data[pending_.size++] = byte;
+            }
+
+            if (isComplete(pending_))
+            {
+                ok = insert(pending_, immediate, frame, tag) && ok;
+                pending_.size = 0;
+                if (status_ >= 0xf0)
+                    status_ = 0;
+            }
+        }
+
+        if (ok)
+            bytesWritten_ += size;
+        return ok;
+    }
+
+    static bool isComplete(const Event& event)
+    {
+        if (event.size == 0)
+            return false;
+
+        const uint8 status = event.data[0];
+        if (status == 0xf0)
+            return event.data[event.size - 1] == 0xf7 || event.size == maxEventSize;
+
+        const uint8 type = status & 0xf0;
+        return event.size == (type == 0xc0 || type == 0xd0 ? 2 : 3);
+    }
+
+    // JACK's frame time is 32 bits and wraps every day or so at 48 kHz, so
+    // frames are only compared by their difference
+    static bool isBefore(jack_nframes_t frame, jack_nframes_t other)
+    {
+        return (int32)(frame - other) < 0;
+    }
+
+    // in frame order, after those due at the same frame, the immediate ones
+    // first
+    bool insert(const Event& message, bool immediate, jack_nframes_t frame, int tag)
+    {
+        if (numEvents_ == capacity || message.size == maxEventSize)
+        {
+            bytesDropped_ += message.size;
+            return false;
+        }
+
+        int at = numEvents_;
+        while (at > 0 && ! events_[at - 1].immediate && (immediate || isBefore(frame, events_[at - 1].frame)))
+        {
+            events_[at] = events_[at - 1];
+            --at;
+        }
+
+        events_[at] = message;
+        events_[at].immediate = immediate;
+        events_[at].frame = frame;
+        events_[at].tag = tag;
+        ++numEvents_;
+        return true;
+    }
+
+    // JACK only takes the callbacks before the client is activated
+    bool activate(jack_client_t* client)
+    {
+        if (api_.setProcessCallback(client, processCallback, this) != 0)
+            return false;
+
+        api_.onShutdown(client, shutdownCallback, this);
+        return api_.activate(client) == 0;
+    }
+
+    static int processCallback(jack_nframes_t numFrames, void* arg)
+    {
+        static_cast<JackMidiSink*>(arg)->process(numFrames);
+        return 0;
+    }
+
+    static void shutdownCallback(void* arg)
+    {
+        static_cast<JackMidiSink*>(arg)->connected_ = 0;
+    }
+
+    void process(jack_nframes_t numFrames)
+    {
+        jack_client_t* client = client_.get();
+        void* buffer = api_.portGetBuffer(port_, numFrames);
+        if (client == nullptr || buffer == nullptr)
+            return;
+
+        api_.midiClearBuffer(buffer);
+        const GenericScopedTryLock<SpinLock> sl(queueLock_);
+        if (! sl.isLocked())
+            return;
+
+        const jack_nframes_t periodStart = api_.lastFrameTime(client);
+        const jack_nframes_t periodEnd = periodStart + numFrames;
+        int written = 0;
+        while (written < numEvents_ && (events_[written].immediate || isBefore(events_[written].frame, periodEnd)))
+        {
+            const Event& event = events_[written];
+            const jack_nframes_t offset = event.immediate ? 0
+                                        : (jack_nframes_t)jlimit(0, (int)numFrames - 1, (int)(int32)(event.frame - periodStart));
+            if (api_.midiEventWrite(buffer, offset, event.data, (size_t)event.size) != 0)
+                break;      // the port buffer is full, the rest waits a period
+            ++written;
+        }
+
+        numEvents_ -= written;
+        for (int i = 0; i < numEvents_; ++i)
+            events_[i] = events_[i + written];
+    }
+
+    // the parts of libjack we need, resolved once
+    struct Api
+    {
+        jack_client_t* (*clientOpen)(const char*, jack_options_t, jack_status_t*, ...) = nullptr;
+        int (*clientClose)(jack_client_t*) = nullptr;
+        int (*activate)(jack_client_t*) = nullptr;
+        jack_port_t* (*portRegister)(jack_client_t*, const char*, const char*, unsigned long, unsigned long) = nullptr;
+        const char* (*portName)(const jack_port_t*) = nullptr;
+        int (*connect)(jack_client_t*, const char*, const char*) = nullptr;
+        int (*setProcessCallback)(jack_client_t*, JackProcessCallback, void*) = nullptr;
+        void (*onShutdown)(jack_client_t*, JackShutdownCallback, void*) = nullptr;
+        jack_nframes_t (*getSampleRate)(jack_client_t*) = nullptr;
+        jack_nframes_t (*frameTime)(const jack_client_t*) = nullptr;
+        jack_nframes_t (*lastFrameTime)(const jack_client_t*) = nullptr;
+        void* (*portGetBuffer)(jack_port_t*, jack_nframes_t) = nullptr;
+        void (*midiClearBuffer)(void*) = nullptr;
+        int (*midiEventWrite)(void*, jack_nframes_t, const jack_midi_data_t*, size_t) = nullptr;
+    };
+
+    bool loadJack()
+    {
+        if (api_.midiEventWrite != nullptr)
+            return true;
+
+        // inside jackd the client API comes from the server library
+        if (! (internalClient_ != nullptr && library_.open("libjackserver.so.0"))
+            && ! library_.open("libjack.so.0") && ! library_.open("libjack.so"))
+            return false;
+
+        auto load = [this] (auto& function, const char* name)
+        {
+            function = reinterpret_cast<typename std::remove_reference<decltype(function)>::type>(library_.getFunction(name));
+            return function != nullptr;
+        };
+
+        return load(api_.clientOpen, "jack_client_open")
+            && load(api_.clientClose, "jack_client_close")
+            && load(api_.activate, "jack_activate")
+            && load(api_.portRegister, "jack_port_register")
+            && load(api_.portName, "jack_port_name")
+            && load(api_.connect, "jack_connect")
+            && load(api_.setProcessCallback, "jack_set_process_callback")
+            && load(api_.onShutdown, "jack_on_shutdown")
+            && load(api_.getSampleRate, "jack_get_sample_rate")
+            && load(api_.frameTime, "jack_frame_time")
+            && load(api_.lastFrameTime, "jack_last_frame_time")
+            && load(api_.portGetBuffer, "jack_port_get_buffer")
+            && load(api_.midiClearBuffer, "jack_midi_clear_buffer")
+            && load(api_.midiEventWrite, "jack_midi_event_write");
+    }
+
+    String destination_;
+    DynamicLibrary library_;
+    Api api_;
+    jack_client_t* internalClient_ = nullptr;
+    bool activated_ = false;            // the internal client, for good
+    Atomic<jack_client_t*> client_ { nullptr };
+    Atomic<int> connected_ { 0 };
+    jack_port_t* port_ = nullptr;
+    double sampleRate_ = 48000.0;
+
+    SpinLock queueLock_;
+    Event events_[capacity];
+    int numEvents_ = 0;
+    Event pending_;
+    uint8 status_ = 0;
+};
+
+#endif
@@ -0,0 +1,156 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// Counts latencies in microseconds into log-linear buckets, 16 per power of
+// two, so any percentile is off by at most 1/16 whatever the magnitude.
+// Recording is a couple of atomic increments and safe from any thread.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram(const String& name)
+        : name_(name)
+    {
+    }
+
+    void record(double ms)
+    {
+        int64 us = jlimit((int64)0, maxValue, (int64)(ms * 1000.0));
+        ++counts_[bucketFor(us)];
+        ++count_;
+
+        int64 max = max_.get();
+        while (us > max && ! max_.compareAndSetBool(us, max))
+            max = max_.get();
+    }
+
+    const String& getName() const
+    {
+        return name_;
+    }
+
+    int64 getCount() const
+    {
+        return count_.get();
+    }
+
+    // the latency in us that this fraction (0..1) of the samples stayed under
+    int64 getPercentile(double fraction) const
+    {
+        return getPercentileSince(nullptr, fraction);
+    }
+
+    // the counts at one point, to take percentiles of only what came after
+    struct Snapshot
+    {
+        int counts[32 + 22 * 16] = {};
+        int64 count = 0;
+    };
+
+    void takeSnapshot(Snapshot& snapshot) const
+    {
+        for (int i = 0; i < numBuckets; ++i)
+            snapshot.counts[i] = counts_[i].get();
+        snapshot.count = count_.get();
+    }
+
+    // as getPercentile() for the samples recorded since the snapshot, or
+    // all of them without one
+    int64 getPercentileSince(const Snapshot* since, double fraction) const
+    {
+        int64 total = count_.get() - (since != nullptr ? since->count : 0);
+        if (total <= 0)
+            return 0;
+
+        int64 wanted = jmax((int64)1, (int64)std::ceil(fraction * (double)total));
+        int64 seen = 0;
+        for (int i = 0; i < numBuckets; ++i)
+        {
+            seen += counts_[i].get() - (since != nullptr ? since->counts[i] : 0);
+            if (seen >= wanted)
+                return jmin(valueOf(i), max_.get());
+        }
+        return max_.get();
+    }
+
+    int64 getMax() const
+    {
+        return max_.get();
+    }
+
+    String getReport() const
+    {
+        return name_.paddedRight(' ', 10)
+            + " p50 " + String(getPercentile(0.5)) + " us"
+            + ", p99 " + String(getPercentile(0.99)) + " us"
+            + ", max " + String(getMax()) + " us"
+            + " (" + String(getCount()) + ")";
+    }
+
+    // not atomic as a whole, samples recorded meanwhile may be kept or lost
+    void reset()
+    {
+        for (auto& count : counts_)
+            count = 0;
+        count_ = 0;
+        max_ = 0;
+    }
+
+private:
+    // values below 32 us get a bucket each, after that 16 per octave up to
+    // about a minute
+    static const int subBuckets = 16;
+    static const int numBuckets = 32 + 22 * subBuckets;
+    static_assert(sizeof(Snapshot::counts) == numBuckets * sizeof(int), "the snapshot needs a count per bucket");
+    static const int64 maxValue = ((int64)1 << 27) - 1;
+
+    static int bucketFor(int64 us)
+    {
+        if (us < 32)
+            return (int)us;
+
+        int msb = 63 - countLeadingZeros((uint64)us);
+        int shift = msb - 4;
+        return 32 + (msb - 5) * subBuckets + (int)((us >> shift) - subBuckets);
+    }
+
+    // the largest value that falls into a bucket
+    static int64 valueOf(int bucket)
+    {
+        if (bucket < 32)
+            return bucket;
+
+        int msb = 5 + (bucket - 32) / subBuckets;
+        int64 sub = subBuckets + (bucket - 32) % subBuckets;
+        return ((sub + 1) << (msb - 4)) - 1;
+    }
+
+    static int countLeadingZeros(uint64 value)
+    {
+        return __builtin_clzll(value);
+    }
+
+    String name_;
+    Atomic<int> counts_[numBuckets];
+    Atomic<int64> count_ { 0 };
+    Atomic<int64> max_ { 0 };
+};
@@ -0,0 +1,210 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "LedState.h"
+
+//==============================================================================
+// A chase or count-in for the pedals, compiled once when it is defined. The
+// frames are strings with a character per pedal from the first: '1' lit, '0'
+// dark and '-' showing the pedal's live state. Each step keeps only what it
+// changes from the one before, so playing it is a couple of bitset
+// operations per step however many pedals it covers.
+class LedAnimation
+{
+public:
+    struct Step
+    {
+        LedBits owned;      // the LEDs the animation shows instead of their state
+        LedBits changed;    // those of them this step writes
+        LedBits on;         // the frame, for all of owned
+        LedBits released;   // the LEDs given back to their state
+    };
+
+    // frames separated by ',', stepMs apart, played loops times or until
+    // stopped for 0; false if there is no frame
+    bool compile(const String& frames, int stepMs, int loops)
+    {
+        steps_.clearQuick();
+        stepMs_ = jmax(1, stepMs);
+        loops_ = jmax(0, loops);
+
+        StringArray tokens;
+        tokens.addTokens(frames, ",", "");
+        tokens.removeEmptyStrings();
+        if (tokens.isEmpty())
+            return false;
+
+        Array<Step> frameBits;
+        for (auto& token : tokens)
+        {
+            Step frame;
+            for (int pedal = 0; pedal < jmin(token.length(), 128); ++pedal)
+            {
+                if (token[pedal] != '0' && token[pedal] != '1')
+                    continue;
+                frame.owned.set(PedalMap::ledNumber(pedal));
+                frame.on.set(PedalMap::ledNumber(pedal), token[pedal] == '1');
+            }
+            frameBits.add(frame);
+        }
+
+        // the first step starts from the live state, each next from the
+        // frame before and the one ending a loop back to the first frame
+        const int numFrames = frameBits.size();
+        steps_.add(deltaBetween(Step(), frameBits.getReference(0)));
+        for (int i = 1; i < numFrames; ++i)
+            steps_.add(deltaBetween(frameBits.getReference(i - 1), frameBits.getReference(i)));
+        steps_.add(deltaBetween(frameBits.getReference(numFrames - 1), frameBits.getReference(0)));
+        steps_.add(deltaBetween(frameBits.getReference(numFrames - 1), Step()));
+        return true;
+    }
+
+    bool isEmpty() const        { return steps_.isEmpty(); }
+    int getNumFrames() const    { return jmax(0, steps_.size() - 2); }
+    int getStepMs() const       { return stepMs_; }
+    int getLoops() const        { return loops_; }
+
+    // step n of the whole run, counting from 0 over every loop
+    const Step& getStep(int64 n) const
+    {
+        const int numFrames = getNumFrames();
+        if (n == 0)
+            return steps_.getReference(0);
+        return steps_.getReference(n % numFrames == 0 ? numFrames : (int)(n % numFrames));
+    }
+
+    // gives every LED back once the last loop is done
+    const Step& getEnd() const
+    {
+        return steps_.getReference(steps_.size() - 1);
+    }
+
+    // the steps in a run, 0 for one until stopped
+    int64 getNumSteps() const
+    {
+        return (int64)loops_ * getNumFrames();
+    }
+
+private:
+    static Step deltaBetween(const Step& from, const Step& to)
+    {
+        Step step;
+        step.owned = to.owned;
+        step.on = to.on;
+        step.changed = to.owned & ~(from.owned & ~(from.on ^ to.on));
+        step.released = from.owned & ~to.owned;
+        return step;
+    }
+
+    Array<Step> steps_;
+    int stepMs_ = 100;
+    int loops_ = 1;
+};
+
+//==============================================================================
+// Plays an animation against a clock in ms. Whoever drives it calls
+// advance() when the next step is due, or later; a late call applies the
+// steps missed in one go, skipping whole loops, so the LEDs end up as the
+// animation has them at that time. Used under the application's stateLock_.
+class LedAnimationPlayer
+{
+public:
+    void start(const LedAnimation& animation, double nowMs)
+    {
+        animation_ = &animation;
+        startMs_ = nowMs;
+        played_ = 0;
+    }
+
+    bool isPlaying() const
+    {
+        return animation_ != nullptr;
+    }
+
+    bool isPlaying(const LedAnimation& animation) const
+    {
+        return animation_ == &animation;
+    }
+
+    // the LEDs the animation shows now, and as what
+    const LedBits& getOwned() const     { return current_.owned; }
+    const LedBits& getOn() const        { return current_.on; }
+
+    // gives the LEDs shown back to their state through apply(step)
+    template <typename Apply>
+    void stop(Apply apply)
+    {
+        if (animation_ == nullptr)
+            return;
+
+        LedAnimation::Step end;
+        end.released = current_.owned;
+        current_ = {};
+        animation_ = nullptr;
+        apply(end);
+    }
+
+    // applies the steps due at nowMs through apply(step), returns when the
+    // next one is, or 0 once the animation has ended
+    template <typename Apply>
+    double advance(double nowMs, Apply apply)
+    {
+        if (animation_ == nullptr)
+            return 0.0;
+
+        const int64 numFrames = animation_->getNumFrames();
+        const int64 numSteps = animation_->getNumSteps();
+        const double stepMs = animation_->getStepMs();
+
+        // half a ms of slack for the timer waking up early
+        int64 due = (int64)std::floor((nowMs + 0.5 - startMs_) / stepMs);
+        if (numSteps > 0)
+            due = jmin(due, numSteps);
+
+        // a loop's deltas add up to nothing, so only the last one missed
+        // has to be played
+        if (played_ > 0 && due - played_ > numFrames)
+            played_ += (due - played_) / numFrames * numFrames - numFrames;
+
+        for (; played_ <= due; ++played_)
+        {
+            if (numSteps > 0 && played_ == numSteps)
+            {
+                current_ = animation_->getEnd();
+                animation_ = nullptr;
+                apply(current_);
+                current_ = {};
+                return 0.0;
+            }
+
+            current_ = animation_->getStep(played_);
+            apply(current_);
+        }
+
+        return startMs_ + (double)played_ * stepMs;
+    }
+
+private:
+    const LedAnimation* animation_ = nullptr;
+    LedAnimation::Step current_;
+    double startMs_ = 0.0;
+    int64 played_ = 0;
+};
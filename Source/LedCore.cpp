@@ -0,0 +1,114 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "LedCore.h"
+
+BoardOutput* LedCore::addBoard(const String& name, int firstLed, int channel, RawMidiResolver* resolver)
+{
+    auto* board = boards_.add(new BoardOutput(name, firstLed, resolver));
+    board->getBatch().setChannel(channel);
+    return board;
+}
+
+BoardOutput* LedCore::addBoard(const String& name, MidiSink* sink, int firstLed, int channel)
+{
+    auto* board = boards_.add(new BoardOutput(name, firstLed, sink));
+    board->getBatch().setChannel(channel);
+    return board;
+}
+
+bool LedCore::open()
+{
+    bool opened = true;
+    for (auto* board : boards_)
+    {
+        if (board->getSink().isOpen())
+            continue;
+
+        if (board->getSink().open())
+        {
+            board->getBatch().resetRunningStatus();
+            board->getShadow().invalidate();
+        }
+        else
+        {
+            opened = false;
+        }
+    }
+    return opened;
+}
+
+void LedCore::close()
+{
+    for (auto* board : boards_)
+        board->getSink().close();
+}
+
+void LedCore::setLed(int pedalIdx, bool on, LedShadow::Lane lane)
+{
+    for (auto* board : boards_)
+    {
+        int number = board->ledNumberFor(pedalIdx);
+        if (number >= 0)
+            board->getShadow().setLed((uint8)number, on, lane);
+    }
+}
+
+void LedCore::setLeds(const LedBits& mask, const LedBits& on, LedShadow::Lane lane)
+{
+    for (auto* board : boards_)
+    {
+        // a board showing the LEDs from the first takes the mask as it is
+        if (board->getFirstLed() == 0)
+        {
+            board->getShadow().setLeds(mask, on, lane);
+            continue;
+        }
+
+        mask.forEach([board, &on, lane] (int number)
+        {
+            int boardNumber = board->ledNumberFor(PedalMap::pedalIndex(number));
+            if (boardNumber >= 0)
+                board->getShadow().setLed((uint8)boardNumber, on.test(number), lane);
+        });
+    }
+}
+
+void LedCore::setDisplay(int value)
+{
+    for (auto* board : boards_)
+        board->getShadow().setNumber(value);
+}
+
+bool LedCore::flush()
+{
+    bool written = false;
+    for (auto* board : boards_)
+        written = board->flush() || written;
+    return written;
+}
+
+void LedCore::invalidate()
+{
+    for (auto* board : boards_)
+    {
+        board->getBatch().resetRunningStatus();
+        board->getShadow().invalidate();
+    }
+}
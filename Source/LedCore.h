@@ -0,0 +1,70 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "BoardOutput.h"
+
+//==============================================================================
+// The LED state, encoding and output part of the bridge without the OSC, to
+// be embedded where the looper runs, in its host or a JACK client, instead
+// of talking to it over loopback. The host sets the looper LEDs and the
+// display and calls flush() when it is done with a set of changes; only
+// what differs from what the boards show is written. Blinking, animations
+// and everything timed stay with the caller. Not thread safe, one thread
+// at a time, as in the bridge with its stateLock_.
+//
+// Built on its own as a static library by Core/loop4r_leds_core.jucer, and
+// shared by the bridge for its boards.
+class LedCore
+{
+public:
+    // a board showing the looper LEDs from firstLed on, on channel (1-16);
+    // it still has to be opened
+    BoardOutput* addBoard(const String& name, int firstLed = 0, int channel = 1, RawMidiResolver* resolver = nullptr);
+
+    // the same on a sink of the caller's, e.g. a JackMidiSink on the
+    // client jackd loaded us as
+    BoardOutput* addBoard(const String& name, MidiSink* sink, int firstLed = 0, int channel = 1);
+
+    // the bridge sets its boards up itself and keeps them here
+    OwnedArray<BoardOutput>& getBoards()        { return boards_; }
+
+    // true once every board's port is open, what they show is unknown
+    bool open();
+    void close();
+
+    // a looper LED by its pedal index, on every board showing it
+    void setLed(int pedalIdx, bool on, LedShadow::Lane lane = LedShadow::StateLane);
+
+    // the LEDs in mask by LED number, as LedState has them
+    void setLeds(const LedBits& mask, const LedBits& on, LedShadow::Lane lane = LedShadow::StateLane);
+
+    // on the display of every board
+    void setDisplay(int value);
+
+    // writes what changed since the last flush, true if anything was
+    bool flush();
+
+    // forgets what the boards show, so the next flush writes all of it
+    void invalidate();
+
+private:
+    OwnedArray<BoardOutput> boards_;
+};
@@ -0,0 +1,138 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "OscOutput.h"
+#include "PackedDiff.h"
+
+//==============================================================================
+// Publishes what the pedalboard shows to a multicast group, so stage
+// displays, other boards and loggers can follow along without each asking
+// the looper. Every publish sends
+//
+//     /loop4r_leds/delta i:sequence i:display b:changes
+//
+// where changes holds two bytes per LED that changed since the last
+// publish: its index and its state (0-3) with bit 2 set when it is lit.
+// Blinking LEDs are only sent when their state changes, subscribers blink
+// them themselves. A full publish, sent periodically for late joiners,
+// lists every LED. The sequence goes up by one per packet so a subscriber
+// can tell when it missed one and wait for the next full publish.
+class LedMulticast
+{
+public:
+    static const int maxLeds = 128;
+
+    bool open(const String& group, int port, int ttl)
+    {
+        if (! output_.connect(group, port))
+            return false;
+
+        output_.setMulticastTtl(ttl);
+        for (auto& code : published_)
+            code = -1;
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return output_.isConnected();
+    }
+
+    void setLed(int index, int state, bool on)
+    {
+        if (! isPositiveAndBelow(index, maxLeds))
+            return;
+
+        const bool blinking = state >= 2;
+        current_[index] = (int8)((state & 3) | (on && ! blinking ? 4 : 0));
+        numLeds_ = jmax(numLeds_, index + 1);
+    }
+
+    // back to none, e.g. when the looper has fewer LEDs now
+    void setNumLeds(int numLeds)
+    {
+        numLeds_ = jlimit(0, maxLeds, numLeds);
+    }
+
+    void setDisplay(int value)
+    {
+        display_ = value;
+    }
+
+    // sends what changed, or everything if full; nothing if nothing changed
+    bool publish(bool full)
+    {
+        uint8 indices[maxLeds];
+        int numChanged = numLeds_;
+        if (full)
+            for (int i = 0; i < numLeds_; ++i)
+                indices[i] = (uint8)i;
+        else
+            numChanged = PackedDiff::changedBytes((const uint8*)current_, (const uint8*)published_, numLeds_, indices);
+
+        int size = 0;
+        for (int i = 0; i < numChanged; ++i)
+        {
+            const int index = indices[i];
+            changes_[size++] = (uint8)index;
+            changes_[size++] = (uint8)current_[index];
+            published_[index] = current_[index];
+        }
+
+        if (size == 0 && ! full && display_ == publishedDisplay_)
+            return true;
+
+        publishedDisplay_ = display_;
+        return output_.send(packet_, (size_t)encode(size));
+    }
+
+private:
+    // by hand into the same buffer every time, the shape never changes
+    int encode(int numChangeBytes)
+    {
+        static const char header[] = "/loop4r_leds/delta\0\0,iib\0\0\0\0";
+        static_assert(sizeof(header) - 1 == 28, "address and type tags padded to 4 bytes");
+
+        int pos = (int)sizeof(header) - 1;
+        memcpy(packet_, header, (size_t)pos);
+        for (auto value : { ++sequence_, display_, numChangeBytes })
+        {
+            auto bigEndian = ByteOrder::swapIfLittleEndian((uint32)value);
+            memcpy(packet_ + pos, &bigEndian, 4);
+            pos += 4;
+        }
+
+        memcpy(packet_ + pos, changes_, (size_t)numChangeBytes);
+        pos += numChangeBytes;
+        while ((pos & 3) != 0)
+            packet_[pos++] = 0;
+        return pos;
+    }
+
+    OscOutput output_;
+    int8 current_[maxLeds] = {};
+    int8 published_[maxLeds];
+    uint8 changes_[2 * maxLeds];
+    char packet_[28 + 12 + 2 * maxLeds];
+    int numLeds_ = 0;
+    int display_ = -1;
+    int publishedDisplay_ = -1;
+    int sequence_ = 0;
+};
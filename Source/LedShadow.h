@@ -0,0 +1,320 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "MidiBatch.h"
+#include "BoardLayout.h"
+
+//==============================================================================
+// What the pedalboard is currently showing. All LED and display output goes
+// through here so that only changes reach the MIDI batch; after invalidate()
+// everything is considered unknown and the next update of each LED and digit
+// is written again. Updates are only recorded until commit(), so an LED that
+// changes several times in between is written once with its latest state.
+// The LEDs are kept as bitsets, so what changed is a single XOR against
+// what is shown.
+//
+// Updates go out in lanes: the LEDs showing the loopers' state first, then
+// blink toggles, then the heartbeat LED and the display. A commit may stop
+// after the first lanes, e.g. while the port is still busy with the last
+// write; the lanes behind are held back and whatever changes in them
+// meanwhile goes out once, with the next commit that takes them.
+class LedShadow
+{
+public:
+    enum Lane
+    {
+        StateLane,
+        BlinkLane,
+        CosmeticLane,
+        numLanes
+    };
+
+    // the FCB1010 shows two digits, other firmware may drive more
+    static const int maxDigits = 4;
+
+    LedShadow(MidiBatch& batch) : batch_(batch)
+    {
+        dirty_.ensureStorageAllocated(128);
+        frame_.ensureStorageAllocated(64);
+        digitControllers_.add(CC_DISPLAY_TENS);
+        digitControllers_.add(CC_DISPLAY_ONES);
+        for (auto& wanted : wantedDigits_)
+            wanted = -1;
+        invalidate();
+    }
+
+    // the controller for each digit, most significant first; an empty set
+    // keeps the ones there are
+    void setDigitControllers(const MemoryBlock& controllers)
+    {
+        if (controllers.getSize() == 0)
+            return;
+
+        digitControllers_.clearQuick();
+        for (size_t i = 0; i < jmin(controllers.getSize(), (size_t)maxDigits); ++i)
+            digitControllers_.add((uint8)controllers[i] & 0x7f);
+        invalidate();
+    }
+
+    int getNumDigits() const
+    {
+        return digitControllers_.size();
+    }
+
+    // the controllers the LEDs are shown with; what is shown is unknown again
+    void setLayout(const BoardLayout& layout)
+    {
+        layout_ = layout;
+        invalidate();
+    }
+
+    void invalidate()
+    {
+        known_.clear();
+        for (auto& shown : digits_)
+            shown = -1;
+    }
+
+    // for an LED whose last state was taken back before it was shown
+    void forgetLed(uint8 number)
+    {
+        known_.reset(number & 0x7f);
+    }
+
+    // for bytes that were dropped before they reached the pedalboard: every
+    // LED and digit taken for shown is written again with its current state
+    // by the next commit, in the state lane
+    void rewriteShown()
+    {
+        LedBits leds = known_ & ~wanted_;
+        leds.forEach([this] (int number) { dirty_.add((uint8)number); });
+        wanted_ |= leds;
+        wantedOn_.assign(leds, shown_);
+        addToLane(leds, StateLane);
+        known_.clear();
+
+        for (int digit = 0; digit < getNumDigits(); ++digit)
+        {
+            if (wantedDigits_[digit] < 0)
+                wantedDigits_[digit] = digits_[digit];
+            digits_[digit] = -1;
+        }
+    }
+
+    void setLed(uint8 number, bool on, Lane lane = StateLane)
+    {
+        number &= 0x7f;
+        if (! wanted_.test(number))
+        {
+            dirty_.add(number);
+            wanted_.set(number);
+        }
+        wantedOn_.set(number, on);
+
+        LedBits led;
+        led.set(number);
+        addToLane(led, lane);
+    }
+
+    // the LEDs with these bits set to the ones in on, lowest number first
+    void setLeds(const LedBits& mask, const LedBits& on, Lane lane = StateLane)
+    {
+        (mask & ~wanted_).forEach([this] (int number) { dirty_.add((uint8)number); });
+        wanted_ |= mask;
+        wantedOn_.assign(mask, on);
+        addToLane(mask, lane);
+    }
+
+    // digit 0 is the most significant
+    void setDigit(int digit, uint8 value)
+    {
+        if (isPositiveAndBelow(digit, getNumDigits()))
+            wantedDigits_[digit] = value;
+    }
+
+    // right aligned with leading zeros, the lowest digits of anything longer
+    void setNumber(int value)
+    {
+        value = jmax(0, value);
+        for (int digit = getNumDigits(); --digit >= 0;)
+        {
+            setDigit(digit, (uint8)(value % 10));
+            value /= 10;
+        }
+    }
+
+    // adds whatever differs from what is shown to the MIDI batch, lane by
+    // lane up to lastLane and within a lane in the order the LEDs were first
+    // touched; the digits are in the cosmetic lane
+    void commit(Lane lastLane = CosmeticLane)
+    {
+        for (int lane = 0; lane <= lastLane; ++lane)
+            commitLane(lanes_[lane]);
+
+        if (lastLane >= CosmeticLane)
+            commitDigits();
+
+        if (! wanted_.any())
+        {
+            dirty_.clearQuick();
+        }
+        else
+        {
+            // keep the held back LEDs in the order they came
+            int kept = 0;
+            for (auto number : dirty_)
+                if (wanted_.test(number))
+                    dirty_.setUnchecked(kept++, number);
+            dirty_.removeLast(dirty_.size() - kept);
+        }
+    }
+
+    // anything set since the last commit, or still held back from it
+    bool hasChanges() const
+    {
+        return ! dirty_.isEmpty() || isHoldingBack();
+    }
+
+    // LEDs set since the last commit or held back from it
+    int getNumPending() const
+    {
+        return dirty_.size();
+    }
+
+    // true while a lane holds back updates from an earlier commit
+    bool isHoldingBack() const
+    {
+        if (wanted_.any())
+            return true;
+
+        for (int digit = 0; digit < getNumDigits(); ++digit)
+            if (wantedDigits_[digit] >= 0)
+                return true;
+        return false;
+    }
+
+    // With a header set, commitFrame() writes the whole state as one SysEx
+    // message: the header, then the 128 LED numbers as bits, 7 to a byte and
+    // lowest number first, then each digit of the display (0x7f for unknown).
+    void setFrameHeader(const MemoryBlock& header)
+    {
+        frameHeader_.clearQuick();
+        for (size_t i = 0; i < header.getSize(); ++i)
+            frameHeader_.add((uint8)header[i] & 0x7f);
+    }
+
+    bool hasFrameHeader() const
+    {
+        return ! frameHeader_.isEmpty();
+    }
+
+    // writes every LED and all digits at once, whether changed or not, LEDs
+    // never set counting as off. Afterwards all of it is known to be shown.
+    void commitFrame()
+    {
+        shown_ = shown_ & known_;
+        shown_.assign(wanted_, wantedOn_);
+        known_ = LedBits::all();
+        wanted_.clear();
+        for (auto& lane : lanes_)
+            lane.clear();
+        dirty_.clearQuick();
+
+        uint8 bits[(128 + 6) / 7] = {};
+        shown_.forEach([&bits] (int number) { bits[number / 7] |= (uint8)(1 << (number % 7)); });
+
+        frame_.clearQuick();
+        frame_.addArray(frameHeader_);
+        frame_.addArray((const uint8*)bits, numElementsInArray(bits));
+        for (int digit = 0; digit < getNumDigits(); ++digit)
+        {
+            if (wantedDigits_[digit] >= 0)
+                digits_[digit] = wantedDigits_[digit];
+            wantedDigits_[digit] = -1;
+            frame_.add(digits_[digit] >= 0 ? (uint8)(digits_[digit] & 0x7f) : (uint8)0x7f);
+        }
+
+        batch_.addSysEx(frame_.begin(), frame_.size());
+    }
+
+private:
+    // an LED updated in several lanes goes with the first of them
+    void addToLane(const LedBits& leds, Lane lane)
+    {
+        LedBits earlier;
+        for (int i = 0; i < lane; ++i)
+            earlier |= lanes_[i];
+
+        LedBits moving = leds & ~earlier;
+        lanes_[lane] |= moving;
+        for (int i = lane + 1; i < numLanes; ++i)
+            lanes_[i] &= ~moving;
+    }
+
+    void commitLane(LedBits& leds)
+    {
+        if (! leds.any())
+            return;
+
+        LedBits changed = leds & (~known_ | (shown_ ^ wantedOn_));
+        if (changed.any())
+            for (auto number : dirty_)
+                if (changed.test(number))
+                    batch_.addEvent(layout_.getStatus(), layout_.getEvent(number, wantedOn_.test(number)));
+
+        known_ |= leds;
+        shown_.assign(leds, wantedOn_);
+        wanted_ &= ~leds;
+        leds.clear();
+    }
+
+    // only the digits that changed
+    void commitDigits()
+    {
+        for (int digit = 0; digit < getNumDigits(); ++digit)
+        {
+            int& wanted = wantedDigits_[digit];
+            if (wanted >= 0 && wanted != digits_[digit])
+            {
+                digits_[digit] = wanted;
+                batch_.addControllerEvent(digitControllers_.getUnchecked(digit), (uint8)wanted);
+            }
+            wanted = -1;
+        }
+    }
+
+    MidiBatch& batch_;
+    BoardLayout layout_;
+
+    // what is shown, for the LEDs in known_
+    LedBits known_;
+    LedBits shown_;
+    int digits_[maxDigits];
+
+    // updates since the last commit, -1 for digits without one
+    LedBits wanted_;
+    LedBits wantedOn_;
+    LedBits lanes_[numLanes];
+    int wantedDigits_[maxDigits];
+    Array<uint8> digitControllers_;
+    Array<uint8> dirty_;
+    Array<uint8> frameHeader_;
+    Array<uint8> frame_;
+};
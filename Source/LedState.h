@@ -0,0 +1,159 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// One bit for each of the 128 LED numbers the pedalboard knows
+struct LedBits
+{
+    uint64 words[2] = { 0, 0 };
+
+    static LedBits all()
+    {
+        LedBits bits;
+        bits.words[0] = bits.words[1] = ~(uint64)0;
+        return bits;
+    }
+
+    bool test(int number) const
+    {
+        return ((words[(number >> 6) & 1] >> (number & 63)) & 1) != 0;
+    }
+
+    void set(int number, bool on = true)
+    {
+        uint64 bit = (uint64)1 << (number & 63);
+        uint64& word = words[(number >> 6) & 1];
+        word = on ? (word | bit) : (word & ~bit);
+    }
+
+    void reset(int number)
+    {
+        set(number, false);
+    }
+
+    void clear()
+    {
+        words[0] = words[1] = 0;
+    }
+
+    bool any() const
+    {
+        return (words[0] | words[1]) != 0;
+    }
+
+    // these bits of mask set to the ones in value, the others left alone
+    void assign(const LedBits& mask, const LedBits& value)
+    {
+        for (int i = 0; i < 2; ++i)
+            words[i] = (words[i] & ~mask.words[i]) | (value.words[i] & mask.words[i]);
+    }
+
+    // calls function with the number of each bit set, lowest first
+    template <typename Function>
+    void forEach(Function function) const
+    {
+        for (int i = 0; i < 2; ++i)
+            for (uint64 word = words[i]; word != 0; word &= word - 1)
+                function(i * 64 + __builtin_ctzll(word));
+    }
+
+    LedBits operator& (const LedBits& other) const  { return combine(other, [] (uint64 a, uint64 b) { return a & b; }); }
+    LedBits operator| (const LedBits& other) const  { return combine(other, [] (uint64 a, uint64 b) { return a | b; }); }
+    LedBits operator^ (const LedBits& other) const  { return combine(other, [] (uint64 a, uint64 b) { return a ^ b; }); }
+    LedBits operator~ () const                      { return all() ^ *this; }
+
+    LedBits& operator&= (const LedBits& other)      { return *this = *this & other; }
+    LedBits& operator|= (const LedBits& other)      { return *this = *this | other; }
+    LedBits& operator^= (const LedBits& other)      { return *this = *this ^ other; }
+
+private:
+    template <typename Op>
+    LedBits combine(const LedBits& other, Op op) const
+    {
+        LedBits result;
+        result.words[0] = op(words[0], other.words[0]);
+        result.words[1] = op(words[1], other.words[1]);
+        return result;
+    }
+};
+
+//==============================================================================
+// Pedals are numbered by index from 0: the ten numbered pedals, then UP and
+// DOWN. In EurekaProm I/O mode pedals 1-9 light LEDs 1-9 and pedal 10 lights
+// LED 0, the controller values of the pedals follow the same numbering.
+// Anything past DOWN is passed through unchanged.
+namespace PedalMap
+{
+    static constexpr int numMapped = 12;
+    static constexpr uint8 ledNumbers[numMapped]   = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 10, 11 };
+    static constexpr int pedalIndexes[numMapped]   = { 9, 0, 1, 2, 3, 4, 5, 6, 7, 8, 10, 11 };
+
+    constexpr uint8 ledNumber(int pedalIdx)
+    {
+        return pedalIdx >= 0 && pedalIdx < numMapped ? ledNumbers[pedalIdx] : (uint8)pedalIdx;
+    }
+
+    constexpr int pedalIndex(int controllerValue)
+    {
+        return controllerValue >= 0 && controllerValue < numMapped ? pedalIndexes[controllerValue] : controllerValue;
+    }
+}
+
+static_assert(PedalMap::ledNumber(9) == 0 && PedalMap::pedalIndex(0) == 9, "pedal 10 is LED 0");
+static_assert(PedalMap::pedalIndex(PedalMap::ledNumber(11)) == 11, "UP and DOWN map onto themselves");
+
+//==============================================================================
+// Whether each looper LED is on and whether it blinks, by LED number, so that
+// all LEDs blinking in step can be switched with a few word operations
+class LedState
+{
+public:
+    bool isOn(uint8 number) const               { return on_.test(number); }
+    void setOn(uint8 number, bool on)           { on_.set(number, on); }
+
+    // the LEDs with these bits set to the ones in on
+    void setOn(const LedBits& mask, const LedBits& on)
+    {
+        on_.assign(mask, on);
+    }
+
+    const LedBits& getOn() const                { return on_; }
+
+    void setBlinking(uint8 number, bool blinking, bool fast)
+    {
+        blinking_[0].set(number, blinking && ! fast);
+        blinking_[1].set(number, blinking && fast);
+    }
+
+    const LedBits& getBlinking(bool fast) const { return blinking_[fast ? 1 : 0]; }
+
+    void clear()
+    {
+        on_.clear();
+        blinking_[0].clear();
+        blinking_[1].clear();
+    }
+
+private:
+    LedBits on_;
+    LedBits blinking_[2];
+};
@@ -0,0 +1,120 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//==============================================================================
+// The last LED state shown, kept in a small file mapped into memory so that
+// storing it after every batch is a copy into the page cache rather than a
+// write, and it survives the bridge crashing. At the next start it goes to
+// the pedalboard straight away, before the looper has answered.
+class LedStateCache
+{
+public:
+    static const int maxLeds = 128;
+    static const int maxEngines = 16;
+
+    struct Image
+    {
+        char magic[8];
+        int32 numLeds;
+        int32 selectedLoop;
+        int32 numEngines;
+        struct Engine { int32 id; int32 ledCount; } engines[maxEngines];
+        struct Led { uint8 on; uint8 state; int16 timer; } leds[maxLeds];
+    };
+
+    ~LedStateCache()
+    {
+        close();
+    }
+
+    // opens or creates the file, whatever it held is in get() if isValid()
+    bool open(const File& file)
+    {
+        close();
+
+        int fd = ::open(file.getFullPathName().toRawUTF8(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        bool sized = fstat(fd, &info) == 0
+            && (info.st_size == (off_t)sizeof(Image) || ftruncate(fd, (off_t)sizeof(Image)) == 0);
+        void* mapped = sized ? mmap(nullptr, sizeof(Image), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+
+        image_ = (Image*)mapped;
+        return true;
+    }
+
+    void close()
+    {
+        if (image_ != nullptr)
+            munmap(image_, sizeof(Image));
+        image_ = nullptr;
+    }
+
+    bool isOpen() const
+    {
+        return image_ != nullptr;
+    }
+
+    // holds a state stored by us, not a new or foreign file
+    bool isValid() const
+    {
+        return image_ != nullptr && memcmp(image_->magic, magic(), sizeof(image_->magic)) == 0
+            && isPositiveAndNotGreaterThan(image_->numLeds, maxLeds)
+            && isPositiveAndNotGreaterThan(image_->numEngines, maxEngines);
+    }
+
+    const Image& get() const
+    {
+        jassert(image_ != nullptr);
+        return *image_;
+    }
+
+    // fill in everything but the magic, which this stamps afterwards
+    Image& beginStore()
+    {
+        jassert(image_ != nullptr);
+        return *image_;
+    }
+
+    void endStore()
+    {
+        memcpy(image_->magic, magic(), sizeof(image_->magic));
+    }
+
+private:
+    static const char* magic()
+    {
+        return "L4RLED01";
+    }
+
+    Image* image_ = nullptr;
+};
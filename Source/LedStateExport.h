@@ -0,0 +1,238 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+#include <climits>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//==============================================================================
+// The live LED state published in a POSIX shared memory segment for other
+// tools on the same machine, guarded by a seqlock: the sequence is odd while
+// the bridge writes, so a reader copies the data and keeps it only if the
+// sequence was even and unchanged around the copy. Readers never block the
+// bridge, which never waits for them; a reader that is up to date sleeps on
+// the sequence as a shared futex, which each write wakes. Times are
+// milliseconds on CLOCK_MONOTONIC, as the readers' own clock_gettime()
+// gives them.
+struct LedStateSegment
+{
+    static const uint32 layoutVersion = 1;
+    static const int maxLeds = 128;
+    static const int maxEngines = 16;
+
+    struct Data
+    {
+        uint32 version;
+        int32 oscConnected;
+        double updatedMs;
+        int32 selectedLoop;         // as on the display, 1 based
+        int32 numLeds;
+        int32 numEngines;
+        struct Engine
+        {
+            int32 id;
+            int32 firstLed;
+            int32 ledCount;
+            int32 senderConnected;
+            double lastHeardMs;
+            double smoothedRttMs;
+        } engines[maxEngines];
+        struct Led { uint8 on; uint8 state; int16 timer; } leds[maxLeds];
+    };
+
+    std::atomic<uint32> sequence;
+    Data data;
+
+    // for readers; false if the bridge kept writing through every try
+    bool read(Data& copy, int maxTries = 100) const
+    {
+        for (int i = 0; i < maxTries; ++i)
+        {
+            uint32 before = sequence.load(std::memory_order_acquire);
+            if ((before & 1) != 0)
+                continue;
+
+            memcpy(&copy, &data, sizeof(copy));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before)
+                return true;
+        }
+        return false;
+    }
+
+    // for readers: sleeps until the sequence is no longer seen, or for
+    // timeoutMs; returns straight away if it already moved on
+    void waitForChange(uint32 seen, int timeoutMs) const
+    {
+        timespec timeout { timeoutMs / 1000, (long)(timeoutMs % 1000) * 1000000 };
+        syscall(SYS_futex, reinterpret_cast<const uint32*>(&sequence), FUTEX_WAIT, seen, &timeout, nullptr, 0);
+    }
+
+    // for the bridge after a write; the readers are other processes, so
+    // the futex isn't a private one
+    void wakeReaders()
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32*>(&sequence), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+};
+
+//==============================================================================
+// The bridge's end: creates the segment and is its only writer
+class LedStateExport
+{
+public:
+    ~LedStateExport()
+    {
+        close();
+    }
+
+    // name as for shm_open(), e.g. "/loop4r_leds"
+    bool open(const String& name)
+    {
+        close();
+
+        String path = name.startsWithChar('/') ? name : "/" + name;
+        int fd = shm_open(path.toRawUTF8(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return false;
+
+        void* mapped = ftruncate(fd, (off_t)sizeof(LedStateSegment)) == 0
+            ? mmap(nullptr, sizeof(LedStateSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+        {
+            shm_unlink(path.toRawUTF8());
+            return false;
+        }
+
+        segment_ = (LedStateSegment*)mapped;
+        name_ = path;
+        return true;
+    }
+
+    // the segment goes, readers still mapping it keep their copy
+    void close()
+    {
+        if (segment_ == nullptr)
+            return;
+
+        munmap(segment_, sizeof(LedStateSegment));
+        shm_unlink(name_.toRawUTF8());
+        segment_ = nullptr;
+    }
+
+    bool isOpen() const
+    {
+        return segment_ != nullptr;
+    }
+
+    // the data may only be changed between these two
+    LedStateSegment::Data& beginWrite()
+    {
+        uint32 sequence = segment_->sequence.load(std::memory_order_relaxed);
+        segment_->sequence.store(sequence | 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return segment_->data;
+    }
+
+    void endWrite()
+    {
+        segment_->data.version = LedStateSegment::layoutVersion;
+        uint32 sequence = segment_->sequence.load(std::memory_order_relaxed);
+        segment_->sequence.store(sequence + 1, std::memory_order_release);
+        segment_->wakeReaders();
+    }
+
+private:
+    LedStateSegment* segment_ = nullptr;
+    String name_;
+};
+
+//==============================================================================
+// A reader's end, mapping a segment some other process created read only
+class LedStateImport
+{
+public:
+    ~LedStateImport()
+    {
+        close();
+    }
+
+    bool open(const String& name)
+    {
+        close();
+
+        String path = name.startsWithChar('/') ? name : "/" + name;
+        int fd = shm_open(path.toRawUTF8(), O_RDONLY | O_CLOEXEC, 0);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        void* mapped = fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(LedStateSegment)
+            ? mmap(nullptr, sizeof(LedStateSegment), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+
+        segment_ = (const LedStateSegment*)mapped;
+        return true;
+    }
+
+    void close()
+    {
+        if (segment_ != nullptr)
+            munmap((void*)segment_, sizeof(LedStateSegment));
+        segment_ = nullptr;
+    }
+
+    bool isOpen() const
+    {
+        return segment_ != nullptr;
+    }
+
+    // false without a consistent copy of the layout we know
+    bool read(LedStateSegment::Data& copy) const
+    {
+        return segment_ != nullptr && segment_->read(copy) && copy.version == LedStateSegment::layoutVersion;
+    }
+
+    // changes with every write, to skip copying what was already seen
+    uint32 getSequence() const
+    {
+        return segment_ != nullptr ? segment_->sequence.load(std::memory_order_acquire) : 0;
+    }
+
+    // until the bridge writes again after sequence, or for timeoutMs
+    void waitForChange(uint32 sequence, int timeoutMs) const
+    {
+        if (segment_ != nullptr)
+            segment_->waitForChange(sequence, timeoutMs);
+    }
+
+private:
+    const LedStateSegment* segment_ = nullptr;
+};
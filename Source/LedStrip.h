@@ -0,0 +1,228 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "PackedDiff.h"
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/spi/spidev.h>
+
+//==============================================================================
+// Mirrors the looper LEDs onto an addressable LED strip on a spidev port,
+// one pixel per LED in the colour of its state. APA102 strips take the
+// colours as they are, WS2812 ones have each data bit stretched into three
+// SPI bits on a 2.4 MHz clock, which gives the timing they expect. The
+// frame is kept from one show() to the next, only the pixels that changed are
+// encoded again and nothing is written when none did; the kernel driver
+// hands the transfer to the DMA engine, so the write costs next to no CPU.
+// One thread shows the frames; the colours may be changed and the counts
+// read from any other, each is a word of its own.
+class LedStrip
+{
+public:
+    enum Chip
+    {
+        Apa102,
+        Ws2812
+    };
+
+    static const int maxPixels = 128;
+    static const int numStates = 4;
+
+    LedStrip()
+    {
+        // dark, lit, blinking, blinking fast
+        const uint32 defaults[numStates] = { 0x000000, 0x00ff00, 0xffa000, 0xff0000 };
+        for (int state = 0; state < numStates; ++state)
+            colours_[state] = defaults[state];
+    }
+
+    ~LedStrip()
+    {
+        close();
+    }
+
+    static bool parseChip(const String& name, Chip& chip)
+    {
+        if (name.equalsIgnoreCase("apa102"))
+            chip = Apa102;
+        else if (name.equalsIgnoreCase("ws2812"))
+            chip = Ws2812;
+        else
+            return false;
+        return true;
+    }
+
+    bool open(const String& device, Chip chip, int numPixels)
+    {
+        close();
+
+        int fd = ::open(device.toRawUTF8(), O_WRONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+
+        uint8 mode = SPI_MODE_0;
+        uint8 bits = 8;
+        uint32 speed = chip == Ws2812 ? 2400000 : 4000000;
+        if (ioctl(fd, SPI_IOC_WR_MODE, &mode) < 0 || ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0
+            || ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        fd_ = fd;
+        chip_ = chip;
+        numPixels_ = jlimit(1, maxPixels, numPixels);
+        for (auto& pixel : pixels_)
+            pixel = 0;
+        frame_.clearQuick();
+        unwritten_ = false;
+        return true;
+    }
+
+    void close()
+    {
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = -1;
+    }
+
+    bool isOpen() const
+    {
+        return fd_ >= 0;
+    }
+
+    // 0xrrggbb for one of the LED states
+    void setColour(int state, uint32 rgb)
+    {
+        if (isPositiveAndBelow(state, numStates))
+            colours_[state] = rgb & 0xffffff;
+    }
+
+    // a blinking LED shows its colour while lit and is dark in between
+    void setLed(int index, int state, bool on)
+    {
+        if (isPositiveAndBelow(index, numPixels_))
+            pixels_[index] = on && isPositiveAndBelow(state, numStates) ? colours_[state].get() : colours_[0].get();
+    }
+
+    // LEDs past the looper's count go dark
+    void setNumLeds(int numLeds)
+    {
+        for (int i = jmax(0, numLeds); i < numPixels_; ++i)
+            pixels_[i] = colours_[0].get();
+    }
+
+    // writes the frame if a pixel changed, returns false if the write failed
+    bool show()
+    {
+        if (fd_ < 0)
+            return false;
+
+        if (frame_.isEmpty())
+            renderFrame();
+        else
+        {
+            uint8 changed[maxPixels];
+            int numChanged = PackedDiff::changedWords(pixels_, rendered_, numPixels_, changed);
+            if (numChanged == 0 && ! unwritten_)
+                return true;
+            for (int i = 0; i < numChanged; ++i)
+                renderPixel(changed[i]);
+        }
+
+        if (::write(fd_, frame_.begin(), (size_t)frame_.size()) != (ssize_t)frame_.size())
+        {
+            // the frame is up to date, it only needs sending again
+            unwritten_ = true;
+            ++failedWrites_;
+            return false;
+        }
+        unwritten_ = false;
+        ++framesWritten_;
+        return true;
+    }
+
+    int64 getFramesWritten() const  { return framesWritten_.get(); }
+    int64 getFailedWrites() const   { return failedWrites_.get(); }
+
+private:
+    // an APA102 frame is a zero start frame, four bytes per pixel, then a
+    // clock edge per two pixels to push the last ones through; a WS2812 one
+    // nine bytes per pixel, then the line held low for the reset
+    void renderFrame()
+    {
+        const int pixelBytes = chip_ == Apa102 ? 4 : 9;
+        const int headerBytes = chip_ == Apa102 ? 4 : 0;
+        const int trailerBytes = chip_ == Apa102 ? (numPixels_ + 15) / 16 : resetBytes;
+        frame_.insertMultiple(0, 0, headerBytes + numPixels_ * pixelBytes + trailerBytes);
+        for (int i = 0; i < numPixels_; ++i)
+            renderPixel(i);
+    }
+
+    void renderPixel(int index)
+    {
+        const uint32 rgb = pixels_[index];
+        rendered_[index] = rgb;
+        if (chip_ == Apa102)
+        {
+            // 0xe0 | brightness, blue, green, red
+            uint8* out = frame_.getRawDataPointer() + 4 + 4 * index;
+            out[0] = 0xff;
+            out[1] = (uint8)rgb;
+            out[2] = (uint8)(rgb >> 8);
+            out[3] = (uint8)(rgb >> 16);
+            return;
+        }
+
+        // green, red, blue, most significant bit first, each 1 as 110 and
+        // each 0 as 100
+        uint8* out = frame_.getRawDataPointer() + 9 * index;
+        const uint32 grb = ((rgb >> 8) & 0xff) << 16 | ((rgb >> 16) & 0xff) << 8 | (rgb & 0xff);
+        uint32 bits = 0;
+        int numBits = 0;
+        for (int bit = 23; bit >= 0; --bit)
+        {
+            bits = bits << 3 | (((grb >> bit) & 1) != 0 ? 6u : 4u);
+            numBits += 3;
+            if (numBits >= 8)
+            {
+                numBits -= 8;
+                *out++ = (uint8)(bits >> numBits);
+            }
+        }
+    }
+
+    // at 2.4 MHz, well over the 50 us a WS2812 needs to latch
+    static const int resetBytes = 24;
+
+    int fd_ = -1;
+    Chip chip_ = Apa102;
+    int numPixels_ = 0;
+    Atomic<uint32> colours_[numStates];
+    uint32 pixels_[maxPixels] = {};
+    uint32 rendered_[maxPixels] = {};     // what frame_ holds
+    Array<uint8> frame_;
+    bool unwritten_ = false;
+    Atomic<int64> framesWritten_ { 0 };
+    Atomic<int64> failedWrites_ { 0 };
+};
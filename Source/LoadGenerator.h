@@ -0,0 +1,180 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "OscOutput.h"
+#include <functional>
+
+//==============================================================================
+// Pretends to be a busy looper: sends a weighted mix of /led, /display,
+// /heartbeat and /pingack messages to a bridge at a fixed average rate,
+// optionally in bursts and with a share of malformed packets, to find out how
+// much traffic the bridge keeps up with.
+class LoadGenerator : private Thread
+{
+public:
+    enum MessageType
+    {
+        Led,
+        Display,
+        Heartbeat,
+        PingAck,
+        numMessageTypes
+    };
+
+    struct Options
+    {
+        int weights[numMessageTypes] = { 70, 20, 8, 2 };
+        int burstSize = 1;          // messages sent back to back
+        int badPercent = 0;         // share of malformed packets
+    };
+
+    typedef std::function<void(int64 sent, int64 bad, double elapsedMs)> FinishedCallback;
+
+    LoadGenerator(FinishedCallback finished)
+        : Thread("loop4r loadgen"),
+          finished_(finished)
+    {
+    }
+
+    ~LoadGenerator()
+    {
+        stop();
+    }
+
+    // only to be changed before start()
+    Options& getOptions()
+    {
+        return options_;
+    }
+
+    bool start(const String& host, int port, int rate, int seconds)
+    {
+        if (rate <= 0 || seconds <= 0 || ! output_.connect(host, port))
+            return false;
+
+        rate_ = rate;
+        seconds_ = seconds;
+        startThread();
+        return true;
+    }
+
+    void stop()
+    {
+        stopThread(1000);
+    }
+
+    bool isRunning() const
+    {
+        return isThreadRunning();
+    }
+
+private:
+    void run() override
+    {
+        const int burstSize = jmax(1, options_.burstSize);
+        const double intervalMs = burstSize * 1000.0 / rate_;
+        const double startMs = Time::getMillisecondCounterHiRes();
+        const double endMs = startMs + seconds_ * 1000.0;
+
+        int64 sent = 0, bad = 0;
+        double nextMs = startMs;
+        while (! threadShouldExit() && nextMs < endMs)
+        {
+            for (int i = 0; i < burstSize; ++i)
+            {
+                bool isBad = random_.nextInt(100) < options_.badPercent;
+                packet_.reset();
+                makeMessage(packet_);
+                size_t size = isBad ? makeBadPacket(packet_) : packet_.getDataSize();
+                output_.send(packet_.getData(), size);
+                ++sent;
+                if (isBad)
+                    ++bad;
+            }
+
+            nextMs += intervalMs;
+            double now = Time::getMillisecondCounterHiRes();
+            if (nextMs > now)
+                Thread::sleep((int)(nextMs - now));
+        }
+
+        finished_(sent, bad, Time::getMillisecondCounterHiRes() - startMs);
+    }
+
+    int pickType()
+    {
+        int total = 0;
+        for (auto weight : options_.weights)
+            total += jmax(0, weight);
+
+        int pick = random_.nextInt(jmax(1, total));
+        for (int type = 0; type < numMessageTypes; ++type)
+        {
+            pick -= jmax(0, options_.weights[type]);
+            if (pick < 0)
+                return type;
+        }
+        return Led;
+    }
+
+    // encoded straight into the packet, so the generator's own cost stays
+    // out of what it measures
+    void makeMessage(MemoryOutputStream& out)
+    {
+        switch (pickType())
+        {
+            case Display:
+                OscPacket::encode(out, "/display", (int32)random_.nextInt(10));
+                break;
+            case Heartbeat:
+                OscPacket::encode(out, "/heartbeat", "osc.udp://127.0.0.1:9000/", "loadgen", (int32)10, (int32)1);
+                break;
+            case PingAck:
+                OscPacket::encode(out, "/pingack", "osc.udp://127.0.0.1:9000/", "loadgen", (int32)10, (int32)1);
+                break;
+            default:
+                // index, on, timer, state
+                OscPacket::encode(out, "/led", (int32)random_.nextInt(10), (int32)random_.nextInt(2),
+                                  (int32)random_.nextInt(6), (int32)random_.nextInt(4));
+                break;
+        }
+    }
+
+    // turns a message into half truncated messages, half garbage, returning
+    // how much of it to send
+    size_t makeBadPacket(MemoryOutputStream& out)
+    {
+        if (random_.nextBool())
+            return (size_t)jmax(4, (int)out.getDataSize() - 1 - random_.nextInt(8));
+
+        out.reset();
+        for (int i = 4 + 4 * random_.nextInt(16); --i >= 0;)
+            out.writeByte((char)random_.nextInt(256));
+        return out.getDataSize();
+    }
+
+    FinishedCallback finished_;
+    Options options_;
+    OscOutput output_;
+    MemoryOutputStream packet_;
+    Random random_;
+    int rate_ = 0;
+    int seconds_ = 0;
+};
@@ -0,0 +1,106 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// Counts the messages for each OSC route over 100 ms windows against a budget
+// of messages a second per route. A route over its budget sheds the cosmetic
+// work first: display updates are dropped and messages are no longer logged
+// one by one. Twice over, LED updates are coalesced over a longer window as
+// well. The level a window ends with holds for the next one, so it takes a
+// quiet window to recover. Guarded by the application's stateLock_.
+class LoadShedder
+{
+public:
+    enum Level
+    {
+        Normal,
+        ShedCosmetic,
+        CoalesceHarder
+    };
+
+    static const int maxRoutes = 16;
+
+    // 0 turns shedding off
+    void setBudget(int messagesPerSecond, double coalesceMs)
+    {
+        budget_ = jmax(0, messagesPerSecond);
+        coalesceMs_ = jmax(0.0, coalesceMs);
+        level_ = Normal;
+    }
+
+    bool isEnabled() const              { return budget_ > 0; }
+    Level getLevel() const              { return level_; }
+    double getCoalesceMs() const        { return level_ == CoalesceHarder ? coalesceMs_ : 0.0; }
+
+    // once per batch of packets, ends the window it is over
+    void beginBatch(double nowMs)
+    {
+        if (! isEnabled() || nowMs - windowStartMs_ < windowMs)
+            return;
+
+        // behind by more than a window there was nothing to count since
+        int worst = 0;
+        if (nowMs - windowStartMs_ < 2 * windowMs)
+            for (auto count : counts_)
+                worst = jmax(worst, count);
+
+        const int perWindow = jmax(1, budget_ * (int)windowMs / 1000);
+        level_ = worst > 2 * perWindow ? CoalesceHarder : worst > perWindow ? ShedCosmetic : Normal;
+        if (level_ != Normal)
+            ++windowsOver_;
+
+        for (auto& count : counts_)
+            count = 0;
+        windowStartMs_ = nowMs;
+    }
+
+    // counts one message for the route, false if it is to be dropped
+    bool admit(int route, bool cosmetic)
+    {
+        if (! isEnabled())
+            return true;
+
+        if (isPositiveAndBelow(route, maxRoutes))
+            ++counts_[route];
+        if (cosmetic && level_ != Normal)
+        {
+            ++shed_;
+            return false;
+        }
+        return true;
+    }
+
+    int64 getShed() const               { return shed_; }
+    int64 getWindowsOver() const        { return windowsOver_; }
+
+private:
+    static constexpr double windowMs = 100.0;
+
+    int budget_ = 0;
+    double coalesceMs_ = 0.0;
+    Level level_ = Normal;
+    double windowStartMs_ = 0.0;
+    int counts_[maxRoutes] = {};
+    int64 shed_ = 0;
+    int64 windowsOver_ = 0;
+};
@@ -0,0 +1,72 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+#include <time.h>
+
+//==============================================================================
+// The time blinking, heartbeats, reconnects and predictions run on, in ms on
+// CLOCK_MONOTONIC like Time::getMillisecondCounterHiRes(). It is the real
+// clock unless simulate() hands it over to a replay, which then moves it on
+// from packet to packet and has the timers fire in between as they fall due,
+// so a two hour set replays in as long as its packets take to handle and
+// always the same way. Latencies are still measured on the real clock.
+class LoopClock
+{
+public:
+    // only before any timer is started
+    void simulate(double startMs)
+    {
+        simulatedNs_ = (int64)(startMs * 1000000.0);
+        simulated_ = true;
+    }
+
+    bool isSimulated() const            { return simulated_; }
+
+    double nowMs() const
+    {
+        return simulated_ ? (double)simulatedNs_.load() / 1000000.0 : Time::getMillisecondCounterHiRes();
+    }
+
+    int64 nowNs() const
+    {
+        if (simulated_)
+            return simulatedNs_.load();
+
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return (int64)time.tv_sec * 1000000000 + time.tv_nsec;
+    }
+
+    // never backwards
+    void setNs(int64 ns)
+    {
+        int64 now = simulatedNs_.load();
+        while (ns > now && ! simulatedNs_.compare_exchange_weak(now, ns))
+        {
+        }
+    }
+
+private:
+    bool simulated_ = false;
+    std::atomic<int64> simulatedNs_ { 0 };
+};
@@ -0,0 +1,531 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "OscOutput.h"
+#include "OscStream.h"
+#include "HeartbeatMonitor.h"
+#include "SyncWorkflow.h"
+#include "ClockOffset.h"
+#include "LooperMirror.h"
+
+//==============================================================================
+// One looper the bridge follows, on a pair of OSC ports of its own. Its LEDs
+// take up the indexes from firstLed on in the bridge's LED space, which the
+// boards map onto their pedals, so several loopers can share a board or get
+// one each. The looper may run on another host, it is told to answer to the
+// address our packets leave from towards it. Guarded by the application's
+// stateLock_ like the LEDs.
+class LooperEngine
+{
+public:
+    struct Requests
+    {
+        MemoryBlock heartbeatPing;
+        MemoryBlock pingAckPing;
+        MemoryBlock registerUpdates;
+        MemoryBlock registerFiltered;   // filled in by encodeFilteredRegistration()
+        MemoryBlock unregisterUpdates;
+        MemoryBlock leds;
+        MemoryBlock display;
+        MemoryBlock snapshot;
+        MemoryBlock registerTempo[3];
+        MemoryBlock unregisterTempo[3];
+        MemoryBlock registerDisplay;    // SooperLooper's own protocol only
+        MemoryBlock unregisterDisplay;
+    };
+
+    LooperEngine(const String& host, int sendPort, int receivePort, int firstLed)
+        : host_(host),
+          sendPort_(sendPort),
+          receivePort_(receivePort),
+          firstLed_(jmax(0, firstLed))
+    {
+    }
+
+    const String& getHost() const       { return host_; }
+    int getSendPort() const             { return sendPort_; }
+    int getReceivePort() const          { return receivePort_; }
+
+    // AF_UNIX paths in place of the ports, empty for UDP
+    const String& getSendPath() const   { return sendPath_; }
+    const String& getReceivePath() const { return receivePath_; }
+
+    String describeSend() const
+    {
+        if (stream_ != nullptr)
+            return "tcp " + String(streamPort_);
+        return sendPath_.isNotEmpty() ? sendPath_ : String(sendPort_);
+    }
+
+    String describeReceive() const
+    {
+        if (stream_ != nullptr)
+            return "tcp " + String(streamPort_);
+        return receivePath_.isNotEmpty() ? receivePath_ : String(receivePort_);
+    }
+
+    int getFirstLed() const             { return firstLed_; }
+
+    // the sender reconnects to the new port on the next connectSender()
+    void setSendPort(int port)
+    {
+        sendPort_ = port;
+        sendPath_.clear();
+        sender_.disconnect();
+    }
+
+    void setSendPath(const String& path)
+    {
+        sendPath_ = path;
+        sender_.disconnect();
+    }
+
+    // the same for a new host, the receiver has to be connected again too
+    // for the requests to name the right return address
+    void setHost(const String& host)
+    {
+        host_ = host;
+        sender_.disconnect();
+    }
+
+    // looks the host up without blocking, for connectSender() to fail
+    // until it is known
+    void setResolver(HostResolver* resolver)
+    {
+        sender_.setResolver(resolver);
+    }
+
+    bool setTrafficClass(int tos)
+    {
+        if (stream_ != nullptr)
+            stream_->setTrafficClass(tos);
+        return sender_.setTrafficClass(tos);
+    }
+
+    // Talks to the looper over one TCP connection to port instead, both
+    // ways; what comes in on it goes to the listener as coming from source.
+    // The connection is made and kept up by the stream's thread, from the
+    // first connectSender() on.
+    void useStream(OscInput::Listener& listener, int source, int port, OscStream::StateCallback stateChanged)
+    {
+        stream_.reset(new OscStream(listener, source));
+        stream_->setStateCallback(stateChanged);
+        streamPort_ = port;
+        sender_.disconnect();
+    }
+
+    bool isStreamed() const
+    {
+        return stream_ != nullptr;
+    }
+
+    // Talks SooperLooper's own OSC instead of /loop4r/..., without the
+    // component translating the loop states into LEDs: the requests ask for
+    // the state of every loop and the selected loop, which the bridge turns
+    // into LEDs itself. Takes effect with the next encodeRequests().
+    void setNative(bool native)
+    {
+        native_ = native;
+    }
+
+    bool isNative() const
+    {
+        return native_;
+    }
+
+    // its loops' states, for rendering its LEDs when native
+    LooperMirror& getMirror()           { return mirror_; }
+
+    const OscStream* getStream() const
+    {
+        return stream_.get();
+    }
+
+    void setMaxPacketSize(int bytes)
+    {
+        if (stream_ != nullptr)
+            stream_->setMaxPacketSize(bytes);
+    }
+
+    // before the application goes away, as the stream's thread calls it
+    void stopStream()
+    {
+        if (stream_ != nullptr)
+            stream_->stop();
+    }
+
+    // takes effect when the receiver is connected again
+    void setReceivePort(int port)
+    {
+        receivePort_ = port;
+        receivePath_.clear();
+    }
+
+    void setReceivePath(const String& path)
+    {
+        receivePath_ = path;
+    }
+
+    // a stream only reports whether its thread has connected yet
+    bool connectSender()
+    {
+        if (stream_ != nullptr)
+        {
+            stream_->start(host_, streamPort_);
+            return stream_->isConnected();
+        }
+        if (sender_.isConnected())
+            return true;
+        return sendPath_.isNotEmpty() ? sender_.connectUnix(sendPath_) : sender_.connect(host_, sendPort_);
+    }
+
+    bool isSenderConnected() const
+    {
+        return stream_ != nullptr ? stream_->isConnected() : sender_.isConnected();
+    }
+
+    // a stream connects again right away
+    void disconnectSender()
+    {
+        if (stream_ != nullptr)
+            stream_->reconnect();
+        sender_.disconnect();
+    }
+
+    bool send(const MemoryBlock& packet)
+    {
+        return stream_ != nullptr ? stream_->send(packet) : sender_.send(packet);
+    }
+
+    // for requests that go out together, the packets have to stay valid
+    // until sendQueued()
+    void queue(const MemoryBlock& packet)
+    {
+        if (stream_ != nullptr)
+            stream_->queue(packet);
+        else
+            sender_.queue(packet);
+    }
+
+    bool sendQueued()
+    {
+        return stream_ != nullptr ? stream_->sendQueued() : sender_.sendQueued();
+    }
+
+    // What the looper was last asked to send us, so registering again only
+    // queues what changed. Forgotten whenever the looper may have forgotten
+    // it too: another instance of it, a new connection, a registration that
+    // may have been lost.
+    enum Registration
+    {
+        UpdatesRegistration,
+        DisplayRegistration,
+        TempoRegistration,      // one per tempo control
+        numRegistrations = TempoRegistration + 3
+    };
+
+    void queueRegistration(int registration, const MemoryBlock& packet)
+    {
+        if (registered_[registration] == packet)
+        {
+            ++registrationsSkipped_;
+            return;
+        }
+        registered_[registration] = packet;
+        queue(packet);
+    }
+
+    // only if there is something to take back
+    void queueUnregistration(int registration, const MemoryBlock& packet)
+    {
+        if (registered_[registration].getSize() == 0)
+            return;
+        registered_[registration].reset();
+        queue(packet);
+    }
+
+    void forgetRegistrations()
+    {
+        for (auto& registered : registered_)
+            registered.reset();
+    }
+
+    int64 getRegistrationsSkipped() const   { return registrationsSkipped_; }
+
+    // the queued requests go out as one bundle, or as few as fit a datagram
+    void setBundleRequests(bool bundle)
+    {
+        sender_.setBundling(bundle);
+    }
+
+    // the datagram sender, for its non-blocking mode and what that held
+    // back or dropped
+    OscOutput& getSender()                  { return sender_; }
+    const OscOutput& getSender() const      { return sender_; }
+
+    // everything we ask the looper for only depends on where we receive,
+    // which needs the sender connected to know our side of the route
+    void encodeRequests(int tempoUpdateMs)
+    {
+        String host = stream_ != nullptr ? stream_->getLocalAddress() : sender_.getLocalAddress();
+        if (host.isEmpty())
+            host = "127.0.0.1";
+        int port = receivePort_;
+
+        // on a path the looper is given liblo's URL for it as the host, with
+        // no port; over a stream the answers come back on the connection
+        String scheme = stream_ != nullptr ? "osc.tcp://" : "osc.udp://";
+        String returnUrl = scheme + (host.containsChar(':') ? "[" + host + "]" : host) + ":" + String(port) + "/";
+        if (receivePath_.isNotEmpty())
+        {
+            returnUrl = "osc.unix://" + receivePath_;
+            host = returnUrl;
+            port = 0;
+        }
+
+        if (native_)
+            encodeNativeRequests(returnUrl);
+        else
+            encodeLoop4rRequests(host, port);
+        requestHost_ = host;
+        requestPort_ = port;
+
+        int i = 0;
+        for (auto control : { "loop_pos", "cycle_len", "loop_len" })
+        {
+            requests_.registerTempo[i] = OscPacket::encode("/sl/-3/register_auto_update", control, tempoUpdateMs, returnUrl, "/loop4r_leds/tempo");
+            requests_.unregisterTempo[i] = OscPacket::encode("/sl/-3/unregister_auto_update", control, returnUrl, "/loop4r_leds/tempo");
+            ++i;
+        }
+    }
+
+    // the answers come back to /loop4r_leds/sl/...; the loopers' states are
+    // polled every nativeUpdateMs, SooperLooper only sending them when they
+    // changed, and the selected loop is sent on every change
+    void encodeNativeRequests(const String& returnUrl)
+    {
+        requests_.heartbeatPing = OscPacket::encode("/ping", returnUrl, "/loop4r_leds/sl/heartbeat");
+        requests_.pingAckPing = OscPacket::encode("/ping", returnUrl, "/loop4r_leds/sl/pingack");
+        requests_.registerUpdates = OscPacket::encode("/sl/-1/register_auto_update", "state", (int32)nativeUpdateMs, returnUrl, "/loop4r_leds/sl/state");
+        requests_.unregisterUpdates = OscPacket::encode("/sl/-1/unregister_auto_update", "state", returnUrl, "/loop4r_leds/sl/state");
+        requests_.registerDisplay = OscPacket::encode("/register_update", "selected_loop_num", returnUrl, "/loop4r_leds/sl/selected");
+        requests_.unregisterDisplay = OscPacket::encode("/unregister_update", "selected_loop_num", returnUrl, "/loop4r_leds/sl/selected");
+        requests_.leds = OscPacket::encode("/sl/-1/get", "state", returnUrl, "/loop4r_leds/sl/state");
+        requests_.display = OscPacket::encode("/get", "selected_loop_num", returnUrl, "/loop4r_leds/sl/selected");
+        requests_.snapshot.reset();
+        nativeReturnUrl_ = returnUrl;
+    }
+
+    // the state of one loop, for a looper speaking SooperLooper's protocol
+    MemoryBlock encodeLoopStateRequest(int loop) const
+    {
+        return OscPacket::encode(OSCMessage(OSCAddressPattern("/sl/" + String(loop) + "/get"), String("state"),
+                                            nativeReturnUrl_, String("/loop4r_leds/sl/state")));
+    }
+
+    void encodeLoop4rRequests(const String& host, int port)
+    {
+        requests_.heartbeatPing = OscPacket::encode("/loop4r/ping", host, port, "/heartbeat");
+        requests_.pingAckPing = OscPacket::encode("/loop4r/ping", host, port, "/pingack");
+        requests_.registerUpdates = OscPacket::encode("/loop4r/register_auto_update", host, port);
+        requests_.unregisterUpdates = OscPacket::encode("/loop4r/unregister_auto_update", host, port);
+        requests_.leds = OscPacket::encode("/loop4r/leds", host, port, "/led");
+        requests_.display = OscPacket::encode("/loop4r/display", host, port, "/display");
+        requests_.snapshot = OscPacket::encode("/loop4r/snapshot", host, port, "/loop4r_leds/snapshot");
+        requests_.registerDisplay.reset();
+        requests_.unregisterDisplay.reset();
+    }
+
+    const Requests& getRequests() const
+    {
+        return requests_;
+    }
+
+    // /loop4r/register_auto_update for only these of its LEDs, each sent at
+    // most every intervalMs. A looper that doesn't know the filter ignores
+    // the arguments after the port and sends everything as before.
+    const MemoryBlock& encodeFilteredRegistration(const Array<int>& looperLeds, int intervalMs)
+    {
+        OSCMessage message("/loop4r/register_auto_update", requestHost_, requestPort_, (int32)jmax(0, intervalMs));
+        for (auto led : looperLeds)
+            message.addInt32(led);
+        requests_.registerFiltered = OscPacket::encode(message);
+        return requests_.registerFiltered;
+    }
+
+    // /loop4r/leds for only these of its LEDs, for a looper that sends a
+    // digest with its heartbeat
+    MemoryBlock encodeLedsRequest(const Array<int>& looperLeds) const
+    {
+        // SooperLooper has it for one loop or all of them
+        if (native_)
+            return requests_.leds;
+
+        OSCMessage message("/loop4r/leds", requestHost_, requestPort_, (String) "/led");
+        for (auto led : looperLeds)
+            message.addInt32(led);
+        return OscPacket::encode(message);
+    }
+
+    // The numbers on its /led messages taken as one count across all its
+    // LEDs: a jump forward means updates went missing, unless they turn up
+    // late. Only numbers of updates that were applied are noted.
+    void noteSequence(uint32 sequence)
+    {
+        if (! sequenceSeen_)
+        {
+            lastSequence_ = sequence;
+            sequenceSeen_ = true;
+            return;
+        }
+
+        uint32 ahead = sequence - lastSequence_;
+        if (ahead == 0)
+            return;
+
+        if (ahead >= 0x80000000u)
+        {
+            if (missingUpdates_ > 0)
+                --missingUpdates_;
+            return;
+        }
+
+        // a long jump is as bad as any other, count it as a full refetch
+        missingUpdates_ = jmin(missingUpdates_ + (int)jmin(ahead - 1, (uint32)maxMissingUpdates), maxMissingUpdates);
+        lastSequence_ = sequence;
+    }
+
+    int getMissingUpdates() const       { return missingUpdates_; }
+
+    void forgetSequence()
+    {
+        sequenceSeen_ = false;
+        missingUpdates_ = 0;
+    }
+
+    // the last number noted, false if none was; for handing over to the
+    // next instance, which carries on counting from it
+    bool getLastSequence(uint32& sequence) const
+    {
+        sequence = lastSequence_;
+        return sequenceSeen_;
+    }
+
+    void restoreSequence(uint32 sequence)
+    {
+        lastSequence_ = sequence;
+        sequenceSeen_ = true;
+    }
+
+    // at most one repair a second, so a looper whose digest never agrees
+    // with ours isn't asked for its LEDs on every heartbeat
+    bool shouldRepair(double nowMs)
+    {
+        if (nowMs - lastRepairMs_ < 1000.0)
+            return false;
+
+        lastRepairMs_ = nowMs;
+        missingUpdates_ = 0;
+        return true;
+    }
+
+    // what the looper told us about itself in its last /pingack or /heartbeat
+    int getEngineId() const             { return engineId_; }
+    void setEngineId(int engineId)      { engineId_ = engineId; }
+    // the same every heartbeat, so only copied when they change
+    void setHostUrl(StringRef url)      { if (hostUrl_ != url) hostUrl_ = url; }
+    const String& getHostUrl() const    { return hostUrl_; }
+    void setVersion(StringRef v)        { if (version_ != v) version_ = v; }
+    bool isSnapshotSupported() const    { return snapshotSupported_; }
+    void setSnapshotSupported(bool s)   { snapshotSupported_ = s; }
+
+    // when we last asked it for all of its state, 0 once its display, which
+    // comes last, has answered
+    double getResyncStartMs() const     { return resyncStartMs_; }
+    void setResyncStartMs(double ms)    { resyncStartMs_ = ms; }
+
+    int getLedCount() const             { return ledCount_; }
+
+    // as many as fit below capacity from firstLed on
+    void setLedCount(int count, int capacity)
+    {
+        ledCount_ = jlimit(0, jmax(0, capacity - firstLed_), count);
+    }
+
+    // the index in the bridge's LED space of one of the looper's LEDs, or -1
+    int ledIndexFor(int looperLed) const
+    {
+        return isPositiveAndBelow(looperLed, ledCount_) ? firstLed_ + looperLed : -1;
+    }
+
+    // one past the last index its LEDs take up
+    int getEndLed() const
+    {
+        return firstLed_ + ledCount_;
+    }
+
+    HeartbeatMonitor& getHeartbeat()    { return heartbeat_; }
+    const HeartbeatMonitor& getHeartbeat() const { return heartbeat_; }
+
+    // greeting it and fetching its state, with stateLock_ held
+    SyncWorkflow& getSync()             { return sync_; }
+    const SyncWorkflow& getSync() const { return sync_; }
+
+    // from the time tags on its heartbeats, for dating its bundles
+    ClockOffset& getClockOffset()       { return clockOffset_; }
+    const ClockOffset& getClockOffset() const { return clockOffset_; }
+
+private:
+    String host_;
+    int sendPort_;
+    int receivePort_;
+    String sendPath_;
+    String receivePath_;
+    int firstLed_;
+    OscOutput sender_;
+    std::unique_ptr<OscStream> stream_;
+    int streamPort_ = 0;
+    Requests requests_;
+    String requestHost_;
+    String nativeReturnUrl_;
+    int requestPort_ = 0;
+
+    int engineId_ = 0;
+    int ledCount_ = 0;
+    String hostUrl_;
+    String version_;
+    bool snapshotSupported_ = false;
+    double resyncStartMs_ = 0.0;
+    bool native_ = false;
+    LooperMirror mirror_;
+    static const int nativeUpdateMs = 10;
+    HeartbeatMonitor heartbeat_;
+    SyncWorkflow sync_;
+    MemoryBlock registered_[numRegistrations];
+    int64 registrationsSkipped_ = 0;
+    ClockOffset clockOffset_;
+
+    static const int maxMissingUpdates = 1024;
+    uint32 lastSequence_ = 0;
+    bool sequenceSeen_ = false;
+    int missingUpdates_ = 0;
+    double lastRepairMs_ = -1000.0;
+};
@@ -0,0 +1,160 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// How a loop's LED shows each of SooperLooper's loop states, for the loop
+// that is selected and for the others. The looks are numbered as the
+// application's LedStates.
+class LoopRules
+{
+public:
+    enum Look
+    {
+        Dark,
+        Lit,
+        Blink,
+        FastBlink
+    };
+
+    // SooperLooper's state control, -1 unknown up to 20 off and muted
+    static const int minState = -1;
+    static const int maxState = 20;
+
+    // lit while it plays, blinking fast while something is recorded into
+    // it and slowly while it waits to start or stop, or is muted or paused
+    LoopRules()
+    {
+        for (int state = minState; state <= maxState; ++state)
+            set(state, Dark, Dark);
+        for (int state : { 4, 9, 11, 12 })             // playing, delay, scratching, one shot
+            set(state, Lit, Lit);
+        for (int state : { 2, 5, 6, 7, 8, 13 })        // recording, overdubbing, multiplying, inserting, replacing, substitute
+            set(state, FastBlink, FastBlink);
+        for (int state : { 1, 3, 10, 14 })             // waiting to start or stop, muted, paused
+            set(state, Blink, Blink);
+    }
+
+    bool set(int state, Look look, Look selectedLook)
+    {
+        if (state < minState || state > maxState)
+            return false;
+
+        rules_[state - minState] = { (uint8)look, (uint8)selectedLook };
+        return true;
+    }
+
+    Look get(int state, bool selected) const
+    {
+        if (state < minState || state > maxState)
+            return Dark;
+
+        const auto& rule = rules_[state - minState];
+        return (Look)(selected ? rule.selected : rule.normal);
+    }
+
+    // dark, lit, blink or fast
+    static bool parseLook(const String& name, Look& look)
+    {
+        static const char* const names[] = { "dark", "lit", "blink", "fast" };
+        for (int i = 0; i < numElementsInArray(names); ++i)
+        {
+            if (name.equalsIgnoreCase(names[i]))
+            {
+                look = (Look)i;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    struct Rule
+    {
+        uint8 normal;
+        uint8 selected;
+    };
+
+    Rule rules_[maxState - minState + 1];
+};
+
+//==============================================================================
+// What the bridge knows of a looper speaking SooperLooper's own protocol:
+// the state of each loop and which loop is selected, from which its LEDs are
+// rendered here with the rules. The cycle position is TempoSync's, which
+// blinking follows when tempo synced. Guarded by the application's
+// stateLock_ like the LEDs.
+class LooperMirror
+{
+public:
+    static const int maxLoops = 128;
+
+    LooperMirror()
+    {
+        reset();
+    }
+
+    // all loops unknown, none selected
+    void reset()
+    {
+        for (auto& state : states_)
+            state = -1;
+        selected_ = -1;
+    }
+
+    // false if the loop is out of range or already was in the state
+    bool setState(int loop, int state)
+    {
+        if (! isPositiveAndBelow(loop, maxLoops) || states_[loop] == state)
+            return false;
+
+        states_[loop] = (int8)jlimit(-128, 127, state);
+        return true;
+    }
+
+    int getState(int loop) const
+    {
+        return isPositiveAndBelow(loop, maxLoops) ? states_[loop] : -1;
+    }
+
+    // returns the loop that was selected before
+    int setSelected(int loop)
+    {
+        const int previous = selected_;
+        selected_ = loop;
+        return previous;
+    }
+
+    int getSelected() const
+    {
+        return selected_;
+    }
+
+    LoopRules::Look render(const LoopRules& rules, int loop) const
+    {
+        return rules.get(getState(loop), loop == selected_);
+    }
+
+private:
+    int8 states_[maxLoops];
+    int selected_ = -1;
+};
@@ -31,6 +31,68 @@
 #include <alsa/asoundlib.h>
 #include <sstream>
 
+#include "BoardOutput.h"
+#include "BlinkEngine.h"
+#include "TempoSync.h"
+#include "DisplayEngine.h"
+#include "PedalInput.h"
+#include "LedMulticast.h"
+#include "LedStrip.h"
+#include "LedAnimation.h"
+#include "GpioStatus.h"
+#include "ThreadCpu.h"
+#include "SystemdNotifier.h"
+#include "StartupProfile.h"
+#include "MemoryLock.h"
+#include "AsyncLog.h"
+#include "OscInput.h"
+#include "OscOutput.h"
+#include "BundleScheduler.h"
+#include "LatencyHistogram.h"
+#include "OscCapture.h"
+#include "SessionFile.h"
+#include "CommandInput.h"
+#include "CommandNameTable.h"
+#include "LedStateCache.h"
+#include "EngineFrameCache.h"
+#include "LedStateExport.h"
+#include "Benchmark.h"
+#include "LoadGenerator.h"
+#include "HeartbeatMonitor.h"
+#include "Reconnector.h"
+#include "HotplugMonitor.h"
+#include "LooperEngine.h"
+#include "EventLoop.h"
+#include "ThreadTuning.h"
+#include "PacketQueue.h"
+#include "OscAddressTable.h"
+#include "OscSchema.h"
+#include "PreciseTimers.h"
+#include "LoadShedder.h"
+#include "MicrobatchController.h"
+#include "SignalWatcher.h"
+#include "LoopClock.h"
+#include "SoakReport.h"
+#include "BlinkJitter.h"
+#include "MidiLoopback.h"
+#include "LedCore.h"
+#include "OutputCalibration.h"
+#include "MetricsExporter.h"
+#include "TraceSpans.h"
+#include "HeadlessDispatcher.h"
+#include "BackgroundQueue.h"
+#include "AtomicLedStates.h"
+#include "DecodeArena.h"
+#include "TransportBenchmark.h"
+#include "OscStressTest.h"
+#include "ScaleBenchmark.h"
+#include "StatCounters.h"
+#include "Handoff.h"
+#include "ArtNetOutput.h"
+#include "RecoveryMeter.h"
+#include "CapacityReport.h"
+#include "FrameFanout.h"
+
 
 //==============================================================================
 enum CommandIndex
@@ -40,7 +102,102 @@ enum CommandIndex
     DEVICE_OUT,
     CHANNEL,
     OSC_IN,
-    OSC_OUT
+    OSC_OUT,
+    RUNNING_STATUS,
+    RESYNC,
+    WRITER_THREAD,
+    NON_BLOCKING,
+    BLINK_PERIODS,
+    BLINK_SYNC,
+    LOG_LEVEL,
+    REALTIME_OSC,
+    RECV_BATCH,
+    COALESCE_WINDOW,
+    RECORD_OSC,
+    REPLAY_OSC,
+    LOAD_GENERATOR,
+    LOAD_MIX,
+    LOAD_BURST,
+    LOAD_BAD,
+    BULK_FRAME,
+    HEARTBEAT,
+    DEVICE_ADD,
+    ENGINE_ADD,
+    LOOPER_HOST,
+    RECV_BUFFER,
+    PACKET_SIZE,
+    KERNEL_TIMESTAMPS,
+    OSC_TOS,
+    BUSY_POLL,
+    EVENT_LOOP,
+    CPU_AFFINITY,
+    RT_PRIORITY,
+    COMPILE,
+    SCHEDULED_MIDI,
+    LED_CACHE,
+    SHM_EXPORT,
+    FLIGHT_RECORDER,
+    FLIGHT_DUMP,
+    BENCHMARK,
+    DISPLAY_CONTENT,
+    DIGIT_CONTROLLERS,
+    WIRE_PACING,
+    PEDAL_INPUT,
+    PEDAL_MAP,
+    PREDICT_LED,
+    LED_MULTICAST,
+    MEMORY_LOCK,
+    TICKLESS,
+    BLINK_ALIGN,
+    SUBSCRIBE,
+    LOAD_SHED,
+    SIMULATED_CLOCK,
+    MIDI_RECORD,
+    GOLDEN_COMPARE,
+    SOAK_REPORT,
+    MIDI_LOOPBACK,
+    STATSD_EXPORT,
+    PROMETHEUS_EXPORT,
+    TRACE_SPANS,
+    PIPELINE,
+    HEADLESS_DISPATCH,
+    IO_URING,
+    RECEIVE_SPIN,
+    RECEIVER_SHARDS,
+    LED_CONTROLLERS,
+    LED_MAP,
+    HEARTBEAT_LED_NUMBER,
+    BOARD_PROFILE,
+    LED_STRIP,
+    STRIP_COLOUR,
+    GPIO_STATUS,
+    BENCH_COUNTERS,
+    WATCHDOG_BUDGET,
+    BOOT_FRAME,
+    LED_SCENE,
+    LED_ANIMATION,
+    OSC_TCP,
+    CALIBRATE,
+    ADAPTIVE_WINDOW,
+    SL_NATIVE,
+    LOOP_RULE,
+    TRANSPORT_BENCH,
+    OSC_STRESS,
+    OSC_NONBLOCKING,
+    MIDI_BUFFER,
+    STALE_AGE,
+    SCALE_BENCH,
+    BENCH_REPEATS,
+    BENCH_BASELINE,
+    LOOP_PREFETCH,
+    DNS_REFRESH,
+    HANDOFF,
+    REQUEST_BUNDLE,
+    ART_NET,
+    ART_NET_COLOUR,
+    ART_NET_WASH,
+    CAPACITY_REPORT,
+    FANOUT_PACING
 };
 
 enum LedStates
@@ -59,45 +216,121 @@ static const int DOWN = 11;
 static const int TIMER_OFF = 0;
 static const int TIMER_FASTBLINK = 1;
 static const int TIMER_BLINK = 3;
+static const int TIMER_TICK_MS = 200;
+static const int TEMPO_SYNC_TICK_MS = 5;
+static const int RECONNECT_TICK_MS = 100;
+static const int HELD_LANES_RETRY_MS = 2;
+static const int PREDICTION_TIMEOUT_MS = 500;
+static const int RESYNC_TIMEOUT_MS = 2000;      // a resync whose display never came
+static const int HANDOFF_TIMEOUT_MS = 2000;     // for the instance handing over to answer
+static const int TRANSACTION_TIMEOUT_MS = 100;  // a /loop4r_leds/begin without its commit
+static const uint32 STALE_SEQUENCE_WINDOW = 1024;  // further back is the looper starting over
+static const int MULTICAST_FULL_MS = 1000;
+static const int DEFERRED_START_MS = 5000;      // without a first frame, start the rest anyway
+static const int MAX_DRAIN_BATCHES = 8;         // written before the queue is drained, if it never is
+// the fan-out sinks, as fpace names them
+static const char* const STRIP_SINK = "strip";
+static const char* const ART_NET_SINK = "artnet";
+// what the tick countdowns above amount to
+static const int DEFAULT_BLINK_MS = (TIMER_BLINK + 1) * TIMER_TICK_MS;
+static const int DEFAULT_FASTBLINK_MS = (TIMER_FASTBLINK + 1) * TIMER_TICK_MS;
 
+// an entry in the command table, never copied once added
 struct ApplicationCommand
 {
-    static ApplicationCommand Dummy()
+    String param_;
+    String altParam_;
+    CommandIndex command_;
+    int expectedOptions_;
+    String optionsDescription_;
+    String commandDescription_;
+};
+
+// a command being parsed or run: which entry it is and its options so far,
+// reused from one command to the next
+struct CommandCall
+{
+    void start(int index, const ApplicationCommand& command)
     {
-	return {"", "", NONE, 0, "", ""};
+        index_ = index;
+        command_ = command.command_;
+        expectedOptions_ = command.expectedOptions_;
+        opts_.clearQuick();
     }
 
     void clear()
     {
-	param_ = "";
-	command_ = NONE;
-	expectedOptions_ = 0;
-	optionsDescription_ = "";
-	commandDescription_ = "";
-	opts_.clear();
+        index_ = -1;
+        command_ = NONE;
+        expectedOptions_ = 0;
+        opts_.clearQuick();
     }
 
-    String param_;
-    String altParam_;
-    CommandIndex command_;
-    int expectedOptions_;
-    String optionsDescription_;
-    String commandDescription_;
+    int index_ = -1;            // in the command table
+    CommandIndex command_ = NONE;
+    int expectedOptions_ = 0;   // still to come, negative for any number
     StringArray opts_;
 };
 
+// on/off and blink mode are kept in the application's LedState
 struct LED {
     int index_;
-    bool on_;
     int timer_;
     LedStates state_;
+    BlinkPhase blink_;        // whether it is lit while blinking
+    double nextToggleMs_ = 0; // when the blink engine toggles it next
+    bool scheduled_ = false;  // that toggle is already queued in the MIDI sink
+    uint32 generation_ = 0;   // the bridge's LED generation at its last change from the looper
+};
 
-    void clear()
+//==============================================================================
+// Every LED the pedalboard can address, allocated up front so that the looper
+// changing its loop count never allocates. Only the first size() are in use.
+class LedStore
+{
+public:
+    static const int capacity = 128;
+
+    // all LEDs dark, count of them in use
+    void reset(int count)
+    {
+        size_ = 0;
+        resize(count);
+    }
+
+    // LEDs coming into use start dark, the others keep their state
+    void resize(int count)
+    {
+        count = jlimit(0, capacity, count);
+        for (int i = size_; i < count; ++i)
+            leds_[i] = { i, TIMER_OFF, Dark, BlinkPhase() };
+        size_ = count;
+    }
+
+    // count LEDs from first dark again, as far as they are in use
+    void resetRange(int first, int count)
+    {
+        for (int i = jmax(0, first); i < jmin(size_, first + count); ++i)
+            leds_[i] = { i, TIMER_OFF, Dark, BlinkPhase() };
+    }
+
+    int size() const
+    {
+        return size_;
+    }
+
+    LED& getReference(int index)
     {
-	on_ = false;
-	timer_ = TIMER_OFF;
-	state_ = Dark;
+        jassert(isPositiveAndBelow(index, size_));
+        return leds_[index];
     }
+
+    LED* begin()    { return leds_; }
+    LED* end()      { return leds_ + size_; }
+
+private:
+    LED leds_[capacity];
+    int size_ = 0;
 };
 
 inline float sign(float value)
@@ -106,999 +339,5729 @@ inline float sign(float value)
 }
 
 class loop4r_ledsApplication  : public JUCEApplicationBase,
-public Timer, private OSCReceiver::Listener<OSCReceiver::MessageLoopCallback>
+private OscInput::Listener, private OscPacket::Handler
 {
 public:
     //==============================================================================
+    // the table the command line, programs and the help are read against,
+    // static so the help doesn't need the app
+    static void addCommands(Array<ApplicationCommand>& commands)
+    {
+        commands.add({"dout",  "device out",       DEVICE_OUT,         1, "name",           "Set the MIDI output: a rawmidi port, null, file:<path>, seq:<client:port> or jack:<port>"});
+        commands.add({"dadd",  "device add",       DEVICE_ADD,         2, "name first",     "Add another MIDI output showing the looper LEDs from first on its pedals"});
+        commands.add({"list",  "",                 LIST,               0, "",               "Lists the MIDI ports"});
+        commands.add({"ch",    "channel",          CHANNEL,            1, "number",         "Set MIDI channel (1-16) of the last added output and those after it, defaults to 1"});
+        commands.add({"oin",   "osc in",           OSC_IN,             1, "number",         "OSC receive port, or an AF_UNIX socket path to bind"});
+        commands.add({"oout",  "osc out",          OSC_OUT,            1, "number",         "OSC send port, or the AF_UNIX socket path the looper is bound to"});
+        commands.add({"eng",   "engine",           ENGINE_ADD,         3, "out in first",   "Also follow the looper on OSC port (or path) out, answering it on port (or path) in, with its LEDs from first on"});
+        commands.add({"host",  "looper host",      LOOPER_HOST,        1, "name",           "Host of the last added looper and those added after it, defaults to 127.0.0.1"});
+        commands.add({"rbuf",  "recv buffer",      RECV_BUFFER,        1, "bytes",          "Ask for an OSC socket receive buffer (SO_RCVBUF) of bytes"});
+        commands.add({"psize", "packet size",      PACKET_SIZE,        1, "bytes",          "Take OSC packets of up to bytes (default 4098), dropping and counting longer ones"});
+        commands.add({"kts",   "kernel stamps",    KERNEL_TIMESTAMPS,  0, "",               "Have the kernel timestamp OSC packets, measuring their wait in the socket as the socket latency"});
+        commands.add({"otcp",  "osc tcp",          OSC_TCP,            1, "port",           "Talk to the last added looper over one TCP connection to port instead, SLIP framed OSC 1.1 both ways"});
+        commands.add({"sl",    "sooperlooper",     SL_NATIVE,          0, "",               "Talk to the last added looper in SooperLooper's own OSC, turning its loop states into LEDs here"});
+        commands.add({"lrule", "loop rule",        LOOP_RULE,          3, "state look sel", "With sl, show SooperLooper's loop state as look (dark, lit, blink or fast), as sel for the selected loop"});
+        commands.add({"onb",   "osc nonblocking",  OSC_NONBLOCKING,    1, "on",             "Never wait for room in the socket buffer sending OSC to the loopers, hold up to 32 packets back and drop repeated requests first"});
+        commands.add({"tos",   "osc tos",          OSC_TOS,            1, "number",         "Mark the OSC sent to the loopers with this TOS byte, e.g. 184 for DSCP EF"});
+        commands.add({"bpoll", "busy poll",        BUSY_POLL,          1, "us",             "Busy poll the OSC sockets for up to us microseconds before sleeping (SO_BUSY_POLL)"});
+        commands.add({"spin",  "receive spin",     RECEIVE_SPIN,       2, "us core",        "Keep polling the OSC sockets for us microseconds after each packet before sleeping, on core (or any); not with el"});
+        commands.add({"rx",    "receivers",        RECEIVER_SHARDS,    1, "number",         "Share the loopers' sockets out between number OSC receiver threads, each on the next of the cpu cores; not with el"});
+        commands.add({"el",    "event loop",       EVENT_LOOP,         0, "",               "Handle OSC, MIDI and all timers inline on one thread waiting on them with epoll"});
+        commands.add({"cpu",   "cpu affinity",     CPU_AFFINITY,       1, "cores",          "Keep the bridge's threads on these cores, e.g. 3 or 2-3, away from JACK's; give it first"});
+        commands.add({"prio",  "rt priority",      RT_PRIORITY,        1, "priority",       "Run the OSC, event loop, blink and message threads with SCHED_FIFO at priority"});
+        commands.add({"sched", "scheduled midi",   SCHEDULED_MIDI,     0, "",               "Queue timed LED toggles for ports without a queue of their own, e.g. rawmidi, on a scheduler thread"});
+        commands.add({"rs",    "running status",   RUNNING_STATUS,     1, "number",         "Use MIDI running status, resending the status byte every number messages (0 disables)"});
+        commands.add({"sync",  "resync",           RESYNC,             0, "",               "Rewrite every LED and the display, even those the pedalboard should already show"});
+        commands.add({"wt",    "writer thread",    WRITER_THREAD,      1, "priority",       "Write MIDI from a separate thread, with SCHED_FIFO at priority if above 0"});
+        commands.add({"mbuf",  "midi buffer",      MIDI_BUFFER,        2, "bytes avail",    "Make the rawmidi kernel buffer this many bytes and wake a writer waiting for room once avail bytes are free, 0 keeps the driver's default"});
+        commands.add({"stale", "stale age",        STALE_AGE,          1, "ms",             "Drop MIDI bytes still on their way this long after the changes were received, writing the current state instead"});
+        commands.add({"nb",    "non blocking",     NON_BLOCKING,       0, "",               "Never block on the MIDI port, queue what it doesn't take and retry"});
+        commands.add({"blink", "blink periods",    BLINK_PERIODS,      2, "ms ms",          "Blink from a high resolution timer, toggling Blink and FastBlink LEDs every ms"});
+        commands.add({"bsync", "blink sync",       BLINK_SYNC,         1, "ms",             "Phase lock blinking to the loop cycle, ahead by ms of output latency"});
+        commands.add({"align", "blink align",      BLINK_ALIGN,        0, "",               "Blink all Blink and all FastBlink LEDs in one shared phase, whatever timer the looper sent"});
+        commands.add({"log",   "log level",        LOG_LEVEL,          1, "level",          "0 errors only, 1 connection changes (default), 2 every OSC message"});
+        commands.add({"rt",    "realtime osc",     REALTIME_OSC,       0, "",               "Handle OSC messages on the receiver thread instead of the message thread"});
+        commands.add({"uring", "io uring",         IO_URING,           0, "",               "With el, wait on an io_uring instead of epoll, the timers and wakeups read there too"});
+        commands.add({"hl",    "headless",         HEADLESS_DISPATCH,  0, "",               "Handle OSC messages on a dispatch thread woken through an eventfd instead of the JUCE message loop"});
+        commands.add({"rb",    "recv batch",       RECV_BATCH,         1, "number",         "Receive up to number queued OSC packets per wakeup and write their MIDI at once"});
+        commands.add({"cw",    "coalesce window",  COALESCE_WINDOW,    1, "ms",             "Hold LED changes from OSC for ms after the first, e.g. 0.5, writing only the latest state of each LED"});
+        commands.add({"shed",  "load shedding",    LOAD_SHED,          2, "rate ms",        "Over rate messages a second to an address, drop display updates and message logging; twice over, also hold LED changes for ms"});
+        commands.add({"acw",   "adaptive window",  ADAPTIVE_WINDOW,    2, "rate ms",        "Widen the coalescing window up to ms while OSC comes in over rate packets a second or MIDI is queued, and close it when traffic is sparse"});
+        commands.add({"rec",   "record osc",       RECORD_OSC,         1, "file",           "Record the OSC packets received to file"});
+        commands.add({"sim",   "simulated clock",  SIMULATED_CLOCK,    0, "",               "Replay on a simulated clock, jumping from packet to packet and firing the timers due in between (before play)"});
+        commands.add({"mrec",  "record midi",      MIDI_RECORD,        1, "file",           "Record the MIDI written to the boards to file, timed on the simulated clock with sim"});
+        commands.add({"gold",  "golden compare",   GOLDEN_COMPARE,     2, "golden run",     "Compare the MIDI recorded in run against golden, print JSON of the differences, then quit"});
+        commands.add({"mloop", "midi loopback",    MIDI_LOOPBACK,      3, "out in count",   "With out looped back to in, time count round trips of probe CC batches of each size, print JSON and quit"});
+        commands.add({"calib", "calibrate",        CALIBRATE,          4, "out in count file", "As mloop, then write the cw, pace and wt settings fitted to the round trips to file, a program to include, and quit"});
+        commands.add({"stsd",  "statsd",           STATSD_EXPORT,      3, "host port sec",  "Every sec seconds push the stats as statsd gauges to host:port"});
+        commands.add({"prom",  "prometheus",       PROMETHEUS_EXPORT,  2, "file sec",       "Every sec seconds write the stats to file for the Prometheus textfile collector"});
+        commands.add({"trace", "trace spans",      TRACE_SPANS,        1, "spans",          "Keep the last spans per thread of receiving, queueing, handling, coalescing and writing, for /loop4r_leds/trace s:file to write as Chrome trace JSON"});
+        commands.add({"pipe",  "pipeline",         PIPELINE,           1, "legacy",         "1 handles every OSC packet on its own through the generic decoder and writes it at once, as before batching, 0 batches (the default); also /loop4r_leds/pipeline i:legacy"});
+        commands.add({"soak",  "soak report",      SOAK_REPORT,        2, "file sec",       "Every sec seconds append memory, list sizes, queue depths and latencies to file, to find leaks and drift over long runs"});
+        commands.add({"play",  "replay osc",       REPLAY_OSC,         2, "file speed",     "Replay recorded OSC packets at speed times the original rate (0 for flat out), then quit"});
+        commands.add({"load",  "load generator",   LOAD_GENERATOR,     3, "port rate sec",  "Instead of driving LEDs, send rate looper messages a second to port for sec seconds, then quit"});
+        commands.add({"bench", "benchmark",        BENCHMARK,          1, "iterations",     "Instead of driving LEDs, time parsing, dispatch, LED updates and blinking on a null port, print JSON and quit"});
+        commands.add({"scene", "led scene",        LED_SCENE,          2, "n states",       "Scene n for /loop4r_leds/scene: a state 0-3 per LED from the first, - to leave one as it is"});
+        commands.add({"anim", "led animation",     LED_ANIMATION,      4, "n ms loops frames", "Animation n for /loop4r_leds/animation: comma separated frames of 1 lit, 0 dark or - live per LED from the first, ms apart, played loops times or until stopped for 0"});
+        commands.add({"bootf", "boot frame",       BOOT_FRAME,         2, "leds display",   "Until the first looper's state arrives, light the pedals in the hex mask leds (by pedal index) and show display, -1 for none"});
+        commands.add({"wdp99", "watchdog p99",     WATCHDOG_BUDGET,    1, "us",             "Under systemd, stop feeding its watchdog while the p99 latency is above us, 0 for no limit"});
+        commands.add({"tbnch", "transport bench",  TRANSPORT_BENCH,    1, "packets",        "Instead of driving LEDs, send packets LED changes over UDP loopback, AF_UNIX and an in-process queue into the core, print throughput and latency as JSON and quit"});
+        commands.add({"ostr",  "osc stress",       OSC_STRESS,         1, "ms",             "Instead of driving LEDs, send juce's OSCSender to its OSCReceiver over loopback at doubling rates for ms each, print the highest rate sustained per message size as JSON and quit"});
+        commands.add({"sbnch", "scale bench",      SCALE_BENCH,        2, "rate sec",       "Instead of driving LEDs, have 1 to 64 engines of 16 loops each send rate LED changes a second over UDP loopback into 8 boards for sec seconds per step, print throughput, latency, losses and CPU per core as JSON and quit"});
+        commands.add({"brep",  "bench repeats",    BENCH_REPEATS,      1, "runs",           "Before bench: time every benchmark runs times, report the median and 95th percentile"});
+        commands.add({"bbase", "bench baseline",   BENCH_BASELINE,     2, "file pct",       "Before bench: compare with the JSON of an earlier bench in file, failing any more than pct percent slower or allocating more"});
+        commands.add({"bperf", "bench counters",   BENCH_COUNTERS,     0, "",               "Before bench: also count cycles, instructions, branch and cache misses per iteration with perf_event_open"});
+        commands.add({"mix",   "load mix",         LOAD_MIX,           4, "l d h p",        "Relative weights of generated /led, /display, /heartbeat and /pingack (before load), defaults to 70 20 8 2"});
+        commands.add({"burst", "load burst",       LOAD_BURST,         1, "number",         "Send generated messages in bursts of number (before load)"});
+        commands.add({"bad",   "load bad",         LOAD_BAD,           1, "percent",        "Make percent of the generated packets malformed (before load)"});
+        commands.add({"cache", "led cache",        LED_CACHE,          1, "file",           "Keep the LED state in file and show it from there on the next start until the loopers answer (after eng)"});
+        commands.add({"shm",   "shared memory",    SHM_EXPORT,         1, "name",           "Publish the LEDs, display and loopers in the shared memory segment name for other tools"});
+        commands.add({"fr",    "flight recorder",  FLIGHT_RECORDER,    1, "file",           "Keep the ring of recent OSC and MIDI events in file, the previous one in file.prev"});
+        commands.add({"fdump", "flight dump",      FLIGHT_DUMP,        2, "ring out",       "Write the events in ring file as text to out, or those recorded so far for a ring of -"});
+        commands.add({"disp",  "display",          DISPLAY_CONTENT,    3, "what ms beats",  "Show loop, cycle, tempo (of beats per cycle) or count (seconds left in the loop), redrawn at most every ms"});
+        commands.add({"dcc",   "digit controllers",DIGIT_CONTROLLERS,  1, "hex",            "The display digits' controllers, most significant first, defaults to 7172 (113 114)"});
+        commands.add({"prof",  "board profile",    BOARD_PROFILE,      1, "name",           "How the last added board and those added after it show LEDs: eurekaprom (default), cc or note"});
+        commands.add({"lcc",   "led controllers",  LED_CONTROLLERS,    2, "on off",         "The controllers that turn an LED on and off on the last added board and later ones, defaults to 106 107"});
+        commands.add({"lmap",  "led map",          LED_MAP,            1, "hex",            "The LED number of each pedal from the first on the last added board and later ones, defaults to 0102030405060708090a0b"});
+        commands.add({"hbled", "heartbeat led",    HEARTBEAT_LED_NUMBER, 1, "number",       "The LED the heartbeat blinks on the last added board and later ones, defaults to 23"});
+        commands.add({"pace",  "wire pacing",      WIRE_PACING,        2, "percent burst",  "Write no faster than percent of the DIN line rate beyond burst bytes, holding back updates meanwhile"});
+        commands.add({"min",   "midi in",          PEDAL_INPUT,        1, "port",           "Read the pedals from rawmidi port and send their presses to the first looper, in place of loop4r_read"});
+        commands.add({"pedal", "pedal map",        PEDAL_MAP,          2, "cc command",     "Send a press of controller cc as /sl/-3/hit command, or to command itself if it is an OSC address"});
+        commands.add({"lpre",  "loop prefetch",    LOOP_PREFETCH,      1, "on",             "On UP and DOWN show the neighbouring loop's LEDs and number at once from what is known of it, until the looper answers"});
+        commands.add({"dns",   "dns refresh",      DNS_REFRESH,        1, "sec",            "Look the looper hosts up again every sec seconds, reconnecting if they moved, defaults to 30"});
+        commands.add({"rbun",  "request bundle",   REQUEST_BUNDLE,     1, "on",             "Send the registrations and requests that go out together as one OSC bundle instead of a datagram each"});
+        commands.add({"hand",  "handoff",          HANDOFF,            1, "path",           "Take over the LEDs, looper state and OSC sockets of the instance running with the same path, then hand over to the next one (on the command line, after eng, before dout)"});
+        commands.add({"pred",  "predict",          PREDICT_LED,        4, "cc led from to", "On a press of cc show the first looper's led in state to right away if it is in from (-1 for any), until its /led says otherwise"});
+        commands.add({"mcast", "multicast",        LED_MULTICAST,      3, "group port ttl", "Publish LED and display changes to the multicast group on port, ttl hops away"});
+        commands.add({"strip", "led strip",        LED_STRIP,          3, "device chip n",  "Show the LEDs on an apa102 or ws2812 strip of n pixels on a spidev device"});
+        commands.add({"scol",  "strip colour",     STRIP_COLOUR,       2, "state rrggbb",   "The strip colour for LEDs in state 0 (dark), 1 (lit), 2 (blinking) or 3 (blinking fast)"});
+        commands.add({"anet",  "art-net",          ART_NET,            3, "host univ fps",  "Show the LEDs on DMX fixtures over Art-Net, three channels each from universe univ on, sending what changed fps times a second"});
+        commands.add({"acol",  "art-net colour",   ART_NET_COLOUR,     2, "state rrggbb",   "The Art-Net colour for LEDs in state 0 (dark), 1 (lit), 2 (blinking) or 3 (blinking fast)"});
+        commands.add({"awash", "art-net wash",     ART_NET_WASH,       1, "channel",        "A wash fixture from this channel of the first universe, past the LEDs' 3 channels each, in the colour of the highest state of any looper's LEDs"});
+        commands.add({"fpace", "fan-out pacing",   FANOUT_PACING,      3, "sink ms depth",  "Show the strip or artnet at most every ms, with up to depth frames (1-8) queued; a negative depth shows every queued frame instead of only the newest"});
+        commands.add({"cap",   "--capacity-report", CAPACITY_REPORT,  2, "rate device",    "Instead of driving LEDs, benchmark this host and time writes to device (or null), print how many updates, loopers and boards it takes at rate LED updates a second per looper as JSON and quit"});
+        commands.add({"gpio",  "gpio status",      GPIO_STATUS,        4, "chip hb link err", "Status LEDs on lines of a gpiochip, -1 for none; the heartbeat then stays off the MIDI"});
+        commands.add({"mlock", "memory lock",      MEMORY_LOCK,        2, "stack_kb heap_kb", "Lock the bridge in RAM, with stack_kb thread stacks and heap_kb of heap faulted in first; give it first"});
+        commands.add({"subs",  "subscribe",        SUBSCRIBE,          1, "ms",             "Ask the loopers only for the LEDs a pedalboard shows, each at most every ms (0 for no limit)"});
+        commands.add({"idle",  "tickless",         TICKLESS,           0, "",               "Wake only when a blink, heartbeat or reconnect is due instead of ticking; give it before el"});
+        commands.add({"sx",    "sysex frame",      BULK_FRAME,         1, "hex",            "Resync all LEDs and the display in one SysEx message, starting with these hex bytes after F0"});
+        commands.add({"hb",    "heartbeat",        HEARTBEAT,          2, "ping timeout",   "Ping a silent looper every ping ms and reconnect after timeout ms of silence, defaults to 200 450"});
+        commands.add({"comp",  "compile",          COMPILE,            2, "in out",         "Compile the program file in into the binary session file out, which starts faster, then quit"});
+    }
+
+    // the help, the version and a list on its own are answered from main()
+    // before JUCE, the message manager or the app exist; false for a
+    // command line that needs them
+    static bool runWithoutJuce(const StringArray& params)
+    {
+        if (params.isEmpty() || params.contains("--help") || params.contains("-h"))
+        {
+            Array<ApplicationCommand> commands;
+            addCommands(commands);
+            printUsage(commands);
+        }
+        else if (params.contains("--version"))
+            printVersion();
+        else if (params.size() == 1 && params[0] == "list")
+            printDevices(RawMidiDevices::list(SND_RAWMIDI_STREAM_INPUT), RawMidiDevices::list(SND_RAWMIDI_STREAM_OUTPUT));
+        else
+            return false;
+        return true;
+    }
+
     loop4r_ledsApplication()
     {
-	commands_.add({"dout",  "device out",       DEVICE_OUT,         1, "name",           "Set the name of the MIDI output port"});
-	commands_.add({"list",  "",                 LIST,               0, "",               "Lists the MIDI ports"});
-	commands_.add({"ch",    "channel",          CHANNEL,            1, "number",         "Set MIDI channel for the commands (0-16), defaults to 0"});
-	commands_.add({"oin",   "osc in",           OSC_IN,             1, "number",         "OSC receive port"});
-	commands_.add({"oout",  "osc out",          OSC_OUT,            1, "number",         "OSC send port"});
+        addCommands(commands_);
+
+        // the looper set with oout and oin, whose LEDs come first
+        engines_.add(new LooperEngine(looperHost_, 9000, 9001, 0));
+        engines_.getFirst()->setResolver(&resolver_);
+        engines_.getFirst()->setLedCount(NUM_LED_PEDALS, LedStore::capacity);
 
-	for (auto i=0; i<10; i++)
-	{
-	    leds_.add({i, false, TIMER_OFF, Dark});
-	}
+        // a looper's host resolving or moving connects it again
+        resolver_.setChangedCallback([this] (const String& host)
+        {
+            {
+                const ScopedLock sl(resolvedLock_);
+                resolvedHosts_.addIfNotAlreadyThere(host);
+            }
+            armOscReconnect(1.0);
+        });
+        engine_ = engines_.getFirst();
+        leds_.reset(NUM_LED_PEDALS);
 
-	channel_ = 1;
-	useHexadecimalsByDefault_ = false;
-	oscSendPort_ = 9000;
-	oscReceivePort_ = 9001;
-	currentCommand_ = ApplicationCommand::Dummy();
+        channel_ = 1;
+        useHexadecimalsByDefault_ = false;
+        commandNames_.reserve(2 * commands_.size());
+        for (int i = 0; i < commands_.size(); ++i)
+        {
+            commandNames_.add(commands_.getReference(i).param_, i);
+            commandNames_.add(commands_.getReference(i).altParam_, i);
+        }
+
+        addOscRoute("/pingack",             &loop4r_ledsApplication::handlePingAckMessage);
+        ledRoute_ = addOscRoute("/led",     &loop4r_ledsApplication::handleLedMessage);
+        displayRoute_ = addOscRoute("/display", &loop4r_ledsApplication::handleDisplayMessage);
+        heartbeatRoute_ = addOscRoute("/heartbeat", &loop4r_ledsApplication::handleHeartbeatMessage);
+        addOscRoute("/loop4r_leds/resync",  &loop4r_ledsApplication::handleResyncMessage);
+        addOscRoute("/loop4r_leds/begin",   &loop4r_ledsApplication::handleBeginMessage);
+        addOscRoute("/loop4r_leds/commit",  &loop4r_ledsApplication::handleCommitMessage);
+        addOscRoute("/loop4r_leds/scene",   &loop4r_ledsApplication::handleSceneMessage);
+        addOscRoute("/loop4r_leds/animation", &loop4r_ledsApplication::handleAnimationMessage);
+        addOscRoute("/loop4r_leds/tempo",   &loop4r_ledsApplication::handleTempoMessage);
+        addOscRoute("/loop4r_leds/sl/pingack", &loop4r_ledsApplication::handleNativePingAckMessage);
+        addOscRoute("/loop4r_leds/sl/heartbeat", &loop4r_ledsApplication::handleNativeHeartbeatMessage);
+        addOscRoute("/loop4r_leds/sl/state", &loop4r_ledsApplication::handleNativeStateMessage);
+        addOscRoute("/loop4r_leds/sl/selected", &loop4r_ledsApplication::handleNativeSelectedMessage);
+        addOscRoute("/loop4r_leds/latency", &loop4r_ledsApplication::handleLatencyMessage);
+        addOscRoute("/loop4r_leds/stats",   &loop4r_ledsApplication::handleStatsMessage);
+        addOscRoute("/loop4r_leds/snapshot", &loop4r_ledsApplication::handleSnapshotMessage);
+        addOscRoute("/loop4r_leds/pedal",   &loop4r_ledsApplication::handlePedalMessage);
+        addOscRoute("/loop4r_leds/trace",   &loop4r_ledsApplication::handleTraceMessage);
+        addOscRoute("/loop4r_leds/pipeline", &loop4r_ledsApplication::handlePipelineMessage);
     }
 
     const String getApplicationName() override       { return ProjectInfo::projectName; }
     const String getApplicationVersion() override    { return ProjectInfo::versionString; }
-    bool moreThanOneInstanceAllowed() override       { return false; }
+    // instances handing over run side by side for a moment
+    bool moreThanOneInstanceAllowed() override       { return getCommandLineParameterArray().contains("hand"); }
 
     //==============================================================================
     void initialise (const String& commandLine) override
     {
-	StringArray cmdLineParams(getCommandLineParameterArray());
-	if (cmdLineParams.contains("--help") || cmdLineParams.contains("-h"))
-	{
-	    printUsage();
-	    systemRequestedQuit();
-	    return;
-	}
-	else if (cmdLineParams.contains("--version"))
-	{
-	    printVersion();
-	    systemRequestedQuit();
-	    return;
-	}
-
-	parseParameters(cmdLineParams);
-
-	if (cmdLineParams.contains("--"))
-	{
-	    while (std::cin)
-	    {
-		std::string line;
-		getline(std::cin, line);
-		StringArray params = parseLineAsParameters(line);
-		parseParameters(params);
-	    }
-	}
-
-	if (cmdLineParams.isEmpty())
-	{
-	    printUsage();
-	    systemRequestedQuit();
-	}
-	else
-	{
-	    startTimer(200);
-	}
-    }
-
-    void timerCallback() override
-    {
-	int err;
-	if (midiOutName_.isNotEmpty() && midiOut_ == nullptr)
-	{
-	    err = snd_rawmidi_open(NULL,&midiOut_, midiOutName_.toRawUTF8(), 0);
-	    if (err)
-	    {
-		std::cerr << "Couldn't open MIDI output port \"" << midiOutName_ << "\"" << std::endl;
-	    }
-	    else
-	    {
-		// initialize the pedal leds to off
-		for (auto i=0; i<NUM_LED_PEDALS; i++)
-		    ledOff(i);
-	    }
-	}
-
-
-	if (currentReceivePort_ < 0 || currentSendPort_ < 0) {
-	    if (tryToConnectOsc())
-	    {
-		std::cerr << "Connected to OSC ports " << (int)currentReceivePort_ << " (in) and " << (int) currentSendPort_ << " (out)" << std::endl;
-		heartbeat_ = 5;
-	    }
-	}
-	else
-	{
-	    // heartbeat
-	    if (heartbeat_ == 0)
-	    {
-		oscSender.send("/loop4r/ping", (String) "127.0.0.1", (int) currentReceivePort_, (String) "/heartbeat");
-	    }
-	    else if (heartbeat_ < -5) // give a second before we try reconnecting
-	    {
-		// we've lost heartbeat, try reconnecting
-		currentReceivePort_ = -1;
-		currentSendPort_ = -1;
-		if (tryToConnectOsc())
-		{
-		    std::cerr << "Reconnected to OSC ports " << (int)currentReceivePort_ << " (in) and " << (int) currentSendPort_ << " (out)" << std::endl;
-		    heartbeat_ = 5;
-		}
-	    }
-	    else
-	    {
-		--heartbeat_;
-	    }
-
-	    // handle pedal led state for blinking pedals
-	    for (auto&& led : leds_)
-	    {
-		if (led.state_ == Blink || led.state_ == FastBlink)
-		{
-		    if (led.timer_ <= 0)
-		    {
-			if (led.on_) {
-			    ledOff(led.index_);
-			}
-			else
-			{
-			    ledOn(led.index_);
-			}
-			led.timer_ = led.state_ == Blink ? TIMER_BLINK : TIMER_FASTBLINK;
-		    }
-		    else
-		    {
-			led.timer_--;
-		    }
-		}
-	    }
-	}
+        // main() has answered the help, the version and a lone list
+        startup_.mark(StartupProfile::Initialise);
+        StringArray cmdLineParams(getCommandLineParameterArray());
+
+        // before any thread starts, so only the watcher sees SIGHUP
+        signals_.block(SIGHUP);
+        log_.start();
+        configParameters_ = cmdLineParams;
+        configCalls_ = &appliedConfig_;
+        parseParameters(cmdLineParams);
+        configCalls_ = nullptr;
+        startup_.mark(StartupProfile::Parameters);
+        if (lockMemory_)
+            lockMemory();
+        signals_.start();
+
+        // the message thread handles OSC unless rt or el moved it elsewhere
+        if (threadTuning_.realtimePriority > 0 && ! threadTuning_.applyToCurrentThread())
+            log_.write(AsyncLog::Error, "Could not set SCHED_FIFO priority " + String(threadTuning_.realtimePriority) + " for the message thread");
+
+        // unless a receiver started it already
+        startDispatcher();
+
+        // housekeeping waits for the packets the message thread drains,
+        // not for the dispatch thread's
+        if (! headlessDispatch_)
+            background_.setUrgent([this] { return packetQueue_.getNumQueued() > 0; }, [this] { drainPacketQueue(); });
+
+        // the hotplug monitor and the exporters wait for the LEDs to be
+        // right, or DEFERRED_START_MS if they never are
+        if (eventLoopMode_ && ! loadGenerator_.isRunning())
+        {
+            if (! startEventLoop())
+                std::cerr << "Error: could not start the event loop" << std::endl;
+            else
+                deferUntilFirstFrame([this] { startHotplug(); });
+        }
+        else if (! loadGenerator_.isRunning())
+        {
+            if (! startTimers())
+                std::cerr << "Error: could not start the timers" << std::endl;
+
+            deferUntilFirstFrame([this] { startHotplug(); });
+        }
+
+        if (loadGenerator_.isRunning() || boards_.isEmpty() || ! reconnects_.isTimerArmed(reconnectTimers_.deferred))
+            runDeferredStarts();
+
+        if (pedalInput_ != nullptr)
+            startPedalInput();
+
+        if (simulatedReplay_.isNotEmpty() && ! replay_.start(File::getCurrentWorkingDirectory().getChildFile(simulatedReplay_), 0.0))
+        {
+            std::cerr << "Error: could not replay " << simulatedReplay_ << std::endl;
+            systemRequestedQuit();
+        }
+
+        // commands streamed in after -- are applied as they arrive, with the
+        // LEDs already running
+        if (cmdLineParams.contains("--"))
+            startCommandInput();
+
+        if (SystemdNotifier::isUnderSystemd() && ! cmdLineParams.isEmpty())
+        {
+            systemd_.notify("READY=1");
+            systemd_.startWatchdog([this] (String& problem) { return checkHealth(problem); });
+        }
     }
 
-    void shutdown() override
+    // for the systemd watchdog, on its thread: the OSC link is up, no MIDI
+    // stays queued without a byte going out, and the p99 latency since the
+    // last check is within wdp99's budget. A thread stuck in a write while
+    // holding stateLock_ fails it too.
+    bool checkHealth(String& problem)
     {
-	// Add your application's shutdown code here..
+        std::unique_ptr<ScopedTryLock> sl;
+        for (int attempt = 0; attempt < 10; ++attempt)
+        {
+            sl.reset(new ScopedTryLock(stateLock_));
+            if (sl->isLocked())
+                break;
+            Thread::sleep(10);
+        }
+        if (! sl->isLocked())
+        {
+            problem = "the LED state has been locked for over 100 ms, a MIDI write may be stuck";
+            return false;
+        }
+
+        if (! isOscConnected() || oscLost_.get() != 0)
+            problem = "the OSC link is down";
 
+        const double nowMs = clock_.nowMs();
+        watchdogBoards_.resize(boards_.size());
+        for (int i = 0; i < boards_.size(); ++i)
+        {
+            BoardOutput& board = *boards_.getUnchecked(i);
+            auto& last = watchdogBoards_.getReference(i);
+            const int64 written = board.getSink().getBytesWritten();
+            const bool pending = board.getWriterQueued() > 0 || board.getSink().hasPending() || board.getPacer().getQueuedBytes(nowMs) > 0;
+            if (pending && last.pending && written == last.written && problem.isEmpty())
+                problem = "MIDI to " + board.getName() + " isn't draining";
+            last = { written, pending };
+        }
 
+        const int64 p99Us = latency_.total.getPercentileSince(&watchdogTotal_, 0.99);
+        latency_.total.takeSnapshot(watchdogTotal_);
+        if (watchdogBudgetUs_ > 0 && p99Us > watchdogBudgetUs_ && problem.isEmpty())
+            problem = "p99 latency " + String(p99Us) + " us over the budget of " + String(watchdogBudgetUs_) + " us";
+
+        return problem.isEmpty();
     }
 
-    //==============================================================================
-    void systemRequestedQuit() override
+    // with el the event loop reads the pedals too and reopenMidi() brings the
+    // port back, otherwise its thread does both
+    void startPedalInput()
     {
-	// This is called when the app is being asked to quit: you can ignore this
-	// request and let the app carry on running, or call quit() to allow the app to close.
-	quit();
+        if (eventLoopMode_ && eventLoop_.isRunning())
+        {
+            if (! pedalInput_->open())
+                std::cerr << "Couldn't open MIDI input port \"" << pedalInput_->getName() << "\"" << std::endl;
+            else
+                watchPedalInput();
+            return;
+        }
+        pedalInput_->start();
     }
 
-    void anotherInstanceStarted (const String& commandLine) override
+    void watchPedalInput()
     {
-	// When another instance of the app is launched while this one is running,
-	// this method is invoked, and the commandLine parameter tells you what
-	// the other instance's command-line arguments were.
+        int handle = pedalInput_->getPollHandle();
+        eventLoop_.watch(handle, EPOLLIN, [this, handle]
+        {
+            if (! pedalInput_->readAvailable())
+                eventLoop_.unwatch(handle);
+        });
     }
-    void suspended() override {}
-    void resumed() override {}
-    void unhandledException(const std::exception*, const String&, int) override { jassertfalse; }
 
-private:
-    ApplicationCommand* findApplicationCommand(const String& param)
+    bool mapPedal(int controller, const String& command)
     {
-	for (auto&& cmd : commands_)
-	{
-	    if (cmd.param_.equalsIgnoreCase(param) || cmd.altParam_.equalsIgnoreCase(param))
-	    {
-		return &cmd;
-	    }
-	}
-	return nullptr;
+        if (! isPositiveAndBelow(controller, 128))
+            return false;
+
+        try
+        {
+            pedalMessages_[controller] = OscPacket::encode(command.startsWithChar('/') ? OSCMessage(OSCAddressPattern(command))
+                                                                                      : OSCMessage("/sl/-3/hit", command));
+        }
+        catch (const OSCFormatError&)
+        {
+            return false;
+        }
+        return true;
     }
 
-    StringArray parseLineAsParameters(const String& line)
+    // on the pedal thread or the event loop's; a controller going above 0 is
+    // a press, going back to 0 its release
+    void pedalReceived(uint8 status, uint8 data1, uint8 data2)
     {
-	StringArray parameters;
-	if (!line.startsWith("#"))
-	{
-	    StringArray tokens;
-	    tokens.addTokens(line, true);
-	    tokens.removeEmptyStrings(true);
-	    for (String token : tokens)
-	    {
-		parameters.add(token.trimCharactersAtStart("\"").trimCharactersAtEnd("\""));
-	    }
-	}
-	return parameters;
+        if ((status & 0xf0) != MIDI_CMD_CONTROL || data2 == 0)
+            return;
+
+        const ScopedLock sl(stateLock_);
+        const MemoryBlock& message = pedalMessages_[data1 & 0x7f];
+        if (message.getSize() == 0 || ! isOscConnected())
+            return;
+
+        LOOP4R_PROBE2(pedal, data1, data2);
+        auto* engine = engines_.getFirst();
+        engine->queue(message);
+        engine->sendQueued();
+        predictPress(data1 & 0x7f);
     }
 
-    void handleVarArgCommand()
+    // /loop4r_leds/pedal i:cc from loop4r_read, which sent the press itself
+    void handlePedalMessage(const OscMessageView& message)
     {
-	if (currentCommand_.expectedOptions_ < 0)
-	{
-	    executeCommand(currentCommand_);
-	}
+        if (message.size() < 1 || ! message[0].isInt32())
+        {
+            reportBadMessage("unrecognized format for pedal message.");
+            return;
+        }
+        predictPress(message[0].getInt32() & 0x7f);
     }
 
-    void parseParameters(StringArray& parameters)
+    // shows what the looper is expected to answer a press with before it
+    // does, remembering what was shown so that no answer in time takes the
+    // guess back
+    void predictPress(int controller)
     {
-	for (String param : parameters)
-	{
-	    if (param == "--") continue;
-
-	    ApplicationCommand* cmd = findApplicationCommand(param);
-	    if (cmd)
-	    {
-		handleVarArgCommand();
-
-		currentCommand_ = *cmd;
-	    }
-	    else if (currentCommand_.command_ == NONE)
-	    {
-		File file = File::getCurrentWorkingDirectory().getChildFile(param);
-		if (file.existsAsFile())
-		{
-		    parseFile(file);
-		}
-	    }
-	    else if (currentCommand_.expectedOptions_ != 0)
-	    {
-		currentCommand_.opts_.add(param);
-		currentCommand_.expectedOptions_ -= 1;
-	    }
-
-	    // handle fixed arg commands
-	    if (currentCommand_.expectedOptions_ == 0)
-	    {
-		executeCommand(currentCommand_);
-	    }
-	}
-
-	handleVarArgCommand();
+        auto* engine = engines_.getFirst();
+        double nowMs = clock_.nowMs();
+        bool predicted = predictSelection(*engine, controller, nowMs);
+        for (auto& prediction : predictions_)
+        {
+            int ledIndex = engine->ledIndexFor(prediction.led);
+            if (prediction.controller != controller || ! isPositiveAndBelow(ledIndex, leds_.size()))
+                continue;
+
+            LED& led = leds_.getReference(ledIndex);
+            if (prediction.from >= 0 && prediction.from != led.state_)
+                continue;
+
+            auto& pending = predicted_[ledIndex];
+            if (pending.untilMs == 0.0)
+            {
+                pending.previous = led.state_;
+                pending.previousOn = ledState_.isOn(ledNumber(ledIndex));
+            }
+            pending.state = (LedStates)prediction.to;
+            pending.untilMs = nowMs + PREDICTION_TIMEOUT_MS;
+            armHeartbeat(pending.untilMs, nowMs);
+            applyLedState(ledIndex, prediction.to != Dark, 0, prediction.to);
+            predicted = true;
+            break;
+        }
+
+        if (predicted)
+            flushMidi();
     }
 
-    void parseFile(File file)
+    // UP and DOWN select the neighbouring loop, shown at once from what we
+    // have of it: the mirror's states for a looper speaking SooperLooper's
+    // protocol, otherwise the LEDs as they were when that loop was last
+    // selected. Only for a loop known to exist; the looper's answer then
+    // settles it like any other guess.
+    bool predictSelection(LooperEngine& engine, int controller, double nowMs)
     {
-	StringArray parameters;
+        const int pedal = PedalMap::pedalIndex(controller);
+        if (! loopPrefetch_ || (pedal != UP && pedal != DOWN) || selectedLoop_ <= 0 || selectionGuess_.untilMs != 0.0)
+            return false;
+
+        const int current = selectedLoop_ - 1;
+        const int target = current + (pedal == UP ? 1 : -1);
+        if (target < 0)
+            return false;
+
+        if (engine.isNative())
+        {
+            if (target >= engine.getLedCount())
+                return false;
+
+            engine.getMirror().setSelected(target);
+            renderLoop(engine, current);
+            renderLoop(engine, target);
+        }
+        else
+        {
+            const auto* frame = loopFrames_.find(target, engine.getEngineId(), engine.getLedCount());
+            if (frame == nullptr)
+                return false;
+
+            storeLoopFrame(engine, current);
+            for (int i = 0; i < frame->ledCount; ++i)
+            {
+                int ledIndex = engine.ledIndexFor(i);
+                if (! isPositiveAndBelow(ledIndex, leds_.size()))
+                    break;
 
-	StringArray lines;
-	file.readLines(lines);
-	for (String line : lines)
-	{
-	    parameters.addArray(parseLineAsParameters(line));
-	}
+                LED& led = leds_.getReference(ledIndex);
+                const auto& cached = frame->leds[i];
+                const LedStates state = static_cast<LedStates>(jlimit(0, (int)FastBlink, (int)cached.state));
+                if (state == led.state_)
+                    continue;
 
-	parseParameters(parameters);
+                auto& pending = predicted_[ledIndex];
+                if (pending.untilMs == 0.0)
+                {
+                    pending.previous = led.state_;
+                    pending.previousOn = ledState_.isOn(ledNumber(ledIndex));
+                }
+                pending.state = state;
+                pending.untilMs = nowMs + PREDICTION_TIMEOUT_MS;
+                applyLedState(ledIndex, cached.on != 0, cached.timer, state);
+            }
+        }
+
+        selectionGuess_ = { nowMs + PREDICTION_TIMEOUT_MS, target, current };
+        armHeartbeat(selectionGuess_.untilMs, nowMs);
+        ++stats_[Stats::selectionGuesses];
+        selectedLoop_ = target + 1;
+        updateDisplay();
+        return true;
     }
 
-    bool checkChannel(const MidiMessage& msg, int channel)
+    // the LEDs while the loop is selected, to show when it is again
+    void storeLoopFrame(const LooperEngine& engine, int loop)
     {
-	return channel == 0 || msg.getChannel() == channel;
+        if (engine.getLedCount() == 0 || loop < 0)
+            return;
+
+        auto& frame = loopFrames_.store(loop, engine.getEngineId(), engine.getLedCount());
+        for (int i = 0; i < frame.ledCount; ++i)
+        {
+            int index = engine.ledIndexFor(i);
+            const LED* led = index >= 0 && index < leds_.size() ? &leds_.getReference(index) : nullptr;
+            frame.leds[i] = { (uint8)(led != nullptr && isLedOn(*led) ? 1 : 0), (uint8)(led != nullptr ? led->state_ : Dark),
+                              (int16)(led != nullptr ? jlimit(-32768, 32767, led->timer_) : 0) };
+        }
     }
 
-    String output7BitAsHex(int v)
+    // the looper's selection coming in, after its LEDs for the loop. The
+    // neighbours are fetched ahead of an UP or DOWN from a looper speaking
+    // SooperLooper's protocol, the others only have the LEDs to keep.
+    void selectionReceived(int loop)
     {
-	return String::toHexString(v).paddedLeft('0', 2).toUpperCase();
+        if (selectionGuess_.untilMs != 0.0)
+        {
+            if (loop == selectionGuess_.loop)
+                ++stats_[Stats::predictionHits];
+            else
+                ++stats_[Stats::mispredictions];
+            selectionGuess_.untilMs = 0.0;
+        }
+
+        if (! loopPrefetch_ || engine_ != engines_.getFirst())
+            return;
+
+        if (! engine_->isNative())
+        {
+            storeLoopFrame(*engine_, loop);
+        }
+        else if (loop != prefetchedFor_)
+        {
+            prefetchedFor_ = loop;
+            for (int neighbour : { loop - 1, loop + 1 })
+                if (isPositiveAndBelow(neighbour, engine_->getLedCount()))
+                    engine_->queue(engine_->encodeLoopStateRequest(neighbour));
+            engine_->sendQueued();
+        }
     }
 
-    String output7Bit(int v)
+    // the looper's /led settles a guess for its LED, right or wrong
+    void reconcilePrediction(int ledIndex, int state)
     {
-	if (useHexadecimalsByDefault_)
-	{
-	    return output7BitAsHex(v);
-	}
-	else
-	{
-	    return String(v);
-	}
+        auto& pending = predicted_[ledIndex];
+        if (pending.untilMs == 0.0)
+            return;
+
+        if (state == pending.state)
+            ++stats_[Stats::predictionHits];
+        else
+            ++stats_[Stats::mispredictions];
+        pending.untilMs = 0.0;
     }
 
-    String output14BitAsHex(int v)
+    // guesses the looper never answered are taken back
+    void expirePredictions(double nowMs)
     {
-	return String::toHexString(v).paddedLeft('0', 4).toUpperCase();
+        bool reverted = false;
+        for (int i = 0; i < leds_.size(); ++i)
+        {
+            auto& pending = predicted_[i];
+            if (pending.untilMs == 0.0 || pending.untilMs > nowMs)
+                continue;
+
+            ++stats_[Stats::mispredictions];
+            pending.untilMs = 0.0;
+            applyLedState(i, pending.previousOn, 0, pending.previous);
+            reverted = true;
+        }
+
+        // a selection never answered goes back, its loops' LEDs with it
+        if (selectionGuess_.untilMs != 0.0 && selectionGuess_.untilMs <= nowMs)
+        {
+            ++stats_[Stats::mispredictions];
+            selectionGuess_.untilMs = 0.0;
+            auto* engine = engines_.getFirst();
+            if (engine->isNative())
+            {
+                engine->getMirror().setSelected(selectionGuess_.previous);
+                renderLoop(*engine, selectionGuess_.loop);
+                renderLoop(*engine, selectionGuess_.previous);
+            }
+            selectedLoop_ = selectionGuess_.previous + 1;
+            updateDisplay();
+            reverted = true;
+        }
+
+        if (reverted)
+            flushMidi();
     }
 
-    String output14Bit(int v)
+    // the event loop reads and runs them inline, otherwise they are read on
+    // a thread of their own and run on the message thread like those given
+    // on the command line
+    void startCommandInput()
     {
-	if (useHexadecimalsByDefault_)
-	{
-	    return output14BitAsHex(v);
-	}
-	else
-	{
-	    return String(v);
-	}
+        if (eventLoopMode_ && eventLoop_.isRunning())
+        {
+            commandInput_.setNonBlocking();
+            if (eventLoop_.watch(commandInput_.getHandle(), EPOLLIN, [this]
+                {
+                    if (! commandInput_.readAvailable())
+                        eventLoop_.unwatch(commandInput_.getHandle());
+                }))
+            {
+                commandsInline_ = true;
+                return;
+            }
+        }
+        commandInput_.start();
     }
 
-    String outputChannel(const MidiMessage& msg)
+    void commandLineReceived(const String& line)
     {
-	return output7Bit(msg.getChannel()).paddedLeft(' ', 2);
+        if (commandsInline_)
+        {
+            runCommandLine(line);
+            return;
+        }
+        background_.post([this, line] { runCommandLine(line); });
     }
 
-    bool tryToConnectOsc() {
-	if (currentSendPort_ < 0) {
-	    if (oscSender.connect ("127.0.0.1", oscSendPort_)) {
-		std::cout << "Successfully connected to OSC Send port " << (int)oscSendPort_ << std::endl;
-		currentSendPort_ = oscSendPort_;
-	    }
-	}
-
-	if (currentReceivePort_ < 0) {
-	    connect();
-	}
-
-	if (currentSendPort_ > 0 && currentReceivePort_ > 0) {
-	    if (!pinged_)
-	    {
-		oscSender.send("/loop4r/ping", (String) "127.0.0.1", (int) currentReceivePort_, (String) "/pingack");
-	    }
-	    return true;
-	}
-
-	return false;
-    }
-
-    void executeCommand(ApplicationCommand& cmd)
-    {
-	switch (cmd.command_)
-	{
-	    case NONE:
-		break;
-	    case LIST:
-		std::cout << "MIDI Input devices:" << std::endl;
-		for (auto&& device : MidiInput::getDevices())
-		{
-		    std::cout << device << std::endl;
-		}
-		std::cout << "MIDI Output devices:" << std::endl;
-		for (auto&& device : MidiOutput::getDevices())
-		{
-		    std::cout << device << std::endl;
-		}
-		systemRequestedQuit();
-		break;
-	    case CHANNEL:
-		channel_ = asDecOrHex7BitValue(cmd.opts_[0]);
-		break;
-	    case DEVICE_OUT:
-	    {
-		int err;
-		midiOut_ = nullptr;
-		midiOutName_ = cmd.opts_[0];
-		err = snd_rawmidi_open(NULL,&midiOut_, midiOutName_.toRawUTF8(), 0);
-		if (err)
-		{
-		    std::cerr << "Couldn't open MIDI output port \"" << midiOutName_ << "\"" << std::endl;
-		}
-		else
-		{
-		    // initialize the pedal leds to off
-		    for (auto i=0; i<NUM_LED_PEDALS; i++)
-			ledOff(i);
-		}
-		break;
-	    }
-	    case OSC_OUT:
-		oscSendPort_ = asPortNumber(cmd.opts_[0]);
-		// specify here where to send OSC messages to: host URL and UDP port number
-		if (! oscSender.connect ("127.0.0.1", oscSendPort_))
-		    std::cerr << "Error: could not connect to UDP port " << cmd.opts_[0] << std::endl;
-		else
-		    currentSendPort_ = oscSendPort_;
-		break;
-	    case OSC_IN:
-		oscReceivePort_ = asPortNumber(cmd.opts_[0]);
-		if (!tryToConnectOsc())
-		    std::cerr << "Error: could not connect to UDP port " << cmd.opts_[0] << std::endl;
-		break;
-	    default:
-		filterCommands_.add(cmd);
-		break;
-	}
+    void runCommandLine(const String& line)
+    {
+        StringArray params = parseLineAsParameters(line);
+        liveInput_ = true;
+        parseParameters(params);
+        liveInput_ = false;
     }
 
-    uint16 asPortNumber(String value)
+    // for the threads on the way from an OSC packet to the MIDI port
+    void applyThreadTuning()
     {
-	return (uint16)limit16Bit(asDecOrHexIntValue(value));
+        if (threadTuning_.affinityMask != 0)
+            Thread::setCurrentThreadAffinityMask(threadTuning_.affinityMask);
+        oscReceiver.setThreadTuning(getReceiverTuning(0, 1));
+        eventLoop_.setThreadTuning(threadTuning_);
+        timers_.setThreadTuning(threadTuning_);
+        blinkEngine_.setThreadTuning(threadTuning_);
+        currentReceivePort_ = -1; // the timer reconnects with a tuned thread
+        if (headlessDispatcher_.isRunning())
+        {
+            headlessDispatcher_.stop();
+            headlessDispatcher_.start(threadTuning_);
+        }
     }
 
-    uint8 asDecOrHex7BitValue(String value)
+    // with hl the dispatcher is the queue's only consumer from the first
+    // packet on, so it starts before any receiver does
+    void startDispatcher()
     {
-	return (uint8)limit7Bit(asDecOrHexIntValue(value));
+        if (! headlessDispatch_ || realtimeOsc_.get() != 0 || headlessDispatcher_.isRunning()
+            || headlessDispatcher_.start(threadTuning_))
+            return;
+
+        std::cerr << "Error: could not start the OSC dispatch thread, using the message thread" << std::endl;
+        headlessDispatch_ = false;
+        drainMessage_->post();      // for whatever was queued meanwhile
     }
 
-    uint16 asDecOrHex14BitValue(String value)
+    // spin's core or else the cpu cores, with several receivers one core
+    // each from them
+    ThreadTuning getReceiverTuning(int receiver, int numReceivers) const
     {
-	return (uint16)limit14Bit(asDecOrHexIntValue(value));
+        ThreadTuning tuning = threadTuning_;
+        if (receiverAffinity_ != 0)
+            tuning.affinityMask = receiverAffinity_;
+        if (numReceivers > 1)
+            tuning.affinityMask = ThreadTuning::nthCore(tuning.affinityMask, receiver);
+        return tuning;
     }
 
-    int asDecOrHexIntValue(String value)
+    // the writers have their priority from wt
+    ThreadTuning getWriterTuning() const
     {
-	if (value.endsWithIgnoreCase("H"))
-	{
-	    return value.dropLastCharacters(1).getHexValue32();
-	}
-	else if (value.endsWithIgnoreCase("M"))
-	{
-	    return value.getIntValue();
-	}
-	else if (useHexadecimalsByDefault_)
-	{
-	    return value.getHexValue32();
-	}
-	else
-	{
-	    return value.getIntValue();
-	}
+        ThreadTuning tuning;
+        tuning.realtimePriority = writerPriority_;
+        tuning.affinityMask = threadTuning_.affinityMask;
+        return tuning;
     }
 
-    static uint8 limit7Bit(int value)
+    // the same timers on a thread of their own, without el
+    bool startTimers()
     {
-	return (uint8)jlimit(0, 0x7f, value);
+        loopTimers_.tick = timers_.addTimer([this] { toggleBlinkingLeds(); });
+        loopTimers_.heartbeat = timers_.addTimer([this] { heartbeatTick(); });
+        loopTimers_.coalesce = timers_.addTimer([this] { flushCoalesced(); });
+        loopTimers_.display = timers_.addTimer([this] { displayTick(); });
+        loopTimers_.soak = timers_.addTimer([this] { soakTick(); });
+        if (! timers_.start() || ! startReconnects(true))
+            return false;
+
+        startLoopTimers();
+        return true;
     }
 
-    static uint16 limit14Bit(int value)
+    // opening a MIDI port or resolving a looper's host may block for a
+    // while, so it happens on a thread of its own at normal priority where
+    // it can't hold up a blink or a heartbeat. With el the OSC sockets
+    // belong to the event loop, which reconnects them itself.
+    bool startReconnects(bool withOsc)
     {
-	return (uint16)jlimit(0, 0x3fff, value);
+        reconnectTimers_.midi = reconnects_.addTimer([this] { reopenMidi(clock_.nowMs()); });
+        reconnectTimers_.midiNow = reconnects_.addTimer([this] { reopenMidi(clock_.nowMs()); });
+        if (withOsc)
+            reconnectTimers_.osc = reconnects_.addTimer([this] { reconnectOsc(); });
+        reconnectTimers_.deferred = reconnects_.addTimer([this] { runDeferredStarts(); });
+        if (! reconnects_.start())
+            return false;
+
+        reconnects_.setTimer(reconnectTimers_.deferred, DEFERRED_START_MS, true);
+        reconnects_.setTimer(reconnectTimers_.midi, RECONNECT_TICK_MS, tickless_);
+        if (withOsc)
+            reconnects_.setTimer(reconnectTimers_.osc, RECONNECT_TICK_MS, tickless_);
+        return true;
     }
 
-    static uint16 limit16Bit(int value)
+    // With idle the tick, the heartbeat and the reconnects are one shots,
+    // armed again for when they have something to do next: the tick for the
+    // next LED to flip without the blink engine, the heartbeat for the next
+    // ping, timeout, guess to revert or multicast refresh, and the
+    // reconnects for the next attempt while something is disconnected.
+    void startLoopTimers()
     {
-	return (uint16)jlimit(0, 0xffff, value);
+        setLoopTimer(loopTimers_.tick, TIMER_TICK_MS, tickless_);
+        setLoopTimer(loopTimers_.heartbeat, tickless_ ? 1 : engines_.getFirst()->getHeartbeat().getPollIntervalMs(), tickless_);
+        if (displayEngine_.needsTempo())
+            setLoopTimer(loopTimers_.display, displayEngine_.getRefreshMs());
+        if (soak_.isOpen())
+            setLoopTimer(loopTimers_.soak, soak_.getIntervalMs());
     }
 
-    int pedalIndex(int controllerValue) {
-	switch (controllerValue) {
-	    case 1:
-	    case 2:
-	    case 3:
-	    case 4:
-	    case 5:
-	    case 6:
-	    case 7:
-	    case 8:
-	    case 9:
-		return controllerValue-1;
-	    case 0:
-		return 9;
-	    case 10:
-		return UP;
-	    case 11:
-		return DOWN;
-	    default:
-		return controllerValue;
-	}
+    // a one shot for dueMs unless it is due before anyway, with stateLock_
+    // held
+    void armLoopTimerBy(int id, double& armedDueMs, double dueMs, double nowMs)
+    {
+        if (! tickless_ || id < 0 || (isLoopTimerArmed(id) && armedDueMs <= dueMs))
+            return;
+
+        armedDueMs = dueMs;
+        setLoopTimer(id, jmax(1.0, dueMs - nowMs), true);
     }
 
-    uint8 ledNumber(int pedalIdx) {
-	switch (pedalIdx) {
-	    case 0:
-	    case 1:
-	    case 2:
-	    case 3:
-	    case 4:
-	    case 5:
-	    case 6:
-	    case 7:
-	    case 8:
-		return pedalIdx+1;
-	    case 9:
-		return 0;
-	    default:
-		return pedalIdx;
-	}
-    }
-
-    void ledOn(int pedalIdx) {
-	int wrote;
-	leds_.getReference(pedalIdx).on_ = true;
-	//sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, 106, ledNumber(pedalIdx)));
-	unsigned char ch[]={MIDI_CMD_CONTROL, 106, ledNumber(pedalIdx)};
-	wrote = snd_rawmidi_write(midiOut_, &ch, sizeof(ch));
-	if (wrote != sizeof(ch))
-	{
-	    std::cerr << "Could not write CC " << (int)106 << " " << (int)ledNumber(pedalIdx) << std::endl;
-	}
-    }
-
-    void ledOff(int pedalIdx) {
-	int wrote;
-	leds_.getReference(pedalIdx).on_ = false;
-	//sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, 107, ledNumber(pedalIdx)));
-	unsigned char ch[]={MIDI_CMD_CONTROL, 107, ledNumber(pedalIdx)};
-	wrote = snd_rawmidi_write(midiOut_, &ch, sizeof(ch));
-	if (wrote != sizeof(ch))
-	{
-	    std::cerr << "Could not write CC " << (int)107 << " " << (int)ledNumber(pedalIdx) << std::endl;
-	}
+    void armBlinkTick(double dueMs, double nowMs)
+    {
+        armLoopTimerBy(loopTimers_.tick, blinkTickDueMs_, dueMs, nowMs);
     }
 
-    void updateLeds()
+    void armHeartbeat(double dueMs, double nowMs)
     {
-	for (auto&& led : leds_)
-	{
-	    updateLedState(led);
-	}
+        armLoopTimerBy(loopTimers_.heartbeat, heartbeatDueMs_, dueMs, nowMs);
     }
 
-    void updateLedState(LED& led)
+    // the next heartbeat poll, guess to revert or multicast refresh
+    double getNextHeartbeatMs() const
     {
-	int wrote;
-	//sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, led.on_? 106 : 107, ledNumber(led.index_)));
-	unsigned char ch[]={MIDI_CMD_CONTROL,(unsigned char)(led.on_?106:107),ledNumber(led.index_)};
-	wrote = snd_rawmidi_write(midiOut_, &ch, sizeof(ch));
-	if (wrote != sizeof(ch))
-	{
-	    std::cerr << "Could not write CC " << (int)(led.on_?106:107) << " " << (int)ledNumber(led.index_) << std::endl;
-	}
-    }
-
-    void getCurrentState(int index)
-    {
-	String buf = "/loop4r";
-	oscSender.send(buf + "/leds",
-		       (String) "127.0.0.1",
-		       (int) currentReceivePort_,
-		       (String) "/led");
-
-	oscSender.send(buf + "/display",
-		       (String) "127.0.0.1",
-		       (int) currentReceivePort_,
-		       (String) "/display");
-    }
-
-    void registerAutoUpdates(bool unreg)
-    {
-	String buf = "/loop4r";
-	if (unreg)
-	{
-	    buf = buf + "/unregister_auto_update";
-	    oscSender.send(buf,
-			   (String) "127.0.0.1",
-			   (int) currentReceivePort_);
-	}
-	else{
-	    buf = buf + "/register_auto_update";
-	    oscSender.send(buf,
-			   (String) "127.0.0.1",
-			   (int) currentReceivePort_);
-	}
-    }
-
-    void handlePingAckMessage(const OSCMessage& message)
-    {
-	if (! message.isEmpty())
-	{
-	    int i = 0;
-	    for (OSCArgument* arg = message.begin(); arg != message.end(); ++arg)
-	    {
-		switch (i)
-		{
-		    case 0:
-			if (arg->isString())
-			    hostUrl_ = arg->getString();
-			break;
-		    case 1:
-			if (arg->isString())
-			    version_ = arg->getString();
-			break;
-		    case 2:
-			if (arg->isInt32())
-			    ledCount_ = arg->getInt32();
-			break;
-		    case 3:
-			if (arg->isInt32())
-			    engineId_ = arg->getInt32();
-			break;
-		    default:
-			std::cerr << "Unexpected number of arguments for /pingack" << std::endl;
-			return;
-		}
-		i++;
-	    }
-	    if (ledCount_ > 0)
-	    {
-		leds_.clear();
-		for (i = 0; i < ledCount_; i++)
-		{
-		    leds_.add({i, false, TIMER_OFF, Dark});
-		    registerAutoUpdates(false);
-		    getCurrentState(i);
-		    updateLeds();
-		}
-	    }
-	    heartbeat_ = 5; // we just heard from the looper
-	}
-    }
-
-    void handleHeartbeatMessage(const OSCMessage& message)
-    {
-	if (! message.isEmpty())
-	{
-	    int i = 0;
-	    int numleds = 0;
-	    int uid = engineId_;
-	    for (OSCArgument* arg = message.begin(); arg != message.end(); ++arg)
-	    {
-		switch (i)
-		{
-		    case 0:
-			if (arg->isString())
-			    hostUrl_ = arg->getString();
-			break;
-		    case 1:
-			if (arg->isString())
-			    version_ = arg->getString();
-			break;
-		    case 2:
-			if (arg->isInt32())
-			    numleds = arg->getInt32();
-			break;
-		    case 3:
-			if (arg->isInt32())
-			    uid = arg->getInt32();
-			break;
-		    default:
-			std::cerr << "Unexpected number of arguments for /heartbeat" << std::endl;
-		}
-		i++;
-	    }
-
-	    if (uid != engineId_) {
-		// looper changed on us, reinitialize
-		if (numleds > 0)
-		{
-		    ledCount_ = numleds;
-		    leds_.clear();
-		    for (i = 0; i < ledCount_; i++)
-		    {
-			leds_.add({i, false, TIMER_OFF, Dark});
-			registerAutoUpdates(false);
-			getCurrentState(i);
-			updateLeds();
-		    }
-		}
-	    }
-	    else
-	    {
-		// check loopcount
-		if (ledCount_ != numleds)
-		{
-		    for (auto i=ledCount_; i<numleds; i++)
-		    {
-			registerAutoUpdates(false);
-			leds_.add({i, false, TIMER_OFF, Dark});
-			updateLeds();
-		    }
-		    ledCount_ = numleds;
-		}
-	    }
-
-	    unsigned char ch[]={MIDI_CMD_CONTROL, (unsigned char)(heartbeatOn_ ? 107 : 106), (unsigned char)23};
-	    ssize_t wrote = snd_rawmidi_write(midiOut_, &ch, sizeof(ch));
-	    if (wrote != sizeof(ch))
-	    {
-	      std::cerr << "Could not write CC " << (int)(heartbeatOn_ ? 107 :106) << " " << 23 << std::endl;
-	    }
-	    heartbeatOn_ = !heartbeatOn_;
-	    heartbeat_ = 5; // we just heard from the looper
-	}
-    }
-
-    void handleLedMessage(const OSCMessage& message)
-    {
-	if (! message.isEmpty())
-	{
-	    OSCArgument* arg = message.begin();
-	    int ledIndex = -1;
-	    if (arg->isInt32())
-	    {
-		ledIndex = arg->getInt32();
-		++arg;
-	    }
-	    else {
-		std::cerr << "unrecognized format for led message." << std::endl;
-		return;
-	    }
-
-	    if (ledIndex < 0 || ledIndex >= ledCount_) {
-		return;
-	    }
-	    else
-	    {
-		LED& led = leds_.getReference(ledIndex);
-		if (arg->isInt32())
-		{
-		    led.on_ = (arg->getInt32() == 0 ? false : true);
-		    ++arg;
-
-		    if (arg->isInt32())
-		    {
-			led.timer_ = arg->getInt32();
-			++arg;
-
-			if (arg->isInt32())
-			{
-			    led.state_ = static_cast<LedStates>(arg->getInt32());
-
-			    updateLedState(led);
-			}
-			else {
-			    std::cerr << "unrecognized format for led message." << std::endl;
-			    return;
-			}
-		    }
-		    else {
-			std::cerr << "unrecognized format for led message." << std::endl;
-			return;
-		    }
-		}
-		else {
-		    std::cerr << "unrecognized format for led message." << std::endl;
-		    return;
-		}
-		heartbeat_ = 5; // we just heard from the looper
-	    }
-	}
-    }
-
-    void handleDisplayMessage(const OSCMessage& message)
-    {
-	if (! message.isEmpty())
-	{
-	    OSCArgument* arg = message.begin();
-	    int selectedLoop = -1;
-	    if (arg->isInt32())
-	    {
-		selectedLoop = arg->getInt32() + 1; // 1 based display!
-		++arg;
-	    }
-	    else {
-		std::cerr << "unrecognized format for display message." << std::endl;
-		return;
-	    }
-
-	    int wrote;
-	    if (selectedLoop / 10 > 0)
-	    {
-		unsigned char ch[]={MIDI_CMD_CONTROL, 113, (unsigned char)(selectedLoop / 10)};
-		wrote = snd_rawmidi_write(midiOut_, &ch, sizeof(ch));
-		if (wrote != sizeof(ch))
-		{
-		    std::cerr << "Could not write CC " << (int)113 << " " << (int)(selectedLoop / 10) << std::endl;
-		}
-		//sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, 113, (uint8)(selectedLoop / 10)));
-	    }
-	    else
-	    {
-		unsigned char ch[]={MIDI_CMD_CONTROL, 113, 0};
-		wrote = snd_rawmidi_write(midiOut_, &ch, sizeof(ch));
-		if (wrote != sizeof(ch))
-		{
-		    std::cerr << "Could not write CC " << (int)113 << " " << 0 << std::endl;
-		}
-		//sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, 113, (uint8)0));
-	    }
-
-	    unsigned char ch[]={MIDI_CMD_CONTROL, 114, (unsigned char)(selectedLoop % 10)};
-	    wrote = snd_rawmidi_write(midiOut_, &ch, sizeof(ch));
-	    if (wrote != sizeof(ch))
-	    {
-		std::cerr << "Could not write CC " << (int)113 << " " << (int)(selectedLoop % 10) << std::endl;
-	    }
-	    //sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, 114, (uint8)(selectedLoop % 10)));
-	}
-    }
-
-    void oscMessageReceived (const OSCMessage& message) override
-    {
-	if (!message.getAddressPattern().toString().startsWith("/heartbeat"))
-	{
-	    std::cout << "-" <<
-	    + "- osc message, address = '"
-	    + message.getAddressPattern().toString()
-	    + "', "
-	    + String (message.size())
-	    + " argument(s)" << std::endl;
-
-	    for (OSCArgument* arg = message.begin(); arg != message.end(); ++arg)
-	    {
-		String typeAsString;
-		String valueAsString;
-
-		if (arg->isFloat32())
-		{
-		    typeAsString = "float32";
-		    valueAsString = String (arg->getFloat32());
-		}
-		else if (arg->isInt32())
-		{
-		    typeAsString = "int32";
-		    valueAsString = String (arg->getInt32());
-		}
-		else if (arg->isString())
-		{
-		    typeAsString = "string";
-		    valueAsString = arg->getString();
-		}
-		else if (arg->isBlob())
-		{
-		    typeAsString = "blob";
-		    auto& blob = arg->getBlob();
-		    valueAsString = String::fromUTF8 ((const char*) blob.getData(), (int) blob.getSize());
-		}
-		else
-		{
-		    typeAsString = "(unknown)";
-		}
-
-		std::cout << "==- " + typeAsString.paddedRight(' ', 12) + valueAsString << std::endl;
-	    }
-	}
-
-	if (message.getAddressPattern().toString().startsWith("/pingack"))
-	{
-	    handlePingAckMessage(message);
-	}
-	else if (message.getAddressPattern().toString().startsWith("/led"))
-	{
-	    handleLedMessage(message);
-	}
-	else if (message.getAddressPattern().toString().startsWith("/display"))
-	{
-	    handleDisplayMessage(message);
-	}
-	else if (message.getAddressPattern().toString().startsWith("/heartbeat"))
-	{
-	    handleHeartbeatMessage(message);
-	}
-    }
-
-    void oscBundleReceived (const OSCBundle& bundle) override
+        double dueMs = std::numeric_limits<double>::max();
+        for (auto* engine : engines_)
+            dueMs = jmin(dueMs, jmin(engine->getHeartbeat().getNextPollMs(), engine->getSync().getNextPollMs()));
+        for (int i = 0; i < leds_.size(); ++i)
+            if (predicted_[i].untilMs != 0.0)
+                dueMs = jmin(dueMs, predicted_[i].untilMs);
+        if (selectionGuess_.untilMs != 0.0)
+            dueMs = jmin(dueMs, selectionGuess_.untilMs);
+        if (multicast_.isOpen())
+            dueMs = jmin(dueMs, multicastFullMs_ + MULTICAST_FULL_MS);
+        return dueMs;
+    }
+
+    void armOscReconnect(double delayMs)
     {
+        if (! tickless_)
+            return;
 
+        if (eventLoopMode_ && loopTimers_.reconnect >= 0)
+            eventLoop_.setTimer(loopTimers_.reconnect, jmax(1.0, delayMs), true);
+        else if (! eventLoopMode_ && reconnectTimers_.osc >= 0)
+            reconnects_.setTimer(reconnectTimers_.osc, jmax(1.0, delayMs), true);
     }
 
-    void connect()
+    // the timers live on the event loop with el, on their own thread otherwise
+    void setLoopTimer(int id, double intervalMs, bool oneShot = false)
     {
-	auto portToConnect = oscReceivePort_;
-
-	if (! isValidOscPort (portToConnect))
-	{
-	    handleInvalidPortNumberEntered();
-	    return;
-	}
-
-	if (oscReceiver.connect (portToConnect))
-	{
-	    currentReceivePort_ = portToConnect;
-	    oscReceiver.addListener (this);
-	    oscReceiver.registerFormatErrorHandler ([this] (const char* data, int dataSize)
-						    {
-							std::cerr << "- (" + String(dataSize) + "bytes with invalid format)" << std::endl;
-						    });
-	}
-	else
-	{
-	    handleConnectError (portToConnect);
-	}
+        if (eventLoopMode_)
+            eventLoop_.setTimer(id, intervalMs, oneShot);
+        else
+            timers_.setTimer(id, intervalMs, oneShot);
     }
 
-    void disconnect()
+    bool isLoopTimerArmed(int id) const
     {
-	if (oscReceiver.disconnect())
-	{
-	    currentReceivePort_ = -1;
-	    oscReceiver.removeListener (this);
-	}
-	else
-	{
-	    handleDisconnectError();
-	}
+        return eventLoopMode_ ? eventLoop_.isTimerArmed(id) : timers_.isTimerArmed(id);
     }
 
-    void handleConnectError (int failedPort)
+    // the timers, the blink engine and the OSC sockets on the event loop's
+    // thread instead of the timer, HighResolutionTimer and receiver threads;
+    // hotplug events and bundles dated later still come from threads of
+    // their own
+    bool startEventLoop()
     {
-	std::cerr << "Error: could not connect to port " + String (failedPort) << std::endl;
+        loopTimers_.tick = eventLoop_.addTimer([this] { toggleBlinkingLeds(); });
+        loopTimers_.heartbeat = eventLoop_.addTimer([this] { heartbeatTick(); });
+        loopTimers_.coalesce = eventLoop_.addTimer([this] { flushCoalesced(); });
+        loopTimers_.reconnect = eventLoop_.addTimer([this] { reconnectOsc(); });
+        loopTimers_.display = eventLoop_.addTimer([this] { displayTick(); });
+        loopTimers_.soak = eventLoop_.addTimer([this] { soakTick(); });
+        if (loopTimers_.tick < 0 || loopTimers_.heartbeat < 0 || loopTimers_.coalesce < 0
+            || loopTimers_.reconnect < 0 || loopTimers_.display < 0 || loopTimers_.soak < 0 || ! startReconnects(false))
+            return false;
+
+        eventLoop_.setTimer(loopTimers_.reconnect, RECONNECT_TICK_MS, tickless_);
+        startLoopTimers();
+        if (blinkEngine_.isRunning())
+        {
+            blinkEngine_.setExternallyDriven(true);
+            loopTimers_.blink = eventLoop_.addTimer([this] { blinkEngine_.tick(); });
+            eventLoop_.setTimer(loopTimers_.blink, blinkEngine_.getTickMs());
+        }
+        return eventLoop_.start();
     }
 
-    void handleDisconnectError()
+    void watchOscSockets()
     {
-	std::cerr << "An unknown error occured while trying to disconnect from UDP port." << std::endl;
+        auto handles = oscReceiver.getSocketHandles();
+        for (int source = 0; source < handles.size(); ++source)
+            eventLoop_.watch(handles[source], EPOLLIN, [this, source] { oscReceiver.readAvailable(source); });
     }
 
-    void handleInvalidPortNumberEntered()
+    void unwatchOscSockets()
     {
-	std::cout << "Error: you have entered an invalid UDP port number." << std::endl;
+        for (auto handle : oscReceiver.getSocketHandles())
+            eventLoop_.unwatch(handle);
     }
 
-    bool isConnected() const
+    // without stateLock_ while they run, their handlers wait for it
+    void stopReceivers()
     {
-	return currentReceivePort_ != -1;
+        unwatchOscSockets();
+        disconnectReceivers();
     }
 
-    bool isValidOscPort (int port) const
+    // a non-blocking port that held bytes back is retried as soon as it
+    // takes more rather than on the next flush
+    void watchPendingMidi()
     {
-	return port > 0 && port < 65536;
-    }
-
-    void printVersion()
-    {
-	std::cout << ProjectInfo::projectName << " v" << ProjectInfo::versionString << std::endl;
-	std::cout << "https://github.com/atinm/loop4r_control" << std::endl;
-    }
-
-    void printUsage()
-    {
-	printVersion();
-	std::cout << std::endl;
-	std::cout << "Usage: " << ProjectInfo::projectName << " [ commands ] [ programfile ] [ -- ]" << std::endl << std::endl
-	<< "Commands:" << std::endl;
-	for (auto&& cmd : commands_)
-	{
-	    std::cout << "  " << cmd.param_.paddedRight(' ', 5);
-	    if (cmd.optionsDescription_.isNotEmpty())
-	    {
-		std::cout << " " << cmd.optionsDescription_.paddedRight(' ', 13);
-	    }
-	    else
-	    {
-		std::cout << "              ";
-	    }
-	    std::cout << "  " << cmd.commandDescription_;
-	    std::cout << std::endl;
-	}
-	std::cout << "  -h  or  --help       Print Help (this message) and exit" << std::endl;
-	std::cout << "  --version            Print version information and exit" << std::endl;
-	std::cout << "  --                   Read commands from standard input until it's closed" << std::endl;
-	std::cout << std::endl;
-	std::cout << "Alternatively, you can use the following long versions of the commands:" << std::endl;
-	String line = " ";
-	for (auto&& cmd : commands_)
-	{
-	    if (cmd.altParam_.isNotEmpty())
-	    {
-		if (line.length() + cmd.altParam_.length() + 1 >= 80)
-		{
-		    std::cout << line << std::endl;
-		    line = " ";
-		}
-		line << " " << cmd.altParam_;
-	    }
-	}
-	std::cout << line << std::endl << std::endl;
-	std::cout << "By default, numbers are interpreted in the decimal system, this can be changed" << std::endl
-	<< "to hexadecimal by sending the \"hex\" command. Additionally, by suffixing a " << std::endl
-	<< "number with \"M\" or \"H\", it will be interpreted as a decimal or hexadecimal" << std::endl
-	<< "respectively." << std::endl;
-	std::cout << std::endl;
-	std::cout << "The MIDI device name doesn't have to be an exact match." << std::endl;
-	std::cout << "If " << getApplicationName() << " can't find the exact name that was specified, it will pick the" << std::endl
-	<< "first MIDI output port that contains the provided text, irrespective of case." << std::endl;
-	std::cout << std::endl;
-    }
-
-    OSCReceiver oscReceiver;
-    OSCSender oscSender;
+        for (auto* board : boards_)
+        {
+            int handle = board->getSink().getPollHandle();
+            if (handle < 0 || board->hasWriter() || ! board->getSink().hasPending())
+                continue;
 
-    int currentReceivePort_ = -1;
-    int currentSendPort_ = -1;
-    int channel_;
-    int oscSendPort_;
-    int oscReceivePort_;
-    int engineId_;
+            eventLoop_.watch(handle, EPOLLOUT, [this, board, handle]
+            {
+                const ScopedLock sl(stateLock_);
+                bool known = boards_.contains(board) && board->getSink().getPollHandle() == handle;
+                if (! known || board->getSink().writePending())
+                    eventLoop_.unwatch(handle);
+            });
+        }
+    }
 
-    Array<LED> leds_;
-    Array<ApplicationCommand> commands_;
-    Array<ApplicationCommand> filterCommands_;
+    // called on the timer thread, or the event loop's; reconnecting is left
+    // to reconnectOsc() and reopenMidi()
+    void toggleBlinkingLeds()
+    {
+        // the generation before the clock, see isChangedSince()
+        const uint32 generation = ledGeneration_.get();
+        double nowMs = clock_.nowMs();
+        double nextFlipMs = 0.0;
 
-    bool useHexadecimalsByDefault_;
+        // the link's state is the reconnect's, so only read with the lock
+        const ScopedLock sl(stateLock_);
+        if (isOscConnected() && ! blinkEngine_.isRunning())
+        {
+            // handle pedal led state for blinking pedals, unless the blink
+            // engine does it
+            nextFlipMs = updateBlinkingLeds(nowMs, generation);
+        }
+        flushBlinks();
+        if (nextFlipMs > 0.0)
+            armBlinkTick(nextFlipMs, nowMs);
+    }
 
-    String midiOutName_;
-    snd_rawmidi_t *midiOut_ = 0;
+    // lights or darkens each blinking LED as its phase has it at nowMs, all
+    // of them into the same batch; returns when the next of them flips, or
+    // 0 if none blinks. LEDs the looper changed after the tick read the
+    // generation are left alone, see isChangedSince().
+    double updateBlinkingLeds(double nowMs, uint32 generation)
+    {
+        // half a ms of slack for the timer waking up early
+        const double atMs = nowMs + 0.5;
+        double nextFlipMs = 0.0;
+        for (auto&& led : leds_)
+        {
+            if (led.state_ != Blink && led.state_ != FastBlink)
+                continue;
 
-    int ledCount_;
-    bool pinged_;
-    String hostUrl_;
-    String version_;
-    int heartbeat_;
-    bool heartbeatOn_ = false;
+            double halfPeriodMs = blinkEngine_.getHalfPeriodMs(led.state_ == FastBlink);
+            bool lit = led.blink_.isLit(halfPeriodMs, atMs);
+            if (isChangedSince(led, generation))
+            {
+                if (lit != isLedOn(led))
+                    ++stats_[Stats::blinkTogglesSuperseded];
+                nextFlipMs = nextFlipMs > 0.0 ? jmin(nextFlipMs, led.nextToggleMs_) : led.nextToggleMs_;
+                continue;
+            }
 
-    ApplicationCommand currentCommand_;
-    Time lastTime_;
-};
+            if (lit != isLedOn(led))
+            {
+                if (lit)
+                    ledOn(led.index_, LedShadow::BlinkLane);
+                else
+                    ledOff(led.index_, LedShadow::BlinkLane);
+                blinkJitter_.noteToggle(led.index_, halfPeriodMs);
+            }
 
-//==============================================================================
-// This macro generates the main() routine that launches the app.
-START_JUCE_APPLICATION (loop4r_ledsApplication)
+            led.nextToggleMs_ = led.blink_.getNextFlipMs(halfPeriodMs, atMs);
+            nextFlipMs = nextFlipMs > 0.0 ? jmin(nextFlipMs, led.nextToggleMs_) : led.nextToggleMs_;
+        }
+        return nextFlipMs;
+    }
+
+    // soak, a line of the report each interval. The allocations are only
+    // those made handling OSC, as they are counted per thread, and only
+    // with LOOP4R_ALLOCATION_COUNT.
+    void soakTick()
+    {
+        SoakReport::Sample sample;
+        sample.rssKb = MemoryLock::getStatusKb("VmRSS");
+        sample.heapKb = SoakReport::getHeapKb();
+        sample.bundlesPending = bundleScheduler_.getNumPending();
+        {
+            const ScopedLock sl(stateLock_);
+            sample.seconds = (clock_.nowMs() - soakStartMs_) / 1000.0;
+            sample.allocations = soakAllocations_;
+            sample.filterCommands = filterCommands_.size();
+            sample.predictions = predictions_.size();
+            sample.batchPeak = soakBatchPeak_;
+            for (auto* board : boards_)
+                sample.writerQueued += board->getWriterQueued();
+            sample.totalP50Us = latency_.total.getPercentileSince(&soakTotal_, 0.5);
+            sample.totalP99Us = latency_.total.getPercentileSince(&soakTotal_, 0.99);
+            sample.dispatchP99Us = latency_.dispatch.getPercentileSince(&soakDispatch_, 0.99);
+
+            soakAllocations_ = 0;
+            soakBatchPeak_ = 0;
+            latency_.total.takeSnapshot(soakTotal_);
+            latency_.dispatch.takeSnapshot(soakDispatch_);
+        }
+        soak_.write(sample);
+    }
+
+    // keeps an eye on the looper, leaving the reconnecting to reconnectOsc()
+    // when it has been silent for too long
+    void heartbeatTick()
+    {
+        double nowMs = clock_.nowMs();
+        const ScopedLock sl(stateLock_);
+        if (! isOscConnected() || oscLost_.get() != 0)
+            return;
+
+        bool lost = false;
+        reportSuppressedErrors(nowMs);
+        expirePredictions(nowMs);
+        updateStatusError();
+        for (auto* engine : engines_)
+        {
+            auto action = engine->getHeartbeat().poll(nowMs);
+            if (action == HeartbeatMonitor::SendPing)
+                engine->send(engine->getRequests().heartbeatPing);
+            else if (action == HeartbeatMonitor::ConnectionLost)
+            {
+                // it stayed quiet through the pings for the whole timeout;
+                // the sockets are shared, another looper going quiet
+                // only needs greeting again; while no looper has answered
+                // yet the greeting backs off in connectOsc()
+                ++stats_[Stats::heartbeatMisses];
+                if (engine == engines_.getFirst())
+                    lost = oscLink_.isConnected();
+                else
+                {
+                    beginRecovery(RecoveryMeter::LinkLost, *engine, nowMs);
+                    engine->send(engine->getRequests().pingAckPing);
+                    engine->getSync().begin(nowMs);
+                }
+            }
+            pollSync(*engine, nowMs);
+        }
+        if (lost)
+            for (auto* engine : engines_)
+            {
+                beginRecovery(RecoveryMeter::LinkLost, *engine, nowMs);
+                engine->getSync().cancel();
+            }
+
+        if (ledExport_.isOpen())
+            publishLedState();
+        if (multicast_.isOpen() && nowMs - multicastFullMs_ >= MULTICAST_FULL_MS)
+        {
+            publishMulticast(true);
+            multicastFullMs_ = nowMs;
+        }
+
+        // the reconnect arms it again once connected
+        if (! lost)
+            armHeartbeat(getNextHeartbeatMs(), nowMs);
+        else
+        {
+            oscLost_ = 1;
+            armOscReconnect(1.0);
+        }
+        updateStatusLink();
+    }
+
+    // a greeting or state request that went unanswered is sent again, with
+    // stateLock_ held; giving up leaves the looper to the heartbeat
+    void pollSync(LooperEngine& engine, double nowMs)
+    {
+        switch (engine.getSync().poll(nowMs))
+        {
+            case SyncWorkflow::ResendGreeting:
+                ++stats_[Stats::syncRetries];
+                engine.send(engine.getRequests().pingAckPing);
+                break;
+            case SyncWorkflow::ResendStateRequest:
+                ++stats_[Stats::syncRetries];
+                engine.forgetRegistrations();
+                registerAutoUpdates(engine, false);
+                getCurrentState(engine);
+                engine.sendQueued();
+                break;
+            case SyncWorkflow::GiveUp:
+                log_.write(AsyncLog::Error, "No answer from the looper at " + engine.describeSend() + " after "
+                           + String(engine.getSync().getMaxAttempts()) + " attempts, waiting for its heartbeat");
+                break;
+            case SyncWorkflow::Nothing:
+                break;
+        }
+    }
+
+    // connects the OSC link, and again once the heartbeat was lost. Called
+    // on the reconnect thread, or the event loop's with el. The receivers
+    // that come down are stopped first without stateLock_, as their handlers
+    // wait for it; everything else happens with it held, since the message
+    // and receiver threads use the same queue, requests and senders.
+    void reconnectOsc()
+    {
+        if (handedOff_.get() != 0)
+            return;
+
+        bool restartReceivers;
+        {
+            const ScopedLock sl(stateLock_);
+            restartReceivers = oscLost_.get() != 0 || currentReceivePort_ < 0;
+        }
+        if (restartReceivers)
+            stopReceivers();
+
+        const ScopedLock sl(stateLock_);
+
+        // a command let go of the receivers meanwhile, they are stopped
+        // next time round
+        if (! restartReceivers && currentReceivePort_ < 0)
+        {
+            armOscReconnect(1.0);
+            return;
+        }
+
+        double nowMs = clock_.nowMs();
+        if (oscLost_.exchange(0) != 0)
+        {
+            // we've lost heartbeat, try reconnecting
+            currentReceivePort_ = -1;
+            for (auto* engine : engines_)
+                engine->disconnectSender();
+            oscLinkLost();
+        }
+
+        // a stream that connected again is taken up right away, greeting
+        // its looper although the rest of the link is still up. Only now
+        // does it know our side of the connection for the return URL.
+        if (oscStreamChanged_.exchange(0) != 0)
+        {
+            for (auto* engine : engines_)
+                if (engine->isStreamed() && engine->isSenderConnected())
+                    engine->encodeRequests(TEMPO_SYNC_TICK_MS * 10);
+            oscLinkLost();
+        }
+
+        // a host that resolved to other addresses is sent to at the new
+        // ones, one resolved for the first time is tried right away
+        StringArray resolved;
+        {
+            const ScopedLock sl(resolvedLock_);
+            resolved.swapWith(resolvedHosts_);
+        }
+        if (! resolved.isEmpty())
+        {
+            for (auto* engine : engines_)
+                if (resolved.contains(engine->getHost()) && engine->getSendPath().isEmpty() && ! engine->isStreamed())
+                    engine->disconnectSender();
+            oscLinkLost();
+        }
+
+        if (! isOscConnected() || ! oscLink_.isConnected())
+            connectOsc(nowMs);
+        if (! isOscConnected() || ! oscLink_.isConnected())
+            armOscReconnect(oscLink_.getDelayMs(nowMs));
+        updateStatusLink();
+    }
+
+    // the link went away, it is tried again right away
+    void oscLinkLost()
+    {
+        oscLink_.lost();
+        oscGreeted_ = false;
+    }
+
+    // a /pingack after we greeted the loopers is what brings the link up,
+    // with stateLock_ held
+    void oscLinkUp()
+    {
+        if (oscLink_.isConnected() || ! oscGreeted_)
+            return;
+
+        log_.write(AsyncLog::Info, String(oscConnectedBefore_ ? "Reconnected" : "Connected") + " to OSC ports " + describeOscPorts());
+        if (oscConnectedBefore_)
+            ++stats_[Stats::oscReconnects];
+        oscConnectedBefore_ = true;
+        oscLink_.connected();
+        oscGreeted_ = false;
+    }
+
+    // lit while any looper is heard from within its heartbeat timeout,
+    // brought up to date on every heartbeat tick; with stateLock_ held
+    void updateStatusLink()
+    {
+        if (! gpio_.isOpen())
+            return;
+        const double nowMs = clock_.nowMs();
+        bool alive = false;
+        for (auto* engine : engines_)
+            alive = alive || engine->getHeartbeat().isAlive(nowMs);
+        gpio_.set(GpioStatus::Link, alive);
+        gpio_.flush();
+    }
+
+    // lit while any pedalboard port is closed; with stateLock_ or
+    // reopenLock_ held
+    void updateStatusError()
+    {
+        if (! gpio_.isOpen())
+            return;
+        bool closed = false;
+        for (auto* board : boards_)
+            closed = closed || ! board->getSink().isOpen();
+        gpio_.set(GpioStatus::Error, closed);
+        gpio_.flush();
+    }
+
+    // the receiver listens for every looper and we can send to all of them
+    bool isOscConnected() const
+    {
+        if (currentReceivePort_ < 0)
+            return false;
+
+        for (auto* engine : engines_)
+            if (! engine->isSenderConnected())
+                return false;
+        return true;
+    }
+
+    // "9001 (in) and 9000 (out)" for each looper
+    String describeOscPorts() const
+    {
+        StringArray ports;
+        for (auto* engine : engines_)
+            ports.add(engine->describeReceive() + " (in) and " + engine->describeSend() + " (out)");
+        return ports.joinIntoString(", ");
+    }
+
+    // tries whatever part of the OSC link is down, backing off while it
+    // keeps failing; with stateLock_ held. A UDP socket connects whether or
+    // not anybody listens, so the link only counts as up once a looper
+    // answers the greeting, see oscLinkUp(); until then the greeting goes
+    // out again with the same backoff.
+    void connectOsc(double nowMs)
+    {
+        // a port dropped on purpose, e.g. by rb, is reconnected right away
+        if (oscLink_.isConnected())
+            oscLinkLost();
+
+        if (! oscLink_.shouldAttempt(nowMs))
+            return;
+
+        if (! tryToConnectOsc())
+        {
+            if (oscLink_.failed(nowMs))
+                log_.write(AsyncLog::Error, "Couldn't connect to OSC ports " + describeOscPorts() + " after "
+                           + String(oscLink_.getFailures()) + " attempts, retrying in " + String(oscLink_.getDelayMs(nowMs)) + " ms");
+            return;
+        }
+
+        const bool logged = oscLink_.failed(nowMs);
+        if (oscGreeted_)
+        {
+            if (logged)
+                log_.write(AsyncLog::Error, "No answer from the loopers at OSC ports " + describeOscPorts() + " after "
+                           + String(oscLink_.getFailures()) + " attempts, retrying in " + String(oscLink_.getDelayMs(nowMs)) + " ms");
+            return;
+        }
+
+        oscGreeted_ = true;
+        log_.write(AsyncLog::Debug, "Greeting the loopers at OSC ports " + describeOscPorts());
+        for (auto* engine : engines_)
+        {
+            engine->getHeartbeat().reset(nowMs);
+            engine->getSync().begin(nowMs);
+            engine->forgetRegistrations();
+        }
+        armHeartbeat(nowMs, nowMs);
+
+        // a restarted looper numbers its LEDs from scratch, one handed
+        // over carries on
+        if (handedEngines_ != 0)
+            return;
+        for (auto& sequence : ledSequences_)
+            sequence = {};
+        for (auto* engine : engines_)
+            engine->forgetSequence();
+    }
+
+    // A tick reads the LED generation and then the time before it waits
+    // for stateLock_; in that order, any change applied after the time was
+    // read has a newer generation. A change from the looper that got the lock
+    // first has already written the LED with its new phase, taken from a
+    // later clock than the tick's; toggling it from the older time would
+    // write it again out of phase, so the tick leaves such LEDs to the next
+    // one. Generations wrap, only their order matters.
+    static bool isChangedSince(const LED& led, uint32 generation)
+    {
+        return (int32)(led.generation_ - generation) > 0;
+    }
+
+    void blinkTick(double nowMs, uint32 generation)
+    {
+        const ScopedLock sl(stateLock_);
+
+        // queueing toggles in the sink would commit the staged updates with
+        // them, the next tick after the commit catches up
+        if (canScheduleMidi() && holdForTransaction())
+            return;
+
+        updateAnimation(nowMs);
+        bool synced = tempoSyncEnabled_ && tempoSync_.isLocked(nowMs);
+        if (canScheduleMidi())
+        {
+            scheduleBlinks(nowMs, synced, generation);
+            return;
+        }
+
+        if (synced)
+        {
+            // all LEDs blinking at a rate are lit together, in phase with the
+            // loop; the shadow makes this a no-op unless the phase flipped
+            for (bool fast : { false, true })
+            {
+                const LedBits& blinking = ledState_.getBlinking(fast);
+                LedBits lit = tempoSync_.isLit(fast, nowMs) ? blinking : LedBits();
+                ledState_.setOn(blinking, lit);
+                showLeds(blinking, lit, LedShadow::BlinkLane);
+            }
+        }
+        else
+        {
+            updateBlinkingLeds(nowMs, generation);
+        }
+
+        // every LED toggled on this tick goes out in one write
+        if (flushBlinks())
+            tempoSync_.addMeasuredLatency(Time::getMillisecondCounterHiRes() - nowMs);
+    }
+
+    // flushMidi() for a batch with blink toggles, timing them as they go out
+    bool flushBlinks()
+    {
+        if (! flushMidi())
+        {
+            blinkJitter_.discard();
+            return false;
+        }
+
+        blinkJitter_.written(Time::getMillisecondCounterHiRes());
+        return true;
+    }
+
+    // only if every board can, a toggle goes to all that show its LED
+    bool canScheduleMidi() const
+    {
+        if (boards_.isEmpty())
+            return false;
+
+        for (auto* board : boards_)
+            if (! board->canSchedule())
+                return false;
+        return true;
+    }
+
+    // Queues each toggle due within the next two ticks in the sink, tagged
+    // with the LED, so it goes out on time however late the next tick wakes
+    // up. The LED state and the shadow are updated when the toggle is
+    // queued; a queued toggle is cancelled if the LED changes before then.
+    void scheduleBlinks(double nowMs, bool synced, uint32 generation)
+    {
+        const double horizonMs = 2.0 * blinkEngine_.getTickMs();
+        struct Toggle { int index; bool on; double atMs; };
+        Toggle toggles[128];
+        int numToggles = 0;
+
+        for (auto&& led : leds_)
+        {
+            if (led.state_ != Blink && led.state_ != FastBlink)
+                continue;
+
+            // its toggle was taken back with the change, the next tick
+            // queues the one its new phase has
+            if (isChangedSince(led, generation))
+            {
+                ++stats_[Stats::blinkTogglesSuperseded];
+                continue;
+            }
+
+            bool fast = led.state_ == FastBlink;
+            double period = blinkEngine_.getHalfPeriodMs(fast);
+            if (led.scheduled_)
+            {
+                if (led.nextToggleMs_ > nowMs)
+                    continue;   // still waiting in the queue
+
+                led.scheduled_ = false;
+                if (! synced)
+                    led.nextToggleMs_ += period;
+            }
+
+            bool on;
+            if (synced)
+            {
+                // correct the phase now, then queue the next flip
+                bool lit = tempoSync_.isLit(fast, nowMs);
+                if (lit)
+                    ledOn(led.index_);
+                else
+                    ledOff(led.index_);
+
+                on = ! lit;
+                led.nextToggleMs_ = nowMs + tempoSync_.getMsUntilFlip(fast, nowMs);
+            }
+            else
+            {
+                if (led.nextToggleMs_ <= nowMs + 0.5)
+                {
+                    // overdue, e.g. it just started blinking
+                    if (isLedOn(led))
+                        ledOff(led.index_);
+                    else
+                        ledOn(led.index_);
+                    blinkJitter_.noteToggle(led.index_, period);
+
+                    led.nextToggleMs_ += period;
+                    if (led.nextToggleMs_ <= nowMs)
+                        led.nextToggleMs_ = nowMs + period;
+                }
+                on = ! isLedOn(led);
+            }
+
+            if (led.nextToggleMs_ < nowMs + horizonMs && numToggles < numElementsInArray(toggles))
+                toggles[numToggles++] = { led.index_, on, led.nextToggleMs_ };
+        }
+
+        // what has to change right away goes out before anything is queued
+        flushBlinks();
+
+        for (int i = 0; i < numToggles; ++i)
+        {
+            LED& led = leds_.getReference(toggles[i].index);
+            if (toggles[i].on)
+                ledOn(led.index_);
+            else
+                ledOff(led.index_);
+
+            for (int b = 0; b < boards_.size(); ++b)
+            {
+                auto* board = boards_[b];
+                board->getShadow().commit();
+                if (! board->getBatch().isEmpty())
+                    flightRecorder_.recordMidi(board->getName(), board->getBatch().getData(), board->getBatch().getNumBytes());
+                if (midiRecorder_.isOpen())
+                    midiRecorder_.record(b, board->getBatch().getData(), board->getBatch().getNumBytes(), toggles[i].atMs - nowMs);
+                if (board->getBatch().flushScheduled(board->getSink(), toggles[i].atMs - nowMs, led.index_))
+                    led.scheduled_ = true;
+                else
+                    board->getShadow().invalidate();
+            }
+
+            // the sink sends it on time, as far as we can tell
+            if (led.scheduled_ && ! synced)
+                blinkJitter_.record(led.index_, blinkEngine_.getHalfPeriodMs(led.state_ == FastBlink),
+                                    Time::getMillisecondCounterHiRes() + toggles[i].atMs - nowMs);
+        }
+
+        for (auto* board : boards_)
+            board->getSink().commitScheduled();
+    }
+
+    // takes back a toggle the sink has queued for this LED, the pedalboard
+    // then still shows the state from before it
+    void cancelScheduledToggle(LED& led)
+    {
+        if (! led.scheduled_)
+            return;
+
+        led.scheduled_ = false;
+        for (auto* board : boards_)
+        {
+            board->getSink().cancelScheduled(led.index_);
+            int number = board->ledNumberFor(led.index_);
+            if (number >= 0)
+                board->getShadow().forgetLed((uint8)number);
+        }
+    }
+
+    void cancelScheduledToggles()
+    {
+        for (auto&& led : leds_)
+            cancelScheduledToggle(led);
+    }
+
+    // Opens a sink that closed itself when its device went away, then writes
+    // everything the pedalboard should show in one batch as it will have
+    // lost it. Only called on the reconnect thread. The opening happens
+    // under reopenLock_ alone, so blinks and incoming LED changes carry on
+    // meanwhile; boards are only added or replaced holding both locks.
+    void reopenMidi(double nowMs)
+    {
+        if (handedOff_.get() != 0)
+            return;
+
+        bool reopened = false;
+        {
+            const ScopedLock sl(reopenLock_);
+            for (auto* board : boards_)
+                if (reopenBoard(*board, nowMs))
+                    reopened = true;
+            updateStatusError();
+        }
+
+        if (reopened)
+        {
+            const ScopedLock sl(stateLock_);
+            resyncLeds();
+            flushMidi();
+        }
+
+        // without el the pedal thread reopens its port itself
+        bool pedalsClosed = pedalInput_ != nullptr && eventLoopMode_ && eventLoop_.isRunning() && ! pedalInput_->isOpen();
+        if (pedalsClosed && pedalInput_->open())
+        {
+            ++stats_[Stats::midiReopens];
+            watchPedalInput();
+            pedalsClosed = false;
+        }
+
+        if (tickless_)
+            armMidiReopen(nowMs, pedalsClosed);
+    }
+
+    // for the earliest retry of a port that isn't open; a flush finding one
+    // closed arms it too
+    void armMidiReopen(double nowMs, bool pedalsClosed)
+    {
+        int delayMs = pedalsClosed ? RECONNECT_TICK_MS : 0;
+        {
+            const ScopedLock sl(reopenLock_);
+            for (auto* board : boards_)
+            {
+                if (board->getSink().isOpen())
+                    continue;
+
+                int boardMs = jmax(1, board->getLink().getDelayMs(nowMs));
+                delayMs = delayMs > 0 ? jmin(delayMs, boardMs) : boardMs;
+            }
+        }
+
+        if (delayMs > 0)
+            reconnects_.setTimer(reconnectTimers_.midi, delayMs, true);
+    }
+
+    bool reopenBoard(BoardOutput& board, double nowMs)
+    {
+        Reconnector& link = board.getLink();
+        if (board.getSink().isOpen())
+            return false;
+
+        if (link.isConnected())
+            link.lost();
+
+        if (! link.shouldAttempt(nowMs))
+            return false;
+
+        if (! board.getSink().open())
+        {
+            if (link.failed(nowMs))
+                log_.write(AsyncLog::Error, "Couldn't open MIDI output port \"" + board.getName() + "\" after "
+                           + String(link.getFailures()) + " attempts, retrying in " + String(link.getDelayMs(nowMs)) + " ms");
+            return false;
+        }
+
+        link.connected();
+        startup_.mark(StartupProfile::MidiOpen);
+        ++stats_[Stats::midiReopens];
+        return true;
+    }
+
+    void lockMemory()
+    {
+        // the log thread started before mlock was read, restarted it gets
+        // the smaller stack
+        log_.stop();
+        log_.start();
+
+        if (! MemoryLock::lockAll(lockStackKb_, lockHeapKb_))
+        {
+            log_.write(AsyncLog::Error, "Could not lock the bridge in memory (" + String(strerror(errno))
+                       + "), it needs CAP_IPC_LOCK or a higher memlock limit");
+            return;
+        }
+
+        log_.write(AsyncLog::Info, "Locked " + String(MemoryLock::getStatusKb("VmLck")) + " kB in memory, "
+                   + String(MemoryLock::getStatusKb("VmRSS")) + " kB resident");
+    }
+
+    // with the backoff capped, polling the device is only a fallback. With
+    // hotplug events the device names are only looked up again when one comes.
+    void startHotplug()
+    {
+        if (boards_.isEmpty() && pedalInput_ == nullptr)
+            return;
+
+        if (hotplug_.start())
+            rawMidiDevices_.setRefreshOnMiss(false);
+        else
+            log_.write(AsyncLog::Info, "No hotplug events, polling for the MIDI device instead");
+    }
+
+    // what the first frame needn't wait for, run on the reconnect thread
+    // once it is out
+    void deferUntilFirstFrame(std::function<void()> start)
+    {
+        {
+            const ScopedLock sl(stateLock_);
+            if (startsDeferred_)
+            {
+                deferredStarts_.add(start);
+                return;
+            }
+        }
+        start();
+    }
+
+    void runDeferredStarts()
+    {
+        Array<std::function<void()>> starts;
+        {
+            const ScopedLock sl(stateLock_);
+            startsDeferred_ = false;
+            starts.swapWith(deferredStarts_);
+        }
+        for (auto& start : starts)
+            start();
+    }
+
+    // called on the hotplug thread
+    void soundDeviceAdded(const String& deviceName)
+    {
+        rawMidiDevices_.invalidate();
+
+        // skip the backoff, the device is most likely one of ours
+        bool reopen = false;
+        {
+            const ScopedLock sl(reopenLock_);
+            for (auto* board : boards_)
+            {
+                if (! board->getSink().isOpen())
+                {
+                    board->getLink().lost();
+                    reopen = true;
+                }
+            }
+        }
+
+        if (reopen)
+        {
+            log_.write(AsyncLog::Info, "Sound device " + deviceName + " added, reopening MIDI output");
+            reconnects_.setTimer(reconnectTimers_.midiNow, 1, true);
+        }
+    }
+
+    void shutdown() override
+    {
+        // Add your application's shutdown code here..
+        systemd_.stop();
+        systemd_.notify("STOPPING=1");
+        handoff_.stop();
+        if (handedOff_.get() == 0)
+            unregisterAll();
+        resolver_.stop();
+        eventLoop_.stop();
+        commandInput_.stop();
+        if (pedalInput_ != nullptr)
+            pedalInput_->stop();
+        timers_.stop();
+        reconnects_.stop();
+        {
+            const ScopedLock sl(stateLock_);
+            startsDeferred_ = false;
+            deferredStarts_.clear();
+        }
+        hotplug_.stop();
+        signals_.stop();
+        replay_.stop();
+        loadGenerator_.stop();
+        metricsExporter_.stop();
+        for (auto* engine : engines_)
+            engine->stopStream();
+        disconnectReceivers();
+        headlessDispatcher_.stop();
+        recorder_.close();
+        bundleScheduler_.stop();
+        blinkEngine_.stop();
+        midiRecorder_.close();
+        attachMidiRecorder();
+        for (auto* board : boards_)
+        {
+            board->stopWriter();
+
+            const MidiSink& sink = board->getSink();
+            if (sink.getBytesDeferred() > 0 || sink.getBytesDropped() > 0)
+            {
+                std::cerr << "MIDI output " << board->getName() << ": " << sink.getBytesWritten() << " bytes written, "
+                          << sink.getBytesDeferred() << " deferred, "
+                          << sink.getBytesDropped() << " dropped, "
+                          << sink.getShortWrites() << " short writes" << std::endl;
+            }
+        }
+        String soakSummary = soak_.close();
+        if (soakSummary.isNotEmpty())
+            log_.write(AsyncLog::Info, soakSummary);
+        logLatencies();
+        logAllocationStages();
+        log_.stop();
+    }
+
+    // so the loopers stop sending to a bridge that is gone
+    void unregisterAll()
+    {
+        const ScopedLock sl(stateLock_);
+        if (! isOscConnected())
+            return;
+
+        for (auto* engine : engines_)
+        {
+            registerAutoUpdates(*engine, true);
+            engine->sendQueued();
+        }
+    }
+
+    //==============================================================================
+    void systemRequestedQuit() override
+    {
+        // This is called when the app is being asked to quit: you can ignore this
+        // request and let the app carry on running, or call quit() to allow the app to close.
+        quit();
+    }
+
+    void anotherInstanceStarted (const String& commandLine) override
+    {
+        // When another instance of the app is launched while this one is running,
+        // this method is invoked, and the commandLine parameter tells you what
+        // the other instance's command-line arguments were.
+    }
+    void suspended() override {}
+    void resumed() override {}
+    void unhandledException(const std::exception*, const String&, int) override { jassertfalse; }
+
+private:
+    StringArray parseLineAsParameters(const String& line)
+    {
+        StringArray parameters;
+        if (!line.startsWith("#"))
+        {
+            StringArray tokens;
+            tokens.addTokens(line, true);
+            tokens.removeEmptyStrings(true);
+            for (String token : tokens)
+            {
+                parameters.add(token.trimCharactersAtStart("\"").trimCharactersAtEnd("\""));
+            }
+        }
+        return parameters;
+    }
+
+    void handleVarArgCommand()
+    {
+        if (currentCommand_.expectedOptions_ < 0)
+        {
+            runCommand(currentCommand_);
+        }
+    }
+
+    // while compiling a program file its commands are only collected; the
+    // call is cleared for the next command either way
+    void runCommand(CommandCall& cmd)
+    {
+        if (compiling_ != nullptr)
+        {
+            if (cmd.command_ != NONE && cmd.command_ != COMPILE)
+                compiling_->add(cmd.index_, cmd.opts_);
+        }
+        else
+        {
+            if (configCalls_ != nullptr && cmd.command_ != NONE)
+                configCalls_->add(cmd);
+            if (liveInput_ && needsRestartLive(cmd.command_))
+                log_.write(AsyncLog::Info, commands_.getReference(cmd.index_).param_ + " takes a restart");
+            else if (! configDryRun_)
+                executeCommand(cmd);
+        }
+        cmd.clear();
+    }
+
+    // On SIGHUP the command line is read again, with the files it names, and
+    // only the commands that differ from last time are run: a new dout only
+    // reopens the MIDI port, a new oin only rebinds the receiver. Commands
+    // are matched by name and how many of that name came before, so a
+    // second dadd is compared with the second dadd. The LEDs are kept as
+    // they are, a new board is brought up to date from them.
+    void reloadConfig()
+    {
+        Array<CommandCall> calls;
+        CommandCall current = currentCommand_;
+        currentCommand_.clear();
+        configCalls_ = &calls;
+        configDryRun_ = true;
+        StringArray parameters(configParameters_);
+        parseParameters(parameters);
+        configCalls_ = nullptr;
+        configDryRun_ = false;
+        currentCommand_ = current;
+
+        int applied = 0;
+        for (int i = 0; i < calls.size(); ++i)
+        {
+            CommandCall& call = calls.getReference(i);
+            const CommandCall* before = findConfigCall(appliedConfig_, call.command_, countBefore(calls, i));
+            if (before != nullptr && before->opts_ == call.opts_)
+                continue;
+
+            const String text = (commands_.getReference(call.index_).param_ + " " + call.opts_.joinIntoString(" ")).trim();
+            if (needsRestart(call.command_))
+            {
+                log_.write(AsyncLog::Info, "Changed " + text + " takes a restart");
+                continue;
+            }
+
+            log_.write(AsyncLog::Info, "Reloading " + text);
+            executeCommand(call);
+            ++applied;
+        }
+
+        for (int i = 0; i < appliedConfig_.size(); ++i)
+        {
+            const CommandCall& call = appliedConfig_.getReference(i);
+            if (findConfigCall(calls, call.command_, countBefore(appliedConfig_, i)) == nullptr)
+                log_.write(AsyncLog::Info, "Removed " + commands_.getReference(call.index_).param_ + " stays in effect until a restart");
+        }
+
+        appliedConfig_.swapWith(calls);
+        log_.write(AsyncLog::Info, "Configuration reloaded, " + String(applied) + " commands changed");
+    }
+
+    // how many calls of the same command come before calls[index]
+    static int countBefore(const Array<CommandCall>& calls, int index)
+    {
+        int count = 0;
+        for (int i = 0; i < index; ++i)
+            if (calls.getReference(i).command_ == calls.getReference(index).command_)
+                ++count;
+        return count;
+    }
+
+    static const CommandCall* findConfigCall(const Array<CommandCall>& calls, CommandIndex command, int occurrence)
+    {
+        for (auto& call : calls)
+            if (call.command_ == command && occurrence-- == 0)
+                return &call;
+        return nullptr;
+    }
+
+    // those that quit, only work before the threads start, or start
+    // something that runs on its own
+    static bool needsRestart(CommandIndex command)
+    {
+        switch (command)
+        {
+            case LIST: case COMPILE: case REPLAY_OSC: case LOAD_GENERATOR: case BENCHMARK: case FLIGHT_DUMP:
+            case MEMORY_LOCK: case EVENT_LOOP: case TICKLESS: case REALTIME_OSC: case HEADLESS_DISPATCH: case IO_URING: case PEDAL_INPUT: case ENGINE_ADD:
+            case SIMULATED_CLOCK: case GOLDEN_COMPARE: case SOAK_REPORT: case MIDI_LOOPBACK: case RECEIVER_SHARDS:
+            case STATSD_EXPORT: case PROMETHEUS_EXPORT: case TRACE_SPANS: case OSC_TCP: case CALIBRATE: case SL_NATIVE:
+            case TRANSPORT_BENCH: case OSC_STRESS: case SCALE_BENCH: case CAPACITY_REPORT: case LED_STRIP: case ART_NET:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // typed in while running, the loopers can't be changed under the
+    // threads that walk them
+    static bool needsRestartLive(CommandIndex command)
+    {
+        return needsRestart(command) || command == OSC_IN || command == OSC_OUT;
+    }
+
+    void parseParameters(StringArray& parameters)
+    {
+        for (String param : parameters)
+        {
+            if (param == "--") continue;
+
+            int index = commandNames_.find(param);
+            if (index >= 0)
+            {
+                handleVarArgCommand();
+
+                currentCommand_.start(index, commands_.getReference(index));
+            }
+            else if (currentCommand_.command_ == NONE)
+            {
+                File file = File::getCurrentWorkingDirectory().getChildFile(param);
+                if (SessionReader::isSessionFile(file))
+                {
+                    loadSession(file);
+                }
+                else if (file.existsAsFile())
+                {
+                    parseFile(file);
+                }
+            }
+            else if (currentCommand_.expectedOptions_ != 0)
+            {
+                currentCommand_.opts_.add(param);
+                currentCommand_.expectedOptions_ -= 1;
+            }
+
+            // handle fixed arg commands
+            if (currentCommand_.command_ != NONE && currentCommand_.expectedOptions_ == 0)
+            {
+                runCommand(currentCommand_);
+            }
+        }
+
+        handleVarArgCommand();
+    }
+
+    void parseFile(File file)
+    {
+        StringArray parameters;
+
+        StringArray lines;
+        file.readLines(lines);
+        for (String line : lines)
+        {
+            parameters.addArray(parseLineAsParameters(line));
+        }
+
+        parseParameters(parameters);
+    }
+
+    // parses a program file, including the files it names, without running
+    // it, and writes its commands out already looked up
+    bool compileSession(const File& in, const File& out)
+    {
+        SessionWriter writer;
+        CommandCall current = currentCommand_;
+        currentCommand_.clear();
+        compiling_ = &writer;
+        parseFile(in);
+        compiling_ = nullptr;
+        currentCommand_ = current;
+
+        if (! writer.writeTo(out, getCommandsFingerprint()))
+            return false;
+
+        std::cout << "Compiled " << writer.size() << " commands into " << out.getFullPathName() << std::endl;
+        return true;
+    }
+
+    void loadSession(const File& file)
+    {
+        SessionReader reader;
+        if (! reader.open(file, getCommandsFingerprint()))
+        {
+            std::cerr << "Error: " << file.getFullPathName() << " was compiled for another version, compile it again" << std::endl;
+            return;
+        }
+
+        int index;
+        CommandCall cmd;
+        while (reader.next(index, cmd.opts_))
+        {
+            if (! isPositiveAndBelow(index, commands_.size())
+                || (commands_.getReference(index).expectedOptions_ >= 0 && cmd.opts_.size() != commands_.getReference(index).expectedOptions_))
+                continue;
+
+            cmd.command_ = commands_.getReference(index).command_;
+            cmd.index_ = index;
+            runCommand(cmd);
+        }
+    }
+
+    // changes whenever a command is added, moved or takes other options, any
+    // of which would make the indexes in a compiled session file wrong
+    uint32 getCommandsFingerprint() const
+    {
+        String table;
+        for (auto&& cmd : commands_)
+            table << cmd.param_ << ' ' << (int)cmd.command_ << ' ' << cmd.expectedOptions_ << '\n';
+        return (uint32)table.hashCode();
+    }
+
+    String output7BitAsHex(int v)
+    {
+        return String::toHexString(v).paddedLeft('0', 2).toUpperCase();
+    }
+
+    String output7Bit(int v)
+    {
+        if (useHexadecimalsByDefault_)
+        {
+            return output7BitAsHex(v);
+        }
+        else
+        {
+            return String(v);
+        }
+    }
+
+    String output14BitAsHex(int v)
+    {
+        return String::toHexString(v).paddedLeft('0', 4).toUpperCase();
+    }
+
+    String output14Bit(int v)
+    {
+        if (useHexadecimalsByDefault_)
+        {
+            return output14BitAsHex(v);
+        }
+        else
+        {
+            return String(v);
+        }
+    }
+
+    bool tryToConnectOsc() {
+        for (auto* engine : engines_) {
+            if (! engine->isSenderConnected() && engine->connectSender()) {
+                std::cout << "Successfully connected to OSC Send port " << engine->describeSend() << std::endl;
+            }
+        }
+
+        if (currentReceivePort_ < 0) {
+            connect();
+        }
+
+        if (isOscConnected()) {
+            startup_.mark(StartupProfile::OscConnected);
+            for (auto* engine : engines_)
+                engine->send(engine->getRequests().pingAckPing);
+            return true;
+        }
+
+        return false;
+    }
+
+    void executeCommand(CommandCall& cmd)
+    {
+        const ScopedLock sl(stateLock_);
+        switch (cmd.command_)
+        {
+            case NONE:
+                break;
+            case LIST:
+                printDevices(rawMidiDevices_.getDevices(SND_RAWMIDI_STREAM_INPUT), rawMidiDevices_.getDevices(SND_RAWMIDI_STREAM_OUTPUT));
+                systemRequestedQuit();
+                break;
+            case CHANNEL:
+                // for the board added last and any added after it
+                channel_ = asDecOrHex7BitValue(cmd.opts_[0]);
+                if (! boards_.isEmpty())
+                    boards_.getLast()->getBatch().setChannel(channel_);
+                break;
+            case DEVICE_OUT:
+            {
+                // replaces the first board, deleting it stops its writer
+                // before its sink is closed
+                const ScopedLock rl(reopenLock_);
+                cancelScheduledToggles();
+                if (boards_.isEmpty())
+                    boards_.add(createBoard(cmd.opts_[0], 0));
+                else
+                    boards_.set(0, createBoard(cmd.opts_[0], 0));
+                attachMidiRecorder();
+                openBoard(*boards_.getFirst());
+                break;
+            }
+            case DEVICE_ADD:
+            {
+                const ScopedLock rl(reopenLock_);
+                cancelScheduledToggles();
+                boards_.add(createBoard(cmd.opts_[0], asDecOrHexIntValue(cmd.opts_[1])));
+                attachMidiRecorder();
+                openBoard(*boards_.getLast());
+                break;
+            }
+            case RUNNING_STATUS:
+                runningStatus_ = asDecOrHexIntValue(cmd.opts_[0]);
+                for (auto* board : boards_)
+                    board->getBatch().setRunningStatus(runningStatus_);
+                break;
+            case RESYNC:
+                resyncLeds();
+                flushMidi();
+                break;
+            case WRITER_THREAD:
+                // one writer per board, for boards added later too
+                writerPriority_ = jmax(0, asDecOrHexIntValue(cmd.opts_[0]));
+                for (auto* board : boards_)
+                    board->startWriter(getWriterTuning(), &latency_.queue);
+                break;
+            case SCHEDULED_MIDI:
+            {
+                // queued toggles are lost with the sinks they were in
+                const ScopedLock rl(reopenLock_);
+                scheduledMidi_ = true;
+                cancelScheduledToggles();
+                for (auto* board : boards_)
+                    board->addScheduler(threadTuning_);
+                break;
+            }
+            case NON_BLOCKING:
+                nonBlocking_ = true;
+                for (auto* board : boards_)
+                    board->getSink().setNonBlocking(true);
+                break;
+            case MIDI_BUFFER:
+            {
+                const int size = asDecOrHexIntValue(cmd.opts_[0]);
+                const int availMin = asDecOrHexIntValue(cmd.opts_[1]);
+                if (size < 0 || availMin < 0)
+                    std::cerr << "Error: can't make the rawmidi buffer " << size << " bytes waking at " << availMin
+                              << ", keeping the driver's default for what is negative" << std::endl;
+                midiBuffer_.size = jmax(0, size);
+                midiBuffer_.availMin = jmax(0, availMin);
+                for (auto* board : boards_)
+                    board->getSink().setBufferParams(midiBuffer_);
+                break;
+            }
+            case STALE_AGE:
+                staleAgeMs_ = jmax(0, asDecOrHexIntValue(cmd.opts_[0]));
+                for (auto* board : boards_)
+                    board->setMaxAgeMs(staleAgeMs_);
+                break;
+            case BLINK_PERIODS:
+                blinkEngine_.start(asDecOrHexIntValue(cmd.opts_[0]), asDecOrHexIntValue(cmd.opts_[1]));
+                break;
+            case LOG_LEVEL:
+                log_.setLevel(asDecOrHexIntValue(cmd.opts_[0]));
+                break;
+            case HEADLESS_DISPATCH:
+                headlessDispatch_ = true;
+                break;
+            case IO_URING:
+                if (! eventLoop_.setUring(true))
+                    std::cerr << "Error: no io_uring for the event loop, using epoll" << std::endl;
+                break;
+            case REALTIME_OSC:
+                realtimeOsc_ = 1;
+                break;
+            case LOAD_GENERATOR:
+                if (! loadGenerator_.start("127.0.0.1", asPortNumber(cmd.opts_[0]), asDecOrHexIntValue(cmd.opts_[1]), asDecOrHexIntValue(cmd.opts_[2])))
+                    std::cerr << "Error: could not start generating load to UDP port " << cmd.opts_[0] << std::endl;
+                break;
+            case LOAD_MIX:
+                for (int i = 0; i < LoadGenerator::numMessageTypes; ++i)
+                    loadGenerator_.getOptions().weights[i] = asDecOrHexIntValue(cmd.opts_[i]);
+                break;
+            case LOAD_BURST:
+                loadGenerator_.getOptions().burstSize = asDecOrHexIntValue(cmd.opts_[0]);
+                break;
+            case LOAD_BAD:
+                loadGenerator_.getOptions().badPercent = jlimit(0, 100, asDecOrHexIntValue(cmd.opts_[0]));
+                break;
+            case COMPILE:
+                if (! compileSession(File::getCurrentWorkingDirectory().getChildFile(cmd.opts_[0]),
+                                     File::getCurrentWorkingDirectory().getChildFile(cmd.opts_[1])))
+                    std::cerr << "Error: could not compile " << cmd.opts_[0] << " into " << cmd.opts_[1] << std::endl;
+                systemRequestedQuit();
+                break;
+            case HEARTBEAT:
+                // for every looper, including those added later
+                heartbeatPingMs_ = asDecOrHexIntValue(cmd.opts_[0]);
+                heartbeatTimeoutMs_ = asDecOrHexIntValue(cmd.opts_[1]);
+                for (auto* engine : engines_)
+                    engine->getHeartbeat().setTiming(heartbeatPingMs_, heartbeatTimeoutMs_);
+                if (loopTimers_.heartbeat >= 0)
+                    setLoopTimer(loopTimers_.heartbeat, tickless_ ? 1 : engines_.getFirst()->getHeartbeat().getPollIntervalMs(), tickless_);
+                break;
+            case FLIGHT_RECORDER:
+                if (! flightRecorder_.open(File::getCurrentWorkingDirectory().getChildFile(cmd.opts_[0])))
+                    std::cerr << "Error: could not record to " << cmd.opts_[0] << ", keeping the ring in memory" << std::endl;
+                break;
+            case LED_SCENE:
+            {
+                const int n = asDecOrHexIntValue(cmd.opts_[0]);
+                if (! isPositiveAndBelow(n, MAX_SCENES))
+                {
+                    std::cerr << "Error: scenes are numbered 0 to " << MAX_SCENES - 1 << std::endl;
+                    break;
+                }
+                // parsed once here, applying one only walks its pairs
+                Array<SceneLed> scene;
+                const String states = cmd.opts_[1];
+                for (int i = 0; i < jmin(states.length(), LedStore::capacity); ++i)
+                    if (states[i] >= '0' && states[i] <= '3')
+                        scene.add({ (int16)i, (int16)(states[i] - '0') });
+                if (scenes_.size() <= n)
+                    scenes_.resize(n + 1);
+                scenes_.set(n, scene);
+                break;
+            }
+            case LED_ANIMATION:
+            {
+                const int n = asDecOrHexIntValue(cmd.opts_[0]);
+                if (! isPositiveAndBelow(n, MAX_ANIMATIONS))
+                {
+                    std::cerr << "Error: animations are numbered 0 to " << MAX_ANIMATIONS - 1 << std::endl;
+                    break;
+                }
+                while (animations_.size() <= n)
+                    animations_.add(new LedAnimation());
+                if (animationPlayer_.isPlaying(*animations_[n]))
+                    stopAnimation();
+
+                // compiled here, playing one only applies its steps
+                const int stepMs = asDecOrHexIntValue(cmd.opts_[1]);
+                if (! animations_[n]->compile(cmd.opts_[3], stepMs, asDecOrHexIntValue(cmd.opts_[2])))
+                {
+                    std::cerr << "Error: animation " << n << " has no frames" << std::endl;
+                    break;
+                }
+
+                // the blink engine plays the steps on its ticks
+                blinkEngine_.addTickMs(animations_[n]->getStepMs());
+                if (! blinkEngine_.isRunning())
+                    blinkEngine_.start(DEFAULT_BLINK_MS, DEFAULT_FASTBLINK_MS);
+                break;
+            }
+            case BOOT_FRAME:
+                bootLeds_ = (uint32)cmd.opts_[0].getHexValue32();
+                bootDisplay_ = asDecOrHexIntValue(cmd.opts_[1]);
+                // boards opened before this get it too
+                if (warmEngines_ == 0 && ! looperAnswered_)
+                {
+                    for (auto* board : boards_)
+                        if (board->getSink().isOpen())
+                            showBootFrame(*board);
+                    flushMidi();
+                }
+                break;
+            case WATCHDOG_BUDGET:
+                watchdogBudgetUs_ = jmax(0, asDecOrHexIntValue(cmd.opts_[0]));
+                break;
+            case BENCH_COUNTERS:
+                benchCounters_ = true;
+                break;
+            case BENCH_REPEATS:
+                benchRepeats_ = asDecOrHexIntValue(cmd.opts_[0]);
+                break;
+            case BENCH_BASELINE:
+                benchBaseline_ = File::getCurrentWorkingDirectory().getChildFile(cmd.opts_[0]);
+                benchTolerance_ = cmd.opts_[1].getDoubleValue();
+                break;
+            case BENCHMARK:
+                std::cout << runBenchmarks(asDecOrHexIntValue(cmd.opts_[0])) << std::endl;
+                systemRequestedQuit();
+                break;
+            case TRANSPORT_BENCH:
+                std::cout << TransportBenchmark().run(asDecOrHexIntValue(cmd.opts_[0])) << std::endl;
+                systemRequestedQuit();
+                break;
+            case OSC_STRESS:
+                std::cout << OscStressTest(9959, asDecOrHexIntValue(cmd.opts_[0])).run() << std::endl;
+                systemRequestedQuit();
+                break;
+            case SCALE_BENCH:
+                std::cout << ScaleBenchmark().run(asDecOrHexIntValue(cmd.opts_[0]), asDecOrHexIntValue(cmd.opts_[1])) << std::endl;
+                systemRequestedQuit();
+                break;
+            case CAPACITY_REPORT:
+                std::cout << runCapacityReport(asDecOrHexIntValue(cmd.opts_[0]), cmd.opts_[1]) << std::endl;
+                systemRequestedQuit();
+                break;
+            case PIPELINE:
+                setLegacyPipeline(asDecOrHexIntValue(cmd.opts_[0]) != 0);
+                break;
+            case TRACE_SPANS:
+                TraceSpans::enable(asDecOrHexIntValue(cmd.opts_[0]));
+                break;
+            case STATSD_EXPORT:
+            {
+                const String host = cmd.opts_[0], port = cmd.opts_[1];
+                const double intervalMs = cmd.opts_[2].getDoubleValue() * 1000.0;
+                deferUntilFirstFrame([this, host, port, intervalMs]
+                {
+                    if (! metricsExporter_.startStatsd(host, asPortNumber(port), intervalMs))
+                        std::cerr << "Error: could not export the stats to " << host << ":" << port << std::endl;
+                });
+                break;
+            }
+            case PROMETHEUS_EXPORT:
+            {
+                const File file = File::getCurrentWorkingDirectory().getChildFile(cmd.opts_[0]);
+                const double intervalMs = cmd.opts_[1].getDoubleValue() * 1000.0;
+                deferUntilFirstFrame([this, file, intervalMs]
+                {
+                    if (! metricsExporter_.startTextfile(file, intervalMs))
+                        std::cerr << "Error: could not export the stats to " << file.getFullPathName() << std::endl;
+                });
+                break;
+            }
+            case MIDI_LOOPBACK:
+            {
+                MidiLoopback loopback(cmd.opts_[0], cmd.opts_[1], &rawMidiDevices_);
+                String results = loopback.run(asDecOrHexIntValue(cmd.opts_[2]));
+                if (results.isEmpty())
+                    std::cerr << "Error: could not open " << cmd.opts_[0] << " and " << cmd.opts_[1] << " for the loopback" << std::endl;
+                else
+                    std::cout << results << std::endl;
+                systemRequestedQuit();
+                break;
+            }
+            case CALIBRATE:
+            {
+                MidiLoopback loopback(cmd.opts_[0], cmd.opts_[1], &rawMidiDevices_);
+                String results = loopback.run(asDecOrHexIntValue(cmd.opts_[2]));
+                OutputCalibration::Settings settings;
+                File file = File::getCurrentWorkingDirectory().getChildFile(cmd.opts_[3]);
+                if (results.isEmpty())
+                    std::cerr << "Error: could not open " << cmd.opts_[0] << " and " << cmd.opts_[1] << " for the loopback" << std::endl;
+                else if (! OutputCalibration::recommend(loopback.getResults(), settings))
+                    std::cerr << "Error: too few probe batches came back whole to calibrate from" << std::endl;
+                else if (! file.replaceWithText(OutputCalibration::toProgram(settings, cmd.opts_[0])))
+                    std::cerr << "Error: could not write " << file.getFullPathName() << std::endl;
+                else
+                    std::cout << results << std::endl << "Wrote the settings to " << file.getFullPathName() << std::endl;
+                systemRequestedQuit();
+                break;
+            }
+            case FLIGHT_DUMP:
+                dumpFlightRecorder(cmd.opts_[0], cmd.opts_[1]);
+                break;
+            case SHM_EXPORT:
+                if (! ledExport_.open(cmd.opts_[0]))
+                    std::cerr << "Error: could not create the shared memory segment " << cmd.opts_[0] << std::endl;
+                else
+                    publishLedState();
+                break;
+            case LED_MULTICAST:
+                if (! multicast_.open(cmd.opts_[0], asPortNumber(cmd.opts_[1]), jmax(1, asDecOrHexIntValue(cmd.opts_[2]))))
+                    std::cerr << "Error: could not publish to " << cmd.opts_[0] << ":" << cmd.opts_[1] << std::endl;
+                break;
+            case LED_STRIP:
+            {
+                LedStrip::Chip chip;
+                if (! LedStrip::parseChip(cmd.opts_[1], chip))
+                    std::cerr << "Error: unknown LED strip chip " << cmd.opts_[1] << std::endl;
+                else if (! strip_.open(cmd.opts_[0], chip, asDecOrHexIntValue(cmd.opts_[2])))
+                    std::cerr << "Error: could not open the SPI device " << cmd.opts_[0] << std::endl;
+                else
+                    addFanoutSink(STRIP_SINK, [this] (const LedFrame& frame) { showStrip(frame); });
+                break;
+            }
+            case GPIO_STATUS:
+            {
+                const int lines[GpioStatus::numLines] = { asDecOrHexIntValue(cmd.opts_[1]), asDecOrHexIntValue(cmd.opts_[2]),
+                                                          asDecOrHexIntValue(cmd.opts_[3]) };
+                if (! gpio_.open(cmd.opts_[0], lines))
+                    std::cerr << "Error: could not request the GPIO lines of " << cmd.opts_[0] << std::endl;
+                else
+                {
+                    updateStatusLink();
+                    updateStatusError();
+                }
+                break;
+            }
+            case STRIP_COLOUR:
+                strip_.setColour(asDecOrHexIntValue(cmd.opts_[0]), (uint32)cmd.opts_[1].getHexValue32());
+                fanout_.republish();
+                break;
+            case ART_NET:
+                if (! artNet_.open(cmd.opts_[0], asDecOrHexIntValue(cmd.opts_[1]), asDecOrHexIntValue(cmd.opts_[2])))
+                    std::cerr << "Error: could not send Art-Net to " << cmd.opts_[0] << std::endl;
+                else
+                    addFanoutSink(ART_NET_SINK, [this] (const LedFrame& frame) { showArtNet(frame); });
+                break;
+            case ART_NET_COLOUR:
+                artNet_.setColour(asDecOrHexIntValue(cmd.opts_[0]), (uint32)cmd.opts_[1].getHexValue32());
+                fanout_.republish();
+                break;
+            case ART_NET_WASH:
+                if (ArtNetOutput::overlapsLeds(asDecOrHexIntValue(cmd.opts_[0]), jmax(getLedEnd(), (int)NUM_LED_PEDALS)))
+                    std::cerr << "Error: the wash from channel " << cmd.opts_[0] << " overlaps the LEDs' channels, the LEDs take them while they are shown" << std::endl;
+                artNet_.setWashChannel(asDecOrHexIntValue(cmd.opts_[0]));
+                fanout_.republish();
+                break;
+            case FANOUT_PACING:
+            {
+                FrameFanout::Pacing pacing;
+                const int depth = asDecOrHexIntValue(cmd.opts_[2]);
+                pacing.minIntervalMs = cmd.opts_[1].getDoubleValue();
+                pacing.depth = std::abs(depth);
+                pacing.coalesce = depth >= 0;
+                if (cmd.opts_[0] == STRIP_SINK)
+                    stripPacing_ = pacing;
+                else if (cmd.opts_[0] == ART_NET_SINK)
+                    artNetPacing_ = pacing;
+                else
+                {
+                    std::cerr << "Error: no output sink " << cmd.opts_[0] << ", only " << STRIP_SINK << " or " << ART_NET_SINK << std::endl;
+                    break;
+                }
+                fanout_.setPacing(cmd.opts_[0], pacing);
+                break;
+            }
+            case BLINK_ALIGN:
+                blinkAligned_ = true;
+                break;
+            case TICKLESS:
+                tickless_ = true;
+                break;
+            case LOAD_SHED:
+                shedder_.setBudget(asDecOrHexIntValue(cmd.opts_[0]), cmd.opts_[1].getDoubleValue());
+                break;
+            case ADAPTIVE_WINDOW:
+                microbatch_.configure(asDecOrHexIntValue(cmd.opts_[0]), cmd.opts_[1].getDoubleValue());
+                break;
+            case SUBSCRIBE:
+                subscribeFiltered_ = true;
+                subscribeIntervalMs_ = jmax(0, asDecOrHexIntValue(cmd.opts_[0]));
+                break;
+            case MEMORY_LOCK:
+                // locked once the commands are done, so it covers what they
+                // allocated; the stacks have to be smaller before threads start
+                lockMemory_ = true;
+                lockStackKb_ = jmax(16, asDecOrHexIntValue(cmd.opts_[0]));
+                lockHeapKb_ = jmax(0, asDecOrHexIntValue(cmd.opts_[1]));
+                if (! MemoryLock::setThreadStackSize(lockStackKb_))
+                    std::cerr << "Error: could not set the thread stack size to " << cmd.opts_[0] << " kB" << std::endl;
+                break;
+            case LED_CACHE:
+                if (! ledCache_.open(File::getCurrentWorkingDirectory().getChildFile(cmd.opts_[0])))
+                    std::cerr << "Error: could not open the LED cache " << cmd.opts_[0] << std::endl;
+                else if (ledCache_.isValid())
+                    restoreLedCache();
+                break;
+            case DISPLAY_CONTENT:
+                if (! displayEngine_.setContent(cmd.opts_[0]))
+                    std::cerr << "Error: unknown display content " << cmd.opts_[0] << std::endl;
+                displayEngine_.setRefreshMs(asDecOrHexIntValue(cmd.opts_[1]));
+                displayEngine_.setBeatsPerCycle(asDecOrHexIntValue(cmd.opts_[2]));
+                break;
+            case DIGIT_CONTROLLERS:
+            {
+                digitControllers_.loadFromHexString(cmd.opts_[0]);
+                for (auto* board : boards_)
+                    board->getShadow().setDigitControllers(digitControllers_);
+                break;
+            }
+            case BOARD_PROFILE:
+                if (! boardLayout_.setProfile(cmd.opts_[0]))
+                {
+                    std::cerr << "Error: unknown board profile " << cmd.opts_[0] << std::endl;
+                    break;
+                }
+                applyBoardLayout();
+                break;
+            case LED_CONTROLLERS:
+                boardLayout_.setLedControllers((uint8)asDecOrHexIntValue(cmd.opts_[0]), (uint8)asDecOrHexIntValue(cmd.opts_[1]));
+                applyBoardLayout();
+                break;
+            case LED_MAP:
+            {
+                MemoryBlock numbers;
+                numbers.loadFromHexString(cmd.opts_[0]);
+                boardLayout_.setLedNumbers(numbers);
+                applyBoardLayout();
+                break;
+            }
+            case HEARTBEAT_LED_NUMBER:
+                boardLayout_.setHeartbeatLed((uint8)asDecOrHexIntValue(cmd.opts_[0]));
+                applyBoardLayout();
+                break;
+            case PEDAL_INPUT:
+                pedalInput_.reset(new PedalInput(cmd.opts_[0], [this] (uint8 status, uint8 data1, uint8 data2)
+                                                 { pedalReceived(status, data1, data2); }, &rawMidiDevices_));
+                break;
+            case PEDAL_MAP:
+                if (! mapPedal(asDecOrHexIntValue(cmd.opts_[0]), cmd.opts_[1]))
+                    std::cerr << "Error: could not map controller " << cmd.opts_[0] << " to " << cmd.opts_[1] << std::endl;
+                break;
+            case LOOP_PREFETCH:
+                loopPrefetch_ = asDecOrHexIntValue(cmd.opts_[0]) != 0;
+                break;
+            case REQUEST_BUNDLE:
+                bundleRequests_ = asDecOrHexIntValue(cmd.opts_[0]) != 0;
+                for (auto* engine : engines_)
+                    engine->setBundleRequests(bundleRequests_);
+                break;
+            case DNS_REFRESH:
+                resolver_.setRefreshMs(asDecOrHexIntValue(cmd.opts_[0]) * 1000);
+                break;
+            case HANDOFF:
+            {
+                Handoff::State state;
+                if (handoff_.takeOver(cmd.opts_[0], state, handedSockets_, HANDOFF_TIMEOUT_MS))
+                    takeOverState(state);
+                if (! handoff_.listen(cmd.opts_[0]))
+                    std::cerr << "Error: could not listen for a handoff on " << cmd.opts_[0] << std::endl;
+                break;
+            }
+            case PREDICT_LED:
+                predictions_.add({ asDecOrHexIntValue(cmd.opts_[0]) & 0x7f, asDecOrHexIntValue(cmd.opts_[1]),
+                                   asDecOrHexIntValue(cmd.opts_[2]), jlimit(0, (int)FastBlink, asDecOrHexIntValue(cmd.opts_[3])) });
+                break;
+            case WIRE_PACING:
+                pacePercent_ = asDecOrHexIntValue(cmd.opts_[0]);
+                paceBurst_ = asDecOrHexIntValue(cmd.opts_[1]);
+                for (auto* board : boards_)
+                    board->getPacer().setRate(pacePercent_, paceBurst_);
+                break;
+            case BULK_FRAME:
+            {
+                frameHeader_.loadFromHexString(cmd.opts_[0]);
+                for (auto* board : boards_)
+                    board->getShadow().setFrameHeader(frameHeader_);
+                break;
+            }
+            case RECORD_OSC:
+                if (! recorder_.open(File::getCurrentWorkingDirectory().getChildFile(cmd.opts_[0])))
+                    std::cerr << "Error: could not record to " << cmd.opts_[0] << std::endl;
+                break;
+            case MIDI_RECORD:
+                if (! midiRecorder_.open(File::getCurrentWorkingDirectory().getChildFile(cmd.opts_[0]), clock_))
+                    std::cerr << "Error: could not record MIDI to " << cmd.opts_[0] << std::endl;
+                attachMidiRecorder();
+                break;
+            case SOAK_REPORT:
+                if (! soak_.open(File::getCurrentWorkingDirectory().getChildFile(cmd.opts_[0]), cmd.opts_[1].getDoubleValue() * 1000.0))
+                    std::cerr << "Error: could not write the soak report to " << cmd.opts_[0] << std::endl;
+                soakStartMs_ = clock_.nowMs();
+                break;
+            case GOLDEN_COMPARE:
+            {
+                MidiCompare::Stream golden, run;
+                if (! MidiCompare::load(File::getCurrentWorkingDirectory().getChildFile(cmd.opts_[0]), golden))
+                    std::cerr << "Error: could not read the MIDI capture " << cmd.opts_[0] << std::endl;
+                else if (! MidiCompare::load(File::getCurrentWorkingDirectory().getChildFile(cmd.opts_[1]), run))
+                    std::cerr << "Error: could not read the MIDI capture " << cmd.opts_[1] << std::endl;
+                else
+                    std::cout << MidiCompare::compare(golden, run) << std::endl;
+                systemRequestedQuit();
+                break;
+            }
+            case SIMULATED_CLOCK:
+                // the blink engine and el keep the real clock
+                clock_.simulate(Time::getMillisecondCounterHiRes());
+                timers_.setClock(&clock_);
+                reconnects_.setClock(&clock_);
+                replay_.setAdvance([this] (double captureMs) { advanceClock(captureMs); });
+                break;
+            case REPLAY_OSC:
+                // on a simulated clock only once the timers are there
+                if (clock_.isSimulated())
+                    simulatedReplay_ = cmd.opts_[0];
+                else if (! replay_.start(File::getCurrentWorkingDirectory().getChildFile(cmd.opts_[0]), cmd.opts_[1].getDoubleValue()))
+                    std::cerr << "Error: could not replay " << cmd.opts_[0] << std::endl;
+                break;
+            case COALESCE_WINDOW:
+                coalesceMs_ = jmax(0.0, cmd.opts_[0].getDoubleValue());
+                break;
+            case RECV_BATCH:
+                oscReceiver.setBatchSize(asDecOrHexIntValue(cmd.opts_[0]));
+                currentReceivePort_ = -1; // the timer reconnects with the new size
+                break;
+            case BLINK_SYNC:
+                tempoSyncEnabled_ = true;
+                tempoSync_.setOutputLatencyMs(asDecOrHexIntValue(cmd.opts_[0]));
+                blinkEngine_.setMaxTickMs(TEMPO_SYNC_TICK_MS);
+                if (! blinkEngine_.isRunning())
+                    blinkEngine_.start(DEFAULT_BLINK_MS, DEFAULT_FASTBLINK_MS);
+                break;
+            case OSC_OUT:
+                if (UnixDatagram::isPath(cmd.opts_[0]))
+                    engines_.getFirst()->setSendPath(cmd.opts_[0]);
+                else
+                    engines_.getFirst()->setSendPort(asPortNumber(cmd.opts_[0]));
+                // specify here where to send OSC messages to: host URL and UDP port number
+                if (! engines_.getFirst()->connectSender() && ! resolver_.isResolving(engines_.getFirst()->getHost()))
+                    std::cerr << "Error: could not connect to UDP port " << cmd.opts_[0] << std::endl;
+                break;
+            case OSC_IN:
+                if (UnixDatagram::isPath(cmd.opts_[0]))
+                    engines_.getFirst()->setReceivePath(cmd.opts_[0]);
+                else
+                    engines_.getFirst()->setReceivePort(asPortNumber(cmd.opts_[0]));
+                if (!tryToConnectOsc())
+                    std::cerr << "Error: could not connect to UDP port " << cmd.opts_[0] << std::endl;
+                break;
+            case CPU_AFFINITY:
+                // threads started from now on inherit it, JUCE's own
+                // included, those already running are restarted or told
+                threadTuning_.affinityMask = ThreadTuning::parseCores(cmd.opts_[0]);
+                if (threadTuning_.affinityMask == 0)
+                    std::cerr << "Error: no cores in " << cmd.opts_[0] << std::endl;
+                applyThreadTuning();
+                break;
+            case RT_PRIORITY:
+                threadTuning_.realtimePriority = jmax(0, asDecOrHexIntValue(cmd.opts_[0]));
+                applyThreadTuning();
+                break;
+            case EVENT_LOOP:
+                // the handlers run inline, the receiver is reconnected
+                // without a thread of its own on the loop's first tick
+                eventLoopMode_ = true;
+                realtimeOsc_ = 1;
+                oscReceiver.setExternalPolling(true);
+                currentReceivePort_ = -1;
+                break;
+            case ENGINE_ADD:
+            {
+                const bool outIsPath = UnixDatagram::isPath(cmd.opts_[0]);
+                const bool inIsPath = UnixDatagram::isPath(cmd.opts_[1]);
+                auto* engine = engines_.add(new LooperEngine(looperHost_, outIsPath ? 0 : asPortNumber(cmd.opts_[0]),
+                                                             inIsPath ? 0 : asPortNumber(cmd.opts_[1]), asDecOrHexIntValue(cmd.opts_[2])));
+                engine->setResolver(&resolver_);
+                if (outIsPath)
+                    engine->setSendPath(cmd.opts_[0]);
+                if (inIsPath)
+                    engine->setReceivePath(cmd.opts_[1]);
+                if (heartbeatPingMs_ > 0)
+                    engine->getHeartbeat().setTiming(heartbeatPingMs_, heartbeatTimeoutMs_);
+                if (oscTos_ >= 0)
+                    engine->setTrafficClass(oscTos_);
+                engine->getSender().setNonBlocking(nonBlockingSend_);
+                engine->setBundleRequests(bundleRequests_);
+                currentReceivePort_ = -1; // the timer reconnects listening on its port too
+                break;
+            }
+            case LOOPER_HOST:
+                // the requests name our address on the route to it
+                looperHost_ = cmd.opts_[0];
+                engines_.getLast()->setHost(looperHost_);
+                currentReceivePort_ = -1;
+                break;
+            case RECV_BUFFER:
+                oscReceiver.setReceiveBufferSize(asDecOrHexIntValue(cmd.opts_[0]));
+                currentReceivePort_ = -1;
+                break;
+            case PACKET_SIZE:
+                oscReceiver.setMaxPacketSize(asDecOrHexIntValue(cmd.opts_[0]));
+                currentReceivePort_ = -1;
+                break;
+            case KERNEL_TIMESTAMPS:
+                kernelTimestamps_ = true;
+                oscReceiver.setKernelTimestamps(true);
+                currentReceivePort_ = -1;
+                break;
+            case BUSY_POLL:
+                oscReceiver.setBusyPollUs(asDecOrHexIntValue(cmd.opts_[0]));
+                currentReceivePort_ = -1;
+                break;
+            case RECEIVE_SPIN:
+                // a spinning receiver wants a core of its own, the others
+                // keep to the cpu cores
+                oscReceiver.setSpinUs(asDecOrHexIntValue(cmd.opts_[0]));
+                receiverAffinity_ = ThreadTuning::parseCores(cmd.opts_[1]);
+                applyThreadTuning();
+                break;
+            case RECEIVER_SHARDS:
+                // made once before the first connect, so the stats can read
+                // them from any thread
+                for (int i = jlimit(1, maxReceivers, asDecOrHexIntValue(cmd.opts_[0])); --i > 0;)
+                    extraReceivers_.add(new OscInput(*this));
+                break;
+            case OSC_TCP:
+            {
+                // the stream's thread only asks for the link to be checked
+                auto* engine = engines_.getLast();
+                engine->useStream(*this, engines_.size() - 1, asPortNumber(cmd.opts_[0]),
+                                  [this] (bool) { oscStreamChanged_ = 1; armOscReconnect(1.0); });
+                if (oscTos_ >= 0)
+                    engine->setTrafficClass(oscTos_);
+                currentReceivePort_ = -1;
+                break;
+            }
+            case SL_NATIVE:
+                engines_.getLast()->setNative(true);
+                currentReceivePort_ = -1;
+                break;
+            case LOOP_RULE:
+            {
+                LoopRules::Look look, selectedLook;
+                if (! LoopRules::parseLook(cmd.opts_[1], look) || ! LoopRules::parseLook(cmd.opts_[2], selectedLook)
+                    || ! loopRules_.set(asDecOrHexIntValue(cmd.opts_[0]), look, selectedLook))
+                {
+                    std::cerr << "Error: no loop state " << cmd.opts_[0] << " or look " << cmd.opts_[1] << " " << cmd.opts_[2] << std::endl;
+                    break;
+                }
+                for (auto* engine : engines_)
+                    if (engine->isNative())
+                        for (int loop = 0; loop < engine->getLedCount(); ++loop)
+                            renderLoop(*engine, loop);
+                break;
+            }
+            case OSC_TOS:
+                oscTos_ = jlimit(0, 255, asDecOrHexIntValue(cmd.opts_[0]));
+                for (auto* engine : engines_)
+                    if (! engine->setTrafficClass(oscTos_))
+                        log_.write(AsyncLog::Error, "Couldn't set TOS " + String(oscTos_) + " for OSC to port " + engine->describeSend());
+                break;
+            case OSC_NONBLOCKING:
+                nonBlockingSend_ = asDecOrHexIntValue(cmd.opts_[0]) != 0;
+                for (auto* engine : engines_)
+                    engine->getSender().setNonBlocking(nonBlockingSend_);
+                break;
+            default:
+                filterCommands_.add(cmd);
+                break;
+        }
+
+        // several commands drop the link for the reconnect to pick up
+        if (! isOscConnected())
+            armOscReconnect(1.0);
+    }
+
+    uint16 asPortNumber(String value)
+    {
+        return (uint16)limit16Bit(asDecOrHexIntValue(value));
+    }
+
+    uint8 asDecOrHex7BitValue(String value)
+    {
+        return (uint8)limit7Bit(asDecOrHexIntValue(value));
+    }
+
+    uint16 asDecOrHex14BitValue(String value)
+    {
+        return (uint16)limit14Bit(asDecOrHexIntValue(value));
+    }
+
+    int asDecOrHexIntValue(String value)
+    {
+        if (value.endsWithIgnoreCase("H"))
+        {
+            return value.dropLastCharacters(1).getHexValue32();
+        }
+        else if (value.endsWithIgnoreCase("M"))
+        {
+            return value.getIntValue();
+        }
+        else if (useHexadecimalsByDefault_)
+        {
+            return value.getHexValue32();
+        }
+        else
+        {
+            return value.getIntValue();
+        }
+    }
+
+    static uint8 limit7Bit(int value)
+    {
+        return (uint8)jlimit(0, 0x7f, value);
+    }
+
+    static uint16 limit14Bit(int value)
+    {
+        return (uint16)jlimit(0, 0x3fff, value);
+    }
+
+    static uint16 limit16Bit(int value)
+    {
+        return (uint16)jlimit(0, 0xffff, value);
+    }
+
+    int pedalIndex(int controllerValue) {
+        return PedalMap::pedalIndex(controllerValue);
+    }
+
+    uint8 ledNumber(int pedalIdx) {
+        return PedalMap::ledNumber(pedalIdx);
+    }
+
+    bool isLedOn(const LED& led) const {
+        return ledState_.isOn(PedalMap::ledNumber(led.index_));
+    }
+
+    // blink toggles go in their own lane, behind state changes
+    void ledOn(int pedalIdx, LedShadow::Lane lane = LedShadow::StateLane) {
+        ledState_.setOn(ledNumber(pedalIdx), true);
+        //sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, 106, ledNumber(pedalIdx)));
+        showLed(pedalIdx, true, lane);
+    }
+
+    void ledOff(int pedalIdx, LedShadow::Lane lane = LedShadow::StateLane) {
+        ledState_.setOn(ledNumber(pedalIdx), false);
+        //sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, 107, ledNumber(pedalIdx)));
+        showLed(pedalIdx, false, lane);
+    }
+
+    // on every board showing the looper's LED
+    void showLed(int pedalIdx, bool on, LedShadow::Lane lane = LedShadow::StateLane)
+    {
+        // while an animation plays over the LED it shows that instead; the
+        // state is shown again when it is done, as it is once the boot
+        // frame gives way
+        if (bootShown_ || animationPlayer_.getOwned().test(ledNumber(pedalIdx)))
+            return;
+
+        core_.setLed(pedalIdx, on, lane);
+    }
+
+    // the same for LedState masks, which go straight to a board showing the
+    // LEDs from the first
+    void showLeds(const LedBits& mask, const LedBits& on, LedShadow::Lane lane = LedShadow::StateLane)
+    {
+        if (bootShown_)
+            return;
+        writeLeds(mask & ~animationPlayer_.getOwned(), on, lane);
+    }
+
+    // as showLeds(), animated or not
+    void writeLeds(const LedBits& mask, const LedBits& on, LedShadow::Lane lane = LedShadow::StateLane)
+    {
+        core_.setLeds(mask, on, lane);
+    }
+
+    // for the last added board as for those added after it, like host is
+    // for loopers; what it shows is unknown again, so all of it is rewritten
+    void applyBoardLayout()
+    {
+        if (boards_.isEmpty())
+            return;
+
+        boards_.getLast()->setLayout(boardLayout_);
+        resyncLeds();
+        flushMidi();
+    }
+
+    // the heartbeat LED and the display are on every board
+    void showOnAllBoards(uint8 number, bool on, LedShadow::Lane lane)
+    {
+        for (auto* board : boards_)
+            board->getShadow().setLed(number, on, lane);
+    }
+
+    void updateLeds()
+    {
+        for (auto&& led : leds_)
+        {
+            updateLedState(led);
+        }
+    }
+
+    void updateLedState(LED& led)
+    {
+        //sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, led.on_? 106 : 107, ledNumber(led.index_)));
+        showLed(led.index_, isLedOn(led));
+    }
+
+    void updateDisplay()
+    {
+        if (bootShown_ && bootDisplay_ >= 0)
+            return;
+
+        int value = displayEngine_.render(selectedLoop_, tempoSync_, clock_.nowMs());
+        if (value < 0)
+            return;
+
+        //sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, 113, (uint8)(selectedLoop_ / 10)));
+        //sendMidiMessage(midiOut_, MidiMessage::controllerEvent(channel_, 114, (uint8)(selectedLoop_ % 10)));
+        core_.setDisplay(value);
+    }
+
+    // redraws what the display engine derives from the auto updates, at its
+    // refresh rate; the shadow drops digits that stayed the same
+    void displayTick()
+    {
+        const ScopedLock sl(stateLock_);
+        updateDisplay();
+        flushMidi();
+    }
+
+    // forget what the pedalboard shows and write everything again
+    void resyncLeds()
+    {
+        cancelScheduledToggles();
+        for (auto* board : boards_)
+        {
+            board->getShadow().invalidate();
+            board->getBatch().resetRunningStatus();
+        }
+        updateLeds();
+        writeLeds(animationPlayer_.getOwned(), animationPlayer_.getOn(), LedShadow::CosmeticLane);
+        updateDisplay();
+        commitFullState();
+    }
+
+    // with a SysEx frame configured everything goes out in it, otherwise the
+    // next flush writes one controller event per LED and digit
+    void commitFullState()
+    {
+        for (auto* board : boards_)
+            commitFullState(*board);
+    }
+
+    void commitFullState(BoardOutput& board)
+    {
+        if (board.getShadow().hasFrameHeader())
+            board.getShadow().commitFrame();
+    }
+
+    // each board is captured by its index
+    void attachMidiRecorder()
+    {
+        for (int i = 0; i < boards_.size(); ++i)
+            boards_[i]->setMidiRecorder(midiRecorder_.isOpen() ? &midiRecorder_ : nullptr, i);
+    }
+
+    // a board for dout or dadd, set up like the others
+    BoardOutput* createBoard(const String& name, int firstLed)
+    {
+        auto* board = new BoardOutput(name, firstLed, &rawMidiDevices_);
+        board->getSink().setNonBlocking(nonBlocking_);
+        board->getSink().setBufferParams(midiBuffer_);
+        board->getBatch().setChannel(channel_);
+        board->getBatch().setRunningStatus(runningStatus_);
+        board->getShadow().setFrameHeader(frameHeader_);
+        board->getShadow().setDigitControllers(digitControllers_);
+        board->setLayout(boardLayout_);
+        board->getPacer().setRate(pacePercent_, paceBurst_);
+        board->setMaxAgeMs(staleAgeMs_);
+        board->setFlightRecorder(&flightRecorder_);
+        board->setPipelineStages(&pipeline_);
+        if (scheduledMidi_)
+            board->addScheduler(threadTuning_);
+        if (writerPriority_ >= 0)
+            board->startWriter(getWriterTuning(), &latency_.queue);
+        return board;
+    }
+
+    // the timer retries with backoff if this fails
+    void openBoard(BoardOutput& board)
+    {
+        board.getLink().lost();
+        if (! board.getSink().open())
+        {
+            board.getLink().failed(clock_.nowMs());
+            std::cerr << "Couldn't open MIDI output port \"" << board.getName() << "\"" << std::endl;
+            return;
+        }
+
+        board.getLink().connected();
+        startup_.mark(StartupProfile::MidiOpen);
+        initialiseMidiPort(board);
+        flushMidi();
+    }
+
+    // called once the board's port has been opened
+    void initialiseMidiPort(BoardOutput& board)
+    {
+        board.getBatch().resetRunningStatus();
+        board.getShadow().invalidate();
+        if (warmEngines_ != 0)
+        {
+            // what the cache had until the loopers answer
+            updateLeds();
+            updateDisplay();
+        }
+        else if (! looperAnswered_ || bootShown_)
+            showBootFrame(board);
+        else
+            showStateOn(board);
+        commitFullState(board);
+    }
+
+    // a board opened while the loopers are up starts from the LEDs the
+    // others show; only its own shadow is written, the shared state and
+    // the other boards stay as they are
+    void showStateOn(BoardOutput& board)
+    {
+        for (auto i=0; i<NUM_LED_PEDALS; i++)
+        {
+            const int pedalIdx = board.getFirstLed() + i;
+            const int number = board.ledNumberFor(pedalIdx);
+            if (number >= 0)
+                board.getShadow().setLed((uint8)number, ledState_.isOn(ledNumber(pedalIdx)));
+        }
+    }
+
+    // what bootf shows until the first looper's state has arrived, in the
+    // same batch as the rest of the board's initial state. It is drawn in
+    // the board's shadow only, the LED state stays the looper's; while it
+    // is up the state is kept out of the shadows, see showLed()
+    void showBootFrame(BoardOutput& board)
+    {
+        for (auto i=0; i<NUM_LED_PEDALS; i++)
+        {
+            const int number = board.ledNumberFor(board.getFirstLed() + i);
+            if (number >= 0)
+                board.getShadow().setLed((uint8)number, ((bootLeds_ >> i) & 1) != 0);
+        }
+        if (bootDisplay_ >= 0)
+            board.getShadow().setNumber(bootDisplay_);
+        bootShown_ = bootShown_ || bootLeds_ != 0 || bootDisplay_ >= 0;
+    }
+
+    // on a /pingack or /heartbeat
+    void looperAnswered()
+    {
+        looperAnswered_ = true;
+    }
+
+    // the first looper's state is in, or there is none to wait for: it
+    // replaces the boot frame through the shadows, which only send what
+    // differs
+    void stateArrived()
+    {
+        if (! bootShown_)
+            return;
+
+        bootShown_ = false;
+        for (auto* board : boards_)
+            showStateOn(*board);
+        updateDisplay();
+        commitFullState();
+    }
+
+    // shows what the pedalboard showed when we last ran, and takes the
+    // loopers for the same as then, so that their answer only has to correct
+    // it rather than starting from dark
+    void restoreLedCache()
+    {
+        restoreLedImage(ledCache_.get(), "the LED cache");
+    }
+
+    void restoreLedImage(const LedStateCache::Image& image, const String& source)
+    {
+        for (int i = 0; i < jmin(image.numEngines, engines_.size()); ++i)
+        {
+            engines_[i]->setLedCount(image.engines[i].ledCount, LedStore::capacity);
+            engines_[i]->setEngineId(image.engines[i].id);
+            warmEngines_ |= (uint32)1 << i;
+        }
+
+        double nowMs = clock_.nowMs();
+        leds_.reset(jmin(image.numLeds, LedStore::capacity));
+        for (auto&& led : leds_)
+        {
+            const auto& cached = image.leds[led.index_];
+            led.timer_ = cached.timer;
+            led.state_ = static_cast<LedStates>(jlimit(0, (int)FastBlink, (int)cached.state));
+            uint8 number = ledNumber(led.index_);
+            ledState_.setOn(number, startBlinkPhase(led, cached.on != 0, nowMs));
+            ledState_.setBlinking(number, led.state_ == Blink || led.state_ == FastBlink, led.state_ == FastBlink);
+        }
+        selectedLoop_ = image.selectedLoop;
+
+        log_.write(AsyncLog::Info, "Restored " + String(leds_.size()) + " LEDs from " + source);
+        resyncLeds();
+        flushMidi();
+    }
+
+    // after every batch written and every heartbeat tick, without ever
+    // waiting for a reader
+    void publishLedState()
+    {
+        auto& data = ledExport_.beginWrite();
+        data.oscConnected = isOscConnected() ? 1 : 0;
+        data.updatedMs = Time::getMillisecondCounterHiRes();
+        data.selectedLoop = selectedLoop_;
+        data.numLeds = jmin(leds_.size(), (int)LedStateSegment::maxLeds);
+        data.numEngines = jmin(engines_.size(), (int)LedStateSegment::maxEngines);
+        for (int i = 0; i < data.numEngines; ++i)
+        {
+            const LooperEngine& engine = *engines_[i];
+            data.engines[i] = { engine.getEngineId(), engine.getFirstLed(), engine.getLedCount(),
+                                engine.isSenderConnected() ? 1 : 0,
+                                engine.getHeartbeat().getLastHeardMs(), engine.getHeartbeat().getSmoothedRttMs() };
+        }
+        for (int i = 0; i < data.numLeds; ++i)
+        {
+            const LED& led = leds_.getReference(i);
+            data.leds[i] = { (uint8)(isLedOn(led) ? 1 : 0), (uint8)led.state_, (int16)jlimit(-32768, 32767, led.timer_) };
+        }
+        ledExport_.endWrite();
+    }
+
+    // for the threads that read LED states without stateLock_, only the
+    // words of LEDs that changed are stored
+    void publishLedWords()
+    {
+        for (int i = 0; i < leds_.size(); ++i)
+        {
+            const LED& led = leds_.getReference(i);
+            ledWords_.set(i, isLedOn(led), (int)led.state_, led.blink_.litAtOrigin, led.timer_);
+        }
+        ledWords_.setNumLeds(leds_.size());
+    }
+
+    // only the LEDs that changed, unless full
+    void publishMulticast(bool full)
+    {
+        multicast_.setNumLeds(leds_.size());
+        for (int i = 0; i < leds_.size(); ++i)
+        {
+            const LED& led = leds_.getReference(i);
+            multicast_.setLed(i, led.state_, isLedOn(led));
+        }
+        multicast_.setDisplay(selectedLoop_);
+        multicast_.publish(full);
+    }
+
+    // the outputs that may take a while to write get every flush, blinks
+    // included, as a frame on threads of their own; only a frame that
+    // differs from the last one is handed over
+    void publishFrame()
+    {
+        frame_.numLeds = jmin(leds_.size(), (int)LedFrame::maxLeds);
+        frame_.display = selectedLoop_;
+        for (int i = 0; i < frame_.numLeds; ++i)
+        {
+            const LED& led = leds_.getReference(i);
+            frame_.states[i] = (uint8)jlimit(0, 255, (int)led.state_);
+            frame_.on[i] = isLedOn(led);
+        }
+        fanout_.publish(frame_, false);
+    }
+
+    void addFanoutSink(const String& name, FrameFanout::Show show)
+    {
+        fanout_.addSink(name, show, name == STRIP_SINK ? stripPacing_ : artNetPacing_);
+        publishFrame();
+    }
+
+    // on the strip's fan-out thread; it only gets written when a pixel
+    // changed
+    void showStrip(const LedFrame& frame)
+    {
+        strip_.setNumLeds(frame.numLeds);
+        for (int i = 0; i < frame.numLeds; ++i)
+            strip_.setLed(i, frame.states[i], frame.on[i]);
+        strip_.show();
+    }
+
+    // like the strip, the fixtures' channels are rendered on a fan-out
+    // thread and sent at the Art-Net frame rate
+    void showArtNet(const LedFrame& frame)
+    {
+        artNet_.setNumLeds(frame.numLeds);
+        for (int i = 0; i < frame.numLeds; ++i)
+            artNet_.setLed(i, frame.states[i], frame.on[i]);
+        artNet_.commit();
+    }
+
+    // Each stage of the way from a packet to the MIDI bytes on its own, with
+    // the MIDI going to a null port in place of the pedalboard; the state
+    // is not worth keeping afterwards
+    String runBenchmarks(int iterations)
+    {
+        Benchmark bench;
+        if (benchCounters_ && ! bench.enableCounters())
+            std::cerr << "Error: no hardware counters, perf_event_paranoid may be above 2" << std::endl;
+        bench.setRepeats(benchRepeats_);
+        if (benchBaseline_ != File() && ! bench.setBaseline(benchBaseline_.loadFileAsString(), benchTolerance_))
+            std::cerr << "Error: " << benchBaseline_.getFullPathName() << " is not the JSON of a bench" << std::endl;
+
+        runMicrobenchmarks(bench, iterations);
+        if (bench.getNumRegressions() > 0)
+        {
+            std::cerr << "Error: " << bench.getNumRegressions() << " benchmarks regressed against " << benchBaseline_.getFullPathName() << std::endl;
+            setApplicationReturnValue(1);
+        }
+        return bench.toJson();
+    }
+
+    // the LEDs go to a single null board from here on
+    void runMicrobenchmarks(Benchmark& bench, int iterations)
+    {
+        struct NullHandler : OscPacket::Handler
+        {
+            void oscMessageReceived(const OscMessageView&) override {}
+            void oscBundleReceived(const char*, int) override {}
+        } nullHandler;
+
+        const ScopedLock rl(reopenLock_);
+        cancelScheduledToggles();
+        boards_.clear();
+        boards_.add(createBoard("null", 0));
+        openBoard(*boards_.getFirst());
+
+        MemoryBlock led = OscPacket::encode(OSCMessage("/led", (int32)3, (int32)1, (int32)0, (int32)1));
+        MemoryBlock heartbeat = OscPacket::encode(OSCMessage("/heartbeat", String("osc.udp://127.0.0.1:9951/"), String("1.7.3"),
+                                                             (int32)engine_->getLedCount(), (int32)engine_->getEngineId()));
+        LedEvent event;
+        bench.run("decode_led", iterations, [&] (int) { OscPacket::decodeLedEvent((const char*)led.getData(), (int)led.getSize(), event); });
+        bench.run("parse_led", iterations, [&] (int) { OscPacket::parse((const char*)led.getData(), (int)led.getSize(), nullHandler); });
+        bench.run("parse_heartbeat", iterations, [&] (int) { OscPacket::parse((const char*)heartbeat.getData(), (int)heartbeat.getSize(), nullHandler); });
+        bench.run("dispatch_heartbeat", iterations, [&] (int) { OscPacket::parse((const char*)heartbeat.getData(), (int)heartbeat.getSize(), *this); });
+        bench.run("dispatch_led", iterations, [&] (int) { OscPacket::parse((const char*)led.getData(), (int)led.getSize(), *this); });
+        bench.run("led_update_encode", iterations, [&] (int i)
+        {
+            setLedState(i % NUM_LED_PEDALS, i & 1, 0, (i & 1) ? Light : Dark);
+            flushMidi();
+        });
+
+        // the diff against what is shown and its encoding, for every LED
+        // changing at once
+        LedShadow& shadow = boards_.getFirst()->getShadow();
+        MidiBatch& batch = boards_.getFirst()->getBatch();
+        LedBits evenLeds;
+        for (int number = 0; number < 128; number += 2)
+            evenLeds.set(number);
+        bench.run("shadow_commit_128", iterations / 10, [&] (int i)
+        {
+            shadow.setLeds(LedBits::all(), (i & 1) ? evenLeds : ~evenLeds);
+            shadow.commit();
+            batch.clear();
+        });
+
+        for (int numLeds : { NUM_LED_PEDALS, LedStore::capacity })
+        {
+            engine_->setLedCount(numLeds, LedStore::capacity);
+            leds_.reset(numLeds);
+            for (auto&& blinking : leds_)
+            {
+                blinking.state_ = Blink;
+                ledState_.setBlinking(ledNumber(blinking.index_), true, false);
+            }
+
+            // every LED is due on every tick
+            double nowMs = clock_.nowMs();
+            const double periodMs = blinkEngine_.getHalfPeriodMs(false) + 1.0;
+            bench.run("blink_tick_" + String(numLeds), iterations / 10, [&] (int)
+            {
+                nowMs += periodMs;
+                blinkTick(nowMs, ledGeneration_.get());
+            });
+        }
+    }
+
+    // the bench's microbenchmarks, a flush over eight null boards and, unless
+    // it is null, writes to device, turned into what this host can drive at
+    // rate LED updates a second per looper
+    String runCapacityReport(int rate, const String& device)
+    {
+        Benchmark bench;
+        runMicrobenchmarks(bench, 20000);
+
+        const ScopedLock rl(reopenLock_);
+        leds_.reset(NUM_LED_PEDALS);
+        engine_->setLedCount(NUM_LED_PEDALS, LedStore::capacity);
+        for (int i = boards_.size(); i < 8; ++i)
+        {
+            boards_.add(createBoard("null", 0));
+            openBoard(*boards_.getLast());
+        }
+        bench.run("flush_8_boards", 20000, [&] (int) { flushMidi(); });
+
+        CapacityReport::Costs costs;
+        costs.dispatchNs = bench.getNsPerOp("dispatch_led");
+        costs.updateNs = bench.getNsPerOp("led_update_encode");
+        costs.boardFlushNs = bench.getNsPerOp("flush_8_boards") / 8.0;
+        if (device != "null")
+        {
+            BoardOutput board(device, 0, &rawMidiDevices_);
+            board.getBatch().setChannel(channel_);
+            board.getBatch().setRunningStatus(runningStatus_);
+            board.setLayout(boardLayout_);
+            if (! board.getSink().open())
+                std::cerr << "Error: could not open " << device << ", leaving the port out" << std::endl;
+            else
+            {
+                CapacityReport::measureWrites(board, ledNumber(0), 2000, costs);
+                board.getSink().close();
+            }
+        }
+        return CapacityReport::toJson(costs, device, rate, bench.getResults());
+    }
+
+    // "-" for the ring being recorded, "-" as out for stdout
+    void dumpFlightRecorder(const String& ring, const String& out)
+    {
+        std::unique_ptr<OutputStream> stream;
+        if (out == "-")
+            stream.reset(new MemoryOutputStream());
+        else
+        {
+            File file = File::getCurrentWorkingDirectory().getChildFile(out);
+            file.deleteFile();
+            stream.reset(new FileOutputStream(file));
+        }
+
+        bool ok = ring == "-" ? flightRecorder_.dump(*stream)
+                              : FlightRecorder::dumpFile(File::getCurrentWorkingDirectory().getChildFile(ring), *stream);
+        if (! ok)
+            std::cerr << "Error: could not dump the flight recorder " << ring << " to " << out << std::endl;
+        else if (out == "-")
+            std::cout << static_cast<MemoryOutputStream*>(stream.get())->toString() << std::flush;
+    }
+
+    // after every batch written, so costs no more than a copy
+    void storeLedCache()
+    {
+        fillLedImage(ledCache_.beginStore());
+        ledCache_.endStore();
+    }
+
+    void fillLedImage(LedStateCache::Image& image)
+    {
+        image.numLeds = jmin(leds_.size(), (int)LedStateCache::maxLeds);
+        image.selectedLoop = selectedLoop_;
+        image.numEngines = jmin(engines_.size(), (int)LedStateCache::maxEngines);
+        for (int i = 0; i < image.numEngines; ++i)
+            image.engines[i] = { engines_[i]->getEngineId(), engines_[i]->getLedCount() };
+        for (int i = 0; i < image.numLeds; ++i)
+        {
+            const LED& led = leds_.getReference(i);
+            image.leds[i] = { (uint8)(isLedOn(led) ? 1 : 0), (uint8)led.state_, (int16)jlimit(-32768, 32767, led.timer_) };
+        }
+    }
+
+    // on the handoff's thread, for the instance taking over. The receivers
+    // stop first, without stateLock_ as their handlers wait for it, and what
+    // they queued is applied, so the snapshot is the last state we saw and
+    // what comes after it waits in the sockets for the new instance.
+    void exportHandoff(Handoff::State& state, Array<int>& sockets)
+    {
+        // the reconnect leaves the sockets alone from here on
+        handedOff_ = 1;
+        unwatchOscSockets();
+        oscReceiver.pause();
+        for (auto* receiver : extraReceivers_)
+            receiver->pause();
+        drainPacketQueue();
+
+        const ScopedLock sl(stateLock_);
+        fillLedImage(state.image);
+        for (int i = 0; i < LedStateCache::maxLeds; ++i)
+            state.ledSequences[i] = { ledSequences_[i].sequence, ledSequences_[i].seen ? 1 : 0 };
+        for (int i = 0; i < jmin(engines_.size(), (int)LedStateCache::maxEngines); ++i)
+        {
+            uint32 sequence = 0;
+            const bool seen = engines_[i]->getLastSequence(sequence);
+            state.engineSequences[i] = { sequence, seen ? 1 : 0 };
+        }
+
+        sockets.addArray(oscReceiver.getSocketHandles());
+        for (int i = 0; i < numReceivers_ - 1; ++i)
+            sockets.addArray(extraReceivers_[i]->getSocketHandles());
+    }
+
+    // on the handoff's thread once the new instance has the sockets: stops
+    // reading them and frees the pedalboard ports for it, leaving the LEDs
+    // lit as they are, then quits without unregistering from the loopers
+    void releaseForHandoff()
+    {
+        handedOff_ = 1;
+        unwatchOscSockets();
+        oscReceiver.release();
+        for (auto* receiver : extraReceivers_)
+            receiver->release();
+        {
+            const ScopedLock rl(reopenLock_);
+            for (auto* board : boards_)
+            {
+                board->stopWriter();
+                board->getSink().close();
+            }
+        }
+        log_.write(AsyncLog::Info, "Handed over to the new instance");
+        MessageManager::callAsync([this] { systemRequestedQuit(); });
+    }
+
+    // on the handoff's thread when the new instance never took the sockets
+    void resumeAfterHandoff()
+    {
+        handedOff_ = 0;
+        oscReceiver.resume();
+        for (auto* receiver : extraReceivers_)
+            receiver->resume();
+        if (eventLoopMode_)
+            watchOscSockets();
+        log_.write(AsyncLog::Error, "The handover fell through, carrying on");
+    }
+
+    // what the instance we took over from showed and had heard, so the
+    // loopers are neither asked for it again nor their numbering restarted.
+    // A looper on a TCP stream kept sending over the old instance's
+    // connection, it is asked for its state as one restored from the cache is.
+    void takeOverState(const Handoff::State& state)
+    {
+        restoreLedImage(state.image, "the instance handing over");
+        for (int i = 0; i < jmin((int)LedStateCache::maxLeds, (int)LedStore::capacity); ++i)
+            ledSequences_[i] = { state.ledSequences[i].sequence, state.ledSequences[i].seen != 0 };
+        for (int i = 0; i < jmin(engines_.size(), (int)LedStateCache::maxEngines); ++i)
+            if (state.engineSequences[i].seen != 0)
+                engines_[i]->restoreSequence(state.engineSequences[i].sequence);
+        handedEngines_ = warmEngines_;
+        for (int i = 0; i < jmin(engines_.size(), 32); ++i)
+            if (engines_[i]->isStreamed())
+                handedEngines_ &= ~((uint32)1 << i);
+    }
+
+    // a looper's answer to getCurrentState() still coming in, by clock_
+    // like the timers
+    bool isResyncing() const
+    {
+        const double nowMs = clock_.nowMs();
+        for (auto* engine : engines_)
+            if (engine->getResyncStartMs() > 0.0 && nowMs - engine->getResyncStartMs() < RESYNC_TIMEOUT_MS)
+                return true;
+        return false;
+    }
+
+    // returns true if there was anything to write, no board is fine too
+    bool flushMidi()
+    {
+        AllocationStages::Scope stage(AllocationStages::MidiOutput);
+        if (holdForTransaction())
+            return false;
+
+        double startMs = Time::getMillisecondCounterHiRes();
+
+        // ahead of the boards, so a board writing inline at the wire's pace
+        // doesn't hold the fan-out back
+        if (! fanout_.isEmpty())
+            publishFrame();
+
+        bool written = false;
+        double retryMs = -1.0;
+        for (auto* board : boards_)
+        {
+            written = board->flush(changesReceivedMs_) || written;
+            if (board->getShadow().isHoldingBack())
+                retryMs = jmax(retryMs, (double)HELD_LANES_RETRY_MS, board->getPacer().getMsUntilReady(startMs));
+            if (tickless_ && ! board->getSink().isOpen() && reconnectTimers_.midi >= 0
+                && ! reconnects_.isTimerArmed(reconnectTimers_.midi))
+                reconnects_.setTimer(reconnectTimers_.midi, 1, true);
+        }
+
+        if (! hasPendingChanges())
+            changesReceivedMs_ = 0.0;
+        if (written && isResyncing())
+            ++stats_[Stats::resyncWrites];
+        if (resyncAnsweredFromMs_ > 0.0)
+        {
+            latency_.resync.record(clock_.nowMs() - resyncAnsweredFromMs_);
+            resyncAnsweredFromMs_ = 0.0;
+        }
+        if (recovery_.isRecovering())
+            checkRecovered();
+
+        // what was held behind a backlog, or for the wire, tries again once
+        // it should go through
+        if (retryMs > 0.0 && loopTimers_.coalesce >= 0 && ! isLoopTimerArmed(loopTimers_.coalesce))
+            setLoopTimer(loopTimers_.coalesce, retryMs, true);
+
+        if (written)
+            latency_.write.record(Time::getMillisecondCounterHiRes() - startMs);
+        if (written && ! startup_.isMarked(StartupProfile::FirstFrame) && startup_.isMarked(StartupProfile::LooperState)
+            && startup_.mark(StartupProfile::FirstFrame))
+        {
+            log_.write(AsyncLog::Info, startup_.getReport());
+            reconnects_.setTimer(reconnectTimers_.deferred, 1, true);
+        }
+        if (written)
+            publishLedWords();
+        if (written && ledCache_.isOpen())
+            storeLedCache();
+        if (written && ledExport_.isOpen())
+            publishLedState();
+        if (written && multicast_.isOpen())
+            publishMulticast(false);
+        if (eventLoopMode_)
+            watchPendingMidi();
+        return written;
+    }
+
+    // a looper that knows /loop4r/snapshot answers with everything in one
+    // message, the others with a /led per LED and a /display. Once a
+    // snapshot came back only that is asked for. Like the registrations
+    // below this only queues the requests, engine.sendQueued() sends them.
+    void getCurrentState(LooperEngine& engine)
+    {
+        engine.setResyncStartMs(clock_.nowMs());
+        if (! engine.isNative())
+            engine.queue(engine.getRequests().snapshot);
+        if (! engine.isSnapshotSupported())
+        {
+            engine.queue(engine.getRequests().leds);
+            engine.queue(engine.getRequests().display);
+        }
+    }
+
+    // blinking and the display only follow the tempo of the first looper
+    // only what the looper doesn't have already is queued
+    void registerAutoUpdates(LooperEngine& engine, bool unreg)
+    {
+        if (unreg)
+            engine.queueUnregistration(LooperEngine::UpdatesRegistration, engine.getRequests().unregisterUpdates);
+        else if (subscribeFiltered_ && ! engine.isNative())
+            engine.queueRegistration(LooperEngine::UpdatesRegistration, engine.encodeFilteredRegistration(getShownLeds(engine), subscribeIntervalMs_));
+        else
+            engine.queueRegistration(LooperEngine::UpdatesRegistration, engine.getRequests().registerUpdates);
+
+        if (engine.isNative() && unreg)
+            engine.queueUnregistration(LooperEngine::DisplayRegistration, engine.getRequests().unregisterDisplay);
+        else if (engine.isNative())
+            engine.queueRegistration(LooperEngine::DisplayRegistration, engine.getRequests().registerDisplay);
+
+        if ((tempoSyncEnabled_ || displayEngine_.needsTempo()) && &engine == engines_.getFirst())
+            registerTempoUpdates(engine, unreg);
+    }
+
+    // the looper's own indices of its LEDs that some pedalboard shows, or all
+    // of them while the cache, the shared memory, multicast, a strip or Art-Net show them
+    Array<int> getShownLeds(const LooperEngine& engine) const
+    {
+        Array<int> shown;
+        bool publishing = ledCache_.isOpen() || ledExport_.isOpen() || multicast_.isOpen() || strip_.isOpen() || artNet_.isOpen();
+        for (int i = 0; i < engine.getLedCount(); ++i)
+        {
+            bool isShown = publishing;
+            for (auto* board : boards_)
+                isShown = isShown || isPositiveAndBelow(engine.getFirstLed() + i - board->getFirstLed(), PedalMap::numMapped);
+            if (isShown)
+                shown.add(i);
+        }
+        return shown;
+    }
+
+    // SooperLooper's own auto updates for the selected loop's position,
+    // cycle length and loop length, for blinking in phase and the display
+    void registerTempoUpdates(LooperEngine& engine, bool unreg)
+    {
+        const auto& requests = engine.getRequests();
+        for (int i = 0; i < 3; ++i)
+        {
+            if (unreg)
+                engine.queueUnregistration(LooperEngine::TempoRegistration + i, requests.unregisterTempo[i]);
+            else
+                engine.queueRegistration(LooperEngine::TempoRegistration + i, requests.registerTempo[i]);
+        }
+    }
+
+    // the looper's LEDs from index first on, laid out after each other's
+    int getLedEnd() const
+    {
+        int end = 0;
+        for (auto* engine : engines_)
+            end = jmax(end, engine->getEndLed());
+        return end;
+    }
+
+    // Starts the looper over with count LEDs, all dark until it answers: one
+    // registration, one state request and one write of the whole state. The
+    // other loopers' LEDs are left alone.
+    void resetLeds(LooperEngine& engine, int count)
+    {
+        forgetLeds(engine, 0);
+        engine.getMirror().reset();
+        engine.setLedCount(count, LedStore::capacity);
+        leds_.resize(getLedEnd());
+        leds_.resetRange(engine.getFirstLed(), engine.getLedCount());
+
+        registerAutoUpdates(engine, false);
+        getCurrentState(engine);
+        engine.sendQueued();
+        updateLeds();
+        commitFullState();
+    }
+
+    // what the instance of the looper we are leaving shows, for switching
+    // back to it; not for one that never answered
+    void storeEngineFrame(const LooperEngine& engine)
+    {
+        if (engine.getHostUrl().isEmpty() || engine.getLedCount() == 0)
+            return;
+
+        auto& frame = frameCache_.store(EngineFrameCache::hostKey(engine.getHostUrl()), engine.getEngineId(), engine.getLedCount());
+        for (int i = 0; i < frame.ledCount; ++i)
+        {
+            int index = engine.ledIndexFor(i);
+            const LED* led = index >= 0 && index < leds_.size() ? &leds_.getReference(index) : nullptr;
+            frame.leds[i] = { (uint8)(led != nullptr && isLedOn(*led) ? 1 : 0), (uint8)(led != nullptr ? led->state_ : Dark),
+                              (int16)(led != nullptr ? jlimit(-32768, 32767, led->timer_) : 0) };
+        }
+    }
+
+    // A looper instance shown before, as after switching sessions between
+    // songs: its last frame goes out at once instead of going dark, the
+    // shadow only writing what differs from the frame we leave, and its
+    // answers then only correct it. Returns false without a frame for it.
+    bool switchToCachedFrame(LooperEngine& engine, int uid, int count, bool fetchAll)
+    {
+        const auto* frame = frameCache_.find(EngineFrameCache::hostKey(engine.getHostUrl()), uid, count);
+        if (frame == nullptr)
+            return false;
+
+        forgetLeds(engine, 0);
+        engine.setLedCount(count, LedStore::capacity);
+        leds_.resize(getLedEnd());
+
+        const double nowMs = clock_.nowMs();
+        for (int i = 0; i < engine.getLedCount(); ++i)
+        {
+            int index = engine.ledIndexFor(i);
+            if (! isPositiveAndBelow(index, leds_.size()))
+                break;
+
+            LED& led = leds_.getReference(index);
+            const auto& cached = frame->leds[i];
+            led.timer_ = cached.timer;
+            led.state_ = static_cast<LedStates>(jlimit(0, (int)FastBlink, (int)cached.state));
+            uint8 number = ledNumber(index);
+            ledState_.setOn(number, startBlinkPhase(led, cached.on != 0, nowMs));
+            ledState_.setBlinking(number, led.state_ == Blink || led.state_ == FastBlink, led.state_ == FastBlink);
+            if (led.state_ == Blink || led.state_ == FastBlink)
+                armBlinkTick(led.nextToggleMs_, nowMs);
+        }
+
+        registerAutoUpdates(engine, false);
+        if (fetchAll)
+            getCurrentState(engine);
+        else
+            engine.queue(engine.getRequests().display);
+        engine.sendQueued();
+        updateLeds();
+        commitFullState();
+        return true;
+    }
+
+    // the looper's LEDs from its from-th on go dark and stop blinking
+    void forgetLeds(LooperEngine& engine, int from)
+    {
+        for (int i = from; i < engine.getLedCount(); ++i)
+        {
+            int index = engine.ledIndexFor(i);
+            if (! isPositiveAndBelow(index, leds_.size()))
+                continue;
+
+            cancelScheduledToggle(leds_.getReference(index));
+            ledState_.setOn(ledNumber(index), false);
+            ledState_.setBlinking(ledNumber(index), false, false);
+            showLed(index, false);
+        }
+        leds_.resetRange(engine.getFirstLed() + from, engine.getLedCount() - from);
+    }
+
+    // A loop added mid-set: only its LEDs start out dark and are asked for,
+    // the others stay as they are. The registration is only sent again if
+    // it lists the LEDs, an unfiltered one already covers the new loop.
+    void addLeds(LooperEngine& engine, int from)
+    {
+        leds_.resetRange(engine.getFirstLed() + from, engine.getLedCount() - from);
+
+        Array<int> added;
+        for (int i = from; i < engine.getLedCount(); ++i)
+        {
+            int index = engine.ledIndexFor(i);
+            if (! isPositiveAndBelow(index, leds_.size()))
+                break;
+
+            ledSequences_[index] = {};
+            showLed(index, false);
+            added.add(i);
+        }
+
+        if (subscribeFiltered_)
+        {
+            registerAutoUpdates(engine, false);
+            engine.sendQueued();
+        }
+        engine.send(engine.encodeLedsRequest(added));
+    }
+
+    // /pingack and /heartbeat: s:url s:version i:loops i:id
+    typedef OscSchema<StringRef, StringRef, int32, int32> HeartbeatSchema;
+    typedef OscSchema<int32, int32, int32, int32> LedSchema;       // i:index i:on i:timer i:state
+    typedef OscSchema<int32, int32, int32, int32, int32> SequencedLedSchema;   // and i:sequence
+    typedef OscSchema<int32> DisplaySchema;                         // i:loop
+    typedef OscSchema<int32, StringRef, float> TempoSchema;         // i:loop s:control f:value
+
+    // SooperLooper's answer to /ping: s:hosturl s:version i:loopcount
+    typedef OscSchema<StringRef, StringRef, int32> NativePingSchema;
+    typedef OscSchema<int32, StringRef, float> NativeUpdateSchema;  // i:loop s:control f:value
+
+    // the handlers below are for the looper whose packet is being handled
+    void handlePingAckMessage(const OscMessageView& message)
+    {
+        if (message.isEmpty())
+            return;
+
+        HeartbeatSchema::Values values;
+        if (! HeartbeatSchema::decode(message, values))
+        {
+            reportBadMessage("unrecognized format for pingack message.");
+            return;
+        }
+
+        pingAckReceived(*engine_, std::get<0>(values), std::get<1>(values), std::get<2>(values), std::get<3>(values));
+    }
+
+    void pingAckReceived(LooperEngine& engine, StringRef hostUrl, StringRef version, int count, int uid)
+    {
+        LOOP4R_PROBE3(pingack, engine.getFirstLed(), count, uid);
+        startup_.mark(StartupProfile::FirstPingAck);
+        looperAnswered();
+        oscLinkUp();
+        const bool switched = uid != engine.getEngineId();
+        if (switched && engine.getEngineId() != 0)
+            beginRecovery(RecoveryMeter::EngineChange, engine, clock_.nowMs());
+        if (switched)
+        {
+            storeEngineFrame(engine);
+            engine.forgetRegistrations();
+        }
+        engine.setHostUrl(hostUrl);
+        engine.setVersion(version);
+
+        // the looper we left off with only has to correct the cached state
+        const uint32 warmBit = (uint32)1 << jmax(0, engines_.indexOf(&engine));
+        bool warm = (warmEngines_ & warmBit) != 0 && uid == engine.getEngineId() && count == engine.getLedCount();
+        const bool handed = warm && (handedEngines_ & warmBit) != 0;
+        warmEngines_ &= ~warmBit;
+        handedEngines_ &= ~warmBit;
+
+        engine.setEngineId(uid);
+        engine.getSync().greeted(clock_.nowMs(), count > 0 && ! handed);
+        if (count == 0 || handed)
+            stateArrived();
+        if (handed)
+        {
+            // the instance before us stopped reading before its snapshot,
+            // so what the looper sent since waited in the sockets we took
+            // over; registering again only notes what it has
+            registerAutoUpdates(engine, false);
+            engine.sendQueued();
+        }
+        else if (warm)
+        {
+            registerAutoUpdates(engine, false);
+            getCurrentState(engine);
+            engine.sendQueued();
+        }
+        else if (count > 0 && ! (switched && switchToCachedFrame(engine, uid, count, true)))
+            resetLeds(engine, count);
+    }
+
+    // SooperLooper has no instance id, the id stands for its host URL
+    static int nativeEngineId(StringRef hostUrl)
+    {
+        return String(hostUrl).hashCode() & 0x7fffffff;
+    }
+
+    // with sl: a LED for each loop, as many as it has
+    void handleNativePingAckMessage(const OscMessageView& message)
+    {
+        NativePingSchema::Values values;
+        if (! NativePingSchema::decode(message, values))
+        {
+            reportBadMessage("unrecognized format for SooperLooper ping answer.");
+            return;
+        }
+
+        pingAckReceived(*engine_, std::get<0>(values), std::get<1>(values), std::get<2>(values), nativeEngineId(std::get<0>(values)));
+    }
+
+    void handleNativeHeartbeatMessage(const OscMessageView& message)
+    {
+        NativePingSchema::Values values;
+        if (! NativePingSchema::decode(message, values))
+        {
+            reportBadMessage("unrecognized format for SooperLooper ping answer.");
+            return;
+        }
+
+        HeartbeatEvent event { std::get<0>(values), std::get<1>(values), std::get<2>(values), nativeEngineId(std::get<0>(values)),
+                               false, 0, false, OSCTimeTag() };
+        heartbeatReceived(*engine_, event);
+    }
+
+    // a loop's LED drawn from the mirror of its looper with the rules; only
+    // a look that changed reaches the LED, so a blink keeps its phase
+    void renderLoop(LooperEngine& engine, int loop)
+    {
+        int ledIndex = engine.ledIndexFor(loop);
+        if (ledIndex < 0 || ledIndex >= leds_.size())
+            return;
+
+        const LedStates state = static_cast<LedStates>(engine.getMirror().render(loopRules_, loop));
+        if (leds_.getReference(ledIndex).state_ == state)
+            return;
+
+        const bool blinking = state == Blink || state == FastBlink;
+        const int timer = blinking ? jmax(1, roundToInt(blinkEngine_.getHalfPeriodMs(state == FastBlink) / TIMER_TICK_MS)) : TIMER_OFF;
+        setLedState(loop, state != Dark ? 1 : 0, timer, state);
+    }
+
+    void handleNativeStateMessage(const OscMessageView& message)
+    {
+        NativeUpdateSchema::Values values;
+        if (! NativeUpdateSchema::decode(message, values))
+        {
+            reportBadMessage("unrecognized format for SooperLooper state update.");
+            return;
+        }
+
+        const int loop = std::get<0>(values);
+        if (loop < 0 || std::get<1>(values) != StringRef("state"))
+            return;
+
+        ++messageCounts_[ledRoute_];
+        shedder_.admit(ledRoute_, false);
+        engine_->getMirror().setState(loop, roundToInt(std::get<2>(values)));
+        renderLoop(*engine_, loop);
+    }
+
+    // selected_loop_num counts from 0 like the display's loop
+    void handleNativeSelectedMessage(const OscMessageView& message)
+    {
+        NativeUpdateSchema::Values values;
+        if (! NativeUpdateSchema::decode(message, values))
+        {
+            reportBadMessage("unrecognized format for SooperLooper selected loop update.");
+            return;
+        }
+
+        // the loops' LEDs may look different selected
+        const int selected = roundToInt(std::get<2>(values));
+        const int previous = engine_->getMirror().setSelected(selected);
+        if (previous != selected)
+        {
+            renderLoop(*engine_, previous);
+            renderLoop(*engine_, selected);
+        }
+
+        ++messageCounts_[displayRoute_];
+        displayReceived(selected, shedder_.admit(displayRoute_, true) || isResyncing());
+    }
+
+    void handleHeartbeatMessage(const OscMessageView& message)
+    {
+        if (message.isEmpty())
+            return;
+
+        LooperEngine& engine = *engine_;
+        HeartbeatSchema::Values values;
+        if (! HeartbeatSchema::decode(message, values))
+        {
+            reportBadMessage("unrecognized format for heartbeat message.");
+            return;
+        }
+
+        HeartbeatEvent event { std::get<0>(values), std::get<1>(values), std::get<2>(values), std::get<3>(values),
+                               message.size() > 4 && message[4].isInt32(), 0,
+                               message[message.size() - 1].isTimeTag(), OSCTimeTag() };
+        if (event.hasDigest)
+            event.digest = message[4].getInt32();
+        if (event.hasTimeTag)
+            event.timeTag = message[message.size() - 1].getTimeTag();
+        heartbeatReceived(engine, event);
+    }
+
+    // from the generic decoder or straight from the packet, either way with
+    // the strings in it: the engine only copies them when they change
+    void heartbeatReceived(LooperEngine& engine, const HeartbeatEvent& event)
+    {
+        LOOP4R_PROBE3(heartbeat, engine.getFirstLed(), event.ledCount, event.engineId);
+        if (! looperAnswered_)
+            looperAnswered();
+        if (event.engineId != engine.getEngineId() && event.ledCount > 0)
+            storeEngineFrame(engine);
+        engine.setHostUrl(event.hostUrl);
+        engine.setVersion(event.version);
+        int numleds = jmax(0, event.ledCount);
+        int uid = event.engineId;
+        if (uid != engine.getEngineId())
+        {
+            // looper changed on us, reinitialize
+            if (numleds > 0)
+            {
+                if (engine.getEngineId() != 0)
+                    beginRecovery(RecoveryMeter::EngineChange, engine, clock_.nowMs());
+                engine.setSnapshotSupported(false); // until the new one says otherwise
+                engine.getClockOffset().reset();
+                engine.forgetRegistrations();
+
+                // with a digest the repair below fetches only the LEDs
+                // that differ from the cached frame
+                if (! switchToCachedFrame(engine, uid, numleds, ! event.hasDigest || engine.isStreamed()))
+                    resetLeds(engine, numleds);
+                engine.setEngineId(uid);
+                engine.getSync().greeted(clock_.nowMs(), true);
+            }
+        }
+        else
+        {
+            // check loopcount
+            if (engine.getLedCount() != numleds)
+            {
+                int oldCount = engine.getLedCount();
+                // LEDs of loops that went away go dark
+                forgetLeds(engine, numleds);
+                engine.setLedCount(numleds, LedStore::capacity);
+                leds_.resize(getLedEnd());
+                if (engine.getLedCount() > oldCount)
+                    addLeds(engine, oldCount);
+            }
+        }
+
+        if (gpio_.has(GpioStatus::Heartbeat))
+        {
+            gpio_.set(GpioStatus::Heartbeat, ! heartbeatOn_);
+            gpio_.flush();
+        }
+        else
+        {
+            for (auto* board : boards_)
+                board->getShadow().setLed(board->getLayout().getHeartbeatLed(), ! heartbeatOn_, LedShadow::CosmeticLane);
+        }
+        heartbeatOn_ = !heartbeatOn_;
+        double nowMs = clock_.nowMs();
+        if (event.hasTimeTag && ! event.timeTag.isImmediately())
+            addClockSample(engine, event.timeTag, nowMs);
+        engine.getHeartbeat().replyReceived(nowMs);
+
+        // a stream loses nothing while connected, and connecting again
+        // fetches everything
+        if (engine.isStreamed())
+            return;
+
+        if (event.hasDigest)
+            repairDrift(engine, event.digest, nowMs);
+        else if (engine.getMissingUpdates() > 0 && engine.shouldRepair(nowMs))
+        {
+            // without a digest there's no telling which LEDs the lost
+            // updates were for
+            ++stats_[Stats::gapRefetches];
+            engine.send(engine.getRequests().leds);
+        }
+    }
+
+    // A looper may put the time it sent a heartbeat at the end of it. One
+    // answering our ping times the round trip, the others are taken to be
+    // half the smoothed round trip old.
+    void addClockSample(LooperEngine& engine, OSCTimeTag sentAt, double nowMs)
+    {
+        const HeartbeatMonitor& heartbeat = engine.getHeartbeat();
+        const double remoteMs = ClockOffset::toMs(sentAt);
+        if (heartbeat.getPingSentMs() > 0.0)
+            engine.getClockOffset().addRoundTrip(heartbeat.getPingSentMs(), remoteMs, nowMs);
+        else
+            engine.getClockOffset().addOneWay(remoteMs, nowMs, heartbeat.getSmoothedRttMs());
+    }
+
+    // A looper may add a digest of its LED states to /heartbeat: the state
+    // of each of its LEDs in 2 bits at (index % 16) * 2, xored together. A
+    // digest that doesn't match ours has only the LEDs of those groups that
+    // differ fetched again, their replies go through the shadow like any
+    // other /led, so only what actually changed is sent to the board.
+    int32 getLedDigest(const LooperEngine& engine)
+    {
+        uint32 digest = 0;
+        for (int i = 0; i < engine.getLedCount(); ++i)
+        {
+            int ledIndex = engine.getFirstLed() + i;
+            if (ledIndex < leds_.size())
+                digest ^= ((uint32)leds_.getReference(ledIndex).state_ & 3) << ((i % 16) * 2);
+        }
+        return (int32)digest;
+    }
+
+    void repairDrift(LooperEngine& engine, int32 theirs, double nowMs)
+    {
+        // the LEDs we didn't subscribe to are meant to differ as well
+        if (subscribeFiltered_ && getShownLeds(engine).size() < engine.getLedCount())
+            return;
+
+        // a guess still waiting for its answer is meant to differ
+        for (int i = 0; i < engine.getLedCount(); ++i)
+        {
+            int ledIndex = engine.getFirstLed() + i;
+            if (ledIndex < leds_.size() && predicted_[ledIndex].untilMs != 0.0)
+                return;
+        }
+
+        uint32 differ = (uint32)(theirs ^ getLedDigest(engine));
+        if (differ == 0 || ! engine.shouldRepair(nowMs))
+            return;
+
+        Array<int> looperLeds;
+        for (int i = 0; i < engine.getLedCount(); ++i)
+            if ((differ >> ((i % 16) * 2)) & 3)
+                looperLeds.add(i);
+
+        ++stats_[Stats::driftRepairs];
+        stats_[Stats::ledsRefetched] += looperLeds.size();
+        engine.send(engine.encodeLedsRequest(looperLeds));
+    }
+
+    void handleLedMessage(const OscMessageView& message)
+    {
+        if (! message.isEmpty()
+            && ! SequencedLedSchema::apply(message, [this] (int32 index, int32 on, int32 timer, int32 state, int32 sequence)
+                                           { setSequencedLedState(index, on, timer, state, sequence); })
+            && ! LedSchema::apply(message, [this] (int32 index, int32 on, int32 timer, int32 state) { setLedState(index, on, timer, state); }))
+            reportBadMessage("unrecognized format for led message.");
+    }
+
+    // /loop4r_leds/snapshot i:display, then i:on i:timer i:state for each LED
+    // from the first, or all of those in a blob as big endian int32s
+    void handleSnapshotMessage(const OscMessageView& message)
+    {
+        if (message.isEmpty() || ! message[0].isInt32())
+        {
+            reportBadMessage("unrecognized format for snapshot message.");
+            return;
+        }
+
+        engine_->setSnapshotSupported(true);
+        int index = 0;
+        if (message.size() == 2 && message[1].isBlob())
+        {
+            // swapped in one go, there are never more LEDs than the store holds
+            int32 values[3 * LedStore::capacity];
+            const int numLeds = jmin(LedStore::capacity, message[1].getBlobSize() / 12);
+            OscPacket::readInt32s(message[1].getBlobData(), 3 * numLeds, values);
+            for (; index < numLeds; ++index)
+                setLedState(index, values[3 * index], values[3 * index + 1], values[3 * index + 2]);
+        }
+        else
+        {
+            for (int i = 1; i + 2 < message.size(); i += 3)
+            {
+                if (! message[i].isInt32() || ! message[i + 1].isInt32() || ! message[i + 2].isInt32())
+                {
+                    reportBadMessage("unrecognized format for snapshot message.");
+                    break;
+                }
+                setLedState(index++, message[i].getInt32(), message[i + 1].getInt32(), message[i + 2].getInt32());
+            }
+        }
+
+        setSelectedLoop(message[0].getInt32());
+    }
+
+    // A /led numbered no later than the last one for its LED arrived late
+    // or twice and is dropped, so a reordered datagram can't undo a newer
+    // state. The numbers may be per LED or one count across the looper's,
+    // compared as serial numbers, so they may wrap; those without one are
+    // always applied. With one count a gap is counted as lost updates,
+    // which the next heartbeat repairs.
+    void setSequencedLedState(int looperLed, int on, int timer, int state, int32 sequence)
+    {
+        int ledIndex = engine_->ledIndexFor(looperLed);
+        if (isPositiveAndBelow(ledIndex, leds_.size()))
+        {
+            auto& last = ledSequences_[ledIndex];
+            if (last.seen && last.sequence - (uint32)sequence < STALE_SEQUENCE_WINDOW)
+            {
+                ++stats_[Stats::staleLeds];
+                return;
+            }
+            last = { (uint32)sequence, true };
+            int missing = engine_->getMissingUpdates();
+            engine_->noteSequence((uint32)sequence);
+            if (engine_->getMissingUpdates() > missing)
+                stats_[Stats::sequenceGaps] += engine_->getMissingUpdates() - missing;
+        }
+
+        setLedState(looperLed, on, timer, state);
+    }
+
+    // ledIndex is the looper's own, its LEDs start at its first
+    void setLedState(int looperLed, int on, int timer, int state)
+    {
+        int ledIndex = engine_->ledIndexFor(looperLed);
+        if (ledIndex < 0 || ledIndex >= leds_.size())
+            return;
+
+        LOOP4R_PROBE4(led_state, ledIndex, on, timer, state);
+        reconcilePrediction(ledIndex, state);
+        applyLedState(ledIndex, on, timer, state);
+    }
+
+    void applyLedState(int ledIndex, int on, int timer, int state)
+    {
+        LED& led = leds_.getReference(ledIndex);
+        led.generation_ = ++ledGeneration_;
+        cancelScheduledToggle(led);
+        blinkJitter_.restart(ledIndex);
+        led.timer_ = timer;
+        led.state_ = static_cast<LedStates>(state);
+
+        double nowMs = clock_.nowMs();
+        uint8 number = ledNumber(ledIndex);
+        ledState_.setOn(number, startBlinkPhase(led, on != 0, nowMs));
+        ledState_.setBlinking(number, led.state_ == Blink || led.state_ == FastBlink, led.state_ == FastBlink);
+        if (led.state_ == Blink || led.state_ == FastBlink)
+            armBlinkTick(led.nextToggleMs_, nowMs);
+
+        updateLedState(led);
+    }
+
+    // The looper's timer counts the ticks until a blinking LED first flips.
+    // With align every LED blinking at a rate shares the phase that starts
+    // at time 0 instead, so they all flip in the same batch. Returns whether
+    // the LED is lit now.
+    bool startBlinkPhase(LED& led, bool on, double nowMs)
+    {
+        const double halfPeriodMs = blinkEngine_.getHalfPeriodMs(led.state_ == FastBlink);
+        if (blinkAligned_ && (led.state_ == Blink || led.state_ == FastBlink))
+        {
+            led.blink_ = { 0.0, true };
+            led.nextToggleMs_ = led.blink_.getNextFlipMs(halfPeriodMs, nowMs);
+            return led.blink_.isLit(halfPeriodMs, nowMs);
+        }
+
+        led.nextToggleMs_ = nowMs + jmax(0, led.timer_) * TIMER_TICK_MS;
+        led.blink_ = { led.nextToggleMs_ - halfPeriodMs, on };
+        return on;
+    }
+
+    void handleDisplayMessage(const OscMessageView& message)
+    {
+        if (! message.isEmpty()
+            && ! DisplaySchema::apply(message, [this] (int32 loop) { displayReceived(loop, displayAdmitted_); }))
+            reportBadMessage("unrecognized format for display message.");
+    }
+
+    // a display update shed under an OSC flood is kept, the last one is
+    // shown once the load is back within budget
+    void displayReceived(int loop, bool admitted)
+    {
+        if (admitted)
+        {
+            shedDisplayEngine_ = nullptr;
+            setSelectedLoop(loop);
+            return;
+        }
+        shedDisplayEngine_ = engine_;
+        shedDisplay_ = loop;
+    }
+
+    void applyShedDisplay()
+    {
+        if (shedDisplayEngine_ == nullptr)
+            return;
+        engine_ = shedDisplayEngine_;
+        shedDisplayEngine_ = nullptr;
+        setSelectedLoop(shedDisplay_);
+    }
+
+    // the display shows whichever looper's selection changed last
+    void setSelectedLoop(int loop)
+    {
+        LOOP4R_PROBE1(display, loop);
+        // the display comes last in a looper's answer, or in its snapshot
+        if (! startup_.isMarked(StartupProfile::LooperState) && startup_.isMarked(StartupProfile::FirstPingAck))
+            startup_.mark(StartupProfile::LooperState);
+        selectedLoop_ = loop + 1; // 1 based display!
+        selectionReceived(loop);
+        engine_->getSync().synced(clock_.nowMs());
+        stateArrived();
+        if (engine_->getResyncStartMs() > 0.0)
+        {
+            // timed once what came before it has been written
+            resyncAnsweredFromMs_ = resyncAnsweredFromMs_ > 0.0 ? jmin(resyncAnsweredFromMs_, engine_->getResyncStartMs())
+                                                                : engine_->getResyncStartMs();
+            engine_->setResyncStartMs(0.0);
+        }
+        updateDisplay();
+    }
+
+    // /loop4r_leds/scene i:n sets every LED the scene names, in the
+    // sender's numbering; the packet's flush writes them as one batch and
+    // the shadow leaves out those already showing
+    void handleSceneMessage(const OscMessageView& message)
+    {
+        if (message.size() != 1 || ! message[0].isInt32())
+        {
+            reportBadMessage("unrecognized format for scene message.");
+            return;
+        }
+
+        const int n = message[0].getInt32();
+        if (! isPositiveAndBelow(n, scenes_.size()))
+        {
+            reportBadMessage("unknown scene in scene message.");
+            return;
+        }
+
+        for (auto& led : scenes_.getReference(n))
+            setLedState(led.index, led.state != Dark ? 1 : 0, 0, led.state);
+    }
+
+    // /loop4r_leds/animation i:n plays animation n instead of any other, a
+    // negative n stops the one playing
+    void handleAnimationMessage(const OscMessageView& message)
+    {
+        if (message.size() != 1 || ! message[0].isInt32())
+        {
+            reportBadMessage("unrecognized format for animation message.");
+            return;
+        }
+
+        const int n = message[0].getInt32();
+        if (n < 0)
+        {
+            stopAnimation();
+            return;
+        }
+
+        if (! isPositiveAndBelow(n, animations_.size()) || animations_[n]->isEmpty())
+        {
+            reportBadMessage("unknown animation in animation message.");
+            return;
+        }
+
+        startAnimation(*animations_[n]);
+    }
+
+    void startAnimation(const LedAnimation& animation)
+    {
+        stopAnimation();
+
+        // a toggle queued in a sink would draw over the animation
+        cancelScheduledToggles();
+        const double nowMs = clock_.nowMs();
+        animationPlayer_.start(animation, nowMs);
+        updateAnimation(nowMs);
+    }
+
+    void stopAnimation()
+    {
+        animationPlayer_.stop([this] (const LedAnimation::Step& step) { applyAnimationStep(step); });
+    }
+
+    // the steps due by nowMs; their frames go in the cosmetic lane, so like
+    // the display they wait behind a backlog and while the wire is busy, and
+    // a frame superseded meanwhile is never written
+    void updateAnimation(double nowMs)
+    {
+        animationPlayer_.advance(nowMs, [this] (const LedAnimation::Step& step) { applyAnimationStep(step); });
+    }
+
+    // the LEDs the step gives back show their state again, as it is now
+    void applyAnimationStep(const LedAnimation::Step& step)
+    {
+        writeLeds(step.changed, step.on, LedShadow::CosmeticLane);
+        writeLeds(step.released, ledState_.getOn() & step.released);
+        ++stats_[Stats::animationSteps];
+    }
+
+    // /loop4r_leds/begin [i:ms] stages every update until
+    // /loop4r_leds/commit, which writes them as one batch of what differs,
+    // so the pedals never show a loop selection half done. Blink toggles
+    // and the heartbeat LED wait too. A commit that doesn't come within ms
+    // (by default TRANSACTION_TIMEOUT_MS) is taken as lost and the updates
+    // go out anyway; a begin in a transaction only extends it.
+    void handleBeginMessage(const OscMessageView& message)
+    {
+        int timeoutMs = TRANSACTION_TIMEOUT_MS;
+        if (message.size() == 1 && message[0].isInt32())
+            timeoutMs = jlimit(1, 1000, (int)message[0].getInt32());
+        else if (! message.isEmpty())
+        {
+            reportBadMessage("unrecognized format for begin message.");
+            return;
+        }
+
+        if (transactionUntilMs_ <= 0.0)
+            ++stats_[Stats::transactions];
+        transactionUntilMs_ = clock_.nowMs() + timeoutMs;
+    }
+
+    void handleCommitMessage(const OscMessageView&)
+    {
+        if (transactionUntilMs_ <= 0.0)
+            return;
+
+        transactionUntilMs_ = 0.0;
+        flushMidi();
+    }
+
+    // true while a transaction holds the writes back, with the coalescing
+    // timer armed to flush when it runs out; by the same clock as the
+    // timers, so a simulated one times the transaction out too
+    bool holdForTransaction()
+    {
+        if (transactionUntilMs_ <= 0.0)
+            return false;
+
+        const double nowMs = clock_.nowMs();
+        if (nowMs >= transactionUntilMs_)
+        {
+            transactionUntilMs_ = 0.0;
+            ++stats_[Stats::transactionTimeouts];
+            return false;
+        }
+
+        if (loopTimers_.coalesce >= 0 && ! isLoopTimerArmed(loopTimers_.coalesce))
+            setLoopTimer(loopTimers_.coalesce, jmax(1.0, transactionUntilMs_ - nowMs), true);
+        return true;
+    }
+
+    void handleResyncMessage(const OscMessageView&)
+    {
+        resyncLeds();
+    }
+
+    // /loop4r_leds/stats i:port [s:host] replies to port on host (by default
+    // this one) with a /loop4r_leds/stats message of name, value pairs
+    void handleStatsMessage(const OscMessageView& message)
+    {
+        if (message.size() < 1 || ! message[0].isInt32())
+        {
+            reportBadMessage("unrecognized format for stats message.");
+            return;
+        }
+
+        OSCMessage reply("/loop4r_leds/stats");
+        auto add = [&reply] (const String& name, int64 value)
+        {
+            reply.addString(name);
+            reply.addInt32((int32)jmin(value, (int64)0x7fffffff));
+        };
+        collectStats(add);
+        collectThreadStats(add);
+        collectLedStats(add);
+
+        String host = message.size() > 1 && message[1].isString() ? message[1].getString() : String("127.0.0.1");
+        OscOutput output;
+        if (! output.connect(host, message[0].getInt32()) || ! output.send(reply))
+            log_.write(AsyncLog::Error, "Could not send stats to " + host + ":" + String(message[0].getInt32()));
+    }
+
+    // on the exporter's thread
+    void exportStats(const MetricsExporter::AddFunction& add)
+    {
+        collectThreadStats(add);
+        collectLedStats(add);
+        const ScopedLock sl(stateLock_);
+        collectStats(add);
+    }
+
+    // the CPU time and context switches of each thread; reads /proc, so
+    // the exporter does it without stateLock_
+    void collectThreadStats(const MetricsExporter::AddFunction& add)
+    {
+        ThreadCpu::forEachThread([&add] (const ThreadCpu::Usage& usage)
+        {
+            add("thread_cpu_ms " + usage.name, usage.cpuUs / 1000);
+            add("thread_voluntary_switches " + usage.name, usage.voluntarySwitches);
+            add("thread_involuntary_switches " + usage.name, usage.involuntarySwitches);
+        });
+    }
+
+    // from the LED words, which need no lock
+    void collectLedStats(const MetricsExporter::AddFunction& add)
+    {
+        int lit = 0, blinking = 0;
+        for (int i = 0; i < ledWords_.getNumLeds(); ++i)
+        {
+            auto led = ledWords_.get(i);
+            lit += led.on ? 1 : 0;
+            blinking += led.state >= Blink ? 1 : 0;
+        }
+        add("leds_lit", lit);
+        add("leds_blinking", blinking);
+        add("led_changes", ledWords_.getNumChanges());
+    }
+
+    // every counter and percentile by name, for the stats message and the
+    // exporter, with stateLock_ held
+    void collectStats(const MetricsExporter::AddFunction& add)
+    {
+        add("pipeline_legacy", legacyPipeline_ ? 1 : 0);
+        add("packets", stats_[Stats::packets].get());
+        add("parse_errors", stats_[Stats::parseErrors].get());
+        add("decode_arena_peak", (int64)decodeArena_.getPeak());
+        add("decode_arena_exhausted", decodeArena_.getExhausted());
+        add("unhandled", stats_[Stats::unhandled].get());
+        add("queue_drops", stats_[Stats::queueDrops].get());
+        int64 sendsDeferred = 0, sendsDropped = 0, sendBacklog = 0;
+        for (auto* engine : engines_)
+        {
+            sendsDeferred += engine->getSender().getNumDeferred();
+            sendsDropped += engine->getSender().getNumDropped();
+            sendBacklog += engine->getSender().getNumBacklogged();
+        }
+        add("osc_sends_deferred", sendsDeferred);
+        add("osc_sends_dropped", sendsDropped);
+        add("osc_send_backlog", sendBacklog);
+        add("background_queued", background_.getNumQueued());
+        add("background_deferred", background_.getNumDeferred());
+        add("background_overdue", background_.getNumOverdue());
+        int64 truncated = oscReceiver.getTruncatedPackets();
+        for (auto* receiver : extraReceivers_)
+            truncated += receiver->getTruncatedPackets();
+        add("truncated_packets", truncated);
+        add("receive_spin_us", (int64)oscReceiver.getSpinUs());
+        int64 spinHits = oscReceiver.getSpinHits();
+        for (auto* receiver : extraReceivers_)
+            spinHits += receiver->getSpinHits();
+        add("receive_spin_hits", spinHits);
+        add("receivers", (int64)numReceivers_);
+        add("shed_level", (int64)shedder_.getLevel());
+        add("shed_messages", shedder_.getShed());
+        add("shed_windows", shedder_.getWindowsOver());
+        add("adaptive_window_us", (int64)(microbatch_.getWindowMs() * 1000.0));
+        add("adaptive_widenings", microbatch_.getWidened());
+        for (int i = 0; i < oscAddresses_.size(); ++i)
+            add("messages " + oscAddresses_.getAddress(i), messageCounts_[i].get());
+        int64 bytesWritten = 0, bytesDropped = 0, shortWrites = 0;
+        for (auto* board : boards_)
+        {
+            bytesWritten += board->getSink().getBytesWritten();
+            bytesDropped += board->getSink().getBytesDropped();
+            shortWrites += board->getSink().getShortWrites();
+        }
+        add("midi_bytes_written", bytesWritten);
+        add("midi_bytes_dropped", bytesDropped);
+        add("midi_short_writes", shortWrites);
+        int64 bufferSize = 0;
+        for (auto* board : boards_)
+            bufferSize = jmax(bufferSize, (int64)board->getSink().getBufferSize());
+        add("midi_buffer_bytes", bufferSize);
+        int64 staleDrops = 0, staleBytes = 0;
+        for (auto* board : boards_)
+        {
+            staleDrops += board->getStaleDrops();
+            staleBytes += board->getStaleBytes();
+        }
+        add("midi_stale_drops", staleDrops);
+        add("midi_stale_bytes", staleBytes);
+        // the wire as the pacer estimates it, for the most backed up board
+        double nowMs = Time::getMillisecondCounterHiRes();
+        int64 wireQueued = 0, wireDrainUs = 0, pacedHolds = 0;
+        for (auto* board : boards_)
+        {
+            wireQueued = jmax(wireQueued, (int64)board->getPacer().getQueuedBytes(nowMs));
+            wireDrainUs = jmax(wireDrainUs, (int64)(board->getPacer().getMsToDrain(nowMs) * 1000.0));
+            pacedHolds += board->getPacer().getHeldBack();
+        }
+        add("midi_wire_queued_bytes", wireQueued);
+        add("midi_wire_drain_us", wireDrainUs);
+        add("midi_paced_holds", pacedHolds);
+        add("osc_reconnects", stats_[Stats::oscReconnects].get());
+        add("animation_steps", stats_[Stats::animationSteps].get());
+        add("transactions", stats_[Stats::transactions].get());
+        add("transaction_timeouts", stats_[Stats::transactionTimeouts].get());
+        add("strip_frames", strip_.getFramesWritten());
+        add("strip_write_errors", strip_.getFailedWrites());
+        add("artnet_packets", artNet_.getPacketsSent());
+        add("artnet_send_errors", artNet_.getFailedSends());
+        add("gpio_write_errors", gpio_.getFailedWrites());
+        for (auto& sink : fanout_.getStats())
+        {
+            add("fanout_" + sink.name + "_frames", sink.shown);
+            add("fanout_" + sink.name + "_dropped", sink.dropped);
+            add("fanout_" + sink.name + "_lag_p99_us", sink.lagP99Us);
+            add("fanout_" + sink.name + "_lag_max_us", sink.lagMaxUs);
+        }
+        add("midi_reopens", stats_[Stats::midiReopens].get());
+        add("heartbeat_misses", stats_[Stats::heartbeatMisses].get());
+        add("watchdog_pings", systemd_.getPings());
+        for (int phase = StartupProfile::Initialise; phase < StartupProfile::numPhases; ++phase)
+            add("startup_" + String(StartupProfile::getName(phase)) + "_ms", startup_.getMsSinceStart(phase));
+        add("watchdog_missed", systemd_.getMissedPings());
+        if (! engines_.isEmpty() && engines_.getFirst()->getClockOffset().isValid())
+        {
+            const ClockOffset& offset = engines_.getFirst()->getClockOffset();
+            add("clock_samples", offset.getNumSamples());
+            add("clock_delay_us", (int64)(offset.getDelayMs() * 1000.0));
+            add("clock_drift_ppb", (int64)(offset.getDriftPpm() * 1000.0));
+        }
+        add("prediction_hits", stats_[Stats::predictionHits].get());
+        add("mispredictions", stats_[Stats::mispredictions].get());
+        add("selection_guesses", stats_[Stats::selectionGuesses].get());
+        add("resyncs", latency_.resync.getCount());
+        add("resync_writes", stats_[Stats::resyncWrites].get());
+        add("resync_p50_us", latency_.resync.getPercentile(0.5));
+        const LatencyHistogram& recovered = recovery_.getHistogram();
+        add("recoveries", recovered.getCount());
+        for (int cause = 0; cause < RecoveryMeter::numCauses; ++cause)
+            add("recoveries_" + String(RecoveryMeter::getName(cause)), recovery_.getCount(cause));
+        add("recovering", recovery_.isRecovering() ? 1 : 0);
+        add("recovery_p50_us", recovered.getPercentile(0.5));
+        add("recovery_p99_us", recovered.getPercentile(0.99));
+        add("recovery_max_us", recovered.getMax());
+        add("recovery_last_us", (int64)(recovery_.getLastMs() * 1000.0));
+        add("recovery_last_midi_bytes", recovery_.getLastMidiBytes());
+        add("recovery_last_osc_packets", recovery_.getLastOscPackets());
+        add("recovery_midi_bytes", recovery_.getMidiBytes());
+        add("recovery_osc_packets", recovery_.getOscPackets());
+        add("stale_leds", stats_[Stats::staleLeds].get());
+        add("sequence_gaps", stats_[Stats::sequenceGaps].get());
+        add("gap_refetches", stats_[Stats::gapRefetches].get());
+        add("frame_cache_hits", frameCache_.getHits());
+        add("frame_cache_misses", frameCache_.getMisses());
+        int64 streamConnects = 0, streamWrites = 0, streamOversize = 0;
+        for (auto* engine : engines_)
+        {
+            if (auto* stream = engine->getStream())
+            {
+                streamConnects += stream->getConnects();
+                streamWrites += stream->getWrites();
+                streamOversize += stream->getOversizePackets();
+            }
+        }
+        add("osc_tcp_connects", streamConnects);
+        add("osc_tcp_writes", streamWrites);
+        add("osc_tcp_oversize", streamOversize);
+        add("drift_repairs", stats_[Stats::driftRepairs].get());
+        add("leds_refetched", stats_[Stats::ledsRefetched].get());
+        // the round trip is the first looper's, the others are usually on the
+        // same host
+        int64 timeouts = 0;
+        for (auto* engine : engines_)
+            timeouts += engine->getHeartbeat().getTimeouts();
+        auto& heartbeat = engines_.getFirst()->getHeartbeat();
+        add("engines", engines_.size());
+        int64 registrationsSkipped = 0, requestBundles = 0;
+        for (auto* engine : engines_)
+        {
+            registrationsSkipped += engine->getRegistrationsSkipped();
+            requestBundles += engine->getSender().getNumBundles();
+        }
+        add("registrations_skipped", registrationsSkipped);
+        add("request_bundles", requestBundles);
+        add("dns_lookups", resolver_.getLookups());
+        add("dns_failures", resolver_.getFailures());
+        add("dns_changes", resolver_.getChanges());
+        add("heartbeat_timeouts", timeouts);
+        add("heartbeat_rtt_us", (int64)(heartbeat.getRttMs() * 1000.0));
+        add("heartbeat_srtt_us", (int64)(heartbeat.getSmoothedRttMs() * 1000.0));
+        add("heartbeat_jitter_us", (int64)(heartbeat.getJitterMs() * 1000.0));
+        int64 syncCancels = 0, syncGiveUps = 0;
+        for (auto* engine : engines_)
+        {
+            syncCancels += engine->getSync().getCancels();
+            syncGiveUps += engine->getSync().getGiveUps();
+        }
+        auto& sync = engines_.getFirst()->getSync();
+        add("sync_step", (int64)sync.getStep());
+        add("sync_retries", stats_[Stats::syncRetries].get());
+        add("sync_cancels", syncCancels);
+        add("sync_giveups", syncGiveUps);
+        for (auto* histogram : { &sync.greeting, &sync.syncing, &sync.total })
+            add(histogram->getName() + "_p50_us", histogram->getPercentile(0.5));
+        for (auto* histogram : { &latency_.socket, &latency_.dispatch, &latency_.decode, &latency_.write, &latency_.queue, &latency_.total })
+        {
+            add(histogram->getName() + "_p50_us", histogram->getPercentile(0.5));
+            add(histogram->getName() + "_p99_us", histogram->getPercentile(0.99));
+            add(histogram->getName() + "_max_us", histogram->getMax());
+        }
+
+        for (int stage = 0; stage < PipelineStages::numStages; ++stage)
+        {
+            auto& metrics = pipeline_.get(stage);
+            String prefix = "stage_" + String(PipelineStages::getName(stage));
+            add(prefix + "_items", metrics.items.get());
+            add(prefix + "_depth", (int64)metrics.depth.get());
+            add(prefix + "_max_depth", (int64)metrics.maxDepth.get());
+            add(prefix + "_p50_us", metrics.latency.getPercentile(0.5));
+            add(prefix + "_p99_us", metrics.latency.getPercentile(0.99));
+        }
+
+        // how far each blink toggle was off its half period, for all LEDs
+        // and those blinking so far
+        add("blink_jitter_mean_us", blinkJitter_.getAllMeanUs());
+        add("blink_jitter_p99_us", blinkJitter_.getAll().getPercentile(0.99));
+        add("blink_jitter_max_us", blinkJitter_.getAll().getMax());
+        add("blink_toggles_superseded", stats_[Stats::blinkTogglesSuperseded].get());
+        for (int i = 0; i < BlinkJitter::maxLeds; ++i)
+        {
+            if (auto* jitter = blinkJitter_.getLed(i))
+            {
+                String prefix = "blink_jitter_" + String(i);
+                add(prefix + "_mean_us", blinkJitter_.getMeanUs(i));
+                add(prefix + "_p99_us", jitter->getPercentile(0.99));
+                add(prefix + "_max_us", jitter->getMax());
+            }
+        }
+
+        if (AllocationStages::enabled)
+        {
+            for (int stage = 0; stage < AllocationStages::numStages; ++stage)
+            {
+                add("allocations_" + String(AllocationStages::getName(stage)), AllocationStages::getCount(stage));
+                add("allocated_bytes_" + String(AllocationStages::getName(stage)), AllocationStages::getBytes(stage));
+            }
+        }
+    }
+
+    // /loop4r_leds/pipeline i:legacy switches between the batched and the
+    // direct path
+    void handlePipelineMessage(const OscMessageView& message)
+    {
+        if (message.isEmpty() || ! message[0].isInt32())
+        {
+            reportBadMessage("unrecognized format for pipeline message.");
+            return;
+        }
+
+        setLegacyPipeline(message[0].getInt32() != 0);
+    }
+
+    // the latencies so far are logged and start again, so each path's come
+    // from its own traffic; with stateLock_ held
+    void setLegacyPipeline(bool legacy)
+    {
+        if (legacy == legacyPipeline_)
+            return;
+
+        logLatencies();
+        latency_.reset();
+        pipeline_.reset();
+        legacyPipeline_ = legacy;
+        log_.write(AsyncLog::Info, legacy ? String("Switched to the direct OSC pipeline") : String("Switched to the batched OSC pipeline"));
+    }
+
+    // /loop4r_leds/trace s:file writes the spans recorded with trace so far,
+    // on the message thread and without the state lock
+    void handleTraceMessage(const OscMessageView& message)
+    {
+        if (message.isEmpty() || ! message[0].isString())
+        {
+            reportBadMessage("unrecognized format for trace message.");
+            return;
+        }
+
+        if (! TraceSpans::isEnabled())
+        {
+            log_.write(AsyncLog::Error, "Nothing traced, trace is not set");
+            return;
+        }
+
+        File file = File::getCurrentWorkingDirectory().getChildFile(message[0].getString());
+        background_.post([this, file]
+        {
+            if (! file.replaceWithText(TraceSpans::toJson()))
+                log_.write(AsyncLog::Error, "Could not write the trace to " + file.getFullPathName());
+        });
+    }
+
+    // /loop4r_leds/latency [i:reset] logs the latency percentiles so far
+    void handleLatencyMessage(const OscMessageView& message)
+    {
+        logLatencies();
+        if (message.size() > 0 && message[0].isInt32() && message[0].getInt32() != 0)
+        {
+            latency_.reset();
+            pipeline_.reset();
+        }
+    }
+
+    // called on the load generator thread
+    void loadFinished(int64 sent, int64 bad, double elapsedMs)
+    {
+        log_.write(AsyncLog::Info, "Sent " + String(sent) + " OSC packets (" + String(bad) + " malformed) in " + String(elapsedMs, 1) + " ms ("
+                   + String(sent * 1000.0 / jmax(1.0, elapsedMs), 0) + " packets/s)");
+        MessageManager::callAsync([this] { systemRequestedQuit(); });
+    }
+
+    // on the replay thread, to the capture time of the batch it hands over
+    // next; the timers call back from here
+    void advanceClock(double captureMs)
+    {
+        if (replayStartNs_ < 0)
+            replayStartNs_ = clock_.nowNs();
+
+        int64 ns = replayStartNs_ + (int64)(captureMs * 1000000.0);
+        timers_.advanceTo(ns);
+        reconnects_.advanceTo(ns);
+    }
+
+    // called on the replay thread
+    void replayFinished(int numPackets, double elapsedMs)
+    {
+        log_.write(AsyncLog::Info, "Replayed " + String(numPackets) + " OSC packets in " + String(elapsedMs, 1) + " ms ("
+                   + String(numPackets * 1000.0 / jmax(1.0, elapsedMs), 0) + " packets/s)");
+        if (clock_.isSimulated() && replayStartNs_ >= 0)
+            log_.write(AsyncLog::Info, "Simulated " + String((double)(clock_.nowNs() - replayStartNs_) / 1.0e9, 1) + " s of playing");
+        MessageManager::callAsync([this] { systemRequestedQuit(); });
+    }
+
+    void logLatencies()
+    {
+        for (auto& line : latency_.getReport())
+            log_.write(AsyncLog::Info, "latency " + line);
+        if (recovery_.getHistogram().getCount() > 0)
+            log_.write(AsyncLog::Info, "latency " + recovery_.getHistogram().getReport());
+        for (auto& line : pipeline_.getReport())
+            log_.write(AsyncLog::Info, "stage " + line);
+    }
+
+    // with LOOP4R_ALLOCATION_STAGES, what each stage allocated per packet
+    void logAllocationStages()
+    {
+        if (! AllocationStages::enabled)
+            return;
+
+        const double packets = (double)jmax((int64)1, stats_[Stats::packets].get());
+        for (int stage = 0; stage < AllocationStages::numStages; ++stage)
+            log_.write(AsyncLog::Info, "allocations " + String(AllocationStages::getName(stage)).paddedRight(' ', 10)
+                       + String(AllocationStages::getCount(stage) / packets, 2) + " per packet, "
+                       + String(AllocationStages::getBytes(stage) / packets, 1) + " bytes per packet");
+    }
+
+    // /loop4r_leds/tempo i:loop s:control f:value
+    void handleTempoMessage(const OscMessageView& message)
+    {
+        if (engine_ != engines_.getFirst())
+            return;
+
+        auto update = [this] (int32, StringRef control, float value)
+        {
+            if (control.text.compare(CharPointer_ASCII("loop_pos")) == 0)
+                tempoSync_.setLoopPosition(value, clock_.nowMs());
+            else if (control.text.compare(CharPointer_ASCII("cycle_len")) == 0)
+                tempoSync_.setCycleLength(value);
+            else if (control.text.compare(CharPointer_ASCII("loop_len")) == 0)
+                displayEngine_.setLoopLength(value);
+        };
+
+        if (! TempoSchema::apply(message, update))
+            reportBadMessage("unrecognized format for tempo message.");
+    }
+
+    // called on the receiver thread
+    void oscPacketsReceived(const OscInput::Packet* packets, int numPackets) override
+    {
+        AllocationStages::Scope stage(AllocationStages::Receive);
+        if (recorder_.isOpen())
+        {
+            // with rx more than one receiver thread gets here
+            const SpinLock::ScopedLockType sl(recorderLock_);
+            recorder_.record(packets, numPackets);
+        }
+
+        if (realtimeOsc_.get() != 0)
+        {
+            handleOscPackets(packets, numPackets);
+            return;
+        }
+
+        for (int i = 0; i < numPackets; ++i)
+            if (! packetQueue_.push(packets[i]))
+                ++stats_[Stats::queueDrops];
+
+        // the same message is posted again each time, so there is nothing
+        // to allocate either
+        if (! packetQueue_.claimWakeup())
+            return;
+        if (headlessDispatch_)
+            headlessDispatcher_.wake();
+        else
+            drainMessage_->post();
+    }
+
+    // on the message thread, or the dispatch thread with hl, everything
+    // queued since the last wakeup in batches as large as 64 packets. The
+    // writes wait for the queue to be drained, so a burst goes out in one
+    // write however many batches it took. A reconnect or a handoff drains
+    // it too before taking the receivers down, overdue housekeeping is only
+    // run in between on the message thread.
+    void drainPacketQueue()
+    {
+        packetQueue_.beginDrain();
+        auto* messageManager = MessageManager::getInstanceWithoutCreating();
+        const bool housekeeping = ! headlessDispatch_ && messageManager != nullptr && messageManager->isThisTheMessageThread();
+
+        // each batch is peeked, handled and released with stateLock_ held,
+        // so a reconnect draining or resizing the queue never does so under
+        // a batch another thread is in the middle of
+        OscInput::Packet batch[64];
+        for (;;)
+        {
+            {
+                const ScopedLock sl(stateLock_);
+                const int numPackets = packetQueue_.peek(batch, numElementsInArray(batch));
+                if (numPackets <= 0)
+                    break;
+                pipeline_.setDepth(PipelineStages::Ingest, packetQueue_.getNumQueued());
+                handleOscPackets(batch, numPackets, true);
+                packetQueue_.release(numPackets);
+            }
+            if (housekeeping)
+                background_.runOverdue();
+        }
+        pipeline_.setDepth(PipelineStages::Ingest, 0);
+        queueDrained();
+    }
+
+    // the end of a drain, when the batches it held are written
+    void queueDrained()
+    {
+        const ScopedLock sl(stateLock_);
+        writeDrained();
+    }
+
+    // with stateLock_ held
+    void writeDrained()
+    {
+        drainedBatches_ = 0;
+        if (drainedFromMs_ <= 0.0)
+            return;
+
+        if (flushMidi())
+            latency_.total.record(Time::getMillisecondCounterHiRes() - drainedFromMs_);
+        drainedFromMs_ = 0.0;
+    }
+
+    struct DrainMessage : public CallbackMessage
+    {
+        DrainMessage(loop4r_ledsApplication& owner)
+            : owner_(owner)
+        {
+        }
+
+        // one posted before hl took the queue over is passed on, so the
+        // dispatch thread stays its only consumer
+        void messageCallback() override
+        {
+            if (owner_.headlessDispatch_)
+                owner_.headlessDispatcher_.wake();
+            else
+                owner_.drainPacketQueue();
+        }
+
+        loop4r_ledsApplication& owner_;
+    };
+
+    // everything a batch of packets changed goes out in one write
+    // with untilDrained the write is left to queueDrained()
+    void handleOscPackets(const OscInput::Packet* packets, int numPackets, bool untilDrained = false)
+    {
+        const ScopedLock sl(stateLock_);
+        double startMs = Time::getMillisecondCounterHiRes();
+        const int64 allocations = Benchmark::getAllocations();
+        latency_.dispatch.record(startMs - packets[0].receivedMs);
+        pipeline_.passed(PipelineStages::Ingest, numPackets, startMs - packets[0].receivedMs);
+        TraceSpans::record("queue wait", packets[0].receivedMs, startMs);
+        if (kernelTimestamps_)
+            for (int i = 0; i < numPackets; ++i)
+                latency_.socket.record(packets[i].socketMs);
+        stats_[Stats::packets] += numPackets;
+        if (changesReceivedMs_ <= 0.0)
+            changesReceivedMs_ = packets[0].receivedMs;
+
+        if (legacyPipeline_)
+            handleOscPacketsOneByOne(packets, numPackets);
+        else
+            handleOscBatch(packets, numPackets, startMs, untilDrained);
+
+        if (soak_.isOpen())
+        {
+            soakAllocations_ += Benchmark::getAllocations() - allocations;
+            soakBatchPeak_ = jmax(soakBatchPeak_, numPackets);
+        }
+    }
+
+    // the batch decoded as a whole and written once, or folded into a
+    // coalescing window
+    void handleOscBatch(const OscInput::Packet* packets, int numPackets, double startMs, bool untilDrained)
+    {
+        auto level = shedder_.getLevel();
+        shedder_.beginBatch(clock_.nowMs());
+        if (shedder_.getLevel() != level)
+            log_.write(AsyncLog::Info, shedder_.getLevel() == LoadShedder::Normal ? String("OSC load back within budget")
+                                                                                : "OSC flood, shedding load at level " + String((int)shedder_.getLevel()));
+        if (shedder_.getLevel() == LoadShedder::Normal && level != LoadShedder::Normal)
+            applyShedDisplay();
+        if (microbatch_.update(clock_.nowMs(), stats_[Stats::packets].get(), isOutputBacklogged()))
+            log_.write(AsyncLog::Debug, "Coalescing window now " + String(microbatch_.getWindowMs(), 2) + " ms");
+
+        for (int i = 0; i < numPackets; ++i)
+        {
+            engine_ = engines_[packets[i].source];
+            if (engine_ == nullptr)
+                engine_ = engines_.getFirst();
+            // any packet that decodes shows the looper is alive, so it is
+            // only pinged once all of its traffic has stopped
+            TraceSpans::Scope span("handle");
+            if (handleOscPacket(packets[i].data, packets[i].size))
+                engine_->getHeartbeat().heard(clock_.isSimulated() ? clock_.nowMs() : packets[i].receivedMs);
+        }
+        latency_.decode.record(Time::getMillisecondCounterHiRes() - startMs);
+        pipeline_.passed(PipelineStages::Decode, numPackets, Time::getMillisecondCounterHiRes() - startMs);
+        pipeline_.setDepth(PipelineStages::State, getNumPendingChanges());
+
+        // with a coalescing window the first change opens it, and whatever
+        // else arrives until it closes is folded into the same write. The
+        // answers to a resync go out as they come, the pacing folding
+        // together whatever arrives while the wire is busy.
+        const double windowMs = isResyncing() ? 0.0 : jmax(coalesceMs_, shedder_.getCoalesceMs(), microbatch_.getWindowMs());
+        if (windowMs <= 0.0 && untilDrained)
+        {
+            if (drainedFromMs_ <= 0.0)
+                drainedFromMs_ = packets[0].receivedMs;
+            // a queue kept from draining by a steady stream still has what
+            // it folded together written every so many batches
+            if (++drainedBatches_ >= MAX_DRAIN_BATCHES)
+                writeDrained();
+        }
+        else if (windowMs <= 0.0)
+        {
+            if (flushMidi())
+                latency_.total.record(Time::getMillisecondCounterHiRes() - packets[0].receivedMs);
+        }
+        else if (hasPendingChanges() && ! isLoopTimerArmed(loopTimers_.coalesce))
+        {
+            coalesceOpenedMs_ = packets[0].receivedMs;
+            setLoopTimer(loopTimers_.coalesce, windowMs, true);
+        }
+    }
+
+    // the direct path from before batching, kept for comparing the two on
+    // the same traffic with pipe: every packet through the generic decoder
+    // and written on its own, without coalescing or shedding
+    void handleOscPacketsOneByOne(const OscInput::Packet* packets, int numPackets)
+    {
+        double decodeMs = 0.0;
+        for (int i = 0; i < numPackets; ++i)
+        {
+            engine_ = engines_[packets[i].source];
+            if (engine_ == nullptr)
+                engine_ = engines_.getFirst();
+
+            double startMs = Time::getMillisecondCounterHiRes();
+            {
+                TraceSpans::Scope span("handle");
+                if (handleOscPacket(packets[i].data, packets[i].size))
+                    engine_->getHeartbeat().heard(clock_.isSimulated() ? clock_.nowMs() : packets[i].receivedMs);
+            }
+            decodeMs += Time::getMillisecondCounterHiRes() - startMs;
+
+            if (flushMidi())
+                latency_.total.record(Time::getMillisecondCounterHiRes() - packets[i].receivedMs);
+        }
+        latency_.decode.record(decodeMs);
+        pipeline_.passed(PipelineStages::Decode, numPackets, decodeMs);
+    }
+
+    // bytes of an earlier flush still queued for any of the boards, or the
+    // pacing holding the next write back
+    bool isOutputBacklogged()
+    {
+        const double nowMs = Time::getMillisecondCounterHiRes();
+        for (auto* board : boards_)
+            if (board->isBacklogged() || ! board->getPacer().isReady(nowMs))
+                return true;
+        return false;
+    }
+
+    int64 getMidiBytesWritten() const
+    {
+        int64 bytesWritten = 0;
+        for (auto* board : boards_)
+            bytesWritten += board->getSink().getBytesWritten();
+        return bytesWritten;
+    }
+
+    // the pedals no longer show what the looper has, until checkRecovered()
+    // finds they do again; with stateLock_ held
+    void beginRecovery(RecoveryMeter::Cause cause, const LooperEngine& engine, double nowMs)
+    {
+        const uint32 engineBit = (uint32)1 << jmax(0, engines_.indexOf(&engine));
+        recovery_.begin(cause, engineBit, nowMs, getMidiBytesWritten(), stats_[Stats::packets].get());
+    }
+
+    // after a flush: every looper the recovery waits for has sent all its
+    // state, and all of it has been written to ports that are open
+    void checkRecovered()
+    {
+        if (hasPendingChanges())
+            return;
+        for (auto* board : boards_)
+            if (! board->getSink().isOpen())
+                return;
+        for (int i = 0; i < engines_.size(); ++i)
+            if ((recovery_.getEngines() & ((uint32)1 << i)) != 0
+                && engines_.getUnchecked(i)->getSync().getStep() != SyncWorkflow::Ready)
+                return;
+
+        if (recovery_.consistent(clock_.nowMs(), getMidiBytesWritten(), stats_[Stats::packets].get()))
+            log_.write(AsyncLog::Info, "The pedals were right again " + String(recovery_.getLastMs(), 1) + " ms after "
+                       + (recovery_.getLastCause() == RecoveryMeter::LinkLost ? "the OSC link was lost" : "the looper changed")
+                       + ", taking " + String(recovery_.getLastMidiBytes()) + " MIDI bytes and "
+                       + String(recovery_.getLastOscPackets()) + " OSC packets");
+    }
+
+    bool hasPendingChanges() const
+    {
+        for (auto* board : boards_)
+            if (board->getShadow().hasChanges())
+                return true;
+        return false;
+    }
+
+    int getNumPendingChanges() const
+    {
+        int pending = 0;
+        for (auto* board : boards_)
+            pending += board->getShadow().getNumPending();
+        return pending;
+    }
+
+    // the coalescing window closing, or held back lanes retrying
+    void flushCoalesced()
+    {
+        const ScopedLock sl(stateLock_);
+        if (coalesceOpenedMs_ > 0.0)
+        {
+            TraceSpans::record("coalesce", coalesceOpenedMs_, Time::getMillisecondCounterHiRes());
+            pipeline_.passed(PipelineStages::Coalesce, 1, Time::getMillisecondCounterHiRes() - coalesceOpenedMs_);
+        }
+        if (flushMidi() && coalesceOpenedMs_ > 0.0)
+            latency_.total.record(Time::getMillisecondCounterHiRes() - coalesceOpenedMs_);
+        coalesceOpenedMs_ = 0.0;
+    }
+
+    // returns false for a packet that doesn't decode
+    bool handleOscPacket(const char* data, int size)
+    {
+        AllocationStages::Scope stage(AllocationStages::Parse);
+        // LED and display updates and heartbeats skip even the generic
+        // decoder, unless every message is being logged
+        const bool fastPath = ! logsEveryMessage() && ! legacyPipeline_;
+        LedEvent event;
+        HeartbeatEvent heartbeat;
+        if (fastPath && OscPacket::decodeLedEvent(data, size, event))
+        {
+            AllocationStages::Scope handler(AllocationStages::Handler);
+            if (event.type == LedEvent::Led)
+            {
+                ++messageCounts_[ledRoute_];
+                shedder_.admit(ledRoute_, false);
+                setLedState(event.args[0], event.args[1], event.args[2], event.args[3]);
+            }
+            else if (event.type == LedEvent::SequencedLed)
+            {
+                ++messageCounts_[ledRoute_];
+                shedder_.admit(ledRoute_, false);
+                setSequencedLedState(event.args[0], event.args[1], event.args[2], event.args[3], event.args[4]);
+            }
+            else
+            {
+                ++messageCounts_[displayRoute_];
+                displayReceived(event.args[0], shedder_.admit(displayRoute_, true) || isResyncing());
+            }
+        }
+        else if (fastPath && OscPacket::decodeHeartbeat(data, size, heartbeat))
+        {
+            AllocationStages::Scope handler(AllocationStages::Handler);
+            ++messageCounts_[heartbeatRoute_];
+            if (shedder_.admit(heartbeatRoute_, false))
+                heartbeatReceived(*engine_, heartbeat);
+        }
+        else if (! OscPacket::parse(data, size, *this, &decodeArena_))
+        {
+            ++stats_[Stats::parseErrors];
+            if (noteBadPacket())
+            {
+                flightRecorder_.recordBadPacket(data, size);
+                log_.write(AsyncLog::Error, "- (" + String(size) + "bytes with invalid format)");
+            }
+            return false;
+        }
+        return true;
+    }
+
+    // Malformed packets and messages are logged a few a second, with a count
+    // of the rest, and only those logged are kept in the flight recorder.
+    // None at all while shedding load.
+    bool noteBadPacket()
+    {
+        reportSuppressedErrors(clock_.nowMs());
+        return badPacketLog_.note() && shedder_.getLevel() == LoadShedder::Normal;
+    }
+
+    void reportBadMessage(const char* text)
+    {
+        if (noteBadPacket())
+            log_.write(AsyncLog::Error, text);
+    }
+
+    void reportSuppressedErrors(double nowMs)
+    {
+        int suppressed = badPacketLog_.takeSuppressed(nowMs);
+        if (suppressed > 0)
+            log_.write(AsyncLog::Error, String(suppressed) + " more malformed OSC packets or messages not logged");
+    }
+
+    // not while shedding load, when logging would only put us further behind
+    bool logsEveryMessage() const
+    {
+        return log_.wants(AsyncLog::Debug) && shedder_.getLevel() == LoadShedder::Normal;
+    }
+
+    void oscMessageReceived (const OscMessageView& message) override
+    {
+        AllocationStages::Scope stage(AllocationStages::Dispatch);
+        const ScopedLock sl(stateLock_);
+        flightRecorder_.recordOsc(message);
+        LOOP4R_PROBE2(osc_message, (const char*)message.getAddress(), message.size());
+        const StringRef address = message.getAddress();
+        if (logsEveryMessage() && ! message.hasAddress("/heartbeat"))
+        {
+            log_.write(AsyncLog::Debug, "-- osc message, address = '"
+                       + String(address)
+                       + "', "
+                       + String (message.size())
+                       + " argument(s)");
+
+            for (int i = 0; i < message.size(); ++i)
+            {
+                const OscValue* arg = &message[i];
+                String typeAsString;
+                String valueAsString;
+
+                if (arg->isFloat32())
+                {
+                    typeAsString = "float32";
+                    valueAsString = String (arg->getFloat32());
+                }
+                else if (arg->isInt32())
+                {
+                    typeAsString = "int32";
+                    valueAsString = String (arg->getInt32());
+                }
+                else if (arg->isString())
+                {
+                    typeAsString = "string";
+                    valueAsString = arg->getString();
+                }
+                else if (arg->isBlob())
+                {
+                    typeAsString = "blob";
+                    valueAsString = String::fromUTF8 (arg->getBlobData(), arg->getBlobSize());
+                }
+                else
+                {
+                    typeAsString = "(unknown)";
+                }
+
+                log_.write(AsyncLog::Debug, "==- " + typeAsString.paddedRight(' ', 12) + valueAsString);
+            }
+        }
+
+        // literal addresses by hash, only patterns go through the matcher
+        int route = oscAddresses_.find(address);
+        if (route >= 0)
+            dispatchOscMessage(route, message);
+        else if (! OscAddressTable::isPattern(address)
+                 || oscAddresses_.forEachMatch(address, [&] (int match) { dispatchOscMessage(match, message); }) == 0)
+            ++stats_[Stats::unhandled];
+    }
+
+    void dispatchOscMessage(int route, const OscMessageView& message)
+    {
+        ++messageCounts_[route];
+        // the display ending a resync is never shed, a shed one is still
+        // decoded to be kept for later
+        displayAdmitted_ = legacyPipeline_ || shedder_.admit(route, route == displayRoute_) || (route == displayRoute_ && isResyncing());
+        if (! displayAdmitted_ && route != displayRoute_)
+            return;
+        LOOP4R_PROBE2(osc_dispatch, route, (const char*)message.getAddress());
+        AllocationStages::Scope stage(AllocationStages::Handler);
+        (this->*oscHandlers_.getUnchecked(route))(message);
+        LOOP4R_PROBE1(osc_handled, route);
+    }
+
+    // dated by the sender's clock, which is known once its heartbeats
+    // carried time tags; until then our wall clock is taken to agree
+    void oscBundleReceived (const char* bundle, int size) override
+    {
+        OSCTimeTag timeTag = OscPacket::getTimeTag(bundle);
+        double delayMs = BundleScheduler::getDelayMs(timeTag);
+        if (engine_ != nullptr && engine_->getClockOffset().isValid() && ! timeTag.isImmediately())
+        {
+            double nowMs = clock_.nowMs();
+            delayMs = engine_->getClockOffset().toLocalMs(ClockOffset::toMs(timeTag), nowMs) - nowMs;
+        }
+        if (delayMs > 0.0)
+        {
+            if (! bundleScheduler_.schedule(bundle, size, delayMs))
+                log_.write(AsyncLog::Error, "Too many OSC bundles waiting for their time tag, dropped one");
+            return;
+        }
+
+        applyBundle(bundle, size);
+    }
+
+    // all of a bundle's messages are applied together and go out in the same
+    // write, nested bundles may still be dated later than their parent
+    void applyBundle(const char* bundle, int size)
+    {
+        OscPacket::forEachElement(bundle, size, *this, &decodeArena_);
+    }
+
+    // called on the scheduler thread once a future dated bundle is due
+    // which looper sent it is lost by then, it is taken to be the first
+    void applyScheduledBundle(const char* bundle, int size)
+    {
+        const ScopedLock sl(stateLock_);
+        engine_ = engines_.getFirst();
+        applyBundle(bundle, size);
+        flushMidi();
+    }
+
+    // one socket per looper, all read by the same receiver thread or with rx
+    // shared out in runs between several; with stateLock_ held, the
+    // receivers stopped already unless they weren't started yet
+    void connect()
+    {
+        Array<int> portsToConnect;
+        StringArray pathsToConnect;
+        for (auto* engine : engines_)
+        {
+            if (engine->getReceivePath().isEmpty() && ! isValidOscPort (engine->getReceivePort()))
+            {
+                handleInvalidPortNumberEntered();
+                return;
+            }
+            portsToConnect.add(engine->getReceivePort());
+            pathsToConnect.add(engine->getReceivePath());
+        }
+
+        // the receiver thread's handlers send these, so only while it is
+        // stopped
+        stopReceivers();
+
+        // the queue's slots have to fit the largest packet, and are only
+        // resized empty with the receiver stopped
+        if (packetQueue_.getPacketSize() != oscReceiver.getMaxPacketSize())
+        {
+            drainPacketQueue();
+            packetQueue_.setPacketSize(oscReceiver.getMaxPacketSize());
+        }
+        for (auto* engine : engines_)
+        {
+            engine->setMaxPacketSize(oscReceiver.getMaxPacketSize());
+            engine->encodeRequests(TEMPO_SYNC_TICK_MS * 10);
+        }
+
+        startDispatcher();
+        if (connectReceivers (portsToConnect, pathsToConnect))
+        {
+            currentReceivePort_ = portsToConnect.getFirst();
+            if (eventLoopMode_)
+                watchOscSockets();
+            log_.write(AsyncLog::Debug, "OSC receive buffer " + String(oscReceiver.getReceiveBufferSize()) + " bytes");
+            if (oscReceiver.wasBusyPollRefused())
+                log_.write(AsyncLog::Error, "Couldn't busy poll the OSC sockets, raising SO_BUSY_POLL needs CAP_NET_ADMIN");
+        }
+        else
+        {
+            handleConnectError (portsToConnect.getFirst());
+        }
+    }
+
+    // the packet queue takes from any number of producers, so the receivers
+    // hand over to the message thread as one would
+    bool connectReceivers(const Array<int>& ports, const StringArray& paths)
+    {
+        const int numReceivers = eventLoopMode_ ? 1 : jlimit(1, jmax(1, ports.size()), extraReceivers_.size() + 1);
+        for (int receiver = 0; receiver < numReceivers; ++receiver)
+        {
+            const int first = receiver * ports.size() / numReceivers;
+            const int end = (receiver + 1) * ports.size() / numReceivers;
+            Array<int> shardPorts;
+            StringArray shardPaths;
+            for (int i = first; i < end; ++i)
+            {
+                shardPorts.add(ports[i]);
+                shardPaths.add(paths[i]);
+            }
+
+            OscInput& input = receiver == 0 ? oscReceiver : *extraReceivers_[receiver - 1];
+            if (receiver > 0)
+                input.copyOptionsFrom(oscReceiver);
+            input.setFirstSource(first);
+            input.setThreadTuning(getReceiverTuning(receiver, numReceivers));
+            input.setAdoptable(&handedSockets_);
+            if (! input.connect(shardPorts, shardPaths))
+            {
+                disconnectReceivers();
+                return false;
+            }
+        }
+
+        // sockets handed over for ports no longer listened on
+        for (auto handle : handedSockets_)
+            ::close(handle);
+        handedSockets_.clearQuick();
+
+        numReceivers_ = numReceivers;
+        return true;
+    }
+
+    void disconnectReceivers()
+    {
+        for (auto* receiver : extraReceivers_)
+            receiver->disconnect();
+        oscReceiver.disconnect();
+        numReceivers_ = 0;
+    }
+
+    void disconnect()
+    {
+        unwatchOscSockets();
+        for (auto* receiver : extraReceivers_)
+            receiver->disconnect();
+        if (oscReceiver.disconnect())
+        {
+            currentReceivePort_ = -1;
+        }
+        else
+        {
+            handleDisconnectError();
+        }
+    }
+
+    // retries are logged with their backoff by connectOsc()
+    void handleConnectError (int failedPort)
+    {
+        log_.write(AsyncLog::Debug, "could not connect to port " + String (failedPort));
+    }
+
+    void handleDisconnectError()
+    {
+        std::cerr << "An unknown error occured while trying to disconnect from UDP port." << std::endl;
+    }
+
+    void handleInvalidPortNumberEntered()
+    {
+        std::cout << "Error: you have entered an invalid UDP port number." << std::endl;
+    }
+
+    bool isConnected() const
+    {
+        return currentReceivePort_ != -1;
+    }
+
+    bool isValidOscPort (int port) const
+    {
+        return port > 0 && port < 65536;
+    }
+
+    static void printVersion()
+    {
+        std::cout << ProjectInfo::projectName << " v" << ProjectInfo::versionString << std::endl;
+        std::cout << "https://github.com/atinm/loop4r_control" << std::endl;
+    }
+
+    static void printUsage(const Array<ApplicationCommand>& commands)
+    {
+        printVersion();
+        std::cout << std::endl;
+        std::cout << "Usage: " << ProjectInfo::projectName << " [ commands ] [ programfile ] [ -- ]" << std::endl << std::endl
+        << "Commands:" << std::endl;
+        for (auto&& cmd : commands)
+        {
+            std::cout << "  " << cmd.param_.paddedRight(' ', 5);
+            if (cmd.optionsDescription_.isNotEmpty())
+            {
+                std::cout << " " << cmd.optionsDescription_.paddedRight(' ', 13);
+            }
+            else
+            {
+                std::cout << "              ";
+            }
+            std::cout << "  " << cmd.commandDescription_;
+            std::cout << std::endl;
+        }
+        std::cout << "  -h  or  --help       Print Help (this message) and exit" << std::endl;
+        std::cout << "  --version            Print version information and exit" << std::endl;
+        std::cout << "  --                   Read commands from standard input until it's closed" << std::endl;
+        std::cout << std::endl;
+        std::cout << "Alternatively, you can use the following long versions of the commands:" << std::endl;
+        String line = " ";
+        for (auto&& cmd : commands)
+        {
+            if (cmd.altParam_.isNotEmpty())
+            {
+                if (line.length() + cmd.altParam_.length() + 1 >= 80)
+                {
+                    std::cout << line << std::endl;
+                    line = " ";
+                }
+                line << " " << cmd.altParam_;
+            }
+        }
+        std::cout << line << std::endl << std::endl;
+        std::cout << "By default, numbers are interpreted in the decimal system, this can be changed" << std::endl
+        << "to hexadecimal by sending the \"hex\" command. Additionally, by suffixing a " << std::endl
+        << "number with \"M\" or \"H\", it will be interpreted as a decimal or hexadecimal" << std::endl
+        << "respectively." << std::endl;
+        std::cout << std::endl;
+        std::cout << "The MIDI device name doesn't have to be an exact match." << std::endl;
+        std::cout << "If " << ProjectInfo::projectName << " can't find the exact name that was specified, it will pick the" << std::endl
+        << "first rawmidi device whose name contains the provided text, irrespective of case." << std::endl;
+        std::cout << std::endl;
+    }
+
+    static void printDevices(const Array<RawMidiDevices::Device>& inputs, const Array<RawMidiDevices::Device>& outputs)
+    {
+        std::cout << "MIDI Input devices:" << std::endl;
+        for (auto&& device : inputs)
+        {
+            std::cout << device.name << "  " << device.description << std::endl;
+        }
+        std::cout << "MIDI Output devices:" << std::endl;
+        for (auto&& device : outputs)
+        {
+            std::cout << device.name << "  " << device.description << std::endl;
+        }
+    }
+
+    OscInput oscReceiver { *this };
+    OwnedArray<OscInput> extraReceivers_;   // from rx
+    int numReceivers_ = 0;                  // connected
+    static const int maxReceivers = 8;
+
+    // the loopers' host names, looked up off the threads that send; it
+    // outlives the engines that use it
+    HostResolver resolver_;
+    CriticalSection resolvedLock_;
+    StringArray resolvedHosts_;         // by the resolver's thread, for reconnectOsc()
+
+    // the first from oout and oin, the rest from eng
+    OwnedArray<LooperEngine> engines_;
+    LooperEngine* engine_ = nullptr;    // whose packet is being handled
+    LooperEngine* shedDisplayEngine_ = nullptr; // whose display update was shed last, if any
+    int shedDisplay_ = 0;
+    bool displayAdmitted_ = true;       // for the display message being dispatched
+    int heartbeatPingMs_ = 0;           // from hb, 0 until given
+    int heartbeatTimeoutMs_ = 0;
+    String looperHost_ { "127.0.0.1" }; // from host, for loopers added after it
+    int oscTos_ = -1;                   // none unless given
+    bool nonBlockingSend_ = false;      // from onb
+    bool bundleRequests_ = false;       // from rbun
+    // with realtime OSC the handlers run on the receiver thread, locking
+    // stateLock_ like the blink thread does
+    Atomic<int> realtimeOsc_ { 0 };
+    bool headlessDispatch_ = false;     // from hl, only before the receiver starts
+    double drainedFromMs_ = 0.0;        // the first packet of a drain still to be written, with stateLock_ held
+    int drainedBatches_ = 0;            // handled since, unwritten
+    HeadlessDispatcher headlessDispatcher_ { [this] { drainPacketQueue(); } };
+    bool kernelTimestamps_ = false;
+
+    // from sim, otherwise the real one
+    LoopClock clock_;
+    int64 replayStartNs_ = -1;
+    String simulatedReplay_;        // from play, started after the timers
+
+    // the periodic work, the heartbeat and the end of the coalescing window
+    // (for LED changes held back, flushed at once)
+    PreciseTimers timers_;
+    double coalesceMs_ = 0.0;           // from cw
+    double coalesceOpenedMs_ = 0.0;     // when the first change in the window arrived
+    double staleAgeMs_ = 0.0;           // from stale
+    double changesReceivedMs_ = 0.0;    // the oldest change not yet written, with stateLock_ held
+    double resyncAnsweredFromMs_ = 0.0; // a resync answered, when it was asked for
+
+    // reopening MIDI ports and, without el, reconnecting the OSC link
+    PreciseTimers reconnects_ { "loop4r reconnect" };
+    struct ReconnectTimers
+    {
+        int midi = -1;
+        int midiNow = -1;       // once, right after a hotplug event
+        int osc = -1;
+        int deferred = -1;      // runDeferredStarts(), once
+    };
+    ReconnectTimers reconnectTimers_;
+    bool startsDeferred_ = true;    // until the first frame, with stateLock_ held
+    Array<std::function<void()>> deferredStarts_;
+    Atomic<int> oscLost_ { 0 };     // set by the heartbeat for reconnectOsc()
+    double transactionUntilMs_ = 0.0;   // from /loop4r_leds/begin, by clock_, with stateLock_ held
+    Atomic<int> oscStreamChanged_ { 0 };    // set by a looper's stream thread
+    Atomic<int> handedOff_ { 0 };           // to a new instance, which has the sockets and ports now, or is being handed them
+
+    // with el everything above runs from here instead
+    EventLoop eventLoop_;
+    bool eventLoopMode_ = false;
+    struct LoopTimers
+    {
+        int tick = -1;
+        int heartbeat = -1;
+        int coalesce = -1;
+        int blink = -1;
+        int reconnect = -1;     // the OSC link, with el
+        int display = -1;
+        int soak = -1;
+    };
+    LoopTimers loopTimers_;
+
+    // from a datagram arriving to its MIDI leaving, stage by stage
+    struct Latencies
+    {
+        LatencyHistogram socket { "socket" };       // kernel receipt to arrival, with kernel timestamps
+        LatencyHistogram dispatch { "dispatch" };   // arrival to handling
+        LatencyHistogram decode { "decode" };       // decoding and applying a batch
+        LatencyHistogram write { "write" };         // handing a batch to the port or writer
+        LatencyHistogram queue { "queue" };         // waiting for the writer thread
+        LatencyHistogram total { "total" };         // arrival to written
+        LatencyHistogram resync { "resync" };       // asking for all the state to its answer written
+
+        StringArray getReport() const
+        {
+            StringArray lines;
+            for (auto* histogram : { &socket, &dispatch, &decode, &write, &queue, &total, &resync })
+                if (histogram->getCount() > 0)
+                    lines.add(histogram->getReport());
+            return lines;
+        }
+
+        void reset()
+        {
+            for (auto* histogram : { &socket, &dispatch, &decode, &write, &queue, &total, &resync })
+                histogram->reset();
+        }
+    };
+    Latencies latency_;
+    RecoveryMeter recovery_;        // how long the pedals were wrong, with stateLock_ held
+    PipelineStages pipeline_;
+
+    // from the receiver and replay threads to the message thread
+    PacketQueue packetQueue_;
+    ReferenceCountedObjectPtr<DrainMessage> drainMessage_ { new DrainMessage(*this) };
+
+    // message thread work that can wait for the packets above
+    BackgroundQueue background_;
+
+    // leds_ as other threads see them, after each written batch
+    AtomicLedStates ledWords_;
+
+    OscRecorder recorder_;
+    SpinLock recorderLock_;
+
+    // what the generic decoder needs beyond the stack, with stateLock_ held
+    DecodeArena decodeArena_;
+    MidiRecorder midiRecorder_;     // from mrec
+
+    // soak, and what it takes from the OSC path between two samples, with
+    // stateLock_ held
+    SoakReport soak_;
+    BlinkJitter blinkJitter_;       // with stateLock_ held
+    bool legacyPipeline_ = false;   // from pipe, with stateLock_ held
+    MetricsExporter metricsExporter_ { [this] (const MetricsExporter::AddFunction& add) { exportStats(add); } };
+    static_assert(LedStore::capacity <= BlinkJitter::maxLeds, "every LED has its jitter");
+    double soakStartMs_ = 0.0;
+    int64 soakAllocations_ = 0;
+    int soakBatchPeak_ = 0;
+    LatencyHistogram::Snapshot soakTotal_, soakDispatch_;
+    SystemdNotifier systemd_;
+    StartupProfile startup_;
+    // from scene, the LEDs each one sets and to what
+    static const int MAX_SCENES = 128;
+    struct SceneLed
+    {
+        int16 index;
+        int16 state;
+    };
+    Array<Array<SceneLed>> scenes_;
+
+    // from anim, for /loop4r_leds/animation
+    static const int MAX_ANIMATIONS = 32;
+    OwnedArray<LedAnimation> animations_;
+    LedAnimationPlayer animationPlayer_;
+    uint32 bootLeds_ = 0;           // from bootf
+    int bootDisplay_ = -1;
+    bool bootShown_ = false;
+    bool looperAnswered_ = false;
+    int watchdogBudgetUs_ = 0;      // from wdp99
+    LatencyHistogram::Snapshot watchdogTotal_;
+    struct WatchdogBoard
+    {
+        int64 written;
+        bool pending;
+    };
+    Array<WatchdogBoard> watchdogBoards_;    // as the last check found them
+    LoadGenerator loadGenerator_ { [this] (int64 sent, int64 bad, double elapsedMs) { loadFinished(sent, bad, elapsedMs); } };
+    OscReplay replay_ { [this] (const OscInput::Packet* packets, int numPackets) { oscPacketsReceived(packets, numPackets); },
+                        [this] (int numPackets, double elapsedMs) { replayFinished(numPackets, elapsedMs); } };
+
+    typedef void (loop4r_ledsApplication::*OscHandler)(const OscMessageView&);
+
+    // the table's entry numbers index the handlers and the counts
+    static const int maxOscRoutes = 16;
+    OscAddressTable oscAddresses_;
+    Array<OscHandler> oscHandlers_;
+    StatCounters<maxOscRoutes> messageCounts_;
+    LoadShedder shedder_;       // from shed
+    LoopRules loopRules_;       // from lrule, for loopers spoken to with sl
+    MicrobatchController microbatch_;   // from acw
+    LogThrottle badPacketLog_;
+    static_assert(maxOscRoutes <= LoadShedder::maxRoutes, "every route has its budget");
+    int ledRoute_ = 0;
+    int displayRoute_ = 0;
+    int heartbeatRoute_ = 0;
+
+    // returns the route's index into messageCounts_
+    int addOscRoute(const String& address, OscHandler handler)
+    {
+        jassert(oscAddresses_.size() < maxOscRoutes);
+        oscHandlers_.add(handler);
+        return oscAddresses_.add(address);
+    }
+
+    // counters for /loop4r_leds/stats, updated without taking any lock
+    // bumped from the receiver, message and reconnect threads alike, each
+    // into a block of its own
+    struct Stats
+    {
+        enum Counter
+        {
+            packets,
+            parseErrors,
+            unhandled,
+            queueDrops,         // packet queue full
+            oscReconnects,
+            animationSteps,
+            transactions,
+            transactionTimeouts,    // begun but never committed
+            midiReopens,
+            heartbeatMisses,    // quiet for the whole timeout
+            predictionHits,
+            mispredictions,     // wrong or never answered
+            staleLeds,          // out of order or repeated
+            sequenceGaps,       // numbers skipped, not yet seen late
+            gapRefetches,       // all LEDs of a looper
+            driftRepairs,       // heartbeat digest didn't match
+            ledsRefetched,
+            selectionGuesses,   // UP and DOWN shown ahead of the looper
+            resyncWrites,       // batches written while a resync came in
+            syncRetries,        // greetings and state requests sent again
+            blinkTogglesSuperseded, // left to the next tick, the looper changed the LED meanwhile
+            numCounters
+        };
+    };
+    StatCounters<Stats::numCounters> stats_;
+
+    int currentReceivePort_ = -1;
+    int channel_;
+
+    LedStore leds_;
+    LedState ledState_;
+    Array<ApplicationCommand> commands_;
+    CommandNameTable commandNames_;
+    SessionWriter* compiling_ = nullptr;
+
+    // the command line as given, and the commands it ran, for reloading
+    StringArray configParameters_;
+    Array<CommandCall> appliedConfig_;
+    Array<CommandCall>* configCalls_ = nullptr;
+    bool configDryRun_ = false;
+    bool liveInput_ = false;        // the commands come from stdin, after startup
+    SignalWatcher signals_ { [this] (int) { background_.post([this] { reloadConfig(); }); } };
+    Array<CommandCall> filterCommands_;
+
+    bool useHexadecimalsByDefault_;
+
+    // what dout, dadd and min names resolve to, before the boards using it
+    RawMidiResolver rawMidiDevices_;
+
+    // the first from dout, the rest from dadd, kept by the same core an
+    // embedding host uses
+    LedCore core_;
+    OwnedArray<BoardOutput>& boards_ { core_.getBoards() };
+
+    // what new boards are set up with
+    bool nonBlocking_ = false;
+    MidiSink::BufferParams midiBuffer_;
+    bool scheduledMidi_ = false;    // boards get a ScheduledMidiSink
+    LedStateCache ledCache_;
+    EngineFrameCache frameCache_;   // by looper instance, for switching back to one
+    LedStateExport ledExport_;
+    LedMulticast multicast_;
+    LedStrip strip_;
+    ArtNetOutput artNet_;
+    GpioStatus gpio_;
+    // after the sinks it shows on, so its threads stop before they go
+    FrameFanout fanout_;
+    LedFrame frame_;
+    FrameFanout::Pacing stripPacing_, artNetPacing_;
+    double multicastFullMs_ = 0.0;
+    FlightRecorder flightRecorder_;
+    uint32 warmEngines_ = 0;        // restored from the cache, not heard from yet
+    uint32 handedEngines_ = 0;      // of those, handed over by the instance before us
+    Array<int> handedSockets_;      // its OSC sockets, until connect() takes them
+    Handoff handoff_ { [this] (Handoff::State& state, Array<int>& sockets) { exportHandoff(state, sockets); },
+                       [this] { releaseForHandoff(); }, [this] { resumeAfterHandoff(); } };
+    int runningStatus_ = 0;
+    int writerPriority_ = -1;   // no writer threads
+    ThreadTuning threadTuning_;
+    uint32 receiverAffinity_ = 0;   // from spin, over the cpu cores
+    bool tickless_ = false;         // from idle
+    bool blinkAligned_ = false;     // from align
+    bool benchCounters_ = false;    // from bperf
+    int benchRepeats_ = 1;          // from brep
+    File benchBaseline_;            // from bbase
+    double benchTolerance_ = 0.0;
+    bool subscribeFiltered_ = false;    // from subs
+    int subscribeIntervalMs_ = 0;
+    double heartbeatDueMs_ = 0.0;
+    double blinkTickDueMs_ = 0.0;
+    bool lockMemory_ = false;       // from mlock
+    int lockStackKb_ = 0;
+    int lockHeapKb_ = 0;
+    MemoryBlock frameHeader_;
+    BlinkEngine blinkEngine_ { [this] { return ledGeneration_.get(); },
+                               [this] (double nowMs, uint32 generation) { blinkTick(nowMs, generation); } };
+    Atomic<uint32> ledGeneration_ { 0 };   // counts the looper's LED changes, read by ticks before they lock
+    BundleScheduler bundleScheduler_ { [this] (const char* bundle, int size) { applyScheduledBundle(bundle, size); } };
+    TempoSync tempoSync_;
+    DisplayEngine displayEngine_;
+    MemoryBlock digitControllers_;
+    BoardLayout boardLayout_;       // from prof, lcc, lmap and hbled
+    int pacePercent_ = 0;
+    int paceBurst_ = 64;
+    bool tempoSyncEnabled_ = false;
+    // guards the LED state and MIDI output shared by the message and blink threads
+    CriticalSection stateLock_;
+    CriticalSection reopenLock_;    // taken after stateLock_, see reopenMidi()
+    int selectedLoop_ = -1;
+
+
+    Reconnector oscLink_;
+    CommandInput commandInput_ { [this] (const String& line) { commandLineReceived(line); } };
+    bool commandsInline_ = false;   // read and run on the event loop
+
+    // min and pedal, the OSC packet for each controller or empty
+    std::unique_ptr<PedalInput> pedalInput_;
+    MemoryBlock pedalMessages_[128];
+
+    // pred, and the guesses not yet answered by LED index
+    struct Prediction
+    {
+        int controller;
+        int led;
+        int from;
+        int to;
+    };
+    Array<Prediction> predictions_;
+    struct PredictedLed
+    {
+        double untilMs = 0.0;
+        LedStates state = Dark;
+        LedStates previous = Dark;
+        bool previousOn = false;
+    };
+    PredictedLed predicted_[LedStore::capacity];
+
+    // from lpre, an UP or DOWN shown before the looper's answer
+    bool loopPrefetch_ = false;
+    struct SelectionGuess
+    {
+        double untilMs = 0.0;
+        int loop = -1;
+        int previous = -1;
+    };
+    SelectionGuess selectionGuess_;
+    EngineFrameCache loopFrames_;   // the first looper's LEDs by selected loop
+    int prefetchedFor_ = -1;
+
+    // from the /led messages that carry one
+    struct LedSequence
+    {
+        uint32 sequence = 0;
+        bool seen = false;
+    };
+    LedSequence ledSequences_[LedStore::capacity];
+    HotplugMonitor hotplug_ { [this] (const String& deviceName) { soundDeviceAdded(deviceName); } };
+    bool oscConnectedBefore_ = false;
+    bool oscGreeted_ = false;       // the sockets are up and the loopers greeted, no /pingack yet
+    bool heartbeatOn_ = false;
+
+    AsyncLog log_;
+    CommandCall currentCommand_;
+    Time lastTime_;
+};
+
+//==============================================================================
+// What START_JUCE_APPLICATION would generate, with the command lines that
+// only print something answered first
+static JUCEApplicationBase* juce_CreateApplication() { return new loop4r_ledsApplication(); }
+
+extern "C" int main (int argc, char* argv[])
+{
+    StringArray params;
+    for (int i = 1; i < argc; ++i)
+        params.add(CharPointer_UTF8(argv[i]));
+    if (loop4r_ledsApplication::runWithoutJuce(params))
+        return 0;
+
+    JUCEApplicationBase::createInstance = &juce_CreateApplication;
+    return JUCEApplicationBase::main(argc, (const char**)argv, nullptr);
+}
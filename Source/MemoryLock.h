@@ -0,0 +1,94 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <alloca.h>
+#include <limits.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+//==============================================================================
+// Keeps the bridge resident so nothing on the LED path waits for a page to be
+// read back from the SD card or touched for the first time. The pools and
+// buffers are already allocated up front, so what is left is the heap the
+// rest allocates from, the stacks and the code, which mlockall() covers.
+struct MemoryLock
+{
+    // the stack of threads started from now on. MCL_FUTURE faults in a new
+    // stack whole, so it keeps the default of 8 MB from being resident for
+    // every thread.
+    static bool setThreadStackSize(int kb)
+    {
+        pthread_attr_t attr;
+        if (pthread_attr_init(&attr) != 0)
+            return false;
+
+        bool ok = pthread_attr_setstacksize(&attr, jmax((size_t)PTHREAD_STACK_MIN, (size_t)kb * 1024)) == 0
+                  && pthread_setattr_default_np(&attr) == 0;
+        pthread_attr_destroy(&attr);
+        return ok;
+    }
+
+    // Has all threads allocate from one heap that never shrinks nor maps
+    // blocks of its own, faults in heapKb of it and stackKb of the calling
+    // thread's stack, then locks everything mapped now or later. Returns
+    // false without CAP_IPC_LOCK or a big enough RLIMIT_MEMLOCK.
+    static bool lockAll(int stackKb, int heapKb)
+    {
+        mallopt(M_ARENA_MAX, 1);
+        mallopt(M_MMAP_MAX, 0);
+        mallopt(M_TRIM_THRESHOLD, -1);
+
+        prefaultHeap((size_t)jmax(0, heapKb) * 1024);
+        prefaultStack((size_t)jmax(0, stackKb) * 1024);
+        return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+    }
+
+    // a field of /proc/self/status such as "VmLck" in kB, -1 if not there
+    static int64 getStatusKb(const String& key)
+    {
+        for (auto& line : StringArray::fromLines(File("/proc/self/status").loadFileAsString()))
+            if (line.startsWith(key + ":"))
+                return line.fromFirstOccurrenceOf(":", false, false).trim().getLargeIntValue();
+        return -1;
+    }
+
+private:
+    // freed again, the trim threshold keeps it in the heap
+    static void prefaultHeap(size_t size)
+    {
+        auto* block = (volatile char*)malloc(size);
+        if (block == nullptr)
+            return;
+
+        for (size_t i = 0; i < size; i += 4096)
+            block[i] = 0;
+        free((void*)block);
+    }
+
+    static void __attribute__((noinline)) prefaultStack(size_t size)
+    {
+        auto* stack = (volatile char*)alloca(size);
+        for (size_t i = 0; i < size; i += 4096)
+            stack[i] = 0;
+    }
+};
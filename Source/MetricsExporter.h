@@ -0,0 +1,155 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <functional>
+
+//==============================================================================
+// Pushes the same counters and percentiles as /loop4r_leds/stats to fleet
+// monitoring every interval, from a low priority thread of its own: as
+// statsd gauges in as few datagrams as fit, or as a Prometheus textfile
+// collector file, written aside and renamed over so a scrape never sees
+// half of it. The collector runs on this thread and takes whatever locks
+// it needs; formatting and sending happen without them.
+class MetricsExporter : private Thread
+{
+public:
+    typedef std::function<void(const String& name, int64 value)> AddFunction;
+    typedef std::function<void(const AddFunction& add)> Collector;
+
+    MetricsExporter(Collector collector)
+        : Thread("loop4r metrics"),
+          collector_(collector)
+    {
+    }
+
+    ~MetricsExporter()
+    {
+        stop();
+    }
+
+    bool startStatsd(const String& host, int port, double intervalMs)
+    {
+        if (isThreadRunning() || ! socket_.bindToPort(0))
+            return false;
+
+        host_ = host;
+        port_ = port;
+        file_ = File();
+        return start(intervalMs);
+    }
+
+    bool startTextfile(const File& file, double intervalMs)
+    {
+        if (isThreadRunning() || ! file.getParentDirectory().isDirectory())
+            return false;
+
+        file_ = file;
+        return start(intervalMs);
+    }
+
+    void stop()
+    {
+        signalThreadShouldExit();
+        notify();
+        stopThread(1000);
+    }
+
+private:
+    struct Metric
+    {
+        String name;
+        int64 value;
+    };
+
+    // statsd and Prometheus both want names of letters, digits and _
+    static String sanitize(const String& name)
+    {
+        String result;
+        for (auto p = name.getCharPointer(); ! p.isEmpty(); ++p)
+            result += CharacterFunctions::isLetterOrDigit(*p) ? *p : (juce_wchar)'_';
+        return result;
+    }
+
+    bool start(double intervalMs)
+    {
+        intervalMs_ = jmax(1000.0, intervalMs);
+        startThread(2);
+        return true;
+    }
+
+    void run() override
+    {
+        Array<Metric> metrics;
+        while (! threadShouldExit())
+        {
+            metrics.clearQuick();
+            collector_([&metrics] (const String& name, int64 value) { metrics.add({ sanitize(name), value }); });
+            if (file_ == File())
+                sendStatsd(metrics);
+            else
+                writeTextfile(metrics);
+
+            wait((int)intervalMs_);
+        }
+    }
+
+    // a datagram per 1432 bytes, what fits in an Ethernet frame
+    void sendStatsd(const Array<Metric>& metrics)
+    {
+        const int maxDatagram = 1432;
+        String datagram;
+        for (auto& metric : metrics)
+        {
+            String line = "loop4r_leds." + metric.name + ":" + String(metric.value) + "|g\n";
+            if (datagram.getNumBytesAsUTF8() + line.getNumBytesAsUTF8() > (size_t)maxDatagram && datagram.isNotEmpty())
+            {
+                socket_.write(host_, port_, datagram.toRawUTF8(), (int)datagram.getNumBytesAsUTF8());
+                datagram.clear();
+            }
+            datagram += line;
+        }
+
+        if (datagram.isNotEmpty())
+            socket_.write(host_, port_, datagram.toRawUTF8(), (int)datagram.getNumBytesAsUTF8());
+    }
+
+    void writeTextfile(const Array<Metric>& metrics)
+    {
+        String text;
+        for (auto& metric : metrics)
+        {
+            String name = "loop4r_leds_" + metric.name;
+            text << "# TYPE " << name << " gauge\n" << name << " " << metric.value << "\n";
+        }
+
+        File temporary = file_.getSiblingFile("." + file_.getFileName() + ".tmp");
+        if (temporary.replaceWithText(text, false, false))
+            temporary.moveFileTo(file_);
+    }
+
+    Collector collector_;
+    DatagramSocket socket_;
+    String host_;
+    int port_ = 0;
+    File file_;
+    double intervalMs_ = 10000.0;
+};
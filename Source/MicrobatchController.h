@@ -0,0 +1,85 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// Sizes the coalescing window from the traffic seen over 100 ms windows: the
+// OSC packets counted in the stats and whether the MIDI output is backed up
+// at the end of it. Above the rate, or with bytes still queued for the
+// pedalboard, the window doubles up to the bound, so a storm of updates goes
+// out in few writes. Under half the rate with nothing queued it halves down
+// to none, and after a quiet window it is none straight away, so a change
+// while playing is written as soon as it arrives. Guarded by the
+// application's stateLock_.
+class MicrobatchController
+{
+public:
+    // a rate of 0 turns it off
+    void configure(int packetsPerSecond, double maxMs)
+    {
+        rate_ = jmax(0, packetsPerSecond);
+        maxMs_ = jmax(0.0, maxMs);
+        windowMs_ = 0.0;
+    }
+
+    bool isEnabled() const              { return rate_ > 0 && maxMs_ > 0.0; }
+    double getWindowMs() const          { return windowMs_; }
+
+    // once per batch of packets, with the packet counter and the output
+    // backlog as they are now; returns true when the window changed
+    bool update(double nowMs, int64 packets, bool backlogged)
+    {
+        if (! isEnabled() || nowMs - windowStartMs_ < periodMs)
+            return false;
+
+        const double previousMs = windowMs_;
+        const int64 counted = packets - packetsAtStart_;
+        const int perPeriod = jmax(1, rate_ * (int)periodMs / 1000);
+
+        if (nowMs - windowStartMs_ >= 2 * periodMs && ! backlogged)
+            windowMs_ = 0.0;
+        else if (counted > perPeriod || backlogged)
+            windowMs_ = jmin(maxMs_, windowMs_ > 0.0 ? windowMs_ * 2.0 : minStepMs);
+        else if (counted < perPeriod / 2)
+            windowMs_ = windowMs_ > minStepMs ? windowMs_ / 2.0 : 0.0;
+
+        if (windowMs_ > previousMs)
+            ++widened_;
+
+        packetsAtStart_ = packets;
+        windowStartMs_ = nowMs;
+        return windowMs_ != previousMs;
+    }
+
+    int64 getWidened() const            { return widened_; }
+
+private:
+    static constexpr double periodMs = 100.0;
+    static constexpr double minStepMs = 0.25;
+
+    int rate_ = 0;
+    double maxMs_ = 0.0;
+    double windowMs_ = 0.0;
+    double windowStartMs_ = 0.0;
+    int64 packetsAtStart_ = 0;
+    int64 widened_ = 0;
+};
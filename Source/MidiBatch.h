@@ -0,0 +1,165 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "MidiSink.h"
+#include "Probes.h"
+#include <alsa/asoundlib.h>
+
+//==============================================================================
+// Collects the MIDI bytes generated while handling one OSC message or one
+// timer tick, so they reach the rawmidi port in a single write and drain
+// instead of one syscall per controller event.
+class MidiBatch
+{
+public:
+    MidiBatch()
+    {
+        bytes_.ensureStorageAllocated(256);
+    }
+
+    // with a refresh interval > 0 consecutive messages with the same status
+    // byte are sent as running status, and the status byte is repeated every
+    // refreshInterval messages so a receiver that missed it resynchronizes
+    void setRunningStatus(int refreshInterval)
+    {
+        refreshInterval_ = jmax(0, refreshInterval);
+        resetRunningStatus();
+    }
+
+    // forget what the receiver last saw, e.g. after the port was reopened
+    void resetRunningStatus()
+    {
+        lastStatus_ = 0;
+        sinceStatus_ = 0;
+    }
+
+    // 1 to 16
+    void setChannel(int channel)
+    {
+        channel_ = (uint8)(jlimit(1, 16, channel) - 1);
+        resetRunningStatus();
+    }
+
+    void addControllerEvent(uint8 controller, uint8 value)
+    {
+        addStatus((uint8)(MIDI_CMD_CONTROL | channel_));
+        bytes_.add(controller);
+        bytes_.add(value);
+    }
+
+    // a channel message of two data bytes built beforehand, status is its
+    // kind without the channel, e.g. MIDI_CMD_CONTROL
+    void addEvent(uint8 status, const uint8* data)
+    {
+        addStatus((uint8)((status & 0xf0) | channel_));
+        bytes_.addArray(data, 2);
+    }
+
+    // data is the message without the F0 and F7 around it, and all 7 bit
+    void addSysEx(const uint8* data, int size)
+    {
+        bytes_.add((uint8)0xf0);
+        bytes_.addArray(data, size);
+        bytes_.add((uint8)0xf7);
+
+        // system exclusive cancels running status
+        resetRunningStatus();
+    }
+
+    bool isEmpty() const
+    {
+        return bytes_.isEmpty();
+    }
+
+    const uint8* getData() const
+    {
+        return bytes_.begin();
+    }
+
+    int getNumBytes() const
+    {
+        return bytes_.size();
+    }
+
+    void clear()
+    {
+        bytes_.clearQuick();
+    }
+
+    // writes everything collected so far and empties the batch, the bytes are
+    // dropped if no port is open as there is nobody to show them to. Returns
+    // false if the bytes did not all make it to the port.
+    bool flush(MidiSink& port)
+    {
+        if (bytes_.isEmpty())
+        {
+            port.writePending();
+            return true;
+        }
+
+        bool ok = port.write(bytes_.getRawDataPointer(), bytes_.size());
+        port.drain();
+        if (! ok)
+        {
+            // the receiver may have lost track of the status byte
+            resetRunningStatus();
+        }
+
+        bytes_.clearQuick();
+        return ok;
+    }
+
+    // the same for a sink that can schedule, which delivers the bytes
+    // delayMs from now unless they are cancelled by tag before then
+    bool flushScheduled(MidiSink& port, double delayMs, int tag)
+    {
+        if (bytes_.isEmpty())
+            return true;
+
+        LOOP4R_PROBE3(midi_schedule, bytes_.size(), (int64)(delayMs * 1000.0), tag);
+        bool ok = port.writeScheduled(bytes_.getRawDataPointer(), bytes_.size(), delayMs, tag);
+        if (! ok)
+            resetRunningStatus();
+
+        bytes_.clearQuick();
+        return ok;
+    }
+
+private:
+    void addStatus(uint8 status)
+    {
+        if (refreshInterval_ > 0 && status == lastStatus_ && sinceStatus_ < refreshInterval_)
+        {
+            ++sinceStatus_;
+            return;
+        }
+
+        bytes_.add(status);
+        lastStatus_ = status;
+        sinceStatus_ = 1;
+    }
+
+    Array<uint8> bytes_;
+    uint8 channel_ = 0;
+    int refreshInterval_ = 0;
+    uint8 lastStatus_ = 0;
+    int sinceStatus_ = 0;
+};
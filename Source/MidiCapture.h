@@ -0,0 +1,271 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "FlatHashMap.h"
+#include "LatencyHistogram.h"
+#include "LedShadow.h"
+#include "LoopClock.h"
+
+//==============================================================================
+// A MIDI capture file is the magic below followed by one record per write to
+// a board: the time since the capture started in us (int64), the board's
+// index (int32), the size (int32) and the bytes, all little endian like the
+// OSC captures. A scheduled write is stamped with the time it is due.
+static const char MIDI_CAPTURE_MAGIC[8] = { 'L', '4', 'R', 'M', 'I', 'D', '0', '1' };
+
+//==============================================================================
+// Writes the MIDI going to the boards to a capture file, timed on the loop
+// clock so a replay on a simulated clock captures the same every time. Only
+// written with the application's stateLock_ held.
+class MidiRecorder
+{
+public:
+    bool open(const File& file, const LoopClock& clock)
+    {
+        file.deleteFile();
+        out_.reset(new FileOutputStream(file, 1 << 16));
+        if (out_->failedToOpen() || ! out_->write(MIDI_CAPTURE_MAGIC, sizeof(MIDI_CAPTURE_MAGIC)))
+        {
+            out_ = nullptr;
+            return false;
+        }
+
+        clock_ = &clock;
+        startMs_ = clock.nowMs();
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return out_ != nullptr;
+    }
+
+    void record(int board, const uint8* data, int size, double delayMs = 0.0)
+    {
+        if (out_ == nullptr || size <= 0)
+            return;
+
+        out_->writeInt64((int64)((clock_->nowMs() + delayMs - startMs_) * 1000.0));
+        out_->writeInt(board);
+        out_->writeInt(size);
+        out_->write(data, (size_t)size);
+    }
+
+    void close()
+    {
+        out_ = nullptr;
+    }
+
+private:
+    std::unique_ptr<FileOutputStream> out_;
+    const LoopClock* clock_ = nullptr;
+    double startMs_ = 0.0;
+};
+
+//==============================================================================
+// Compares the MIDI of a run against a golden capture of the same session.
+// Both are decoded, running status included, into what each board shows: the
+// LEDs lit by CC_LED_ON and CC_LED_OFF, and the display digits. The runs are
+// equivalent if they end up showing the same; in between every change the
+// golden run showed is looked for in the other, in order, and how far off in
+// time it came is its lag. Changes the other run never showed were coalesced
+// away, writes that changed nothing aren't changes. SysEx, e.g. sx frames,
+// is counted but not decoded.
+class MidiCompare
+{
+public:
+    struct Change
+    {
+        int64 timeUs;
+        int key;            // board * numKeys + LED number, or a digit
+        int value;
+    };
+
+    struct Stream
+    {
+        int64 bytes = 0;
+        int64 writes = 0;
+        int64 sysex = 0;
+        Array<Change> changes;
+        FlatHashMap<int, int> shown;    // by key, what each ended up showing
+    };
+
+    static const int numKeys = 130;     // the LEDs, then the two digits
+
+    static bool load(const File& file, Stream& stream)
+    {
+        MemoryBlock data;
+        if (! file.loadFileAsData(data) || data.getSize() < sizeof(MIDI_CAPTURE_MAGIC)
+            || memcmp(data.getData(), MIDI_CAPTURE_MAGIC, sizeof(MIDI_CAPTURE_MAGIC)) != 0)
+            return false;
+
+        const char* bytes = (const char*)data.getData();
+        const int size = (int)data.getSize();
+        int pos = (int)sizeof(MIDI_CAPTURE_MAGIC);
+        Decoder decoders[8];
+        while (size - pos >= 16)
+        {
+            int64 us = (int64)ByteOrder::littleEndianInt64(bytes + pos);
+            int board = (int)ByteOrder::littleEndianInt(bytes + pos + 8);
+            int length = (int)ByteOrder::littleEndianInt(bytes + pos + 12);
+            if (length < 0 || length > size - pos - 16)
+                return false;
+
+            ++stream.writes;
+            stream.bytes += length;
+            decoders[jlimit(0, 7, board)].decode((const uint8*)bytes + pos + 16, length, us, jmax(0, board) * numKeys, stream);
+            pos += 16 + length;
+        }
+        return pos == size;
+    }
+
+    static String compare(const Stream& golden, const Stream& run)
+    {
+        // each key's changes in order, the runs' timing apart
+        LatencyHistogram lag("lag");
+        int64 matched = 0, missing = 0, early = 0;
+        FlatHashMap<int, int> next;     // by key, the run's next unmatched change
+        for (auto& change : golden.changes)
+        {
+            int i = next[change.key];
+            while (i < run.changes.size() && run.changes.getReference(i).key != change.key)
+                ++i;
+
+            if (i < run.changes.size() && run.changes.getReference(i).value == change.value)
+            {
+                int64 lagUs = run.changes.getReference(i).timeUs - change.timeUs;
+                lag.record((double)std::abs(lagUs) / 1000.0);
+                if (lagUs < 0)
+                    ++early;
+                ++matched;
+                next.set(change.key, i + 1);
+            }
+            else
+            {
+                ++missing;
+            }
+        }
+
+        bool equivalent = golden.shown.size() == run.shown.size();
+        golden.shown.forEach([&] (int key, int value)
+        {
+            const int* shown = run.shown.find(key);
+            equivalent = equivalent && shown != nullptr && *shown == value;
+        });
+
+        auto* root = new DynamicObject();
+        root->setProperty("version", ProjectInfo::versionString);
+        root->setProperty("equivalent", equivalent);
+        root->setProperty("golden", describe(golden));
+        root->setProperty("run", describe(run));
+        root->setProperty("bytes_delta", run.bytes - golden.bytes);
+        root->setProperty("writes_delta", run.writes - golden.writes);
+        root->setProperty("changes_matched", matched);
+        root->setProperty("changes_coalesced", missing);
+        root->setProperty("changes_extra", (int64)run.changes.size() - matched);
+        root->setProperty("changes_early", early);
+        root->setProperty("lag_p50_us", lag.getPercentile(0.5));
+        root->setProperty("lag_p99_us", lag.getPercentile(0.99));
+        root->setProperty("lag_max_us", lag.getMax());
+        return JSON::toString(var(root));
+    }
+
+private:
+    // one board's byte stream, running status carried over between writes
+    struct Decoder
+    {
+        void decode(const uint8* data, int size, int64 us, int firstKey, Stream& stream)
+        {
+            for (int i = 0; i < size; ++i)
+            {
+                uint8 byte = data[i];
+                if (byte >= 0xf8)
+                    continue;       // real time, anywhere
+
+                if (inSysex_)
+                {
+                    inSysex_ = byte != 0xf7;
+                    continue;
+                }
+
+                if (byte & 0x80)
+                {
+                    inSysex_ = byte == 0xf0;
+                    if (inSysex_)
+                        ++stream.sysex;
+                    status_ = byte < 0xf0 ? byte : 0;
+                    numData_ = 0;
+                    continue;
+                }
+
+                if (status_ == 0)
+                    continue;
+
+                data_[numData_++] = byte;
+                if (numData_ < dataBytes(status_))
+                    continue;
+
+                numData_ = 0;
+                if ((status_ & 0xf0) == 0xb0)
+                    controller(data_[0], data_[1], us, firstKey, stream);
+            }
+        }
+
+        static int dataBytes(uint8 status)
+        {
+            const uint8 type = status & 0xf0;
+            return type == 0xc0 || type == 0xd0 ? 1 : 2;
+        }
+
+        void controller(uint8 number, uint8 value, int64 us, int firstKey, Stream& stream)
+        {
+            if (number == CC_LED_ON || number == CC_LED_OFF)
+                show(stream, firstKey + value, number == CC_LED_ON ? 1 : 0, us);
+            else if (number == CC_DISPLAY_TENS || number == CC_DISPLAY_ONES)
+                show(stream, firstKey + 128 + (number - CC_DISPLAY_TENS), value, us);
+        }
+
+        static void show(Stream& stream, int key, int value, int64 us)
+        {
+            const int* shown = stream.shown.find(key);
+            if (shown != nullptr && *shown == value)
+                return;
+
+            stream.shown.set(key, value);
+            stream.changes.add({ us, key, value });
+        }
+
+        uint8 status_ = 0;
+        uint8 data_[2] = {};
+        int numData_ = 0;
+        bool inSysex_ = false;
+    };
+
+    static var describe(const Stream& stream)
+    {
+        auto* result = new DynamicObject();
+        result->setProperty("bytes", stream.bytes);
+        result->setProperty("writes", stream.writes);
+        result->setProperty("changes", stream.changes.size());
+        result->setProperty("sysex", stream.sysex);
+        return var(result);
+    }
+};
@@ -0,0 +1,182 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "RawMidiPort.h"
+#include "LatencyHistogram.h"
+
+//==============================================================================
+// Measures the interface itself: with the output looped back to an input,
+// by a cable or a second port, batches of probe CCs go out through the same
+// RawMidiPort writes as the LEDs and the time until the last byte of each
+// batch is read back is taken, for batches of 1 to 64 messages, along with
+// how long the write itself took. The result is JSON with the percentiles
+// per batch size, to choose a coalescing window for the interface.
+class MidiLoopback
+{
+public:
+    struct BatchResult
+    {
+        int messages = 0;
+        int64 writeP50Us = 0;
+        int64 writeP99Us = 0;
+        int64 roundTripP50Us = 0;
+        int64 roundTripP99Us = 0;
+        int64 roundTripMaxUs = 0;
+        int lost = 0;
+    };
+
+    MidiLoopback(const String& output, const String& input, RawMidiResolver* resolver)
+        : output_(output, resolver),
+          input_(input),
+          resolver_(resolver)
+    {
+    }
+
+    ~MidiLoopback()
+    {
+        if (in_ != nullptr)
+            snd_rawmidi_close(in_);
+    }
+
+    // JSON, or empty if a port would not open
+    String run(int repeats)
+    {
+        String device = resolver_ != nullptr ? resolver_->resolve(input_, SND_RAWMIDI_STREAM_INPUT) : input_;
+        if (device.isEmpty() || ! output_.open()
+            || snd_rawmidi_open(&in_, NULL, device.toRawUTF8(), SND_RAWMIDI_NONBLOCK) < 0)
+            return {};
+
+        Array<var> results;
+        results_.clearQuick();
+        for (int batchSize = 1; batchSize <= maxBatch; batchSize *= 2)
+        {
+            LatencyHistogram roundTrip("loopback");
+            LatencyHistogram write("write");
+            int lost = 0;
+            for (int i = 0; i < jmax(1, repeats); ++i)
+            {
+                double ms = probe(batchSize, write);
+                if (ms < 0.0)
+                    ++lost;
+                else
+                    roundTrip.record(ms);
+            }
+
+            BatchResult batch;
+            batch.messages = batchSize;
+            batch.writeP50Us = write.getPercentile(0.5);
+            batch.writeP99Us = write.getPercentile(0.99);
+            batch.roundTripP50Us = roundTrip.getPercentile(0.5);
+            batch.roundTripP99Us = roundTrip.getPercentile(0.99);
+            batch.roundTripMaxUs = roundTrip.getMax();
+            batch.lost = lost;
+            results_.add(batch);
+
+            auto* result = new DynamicObject();
+            result->setProperty("messages", batchSize);
+            result->setProperty("bytes", batchSize * 3);
+            result->setProperty("write_p50_us", batch.writeP50Us);
+            result->setProperty("write_p99_us", batch.writeP99Us);
+            result->setProperty("round_trip_p50_us", batch.roundTripP50Us);
+            result->setProperty("round_trip_p99_us", batch.roundTripP99Us);
+            result->setProperty("round_trip_max_us", batch.roundTripMaxUs);
+            result->setProperty("lost", lost);
+            results.add(var(result));
+        }
+
+        output_.close();
+        return JSON::toString(var(results));
+    }
+
+    // from the last run(), by batch size from the smallest
+    const Array<BatchResult>& getResults() const
+    {
+        return results_;
+    }
+
+private:
+    static const int maxBatch = 64;
+    static const int timeoutMs = 1000;
+
+    // ms from writing batchSize CCs to reading the last of them back, or -1
+    // if they didn't all come back in time; the write alone goes into write
+    double probe(int batchSize, LatencyHistogram& write)
+    {
+        discardInput();
+
+        uint8 batch[maxBatch * 3];
+        for (int i = 0; i < batchSize; ++i)
+        {
+            batch[i * 3] = 0xbf;                        // channel 16
+            batch[i * 3 + 1] = 0x66;                    // an undefined controller
+            batch[i * 3 + 2] = (uint8)(sequence_++ & 0x7f);
+        }
+
+        const double startMs = Time::getMillisecondCounterHiRes();
+        if (! output_.write(batch, batchSize * 3))
+            return -1.0;
+        write.record(Time::getMillisecondCounterHiRes() - startMs);
+
+        int received = 0;
+        while (received < batchSize * 3)
+        {
+            double waitMs = startMs + timeoutMs - Time::getMillisecondCounterHiRes();
+            if (waitMs <= 0.0 || ! waitForInput((int)std::ceil(waitMs)))
+                return -1.0;
+
+            uint8 buffer[256];
+            ssize_t size = snd_rawmidi_read(in_, buffer, sizeof(buffer));
+            if (size == -EAGAIN || size == -EINTR)
+                continue;
+            if (size < 0)
+                return -1.0;
+
+            for (ssize_t i = 0; i < size; ++i)
+                if (buffer[i] < 0xf8)               // active sensing and clock don't count
+                    ++received;
+        }
+        return Time::getMillisecondCounterHiRes() - startMs;
+    }
+
+    bool waitForInput(int timeoutMs)
+    {
+        pollfd pfd;
+        if (snd_rawmidi_poll_descriptors(in_, &pfd, 1) != 1)
+            return false;
+        return poll(&pfd, 1, timeoutMs) > 0 && (pfd.revents & POLLIN) != 0;
+    }
+
+    // whatever is left over from a batch that timed out
+    void discardInput()
+    {
+        uint8 buffer[256];
+        while (snd_rawmidi_read(in_, buffer, sizeof(buffer)) > 0)
+        {
+        }
+    }
+
+    RawMidiPort output_;
+    String input_;
+    RawMidiResolver* resolver_;
+    snd_rawmidi_t* in_ = nullptr;
+    int sequence_ = 0;
+    Array<BatchResult> results_;
+};
@@ -0,0 +1,181 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+//==============================================================================
+// Where the MIDI bytes for the pedalboard go. Only one thread at a time may
+// write; opening happens on the message thread and may be retried for as
+// long as isOpen() is false.
+class MidiSink
+{
+public:
+    virtual ~MidiSink() {}
+
+    virtual bool open() = 0;
+    virtual void close() = 0;
+    virtual bool isOpen() const = 0;
+
+    // returns false if any of the bytes were lost
+    virtual bool write(const uint8* data, int size) = 0;
+
+    // sinks that can hold bytes back retry them here, returning true once
+    // nothing is left pending
+    virtual bool writePending()                     { return true; }
+    virtual bool hasPending() const                 { return false; }
+
+    // gives up on the pending bytes that are not part of a message already
+    // partly written, returning how many were dropped
+    virtual int dropPending()                       { return 0; }
+
+    // waits for the sink to accept more bytes, returns false on timeout
+    virtual bool waitUntilWritable(int timeoutMs)   { ignoreUnused(timeoutMs); return true; }
+
+    virtual void drain()                            {}
+
+    // a descriptor to poll for the sink taking bytes again, or -1
+    virtual int getPollHandle() const               { return -1; }
+    virtual void setNonBlocking(bool nonBlocking)   { ignoreUnused(nonBlocking); }
+
+    // the kernel buffer of sinks that have one, in bytes: its size, and how
+    // much of it has to be free before a writer waiting for room wakes up.
+    // 0 leaves the driver's default.
+    struct BufferParams
+    {
+        int size = 0;
+        int availMin = 0;
+    };
+    virtual void setBufferParams(const BufferParams& params) { ignoreUnused(params); }
+
+    // the size the kernel buffer has, 0 if unknown
+    virtual int getBufferSize() const               { return 0; }
+
+    // sinks with a queue of their own can deliver bytes delayMs from now.
+    // The tag identifies them for cancelScheduled(), which with a negative
+    // tag takes back everything still queued.
+    virtual bool canSchedule() const                { return false; }
+    virtual bool writeScheduled(const uint8* data, int size, double delayMs, int tag)
+    {
+        ignoreUnused(delayMs, tag);
+        return write(data, size);
+    }
+    virtual void cancelScheduled(int tag)           { ignoreUnused(tag); }
+
+    // sinks that hold scheduled writes back to hand them over together do
+    // so here, once the writes of a tick are done
+    virtual void commitScheduled()                  {}
+
+    int64 getBytesWritten() const          { return bytesWritten_.get(); }
+    int64 getBytesDeferred() const         { return bytesDeferred_.get(); }
+    int64 getBytesDropped() const          { return bytesDropped_.get(); }
+    int64 getShortWrites() const           { return shortWrites_.get(); }
+
+protected:
+    Atomic<int64> bytesWritten_ { 0 };
+    Atomic<int64> bytesDeferred_ { 0 };
+    Atomic<int64> bytesDropped_ { 0 };
+    Atomic<int64> shortWrites_ { 0 };
+};
+
+//==============================================================================
+// Takes everything and only counts it, for measuring the software side
+// without a pedalboard attached
+class NullMidiSink : public MidiSink
+{
+public:
+    bool open() override                    { return true; }
+    void close() override                   {}
+    bool isOpen() const override            { return true; }
+
+    bool write(const uint8*, int size) override
+    {
+        bytesWritten_ += size;
+        return true;
+    }
+};
+
+//==============================================================================
+// Appends the raw MIDI bytes to a file, or writes them into a named pipe once
+// something reads from it
+class FileMidiSink : public MidiSink
+{
+public:
+    FileMidiSink(const String& path)
+        : path_(path)
+    {
+    }
+
+    ~FileMidiSink()
+    {
+        close();
+    }
+
+    bool open() override
+    {
+        // a reader closing the pipe should fail the write, not end us
+        signal(SIGPIPE, SIG_IGN);
+
+        // non-blocking so a pipe without a reader fails instead of hanging,
+        // the writes themselves block as they do on a device
+        int fd = ::open(path_.toRawUTF8(), O_WRONLY | O_CREAT | O_APPEND | O_NONBLOCK | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return false;
+
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        fd_ = fd;
+        return true;
+    }
+
+    void close() override
+    {
+        int fd = fd_.exchange(-1);
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    bool isOpen() const override
+    {
+        return fd_.get() >= 0;
+    }
+
+    bool write(const uint8* data, int size) override
+    {
+        int fd = fd_.get();
+        ssize_t wrote = fd >= 0 ? ::write(fd, data, (size_t)size) : -1;
+        if (wrote != (ssize_t)size)
+        {
+            ++shortWrites_;
+            bytesDropped_ += size - jmax(0, (int)wrote);
+            if (wrote < 0 && fd >= 0)
+                close();      // the reader went away, reopen later
+            return false;
+        }
+
+        bytesWritten_ += size;
+        return true;
+    }
+
+private:
+    String path_;
+    Atomic<int> fd_ { -1 };
+};
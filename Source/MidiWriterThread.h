@@ -0,0 +1,285 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "FutexEvent.h"
+#include "MidiSink.h"
+#include "LatencyHistogram.h"
+#include "ThreadTuning.h"
+#include "TraceSpans.h"
+
+//==============================================================================
+// Writes MIDI bytes to the sink from its own thread, so a slow or full
+// device never blocks the message thread. The message thread is the only
+// producer and this thread the only consumer of the fifo, handing over on a
+// FutexEvent so a write while the thread is busy costs no system call.
+// Each block is stamped as it is queued. With a maximum age, bytes that
+// reach the front of the fifo longer than that after the changes in them
+// were received are dropped unwritten, and the board told to write the
+// current state in their place; until a status byte comes, what follows
+// the dropped bytes ran on the status in them and goes too.
+class MidiWriterThread : private Thread
+{
+public:
+    // queueLatency, if given, records how long bytes wait in the fifo
+    MidiWriterThread(MidiSink* sink, LatencyHistogram* queueLatency = nullptr, int fifoSize = 4096)
+        : Thread("loop4r MIDI out"),
+          sink_(sink),
+          queueLatency_(queueLatency),
+          fifo_(fifoSize),
+          blockFifo_(maxBlocks)
+    {
+        buffer_.malloc((size_t)fifoSize);
+    }
+
+    ~MidiWriterThread()
+    {
+        stop();
+    }
+
+    // a realtime priority asks for SCHED_FIFO, falling back to the normal
+    // scheduler if we are not permitted to
+    void start(const ThreadTuning& tuning)
+    {
+        tuning_ = tuning;
+        startThread();
+    }
+
+    void stop()
+    {
+        signalThreadShouldExit();
+        wakeup_.signal();
+        stopThread(1000);
+    }
+
+    // once this returns the writer no longer touches the previous sink, which
+    // may then be deleted. Bytes queued meanwhile go to the new one, or are
+    // dropped for no sink at all.
+    void setSink(MidiSink* sink)
+    {
+        const ScopedLock sl(sinkLock_);
+        sink_ = sink;
+    }
+
+    // 0 writes everything however late
+    void setMaxAgeMs(double maxAgeMs)
+    {
+        maxAgeMs_ = jmax(0.0, maxAgeMs);
+    }
+
+    // queues the bytes as one block, returns false if there is no room for
+    // all of them in which case none are queued. receivedMs is when the
+    // oldest change in them was received, 0 for now.
+    bool write(const uint8* data, int size, double receivedMs = 0.0)
+    {
+        int block1, numBlocks1, block2, numBlocks2;
+        blockFifo_.prepareToWrite(1, block1, numBlocks1, block2, numBlocks2);
+        int start1, size1, start2, size2;
+        fifo_.prepareToWrite(size, start1, size1, start2, size2);
+        if (numBlocks1 + numBlocks2 < 1 || size1 + size2 < size)
+        {
+            return false;
+        }
+
+        memcpy(buffer_ + start1, data, (size_t)size1);
+        if (size2 > 0)
+            memcpy(buffer_ + start2, data + size1, (size_t)size2);
+        fifo_.finishedWrite(size1 + size2);
+
+        const double nowMs = Time::getMillisecondCounterHiRes();
+        blocks_[numBlocks1 > 0 ? block1 : block2] = { size, nowMs, receivedMs > 0.0 ? receivedMs : nowMs };
+        blockFifo_.finishedWrite(1);
+
+        wakeup_.signal();
+        return true;
+    }
+
+    // bytes queued that the sink has not taken yet
+    int getNumQueued() const
+    {
+        return fifo_.getNumReady();
+    }
+
+    // true if a write failed since the last call, the pedalboard may then
+    // not show what we think it does
+    bool checkAndClearFailure()
+    {
+        return failed_.exchange(0) != 0;
+    }
+
+    // true if stale bytes were dropped since the last call
+    bool checkAndClearStale()
+    {
+        return stale_.exchange(0) != 0;
+    }
+
+    int64 getStaleDrops() const     { return staleDrops_.get(); }
+    int64 getStaleBytes() const     { return staleBytes_.get(); }
+
+private:
+    void run() override
+    {
+        if (! tuning_.applyToCurrentThread())
+        {
+            std::cerr << "Could not set SCHED_FIFO priority " << tuning_.realtimePriority << " for the MIDI writer" << std::endl;
+        }
+
+        while (! threadShouldExit())
+        {
+            if (blockFifo_.getNumReady() == 0)
+            {
+                if (! hasPending())
+                {
+                    wakeup_.wait(-1);
+                }
+                else if (! retryPending())
+                {
+                    wakeup_.wait(10);
+                }
+                continue;
+            }
+
+            // the blocks queued so far, by the stamps of the oldest
+            int numBytes = 0;
+            double queuedMs = 0.0;
+            double receivedMs = 0.0;
+            takeBlocks(numBytes, queuedMs, receivedMs);
+
+            const double nowMs = Time::getMillisecondCounterHiRes();
+            if (queueLatency_ != nullptr)
+                queueLatency_->record(nowMs - queuedMs);
+
+            // everything queued goes, what came after the stale bytes is
+            // rewritten from the current state with them
+            const double maxAgeMs = maxAgeMs_.get();
+            if (maxAgeMs > 0.0 && nowMs - receivedMs > maxAgeMs)
+            {
+                fifo_.finishedRead(numBytes);
+                staleBytes_ += numBytes;
+                ++staleDrops_;
+                stale_ = 1;
+                awaitingStatus_ = true;
+                continue;
+            }
+
+            if (awaitingStatus_)
+                numBytes -= skipToStatus(numBytes);
+            if (numBytes == 0)
+                continue;
+
+            int start1, size1, start2, size2;
+            fifo_.prepareToRead(numBytes, start1, size1, start2, size2);
+
+            bool ok = true;
+            {
+                TraceSpans::Scope span("midi write");
+                const ScopedLock sl(sinkLock_);
+                if (sink_ != nullptr)
+                {
+                    ok = sink_->write(buffer_ + start1, size1);
+                    if (size2 > 0)
+                        ok = sink_->write(buffer_ + start2, size2) && ok;
+                    sink_->drain();
+                }
+            }
+            fifo_.finishedRead(size1 + size2);
+
+            if (! ok)
+                failed_ = 1;
+        }
+    }
+
+    void takeBlocks(int& numBytes, double& queuedMs, double& receivedMs)
+    {
+        int block1, numBlocks1, block2, numBlocks2;
+        blockFifo_.prepareToRead(blockFifo_.getNumReady(), block1, numBlocks1, block2, numBlocks2);
+        queuedMs = blocks_[numBlocks1 > 0 ? block1 : block2].queuedMs;
+        receivedMs = std::numeric_limits<double>::max();
+        for (int i = 0; i < numBlocks1 + numBlocks2; ++i)
+        {
+            const Block& block = blocks_[i < numBlocks1 ? block1 + i : block2 + i - numBlocks1];
+            numBytes += block.size;
+            receivedMs = jmin(receivedMs, block.receivedMs);
+        }
+        blockFifo_.finishedRead(numBlocks1 + numBlocks2);
+    }
+
+    // drops the data bytes at the front that ran on a dropped status,
+    // returns how many
+    int skipToStatus(int numBytes)
+    {
+        int start1, size1, start2, size2;
+        fifo_.prepareToRead(numBytes, start1, size1, start2, size2);
+        int skipped = 0;
+        while (skipped < size1 + size2
+               && buffer_[skipped < size1 ? start1 + skipped : start2 + skipped - size1] < 0x80)
+            ++skipped;
+
+        awaitingStatus_ = skipped == size1 + size2;
+        fifo_.finishedRead(skipped);
+        staleBytes_ += skipped;
+        return skipped;
+    }
+
+    bool hasPending()
+    {
+        const ScopedLock sl(sinkLock_);
+        return sink_ != nullptr && sink_->hasPending();
+    }
+
+    // returns false if the sink did not become writable in time
+    bool retryPending()
+    {
+        const ScopedLock sl(sinkLock_);
+        if (sink_ == nullptr || ! sink_->waitUntilWritable(100))
+            return false;
+
+        sink_->writePending();
+        return true;
+    }
+
+    CriticalSection sinkLock_;
+    MidiSink* sink_;
+    LatencyHistogram* queueLatency_;
+
+    // a write(): its size, when it was queued and when the oldest change in
+    // it was received
+    struct Block
+    {
+        int size;
+        double queuedMs;
+        double receivedMs;
+    };
+
+    static const int maxBlocks = 256;
+
+    Atomic<double> maxAgeMs_ { 0.0 };
+    Atomic<int> stale_ { 0 };
+    Atomic<int64> staleDrops_ { 0 };
+    Atomic<int64> staleBytes_ { 0 };
+    AbstractFifo fifo_;
+    HeapBlock<uint8> buffer_;
+    AbstractFifo blockFifo_;
+    Block blocks_[maxBlocks];
+    bool awaitingStatus_ = false;   // by this thread, since a drop
+    Atomic<int> failed_ { 0 };
+    ThreadTuning tuning_;
+    FutexEvent wakeup_;
+};
@@ -0,0 +1,315 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// The addresses we handle, each numbered in the order added and hashed once
+// when it is. A literal address is looked up by its hash in a small open
+// addressing table, the text is only compared once the hash matches. An
+// address with OSC wildcards in it is a pattern instead. The entries are
+// also kept as a tree of their parts between slashes, which a pattern is
+// walked down one part at a time, so only the branches that part matches
+// are looked at, and nothing is allocated or tokenised for it.
+class OscAddressTable
+{
+public:
+    OscAddressTable()
+    {
+        for (auto& slot : slots_)
+            slot = -1;
+        nodes_.add({});     // the root
+    }
+
+    // returns the new entry's number, the address must be a valid OSC address
+    int add(const String& address)
+    {
+        jassert(entries_.size() < maxEntries && find(address) < 0);
+
+        int index = entries_.size();
+        entries_.add({ address, hash(address.toRawUTF8()) });
+        addToTree(address, index);
+        for (uint32 slot = entries_.getReference(index).hash;; ++slot)
+        {
+            if (slots_[slot & slotMask] < 0)
+            {
+                slots_[slot & slotMask] = index;
+                break;
+            }
+        }
+        return index;
+    }
+
+    // an entry's number, or -1; patterns are never found here
+    int find(StringRef address) const
+    {
+        const uint32 addressHash = hash(address);
+        for (uint32 slot = addressHash;; ++slot)
+        {
+            int index = slots_[slot & slotMask];
+            if (index < 0)
+                return -1;
+
+            auto& entry = entries_.getReference(index);
+            if (entry.hash == addressHash && entry.address == address)
+                return index;
+        }
+    }
+
+    static bool isPattern(StringRef address)
+    {
+        return strpbrk(address, "*?[]{}") != nullptr;
+    }
+
+    // calls back with the number of every entry the pattern matches, in the
+    // order they were added, and returns how many there were; an invalid
+    // pattern matches nothing. Supports ?, *, [abc], [a-z], [!abc] and
+    // {foo,bar} within a part.
+    template <typename Callback>
+    int forEachMatch(StringRef pattern, Callback callback) const
+    {
+        Part parts[maxDepth];
+        const int numParts = split(pattern, parts);
+        if (numParts < 0)
+            return 0;
+
+        uint32 matched = 0;
+        collectMatches(0, parts, numParts, matched);
+
+        int matches = 0;
+        for (int i = 0; i < entries_.size(); ++i)
+        {
+            if ((matched & ((uint32)1 << i)) != 0)
+            {
+                callback(i);
+                ++matches;
+            }
+        }
+        return matches;
+    }
+
+    int size() const
+    {
+        return entries_.size();
+    }
+
+    const String& getAddress(int index) const
+    {
+        return entries_.getReference(index).address;
+    }
+
+private:
+    static const int maxEntries = 32;
+    static const uint32 slotMask = 2 * maxEntries - 1;     // at most half full
+    static const int maxDepth = 16;
+    static_assert(maxEntries <= 32, "matches are collected in a uint32");
+
+    // FNV-1a
+    static uint32 hash(const char* text)
+    {
+        uint32 result = 2166136261u;
+        for (; *text != 0; ++text)
+        {
+            result ^= (uint8)*text;
+            result *= 16777619u;
+        }
+        return result;
+    }
+
+    struct Entry
+    {
+        String address;
+        uint32 hash;
+    };
+
+    // one part of an address between slashes, pointing into it
+    struct Part
+    {
+        const char* start;
+        const char* end;
+    };
+
+    struct Node
+    {
+        String part;
+        int firstChild = -1;
+        int nextSibling = -1;
+        int entry = -1;             // the entry ending here, if any
+    };
+
+    // the parts of "/a/b/c", empty ones skipped, or -1 if it doesn't start
+    // with a slash or has too many
+    static int split(const char* address, Part* parts)
+    {
+        if (*address != '/')
+            return -1;
+
+        int numParts = 0;
+        for (const char* start = address + 1;;)
+        {
+            const char* end = start;
+            while (*end != 0 && *end != '/')
+                ++end;
+            if (end > start)
+            {
+                if (numParts == maxDepth)
+                    return -1;
+                parts[numParts++] = { start, end };
+            }
+            if (*end == 0)
+                return numParts;
+            start = end + 1;
+        }
+    }
+
+    void addToTree(const String& address, int index)
+    {
+        Part parts[maxDepth];
+        const int numParts = split(address.toRawUTF8(), parts);
+        jassert(numParts >= 0);
+
+        int node = 0;
+        for (int i = 0; i < numParts; ++i)
+        {
+            const String part(parts[i].start, (size_t)(parts[i].end - parts[i].start));
+            int child = nodes_.getReference(node).firstChild;
+            while (child >= 0 && nodes_.getReference(child).part != part)
+                child = nodes_.getReference(child).nextSibling;
+
+            if (child < 0)
+            {
+                child = nodes_.size();
+                Node added;
+                added.part = part;
+                added.nextSibling = nodes_.getReference(node).firstChild;
+                nodes_.add(added);
+                nodes_.getReference(node).firstChild = child;
+            }
+            node = child;
+        }
+        nodes_.getReference(node).entry = index;
+    }
+
+    void collectMatches(int node, const Part* parts, int numParts, uint32& matched) const
+    {
+        const Node& here = nodes_.getReference(node);
+        if (numParts == 0)
+        {
+            if (here.entry >= 0)
+                matched |= (uint32)1 << here.entry;
+            return;
+        }
+
+        for (int child = here.firstChild; child >= 0; child = nodes_.getReference(child).nextSibling)
+        {
+            const String& part = nodes_.getReference(child).part;
+            const char* text = part.toRawUTF8();
+            if (matches(parts[0].start, parts[0].end, text, text + part.getNumBytesAsUTF8()))
+                collectMatches(child, parts + 1, numParts - 1, matched);
+        }
+    }
+
+    // one part of a pattern against one part of an address
+    static bool matches(const char* pattern, const char* patternEnd, const char* text, const char* textEnd)
+    {
+        while (pattern < patternEnd)
+        {
+            switch (*pattern)
+            {
+                case '*':
+                    // any run of characters, tried from the shortest
+                    for (const char* rest = text; rest <= textEnd; ++rest)
+                        if (matches(pattern + 1, patternEnd, rest, textEnd))
+                            return true;
+                    return false;
+
+                case '?':
+                    if (text == textEnd)
+                        return false;
+                    ++pattern;
+                    ++text;
+                    break;
+
+                case '[':
+                {
+                    const char* close = (const char*)memchr(pattern, ']', (size_t)(patternEnd - pattern));
+                    if (close == nullptr || text == textEnd || ! isInSet(pattern + 1, close, *text))
+                        return false;
+                    pattern = close + 1;
+                    ++text;
+                    break;
+                }
+
+                case '{':
+                {
+                    const char* close = (const char*)memchr(pattern, '}', (size_t)(patternEnd - pattern));
+                    if (close == nullptr)
+                        return false;
+                    for (const char* option = pattern + 1; option <= close;)
+                    {
+                        const char* optionEnd = option;
+                        while (optionEnd < close && *optionEnd != ',')
+                            ++optionEnd;
+                        const size_t length = (size_t)(optionEnd - option);
+                        if (length <= (size_t)(textEnd - text) && memcmp(option, text, length) == 0
+                            && matches(close + 1, patternEnd, text + length, textEnd))
+                            return true;
+                        option = optionEnd + 1;
+                    }
+                    return false;
+                }
+
+                default:
+                    if (text == textEnd || *pattern != *text)
+                        return false;
+                    ++pattern;
+                    ++text;
+                    break;
+            }
+        }
+        return text == textEnd;
+    }
+
+    // "abc" or "a-z", either with a ! in front for everything else
+    static bool isInSet(const char* set, const char* end, char c)
+    {
+        const bool negated = set < end && *set == '!';
+        if (negated)
+            ++set;
+
+        bool found = false;
+        for (; set < end; ++set)
+        {
+            if (end - set > 2 && set[1] == '-')
+            {
+                found = found || (c >= set[0] && c <= set[2]);
+                set += 2;
+            }
+            else
+                found = found || *set == c;
+        }
+        return found != negated;
+    }
+
+    Array<Entry> entries_;
+    Array<Node> nodes_;
+    int slots_[slotMask + 1];       // entry numbers, -1 for free
+};
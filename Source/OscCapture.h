@@ -0,0 +1,188 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "OscInput.h"
+#include <functional>
+
+//==============================================================================
+// A capture file is the magic below followed by one record per datagram: the
+// time since the capture started in us (int64), the size (int32) and the
+// datagram itself, all little endian. Datagrams received in the same batch
+// share a timestamp and are replayed as one batch again.
+static const char OSC_CAPTURE_MAGIC[8] = { 'L', '4', 'R', 'O', 'S', 'C', '0', '1' };
+
+//==============================================================================
+// Appends every datagram handed to it to a capture file. Only the OSC
+// receiver thread writes.
+class OscRecorder
+{
+public:
+    bool open(const File& file)
+    {
+        file.deleteFile();
+        out_.reset(new FileOutputStream(file, 1 << 16));
+        if (out_->failedToOpen() || ! out_->write(OSC_CAPTURE_MAGIC, sizeof(OSC_CAPTURE_MAGIC)))
+        {
+            out_ = nullptr;
+            return false;
+        }
+
+        startMs_ = Time::getMillisecondCounterHiRes();
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return out_ != nullptr;
+    }
+
+    void record(const OscInput::Packet* packets, int numPackets)
+    {
+        for (int i = 0; i < numPackets; ++i)
+        {
+            out_->writeInt64((int64)((packets[i].receivedMs - startMs_) * 1000.0));
+            out_->writeInt(packets[i].size);
+            out_->write(packets[i].data, (size_t)packets[i].size);
+        }
+    }
+
+    void close()
+    {
+        out_ = nullptr;
+    }
+
+private:
+    std::unique_ptr<FileOutputStream> out_;
+    double startMs_ = 0.0;
+};
+
+//==============================================================================
+// Feeds a capture file back in from its own thread, with the original timing
+// scaled by speed, or as fast as possible for a speed of 0. The file is read
+// into memory first so disk access doesn't distort a benchmark. With an
+// advance callback nothing sleeps, it is told the capture time of each batch
+// before it is handed over, to move a simulated clock on to it.
+class OscReplay : private Thread
+{
+public:
+    typedef std::function<void(const OscInput::Packet* packets, int numPackets)> Callback;
+    typedef std::function<void(int numPackets, double elapsedMs)> FinishedCallback;
+    typedef std::function<void(double captureMs)> AdvanceCallback;
+
+    OscReplay(Callback callback, FinishedCallback finished)
+        : Thread("loop4r replay"),
+          callback_(callback),
+          finished_(finished)
+    {
+    }
+
+    ~OscReplay()
+    {
+        stop();
+    }
+
+    void stop()
+    {
+        stopThread(1000);
+    }
+
+    // only before start()
+    void setAdvance(AdvanceCallback advance)
+    {
+        advance_ = advance;
+    }
+
+    bool start(const File& file, double speed)
+    {
+        if (! file.loadFileAsData(data_) || data_.getSize() < sizeof(OSC_CAPTURE_MAGIC)
+            || memcmp(data_.getData(), OSC_CAPTURE_MAGIC, sizeof(OSC_CAPTURE_MAGIC)) != 0)
+            return false;
+
+        speed_ = jmax(0.0, speed);
+        startThread();
+        return true;
+    }
+
+private:
+    void run() override
+    {
+        const char* data = (const char*)data_.getData();
+        const int size = (int)data_.getSize();
+        int pos = (int)sizeof(OSC_CAPTURE_MAGIC);
+
+        Array<OscInput::Packet> batch;
+        int64 batchUs = 0;
+        int numPackets = 0;
+        double startMs = Time::getMillisecondCounterHiRes();
+
+        while (! threadShouldExit())
+        {
+            bool atEnd = size - pos < 12;
+            int64 us = 0;
+            int packetSize = 0;
+            if (! atEnd)
+            {
+                us = (int64)ByteOrder::littleEndianInt64(data + pos);
+                packetSize = (int)ByteOrder::littleEndianInt(data + pos + 8);
+                atEnd = packetSize < 0 || packetSize > size - pos - 12;
+            }
+
+            // a new timestamp ends the batch
+            if (! batch.isEmpty() && (atEnd || us != batchUs))
+            {
+                double now = Time::getMillisecondCounterHiRes();
+                for (auto& packet : batch)
+                    packet.receivedMs = now;
+                callback_(batch.begin(), batch.size());
+                numPackets += batch.size();
+                batch.clearQuick();
+            }
+
+            if (atEnd)
+                break;
+
+            if (batch.isEmpty())
+            {
+                batchUs = us;
+                if (advance_ != nullptr)
+                    advance_((double)us / 1000.0);
+                else if (speed_ > 0.0)
+                {
+                    double dueMs = startMs + (double)us / 1000.0 / speed_;
+                    double now = Time::getMillisecondCounterHiRes();
+                    // stop() wakes it
+                    if (dueMs > now)
+                        wait((int)(dueMs - now));
+                }
+            }
+
+            batch.add({ data + pos + 12, packetSize, 0.0 });
+            pos += 12 + packetSize;
+        }
+
+        finished_(numPackets, Time::getMillisecondCounterHiRes() - startMs);
+    }
+
+    Callback callback_;
+    FinishedCallback finished_;
+    AdvanceCallback advance_;
+    MemoryBlock data_;
+    double speed_ = 1.0;
+};
@@ -0,0 +1,580 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "ThreadTuning.h"
+#include "Probes.h"
+#include "TraceSpans.h"
+#include "UnixDatagram.h"
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+
+//==============================================================================
+// Receives OSC datagrams on its own thread and hands the raw bytes to the
+// listener, which decides how to decode them and on which thread. This takes
+// the place of OSCReceiver, which only ever gives us fully built OSCMessages.
+// With a batch size above 1 every wakeup drains up to that many queued
+// datagrams with one recvmmsg() and passes them on together. It can listen on
+// several ports, one per looper, from the same thread waiting on all of them
+// with one epoll set; each packet says which of them it came in on. A port
+// can be an AF_UNIX path instead.
+class OscInput : private Thread
+{
+public:
+    // the largest packet OSCReceiver accepts, which is what we take by
+    // default
+    static const int defaultPacketSize = 4098;
+
+    struct Packet
+    {
+        const char* data;
+        int size;
+        double receivedMs;
+        int source = 0;         // index of the port in connect(), after the first source
+        double socketMs = 0.0;  // queued in the socket before it was read, with kernel timestamps
+    };
+
+    struct Listener
+    {
+        virtual ~Listener() {}
+
+        // called on the receiver thread, the data is only valid during the call
+        virtual void oscPacketsReceived(const Packet* packets, int numPackets) = 0;
+    };
+
+    OscInput(Listener& listener)
+        : Thread("loop4r OSC in"),
+          listener_(listener)
+    {
+    }
+
+    ~OscInput()
+    {
+        disconnect();
+    }
+
+    // takes effect on the next connect()
+    void setThreadTuning(const ThreadTuning& tuning)
+    {
+        tuning_ = tuning;
+    }
+
+    // takes effect on the next connect()
+    void setBatchSize(int numPackets)
+    {
+        batchSize_ = jmax(1, numPackets);
+    }
+
+    // SO_RCVBUF for the sockets, so bursts from a looper on another host
+    // aren't dropped while we're busy; 0 leaves the system default. Takes
+    // effect on the next connect().
+    void setReceiveBufferSize(int bytes)
+    {
+        receiveBufferSize_ = jmax(0, bytes);
+    }
+
+    // SO_BUSY_POLL: spin on the device queue for up to this long before
+    // sleeping, trading CPU for wakeup latency. Raising it needs
+    // CAP_NET_ADMIN. Takes effect on the next connect().
+    void setBusyPollUs(int us)
+    {
+        busyPollUs_ = jmax(0, us);
+    }
+
+    // after a packet the receiver keeps polling without sleeping for this
+    // long before it blocks again, so a burst from the looper doesn't pay a
+    // scheduler wakeup per datagram. Unlike SO_BUSY_POLL it needs no
+    // privileges and works on loopback, at the cost of a core while it
+    // spins. Takes effect on the next connect().
+    void setSpinUs(int us)
+    {
+        spinUs_ = jlimit(0, 1000000, us);
+    }
+
+    int getSpinUs() const               { return spinUs_; }
+
+    // packets found while spinning, each one a wakeup saved
+    int64 getSpinHits() const           { return spinHits_.get(); }
+
+    // the largest datagram we take, anything longer is dropped and counted
+    // instead of being handed on cut short. Takes effect on the next
+    // connect().
+    void setMaxPacketSize(int bytes)
+    {
+        packetSize_ = jlimit(16, 65536, bytes);
+    }
+
+    int getMaxPacketSize() const        { return packetSize_; }
+
+    // SO_TIMESTAMPNS: the kernel stamps every datagram as it arrives, which
+    // tells how long it waited in the socket until we read it. Takes effect
+    // on the next connect().
+    void setKernelTimestamps(bool enabled)
+    {
+        kernelTimestamps_ = enabled;
+    }
+    int64 getTruncatedPackets() const   { return truncated_.get(); }
+
+    // the source the first port given to connect() comes in as, so several
+    // receivers can share the loopers out between them and still number
+    // their packets as one. Takes effect on the next connect().
+    void setFirstSource(int source)
+    {
+        firstSource_ = jmax(0, source);
+    }
+
+    // everything set above but the thread tuning and first source, for the
+    // other receivers of a group; only while both are disconnected
+    void copyOptionsFrom(const OscInput& other)
+    {
+        batchSize_ = other.batchSize_;
+        packetSize_ = other.packetSize_;
+        receiveBufferSize_ = other.receiveBufferSize_;
+        busyPollUs_ = other.busyPollUs_;
+        spinUs_ = other.spinUs_;
+        kernelTimestamps_ = other.kernelTimestamps_;
+        externalPolling_ = other.externalPolling_;
+    }
+
+    // with external polling connect() starts no thread, whoever waits on the
+    // socket handles calls readAvailable() when one of them is readable.
+    // Takes effect on the next connect().
+    void setExternalPolling(bool external)
+    {
+        externalPolling_ = external;
+    }
+
+    // sockets another process handed over, bound already: connect() takes
+    // those bound to its ports out of the pool rather than binding anew.
+    // Only before connect(), the pool has to outlive it.
+    void setAdoptable(Array<int>* pool)
+    {
+        adoptable_ = pool;
+    }
+
+    // stops reading for a while, leaving the sockets open so what arrives
+    // waits in them; resume() reads again. Nothing to do with external
+    // polling, whoever polls stops watching the handles instead.
+    void pause()
+    {
+        if (! isThreadRunning())
+            return;
+
+        signalThreadShouldExit();
+        if (wakeFd_ >= 0)
+            eventfd_write(wakeFd_, 1);
+        stopThread(10000);
+        paused_ = true;
+    }
+
+    void resume()
+    {
+        if (! paused_)
+            return;
+
+        eventfd_t count;
+        if (wakeFd_ >= 0)
+            eventfd_read(wakeFd_, &count);
+        paused_ = false;
+        startThread();
+    }
+
+    // lets go of the sockets for another process that took them over: stops
+    // reading without shutting them down, which would end them for it too
+    void release()
+    {
+        if (handles_.isEmpty())
+            return;
+
+        for (auto handle : handles_)
+            if (epollFd_ >= 0)
+                epoll_ctl(epollFd_, EPOLL_CTL_DEL, handle, nullptr);
+        signalThreadShouldExit();
+        if (wakeFd_ >= 0)
+            eventfd_write(wakeFd_, 1);
+        stopThread(10000);
+
+        // the handles stay valid for the sockets' owners to close, on
+        // /dev/null; the paths are the other process's now
+        int null = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        for (auto handle : handles_)
+            if (null >= 0)
+                dup2(null, handle);
+        if (null >= 0)
+            ::close(null);
+        boundPaths_.clear();
+        closeSockets();
+    }
+
+    // in the order of the ports given to connect()
+    Array<int> getSocketHandles() const
+    {
+        return handles_;
+    }
+
+    // reads what the source's socket has queued, up to the batch size, and
+    // hands it to the listener on the calling thread
+    void readAvailable(int source)
+    {
+        if (! isPositiveAndBelow(source, handles_.size()))
+            return;
+
+        const double readMs = TraceSpans::isEnabled() ? Time::getMillisecondCounterHiRes() : 0.0;
+        int numPackets = batchSize_ > 1 ? readBatch(source) : readOne(source);
+        if (numPackets > 0)
+        {
+            double now = Time::getMillisecondCounterHiRes();
+            if (readMs > 0.0)
+                TraceSpans::record("receive", readMs, now);
+            for (int i = 0; i < numPackets; ++i)
+            {
+                packets_[i].receivedMs = now;
+                LOOP4R_PROBE2(osc_packet, source, packets_[i].size);
+            }
+            LOOP4R_PROBE2(osc_batch, source, numPackets);
+            listener_.oscPacketsReceived(packets_, numPackets);
+        }
+    }
+
+    // what the kernel granted on the last connect(), which for SO_RCVBUF is
+    // twice what was asked for, capped by net.core.rmem_max without
+    // CAP_NET_ADMIN
+    int getReceiveBufferSize() const    { return grantedBufferSize_; }
+    bool wasBusyPollRefused() const     { return busyPollUs_ > 0 && ! busyPolling_; }
+
+    // a non-empty path in unixPaths takes the place of the port at the same
+    // index
+    bool connect(const Array<int>& ports, const StringArray& unixPaths = {})
+    {
+        disconnect();
+
+        buffer_.malloc((size_t)(batchSize_ * packetSize_));
+        packets_.malloc((size_t)batchSize_);
+        messages_.calloc((size_t)batchSize_);
+        iovecs_.malloc((size_t)batchSize_);
+        control_.calloc((size_t)batchSize_ * controlSize);
+        for (int i = 0; i < batchSize_; ++i)
+        {
+            iovecs_[i].iov_base = buffer_ + i * packetSize_;
+            iovecs_[i].iov_len = (size_t)packetSize_;
+            messages_[i].msg_hdr.msg_iov = iovecs_ + i;
+            messages_[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        events_.calloc((size_t)ports.size() + 1);
+        if (! externalPolling_)
+        {
+            // the wake only for release(), which can't shut the sockets down
+            epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+            wakeFd_ = epollFd_ >= 0 ? eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK) : -1;
+            epoll_event wake = {};
+            wake.events = EPOLLIN;
+            wake.data.u32 = wakeSource;
+            if (wakeFd_ < 0 || epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &wake) != 0)
+            {
+                closeSockets();
+                return false;
+            }
+        }
+
+        for (int i = 0; i < ports.size(); ++i)
+        {
+            int handle = takeAdopted(ports[i], unixPaths[i]);
+            if (handle >= 0)
+                unixHandles_.add(handle);
+            else if (unixPaths[i].isNotEmpty())
+            {
+                handle = UnixDatagram::bind(unixPaths[i]);
+                if (handle >= 0)
+                {
+                    unixHandles_.add(handle);
+                    boundPaths_.add(unixPaths[i]);
+                }
+            }
+            else
+            {
+                auto* socket = sockets_.add(new DatagramSocket(false));
+                if (socket->bindToPort(ports[i]))
+                    handle = socket->getRawSocketHandle();
+            }
+
+            if (handle < 0)
+            {
+                closeSockets();
+                return false;
+            }
+
+            tune(handle);
+            if (epollFd_ >= 0)
+            {
+                // which socket it is comes back with the event
+                epoll_event event = {};
+                event.events = EPOLLIN;
+                event.data.u32 = (uint32)handles_.size();
+                if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, handle, &event) != 0)
+                {
+                    closeSockets();
+                    return false;
+                }
+            }
+            handles_.add(handle);
+        }
+
+        if (handles_.isEmpty())
+        {
+            closeSockets();
+            return false;
+        }
+
+        if (! externalPolling_)
+            startThread();
+        return true;
+    }
+
+    bool disconnect()
+    {
+        if (! handles_.isEmpty())
+        {
+            signalThreadShouldExit();
+            for (auto handle : handles_)
+                ::shutdown(handle, SHUT_RDWR);
+            stopThread(10000);
+            closeSockets();
+        }
+        return true;
+    }
+
+private:
+    // the UDP handles go with their DatagramSocket, the AF_UNIX and adopted
+    // ones are closed here and the paths we bound removed
+    void closeSockets()
+    {
+        sockets_.clear();
+        for (auto handle : unixHandles_)
+            ::close(handle);
+        for (auto& path : boundPaths_)
+            ::unlink(path.toRawUTF8());
+        unixHandles_.clearQuick();
+        boundPaths_.clear();
+        handles_.clearQuick();
+        if (epollFd_ >= 0)
+            ::close(epollFd_);
+        epollFd_ = -1;
+        if (wakeFd_ >= 0)
+            ::close(wakeFd_);
+        wakeFd_ = -1;
+    }
+
+    // an adopted socket bound to the port, or the path if there is one
+    int takeAdopted(int port, const String& path)
+    {
+        if (adoptable_ == nullptr)
+            return -1;
+
+        for (int i = 0; i < adoptable_->size(); ++i)
+        {
+            sockaddr_storage address;
+            socklen_t length = sizeof(address);
+            const int handle = adoptable_->getUnchecked(i);
+            if (getsockname(handle, (sockaddr*)&address, &length) != 0)
+                continue;
+
+            bool matches = false;
+            if (address.ss_family == AF_UNIX)
+                matches = path.isNotEmpty() && path == String(((sockaddr_un*)&address)->sun_path);
+            else if (address.ss_family == AF_INET)
+                matches = path.isEmpty() && ntohs(((sockaddr_in*)&address)->sin_port) == port;
+            else if (address.ss_family == AF_INET6)
+                matches = path.isEmpty() && ntohs(((sockaddr_in6*)&address)->sin6_port) == port;
+            if (matches)
+            {
+                adoptable_->remove(i);
+                return handle;
+            }
+        }
+        return -1;
+    }
+
+    void tune(int handle)
+    {
+        if (receiveBufferSize_ > 0)
+        {
+            // the forced variant gets past rmem_max where we're allowed to
+            int size = receiveBufferSize_;
+            if (setsockopt(handle, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) != 0)
+                setsockopt(handle, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        }
+
+        int granted = 0;
+        socklen_t length = sizeof(granted);
+        getsockopt(handle, SOL_SOCKET, SO_RCVBUF, &granted, &length);
+        grantedBufferSize_ = granted;
+
+        busyPolling_ = false;
+        if (busyPollUs_ > 0)
+        {
+            int us = busyPollUs_;
+            busyPolling_ = setsockopt(handle, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us)) == 0;
+        }
+
+        int timestamps = kernelTimestamps_ ? 1 : 0;
+        setsockopt(handle, SOL_SOCKET, SO_TIMESTAMPNS, &timestamps, sizeof(timestamps));
+    }
+
+    void run() override
+    {
+        if (! tuning_.applyToCurrentThread())
+            std::cerr << "Could not set SCHED_FIFO priority " << tuning_.realtimePriority << " for the OSC receiver" << std::endl;
+
+        const int numSockets = handles_.size();
+        const double spinMs = spinUs_ / 1000.0;
+        double lastPacketMs = 0.0;
+        while (! threadShouldExit())
+        {
+            // disconnect() shutting the sockets down or release() waking
+            // it up ends the wait, while spinning the exit check above does
+            bool spinning = spinMs > 0.0 && Time::getMillisecondCounterHiRes() - lastPacketMs < spinMs;
+            int ready = epoll_wait(epollFd_, events_, numSockets + 1, spinning ? 0 : -1);
+            if (threadShouldExit())
+                return;
+            if (ready <= 0)
+                continue;
+
+            if (spinMs > 0.0)
+            {
+                if (spinning)
+                    ++spinHits_;
+                lastPacketMs = Time::getMillisecondCounterHiRes();
+            }
+
+            // only the sockets with something to read come back
+            for (int i = 0; i < ready; ++i)
+                if ((events_[i].events & EPOLLIN) != 0)
+                    readAvailable((int)events_[i].data.u32);
+        }
+    }
+
+    int readOne(int source)
+    {
+        prepareControl(1);
+        ssize_t size = recvmsg(handles_.getUnchecked(source), &messages_[0].msg_hdr, MSG_DONTWAIT);
+        if (size < 0)
+            return 0;
+
+        messages_[0].msg_len = (unsigned int)size;
+        return collect(source, 1);
+    }
+
+    int readBatch(int source)
+    {
+        prepareControl(batchSize_);
+        int received = recvmmsg(handles_.getUnchecked(source), messages_, (unsigned int)batchSize_, MSG_DONTWAIT, nullptr);
+        return collect(source, received);
+    }
+
+    // the kernel overwrites the control lengths, so they are set again
+    // before every read
+    void prepareControl(int numMessages)
+    {
+        for (int i = 0; i < numMessages; ++i)
+        {
+            messages_[i].msg_hdr.msg_control = kernelTimestamps_ ? control_ + i * controlSize : nullptr;
+            messages_[i].msg_hdr.msg_controllen = kernelTimestamps_ ? controlSize : 0;
+        }
+    }
+
+    // drops runts and datagrams longer than the buffer, which the kernel
+    // cut short and flagged
+    int collect(int source, int received)
+    {
+        timespec now;
+        if (kernelTimestamps_)
+            clock_gettime(CLOCK_REALTIME, &now);
+
+        int numPackets = 0;
+        for (int i = 0; i < received; ++i)
+        {
+            msghdr& header = messages_[i].msg_hdr;
+            int size = (int)messages_[i].msg_len;
+            if ((header.msg_flags & MSG_TRUNC) != 0)
+            {
+                ++truncated_;
+                continue;
+            }
+            if (size < 4)
+                continue;
+
+            Packet& packet = packets_[numPackets++];
+            packet = { buffer_ + i * packetSize_, size, 0.0, firstSource_ + source };
+            if (kernelTimestamps_)
+                packet.socketMs = getSocketMs(header, now);
+        }
+        return numPackets;
+    }
+
+    static double getSocketMs(msghdr& header, const timespec& now)
+    {
+        for (cmsghdr* control = CMSG_FIRSTHDR(&header); control != nullptr; control = CMSG_NXTHDR(&header, control))
+        {
+            if (control->cmsg_level == SOL_SOCKET && control->cmsg_type == SCM_TIMESTAMPNS)
+            {
+                timespec stamp;
+                memcpy(&stamp, CMSG_DATA(control), sizeof(stamp));
+                return jmax(0.0, (double)(now.tv_sec - stamp.tv_sec) * 1000.0 + (double)(now.tv_nsec - stamp.tv_nsec) / 1000000.0);
+            }
+        }
+        return 0.0;
+    }
+
+    Listener& listener_;
+    OwnedArray<DatagramSocket> sockets_;
+    Array<int> unixHandles_;
+    StringArray boundPaths_;
+    Array<int> handles_;        // every socket's, by source
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+    bool paused_ = false;
+    static const uint32 wakeSource = 0xffffffff;
+    Array<int>* adoptable_ = nullptr;
+    HeapBlock<epoll_event> events_;
+    int batchSize_ = 1;
+    int packetSize_ = defaultPacketSize;
+    Atomic<int64> truncated_ { 0 };
+    int receiveBufferSize_ = 0;
+    int busyPollUs_ = 0;
+    int spinUs_ = 0;
+    int firstSource_ = 0;
+    Atomic<int64> spinHits_ { 0 };
+    int grantedBufferSize_ = 0;
+    bool busyPolling_ = false;
+    bool externalPolling_ = false;
+    ThreadTuning tuning_;
+    HeapBlock<char> buffer_;
+    HeapBlock<Packet> packets_;
+    HeapBlock<mmsghdr> messages_;
+    HeapBlock<iovec> iovecs_;
+    HeapBlock<char> control_;
+    bool kernelTimestamps_ = false;
+
+    static const int controlSize = CMSG_SPACE(sizeof(timespec));
+};
@@ -0,0 +1,221 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "DecodeArena.h"
+
+//==============================================================================
+// An OSC argument as a tagged union: int32, float32 and time tag values are
+// held directly, strings and blobs point at bytes owned by someone else,
+// usually the received packet. Strings are null terminated where they point.
+class OscValue
+{
+public:
+    OscValue() {}
+
+    static OscValue int32Value(int32 value)
+    {
+        OscValue result(OSCTypes::int32);
+        result.int32_ = value;
+        return result;
+    }
+
+    static OscValue float32Value(float value)
+    {
+        OscValue result(OSCTypes::float32);
+        result.float32_ = value;
+        return result;
+    }
+
+    static OscValue stringValue(const char* text, int length)
+    {
+        OscValue result(OSCTypes::string);
+        result.data_ = text;
+        result.size_ = length;
+        return result;
+    }
+
+    static OscValue timeTagValue(uint64 rawTimeTag)
+    {
+        OscValue result(timeTagType);
+        result.timeTag_ = rawTimeTag;
+        return result;
+    }
+
+    static OscValue blobValue(const void* data, int size)
+    {
+        OscValue result(OSCTypes::blob);
+        result.data_ = (const char*)data;
+        result.size_ = size;
+        return result;
+    }
+
+    OSCType getType() const         { return type_; }
+    bool isInt32() const            { return type_ == OSCTypes::int32; }
+    bool isFloat32() const          { return type_ == OSCTypes::float32; }
+    bool isString() const           { return type_ == OSCTypes::string; }
+    bool isBlob() const             { return type_ == OSCTypes::blob; }
+    bool isTimeTag() const          { return type_ == timeTagType; }
+
+    int32 getInt32() const          { jassert(isInt32()); return int32_; }
+    float getFloat32() const        { jassert(isFloat32()); return float32_; }
+    OSCTimeTag getTimeTag() const   { jassert(isTimeTag()); return OSCTimeTag(timeTag_); }
+
+    // compares and converts without copying, getString() makes a String
+    StringRef getStringRef() const  { jassert(isString()); return StringRef(data_); }
+    String getString() const        { jassert(isString()); return String::fromUTF8(data_, size_); }
+    int getStringLength() const     { jassert(isString()); return size_; }   // in bytes, known from parsing
+
+    const char* getBlobData() const { jassert(isBlob()); return data_; }
+    int getBlobSize() const         { jassert(isBlob()); return size_; }
+
+private:
+    // juce's OSC doesn't know time tag arguments, a looper may send them
+    static const OSCType timeTagType = 't';
+
+    explicit OscValue(OSCType type)
+        : type_(type)
+    {
+    }
+
+    OSCType type_ = 0;
+    union
+    {
+        int32 int32_ = 0;
+        float float32_;
+        uint64 timeTag_;
+    };
+    const char* data_ = nullptr;
+    int size_ = 0;
+};
+
+//==============================================================================
+// What the message handlers get instead of an OSCMessage: the address and up
+// to inlineCapacity arguments stored in the object itself, so a /led or a
+// /heartbeat is decoded without touching the heap. Only longer messages such
+// as a snapshot in int32s spill over, into the decode arena if there is one
+// with room left, or else an allocated block. A view is only valid for as
+// long as the bytes it points at, and the arena's scope it was decoded in.
+class OscMessageView
+{
+public:
+    static const int inlineCapacity = 8;
+
+    OscMessageView(DecodeArena* arena = nullptr)
+        : arena_(arena)
+    {
+    }
+
+    // starts over with an address and type tags (without the leading
+    // comma) pointing into a packet
+    void reset(const char* address, const char* typeTags)
+    {
+        address_ = StringRef(address);
+        typeTags_ = StringRef(typeTags);
+        size_ = 0;
+
+        // the arena's room may be gone by the next message
+        if (overflow_ != heapOverflow_.getData())
+        {
+            overflow_ = nullptr;
+            overflowCapacity_ = 0;
+        }
+    }
+
+    void add(const OscValue& value)
+    {
+        if (size_ >= inlineCapacity && size_ - inlineCapacity >= overflowCapacity_)
+            grow();
+
+        getSlot(size_++) = value;
+    }
+
+    StringRef getAddress() const    { return address_; }
+    bool hasAddress(const char* address) const  { return strcmp(address_, address) == 0; }
+
+    // one character per argument, as in the packet
+    StringRef getTypeTags() const   { return typeTags_; }
+
+    int size() const                { return size_; }
+    bool isEmpty() const            { return size_ == 0; }
+
+    const OscValue& operator[](int index) const
+    {
+        jassert(isPositiveAndBelow(index, size_));
+        return const_cast<OscMessageView*>(this)->getSlot(index);
+    }
+
+private:
+    OscValue& getSlot(int index)
+    {
+        return index < inlineCapacity ? inline_[index] : overflow_[index - inlineCapacity];
+    }
+
+    // twice the room, in place if it is the arena's last block, otherwise
+    // what was in the arena stays there until its scope ends
+    void grow()
+    {
+        const int capacity = jmax(16, overflowCapacity_ * 2);
+        const int used = size_ - inlineCapacity;
+        if (arena_ != nullptr && overflow_ != nullptr && overflow_ != heapOverflow_.getData()
+            && arena_->extend(overflow_, sizeof(OscValue) * (size_t)overflowCapacity_, sizeof(OscValue) * (size_t)capacity))
+        {
+            overflowCapacity_ = capacity;
+            return;
+        }
+
+        auto* block = arena_ != nullptr ? static_cast<OscValue*>(arena_->allocate(sizeof(OscValue) * (size_t)capacity)) : nullptr;
+        if (block != nullptr)
+        {
+            for (int i = 0; i < used; ++i)
+                block[i] = overflow_[i];
+            heapOverflow_.free();
+        }
+        else
+        {
+            if (heapOverflow_ == nullptr)
+            {
+                heapOverflow_.malloc((size_t)capacity);
+                for (int i = 0; i < used; ++i)
+                    heapOverflow_[i] = overflow_[i];
+            }
+            else
+            {
+                heapOverflow_.realloc((size_t)capacity);
+            }
+            block = heapOverflow_;
+        }
+
+        overflow_ = block;
+        overflowCapacity_ = capacity;
+    }
+
+    StringRef address_ { "" };
+    StringRef typeTags_ { "" };
+    OscValue inline_[inlineCapacity];
+    DecodeArena* arena_;
+    OscValue* overflow_ = nullptr;      // in the arena or heapOverflow_
+    HeapBlock<OscValue> heapOverflow_;
+    int overflowCapacity_ = 0;
+    int size_ = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(OscMessageView)
+};
@@ -0,0 +1,434 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "OscPacket.h"
+#include "UnixDatagram.h"
+#include "HostResolver.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netdb.h>
+#include <unistd.h>
+
+//==============================================================================
+// Sends OSC to the looper. Works like OSCSender, and additionally sends
+// packets that were encoded once with OscPacket::encode(), which is what the
+// requests we repeat all the time (pings, auto update registration) use.
+// The destination is resolved once in connect() and the socket connected to
+// it, so a send is a single send() with no address lookup or comparison,
+// and a batch of queued packets a single sendmmsg(). connectUnix() sends
+// to an AF_UNIX path on the same host instead. With a resolver the name is
+// looked up on its thread instead, connect() failing until it is known.
+//
+// Non-blocking, a send that finds the socket buffer full doesn't wait for
+// room: the packet is copied into a small backlog that goes out ahead of
+// anything sent later, from the next send on. Pre-encoded packets are the
+// requests we repeat anyway, so a newer copy replaces one still waiting and
+// a full backlog drops the oldest of them; a full backlog of nothing else
+// drops the new packet. Either way it is counted. The backlog has a lock of
+// its own, so a disconnect or a send from another thread than the usual one
+// can't leave it half changed.
+class OscOutput
+{
+public:
+    ~OscOutput()
+    {
+        disconnect();
+    }
+
+    // the resolver has to outlive the output
+    void setResolver(HostResolver* resolver)
+    {
+        resolver_ = resolver;
+    }
+
+    bool connect(const String& host, int port)
+    {
+        disconnect();
+
+        Array<HostResolver::Address> addresses;
+        if (resolver_ != nullptr)
+        {
+            if (! resolver_->lookup(host, port, addresses))
+                return false;
+
+            for (int i = 0; i < addresses.size() && handle_ < 0; ++i)
+                connectTo(addresses.getReference(i).family, (const sockaddr*)&addresses.getReference(i).address,
+                          addresses.getReference(i).length);
+        }
+        else
+        {
+            addrinfo hints;
+            zerostruct(hints);
+            hints.ai_family = AF_UNSPEC;
+            hints.ai_socktype = SOCK_DGRAM;
+
+            addrinfo* info = nullptr;
+            if (getaddrinfo(host.toRawUTF8(), String(port).toRawUTF8(), &hints, &info) != 0)
+                return false;
+
+            for (addrinfo* i = info; i != nullptr && handle_ < 0; i = i->ai_next)
+                connectTo(i->ai_family, i->ai_addr, i->ai_addrlen);
+            freeaddrinfo(info);
+        }
+
+        if (handle_ >= 0 && tos_ >= 0)
+            applyTrafficClass();
+        return handle_ >= 0;
+    }
+
+    bool connectUnix(const String& path)
+    {
+        disconnect();
+        handle_ = UnixDatagram::connect(path);
+        family_ = AF_UNIX;
+        return handle_ >= 0;
+    }
+
+    // marks what we send with this TOS byte (the DSCP shifted up by 2), now
+    // and after reconnecting. Returns false if the socket refused it.
+    bool setTrafficClass(int tos)
+    {
+        tos_ = tos;
+        return handle_ < 0 || applyTrafficClass();
+    }
+
+    // hops a multicast packet may take, 1 to stay on the local network
+    bool setMulticastTtl(int ttl)
+    {
+        if (family_ == AF_INET6)
+            return setsockopt(handle_, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof(ttl)) == 0;
+        return setsockopt(handle_, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) == 0;
+    }
+
+    // needed to send to a broadcast address, from the next connect() on
+    void setBroadcast(bool broadcast)
+    {
+        broadcast_ = broadcast;
+    }
+
+    // the address our packets leave from on the way to the destination,
+    // which is the one to give the looper to answer to
+    String getLocalAddress() const
+    {
+        sockaddr_storage address;
+        socklen_t length = sizeof(address);
+        char text[INET6_ADDRSTRLEN] = { 0 };
+        if (handle_ < 0 || family_ == AF_UNIX || getsockname(handle_, (sockaddr*)&address, &length) != 0)
+            return {};
+
+        if (address.ss_family == AF_INET6)
+            inet_ntop(AF_INET6, &((sockaddr_in6*)&address)->sin6_addr, text, sizeof(text));
+        else
+            inet_ntop(AF_INET, &((sockaddr_in*)&address)->sin_addr, text, sizeof(text));
+        return String(text);
+    }
+
+    void disconnect()
+    {
+        const ScopedLock sl(backlogLock_);
+        if (handle_ >= 0)
+            ::close(handle_);
+        handle_ = -1;
+        numBacklogged_ = 0;
+    }
+
+    void setNonBlocking(bool nonBlocking)
+    {
+        nonBlocking_ = nonBlocking;
+    }
+
+    // sends what waits in the backlog, true once nothing is left
+    bool flushBacklog()
+    {
+        const ScopedLock sl(backlogLock_);
+        while (numBacklogged_ > 0)
+        {
+            auto& packet = backlog_[firstBacklogged_];
+            if (handle_ < 0 || ::send(handle_, packet.data.getData(), packet.data.getSize(), MSG_DONTWAIT) < 0)
+            {
+                if (handle_ >= 0 && isFull())
+                    return false;
+                ++dropped_;
+            }
+
+            firstBacklogged_ = (firstBacklogged_ + 1) % maxBacklogged;
+            --numBacklogged_;
+        }
+        return true;
+    }
+
+    int getNumBacklogged() const    { return numBacklogged_; }
+    int64 getNumDeferred() const    { return deferred_; }
+    int64 getNumDropped() const     { return dropped_; }
+
+    bool isConnected() const
+    {
+        return handle_ >= 0;
+    }
+
+    bool send(const void* data, size_t size)
+    {
+        return send(data, size, nullptr);
+    }
+
+    // a pre-encoded packet, which the backlog may replace or drop
+    bool send(const MemoryBlock& packet)
+    {
+        return send(packet.getData(), packet.getSize(), &packet);
+    }
+
+    // queued packets go out together with one sendmmsg() and have to stay
+    // valid until sendQueued(); a full queue sends what it holds first
+    void queue(const MemoryBlock& packet)
+    {
+        if (numQueued_ == maxQueued)
+            sendQueued();
+        queued_[numQueued_++] = &packet;
+    }
+
+    // queued packets go out packed into bundles rather than one datagram
+    // each, as many to a bundle as fit maxBundleSize
+    void setBundling(bool bundling)
+    {
+        bundling_ = bundling;
+    }
+
+    int64 getNumBundles() const     { return bundles_; }
+
+    // returns false if any of the queued packets weren't sent
+    bool sendQueued()
+    {
+        const int numPackets = numQueued_;
+        numQueued_ = 0;
+        if (numPackets == 0)
+            return true;
+        if (handle_ < 0)
+            return false;
+        if (bundling_ && numPackets > 1)
+            return sendBundled(numPackets);
+
+        const ScopedLock sl(backlogLock_);
+        if (nonBlocking_ && ! flushBacklog())
+        {
+            for (int i = 0; i < numPackets; ++i)
+                defer(queued_[i]->getData(), queued_[i]->getSize(), queued_[i]);
+            return true;
+        }
+
+        mmsghdr messages[maxQueued];
+        iovec iovecs[maxQueued];
+        zeromem(messages, sizeof(messages));
+        for (int i = 0; i < numPackets; ++i)
+        {
+            iovecs[i].iov_base = const_cast<void*>(queued_[i]->getData());
+            iovecs[i].iov_len = queued_[i]->getSize();
+            messages[i].msg_hdr.msg_iov = iovecs + i;
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        for (int sent = 0; sent < numPackets;)
+        {
+            int count = sendmmsg(handle_, messages + sent, (unsigned int)(numPackets - sent), nonBlocking_ ? MSG_DONTWAIT : 0);
+            if (count <= 0 && nonBlocking_ && isFull())
+            {
+                for (; sent < numPackets; ++sent)
+                    defer(queued_[sent]->getData(), queued_[sent]->getSize(), queued_[sent]);
+                return true;
+            }
+            if (count <= 0)
+                return false;
+            sent += count;
+        }
+        return true;
+    }
+
+    // encoded into a buffer kept from one send to the next, so once it has
+    // grown to the largest message nothing is allocated
+    bool send(const OSCMessage& message)
+    {
+        buffer_.reset();
+        return OscPacket::encode(message, buffer_) && send(buffer_.getData(), buffer_.getDataSize());
+    }
+
+    // the same without an OSCMessage or its address pattern
+    template <typename... Args>
+    bool send(OscLiteral address, const Args&... args)
+    {
+        buffer_.reset();
+        return OscPacket::encode(buffer_, address, args...) && send(buffer_.getData(), buffer_.getDataSize());
+    }
+
+private:
+    // one address of those a name resolved to
+    void connectTo(int family, const sockaddr* address, socklen_t length)
+    {
+        handle_ = socket(family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        int broadcast = 1;
+        if (handle_ >= 0 && broadcast_)
+            setsockopt(handle_, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+        if (handle_ >= 0 && ::connect(handle_, address, length) != 0)
+            disconnect();
+        else
+            family_ = family;
+    }
+
+    // dated immediately; a packet too large to share one goes in a bundle
+    // of its own
+    bool sendBundled(int numPackets)
+    {
+        bool sent = true;
+        for (int i = 0; i < numPackets;)
+        {
+            bundle_.reset();
+            bundle_.write("#bundle", 8);
+            bundle_.writeInt64BigEndian(1);
+            for (int inBundle = 0; i < numPackets; ++i, ++inBundle)
+            {
+                const size_t size = queued_[i]->getSize();
+                if (inBundle > 0 && bundle_.getDataSize() + 4 + size > (size_t)maxBundleSize)
+                    break;
+                bundle_.writeIntBigEndian((int)size);
+                bundle_.write(queued_[i]->getData(), size);
+            }
+            ++bundles_;
+            sent = send(bundle_.getData(), bundle_.getDataSize()) && sent;
+        }
+        return sent;
+    }
+
+    // source is the pre-encoded packet the bytes are, or nullptr
+    bool send(const void* data, size_t size, const MemoryBlock* source)
+    {
+        if (handle_ < 0)
+            return false;
+
+        // fails with ECONNREFUSED after the looper went away, until it's back
+        if (! nonBlocking_)
+            return ::send(handle_, data, size, 0) == (ssize_t)size;
+
+        // behind what is already waiting
+        const ScopedLock sl(backlogLock_);
+        if (! flushBacklog())
+        {
+            defer(data, size, source);
+            return true;
+        }
+
+        if (::send(handle_, data, size, MSG_DONTWAIT) == (ssize_t)size)
+            return true;
+        if (! isFull())
+            return false;
+
+        defer(data, size, source);
+        return true;
+    }
+
+    static bool isFull()
+    {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS;
+    }
+
+    void defer(const void* data, size_t size, const MemoryBlock* source)
+    {
+        ++deferred_;
+        int slot = -1;
+        for (int i = 0; i < numBacklogged_ && slot < 0 && source != nullptr; ++i)
+            if (backlog_[(firstBacklogged_ + i) % maxBacklogged].source == source)
+                slot = (firstBacklogged_ + i) % maxBacklogged;
+
+        if (slot >= 0)
+        {
+            // the older copy of the same request is worth nothing now
+            ++dropped_;
+        }
+        else if (numBacklogged_ == maxBacklogged && ! dropOldestRepeated())
+        {
+            ++dropped_;
+            return;
+        }
+        else
+        {
+            slot = (firstBacklogged_ + numBacklogged_++) % maxBacklogged;
+        }
+
+        backlog_[slot].data.replaceWith(data, size);
+        backlog_[slot].source = source;
+    }
+
+    // makes room by dropping the oldest pre-encoded packet; false if there
+    // is none
+    bool dropOldestRepeated()
+    {
+        for (int i = 0; i < numBacklogged_; ++i)
+        {
+            if (backlog_[(firstBacklogged_ + i) % maxBacklogged].source == nullptr)
+                continue;
+
+            // the ones after it move up
+            for (int j = i; j < numBacklogged_ - 1; ++j)
+                std::swap(backlog_[(firstBacklogged_ + j) % maxBacklogged], backlog_[(firstBacklogged_ + j + 1) % maxBacklogged]);
+            --numBacklogged_;
+            ++dropped_;
+            return true;
+        }
+        return false;
+    }
+
+    bool applyTrafficClass()
+    {
+        int tos = tos_;
+        if (family_ == AF_UNIX)
+            return true;
+        if (family_ == AF_INET6)
+            return setsockopt(handle_, IPPROTO_IPV6, IPV6_TCLASS, &tos, sizeof(tos)) == 0;
+        return setsockopt(handle_, IPPROTO_IP, IP_TOS, &tos, sizeof(tos)) == 0;
+    }
+
+    static const int maxQueued = 16;
+    static const int maxBacklogged = 32;
+
+    struct Backlogged
+    {
+        MemoryBlock data;
+        const MemoryBlock* source = nullptr;
+    };
+
+    MemoryOutputStream buffer_;
+    const MemoryBlock* queued_[maxQueued];
+    int numQueued_ = 0;
+    int handle_ = -1;
+    int family_ = AF_INET;
+    HostResolver* resolver_ = nullptr;
+    bool bundling_ = false;
+    bool broadcast_ = false;
+    MemoryOutputStream bundle_;
+    int64 bundles_ = 0;
+    static const int maxBundleSize = 4096;     // what OSCReceiver takes
+    int tos_ = -1;
+    bool nonBlocking_ = false;
+    CriticalSection backlogLock_;
+    Backlogged backlog_[maxBacklogged];
+    int firstBacklogged_ = 0;
+    int numBacklogged_ = 0;
+    int64 deferred_ = 0;
+    int64 dropped_ = 0;
+};
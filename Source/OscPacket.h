@@ -0,0 +1,576 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "OscMessageView.h"
+#include <memory>
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+ #include <arm_neon.h>
+ #define LOOP4R_NEON 1
+#elif defined (__SSSE3__)
+ #include <tmmintrin.h>
+#elif defined (__SSE2__)
+ #include <emmintrin.h>
+#endif
+
+//==============================================================================
+// One of the two messages that make up nearly all of the looper's traffic,
+// "/led ,iiii" (index, on, timer, state) and "/display ,i" (loop)
+struct LedEvent
+{
+    enum Type
+    {
+        Led,
+        SequencedLed,       // with a sequence number after the state
+        Display
+    };
+
+    int type;
+    int32 args[5];
+};
+
+//==============================================================================
+// "/heartbeat ,ssii" (host url, version, LED count, engine id), optionally
+// with a digest of the looper's LED states after them. The strings point
+// into the packet.
+struct HeartbeatEvent
+{
+    StringRef hostUrl;
+    StringRef version;
+    int32 ledCount;
+    int32 engineId;
+    bool hasDigest;
+    int32 digest;
+    bool hasTimeTag;        // when the looper sent it, by its clock
+    OSCTimeTag timeTag;
+};
+
+//==============================================================================
+// An address to send to that is a literal in the source, taken as it is:
+// nothing is tokenised or checked, neither here nor when it's sent, so it
+// has to be a valid OSC address without wildcards, those are for the
+// receiving end. Only its length is taken from the array.
+class OscLiteral
+{
+public:
+    template <size_t size>
+    constexpr OscLiteral(const char (&text)[size])
+        : text_(text),
+          length_((int)size - 1)
+    {
+    }
+
+    constexpr const char* getText() const   { return text_; }
+    constexpr int getLength() const         { return length_; }
+
+private:
+    const char* text_;
+    int length_;
+};
+
+//==============================================================================
+// Decodes and encodes OSC datagrams. decodeLedEvent() and decodeHeartbeat()
+// read the common messages straight from the buffer without allocating, parse() is the
+// generic fallback for everything else, handing over messages as views into
+// the packet and bundles as they are in it, nothing is copied. encode()
+// serialises a message once so it can be sent many times.
+class OscPacket
+{
+public:
+    struct Handler
+    {
+        virtual ~Handler() {}
+        virtual void oscMessageReceived(const OscMessageView& message) = 0;
+        // a bundle parse() has checked, as it is in the packet; its elements
+        // are only valid during the call and handed out by forEachElement()
+        virtual void oscBundleReceived(const char* bundle, int size) = 0;
+    };
+
+    static bool decodeLedEvent(const char* data, int size, LedEvent& event)
+    {
+        // address and type tags, each null padded to a multiple of 4
+        static const char led[] = "/led\0\0\0\0,iiii\0\0\0";
+        static const char sequencedLed[] = "/led\0\0\0\0,iiiii\0\0";
+        static const char display[] = "/display\0\0\0\0,i\0\0";
+        const int headerSize = 16;
+
+        if (size == headerSize + 16 && memcmp(data, led, headerSize) == 0)
+        {
+            event.type = LedEvent::Led;
+            for (int i = 0; i < 4; ++i)
+                event.args[i] = readInt32(data + headerSize + 4 * i);
+            return true;
+        }
+
+        if (size == headerSize + 20 && memcmp(data, sequencedLed, headerSize) == 0)
+        {
+            event.type = LedEvent::SequencedLed;
+            for (int i = 0; i < 5; ++i)
+                event.args[i] = readInt32(data + headerSize + 4 * i);
+            return true;
+        }
+
+        if (size == headerSize + 4 && memcmp(data, display, headerSize) == 0)
+        {
+            event.type = LedEvent::Display;
+            event.args[0] = readInt32(data + headerSize);
+            return true;
+        }
+
+        return false;
+    }
+
+    // a heartbeat with exactly the arguments the looper sends, with or
+    // without a digest and a time tag, anything else is left to parse()
+    static bool decodeHeartbeat(const char* data, int size, HeartbeatEvent& event)
+    {
+        static const char* const headers[] = { "/heartbeat\0\0,ssii\0\0\0", "/heartbeat\0\0,ssiii\0\0",
+                                               "/heartbeat\0\0,ssiit\0\0", "/heartbeat\0\0,ssiiit\0" };
+        const int headerSize = 20;
+
+        if (size < headerSize + 16)
+            return false;
+        int form = 0;
+        while (form < 4 && memcmp(data, headers[form], headerSize) != 0)
+            ++form;
+        if (form == 4)
+            return false;
+        event.hasDigest = (form & 1) != 0;
+        event.hasTimeTag = form >= 2;
+
+        Reader reader(data + headerSize, size - headerSize);
+        const char *hostUrl, *version, *args;
+        int length;
+        const int argsSize = (event.hasDigest ? 12 : 8) + (event.hasTimeTag ? 8 : 0);
+        if (! reader.readRawString(hostUrl, length) || ! reader.readRawString(version, length)
+            || (args = reader.take(argsSize)) == nullptr || ! reader.atEnd())
+            return false;
+
+        event.hostUrl = StringRef(hostUrl);
+        event.version = StringRef(version);
+        event.ledCount = readInt32(args);
+        event.engineId = readInt32(args + 4);
+        event.digest = event.hasDigest ? readInt32(args + 8) : 0;
+        event.timeTag = event.hasTimeTag ? OSCTimeTag(ByteOrder::bigEndianInt64(args + argsSize - 8)) : OSCTimeTag();
+        return true;
+    }
+
+    // returns false if the packet is malformed. Messages longer than a view
+    // holds inline take their room from the arena, if given, which is back
+    // to where it was once this returns.
+    static bool parse(const char* data, int size, Handler& handler, DecodeArena* arena = nullptr)
+    {
+        DecodeArena::Scope scope(arena);
+        if (isBundle(data, size))
+        {
+            if (! checkBundle(data, size, arena))
+                return false;
+            handler.oscBundleReceived(data, size);
+        }
+        else
+        {
+            Reader reader(data, size);
+            OscMessageView message(arena);
+            if (! readMessage(reader, message))
+                return false;
+            handler.oscMessageReceived(message);
+        }
+        return true;
+    }
+
+    // hands the messages of a checked bundle to the handler, nested bundles
+    // go to it as bundles of their own since they may be dated later
+    static void forEachElement(const char* bundle, int size, Handler& handler, DecodeArena* arena = nullptr)
+    {
+        Reader reader(bundle, size);
+        reader.skip(16);
+
+        const char* element;
+        int elementSize;
+        while (! reader.atEnd() && reader.readElement(element, elementSize))
+        {
+            if (isBundle(element, elementSize))
+            {
+                handler.oscBundleReceived(element, elementSize);
+            }
+            else
+            {
+                DecodeArena::Scope scope(arena);
+                Reader elementReader(element, elementSize);
+                OscMessageView message(arena);
+                if (readMessage(elementReader, message))
+                    handler.oscMessageReceived(message);
+            }
+        }
+    }
+
+    static OSCTimeTag getTimeTag(const char* bundle)
+    {
+        return OSCTimeTag(ByteOrder::bigEndianInt64(bundle + 8));
+    }
+
+    static bool isBundle(const char* data, int size)
+    {
+        return size >= 16 && memcmp(data, "#bundle", 8) == 0;
+    }
+
+    static MemoryBlock encode(const OSCMessage& message)
+    {
+        MemoryOutputStream out;
+        encode(message, out);
+        return out.getMemoryBlock();
+    }
+
+    // as encode() of an OSCMessage, but straight from the arguments, which
+    // are int32, float or strings, without building one
+    template <typename... Args>
+    static bool encode(MemoryOutputStream& out, OscLiteral address, const Args&... args)
+    {
+        const char typeTags[] = { ',', typeTagOf(args)..., 0 };
+        return out.write(address.getText(), (size_t)address.getLength() + 1) && writePadding(out)
+            && out.write(typeTags, sizeof(typeTags)) && writePadding(out)
+            && writeArguments(out, args...);
+    }
+
+    template <typename... Args>
+    static MemoryBlock encode(OscLiteral address, const Args&... args)
+    {
+        MemoryOutputStream out;
+        encode(out, address, args...);
+        return out.getMemoryBlock();
+    }
+
+    // appends the message to out, which may be reset and reused, or may
+    // write into a buffer of the caller's; returns false if that was too
+    // small for it
+    static bool encode(const OSCMessage& message, MemoryOutputStream& out)
+    {
+        if (! writeString(out, message.getAddressPattern().toString()) || ! out.writeByte(','))
+            return false;
+        for (auto& arg : message)
+            if (! out.writeByte((char)arg.getType()))
+                return false;
+        if (! out.writeByte(0) || ! writePadding(out))
+            return false;
+
+        for (auto& arg : message)
+        {
+            bool written = true;
+            if (arg.isInt32())
+            {
+                written = out.writeIntBigEndian(arg.getInt32());
+            }
+            else if (arg.isFloat32())
+            {
+                written = out.writeFloatBigEndian(arg.getFloat32());
+            }
+            else if (arg.isString())
+            {
+                written = writeString(out, arg.getString());
+            }
+            else if (arg.isBlob())
+            {
+                auto& blob = arg.getBlob();
+                written = out.writeIntBigEndian((int)blob.getSize())
+                    && out.write(blob.getData(), blob.getSize())
+                    && writePadding(out);
+            }
+
+            if (! written)
+                return false;
+        }
+        return true;
+    }
+
+    // count big endian int32s from data, which needn't be aligned, four at
+    // a time with a vector byte swap where there is one
+    static void readInt32s(const char* data, int count, int32* out)
+    {
+        int i = 0;
+       #if LOOP4R_NEON
+        for (; i + 4 <= count; i += 4)
+            vst1q_s32(out + i, vreinterpretq_s32_u8(vrev32q_u8(vld1q_u8((const uint8*)data + 4 * i))));
+       #elif defined (__SSSE3__)
+        const __m128i swap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_si128((__m128i*)(out + i), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 4 * i)), swap));
+       #elif defined (__SSE2__)
+        for (; i + 4 <= count; i += 4)
+        {
+            // the bytes of each half swapped, then the halves
+            __m128i x = _mm_loadu_si128((const __m128i*)(data + 4 * i));
+            x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+            x = _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+            _mm_storeu_si128((__m128i*)(out + i), x);
+        }
+       #endif
+        for (; i < count; ++i)
+            out[i] = readInt32(data + 4 * i);
+    }
+
+private:
+    static int32 readInt32(const char* data)
+    {
+        return (int32)ByteOrder::bigEndianInt(data);
+    }
+
+    static bool writeString(MemoryOutputStream& out, const String& value)
+    {
+        return out.write(value.toRawUTF8(), value.getNumBytesAsUTF8() + 1) && writePadding(out);
+    }
+
+    static constexpr char typeTagOf(int32)              { return 'i'; }
+    static constexpr char typeTagOf(float)              { return 'f'; }
+    static constexpr char typeTagOf(const String&)      { return 's'; }
+    static constexpr char typeTagOf(const char*)        { return 's'; }
+
+    static bool writeArgument(MemoryOutputStream& out, int32 value)         { return out.writeIntBigEndian(value); }
+    static bool writeArgument(MemoryOutputStream& out, float value)         { return out.writeFloatBigEndian(value); }
+    static bool writeArgument(MemoryOutputStream& out, const String& value) { return writeString(out, value); }
+
+    static bool writeArgument(MemoryOutputStream& out, const char* value)
+    {
+        return out.write(value, strlen(value) + 1) && writePadding(out);
+    }
+
+    static bool writeArguments(MemoryOutputStream&)
+    {
+        return true;
+    }
+
+    template <typename Arg, typename... Args>
+    static bool writeArguments(MemoryOutputStream& out, const Arg& arg, const Args&... args)
+    {
+        return writeArgument(out, arg) && writeArguments(out, args...);
+    }
+
+    static bool writePadding(MemoryOutputStream& out)
+    {
+        while ((out.getDataSize() & 3) != 0)
+            if (! out.writeByte(0))
+                return false;
+        return true;
+    }
+
+    struct Reader
+    {
+        Reader(const char* data, int size)
+            : data_(data), size_(size)
+        {
+        }
+
+        bool atEnd() const
+        {
+            return pos_ >= size_;
+        }
+
+        bool readInt32(int32& value)
+        {
+            if (size_ - pos_ < 4)
+                return false;
+            value = OscPacket::readInt32(data_ + pos_);
+            pos_ += 4;
+            return true;
+        }
+
+        // points into the packet, the length without the terminating null
+        bool readRawString(const char*& value, int& length)
+        {
+            const char* start = data_ + pos_;
+            const char* end = (const char*)memchr(start, 0, (size_t)(size_ - pos_));
+            if (end == nullptr)
+                return false;
+            value = start;
+            length = (int)(end - start);
+            return skip((length + 4) & ~3);
+        }
+
+        bool readRawBlob(const char*& value, int& size)
+        {
+            int32 blobSize;
+            if (! readInt32(blobSize) || blobSize < 0 || blobSize > size_ - pos_)
+                return false;
+            value = data_ + pos_;
+            size = blobSize;
+            return skip((blobSize + 3) & ~3);
+        }
+
+        // a bundle element with its int32 size in front
+        bool readElement(const char*& element, int& elementSize)
+        {
+            int32 value;
+            if (! readInt32(value) || value <= 0 || value > size_ - pos_)
+                return false;
+            element = data_ + pos_;
+            elementSize = value;
+            return skip(value);
+        }
+
+        bool skip(int bytes)
+        {
+            if (bytes > size_ - pos_)
+                return false;
+            pos_ += bytes;
+            return true;
+        }
+
+        // the next bytes, checked once for whoever reads them, or nullptr
+        const char* take(int bytes)
+        {
+            const char* start = data_ + pos_;
+            return skip(bytes) ? start : nullptr;
+        }
+
+        const char* data_;
+        int size_;
+        int pos_ = 0;
+    };
+
+    // points the view into the packet, nothing is copied
+    static bool readMessage(Reader& reader, OscMessageView& view)
+    {
+        const char *address, *typeTags;
+        int addressSize, numTypeTags;
+        if (! reader.readRawString(address, addressSize) || ! reader.readRawString(typeTags, numTypeTags)
+            || numTypeTags == 0 || typeTags[0] != ',')
+            return false;
+
+        view.reset(address, typeTags + 1);
+        if (hasOnlyFixedSizeArguments(typeTags + 1, numTypeTags - 1))
+            return readFixedSizeArguments(reader, typeTags, numTypeTags, view);
+
+        for (int i = 1; i < numTypeTags; ++i)
+        {
+            switch (typeTags[i])
+            {
+                case 'i':
+                {
+                    int32 value;
+                    if (! reader.readInt32(value))
+                        return false;
+                    view.add(OscValue::int32Value(value));
+                    break;
+                }
+                case 'f':
+                {
+                    int32 bits;
+                    if (! reader.readInt32(bits))
+                        return false;
+                    float value;
+                    memcpy(&value, &bits, sizeof(value));
+                    view.add(OscValue::float32Value(value));
+                    break;
+                }
+                case 's':
+                {
+                    const char* value;
+                    int valueSize;
+                    if (! reader.readRawString(value, valueSize))
+                        return false;
+                    view.add(OscValue::stringValue(value, valueSize));
+                    break;
+                }
+                case 'b':
+                {
+                    const char* value;
+                    int valueSize;
+                    if (! reader.readRawBlob(value, valueSize))
+                        return false;
+                    view.add(OscValue::blobValue(value, valueSize));
+                    break;
+                }
+                case 't':
+                {
+                    const char* value = reader.take(8);
+                    if (value == nullptr)
+                        return false;
+                    view.add(OscValue::timeTagValue(ByteOrder::bigEndianInt64(value)));
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    static bool hasOnlyFixedSizeArguments(const char* typeTags, int numTypeTags)
+    {
+        for (int i = 0; i < numTypeTags; ++i)
+            if (typeTags[i] != 'i' && typeTags[i] != 'f')
+                return false;
+        return true;
+    }
+
+    // ints and floats only, nearly all of the traffic: the packet is checked
+    // to hold all of them once, then they're swapped in bulk, a run at a
+    // time, without a check each
+    static bool readFixedSizeArguments(Reader& reader, const char* typeTags, int numTypeTags, OscMessageView& view)
+    {
+        const char* args = reader.take(4 * (numTypeTags - 1));
+        if (args == nullptr)
+            return false;
+
+        int32 values[64];
+        for (int i = 1; i < numTypeTags; i += numElementsInArray(values))
+        {
+            const int count = jmin((int)numElementsInArray(values), numTypeTags - i);
+            readInt32s(args + 4 * (i - 1), count, values);
+            for (int j = 0; j < count; ++j)
+            {
+                if (typeTags[i + j] == 'i')
+                {
+                    view.add(OscValue::int32Value(values[j]));
+                    continue;
+                }
+
+                float value;
+                memcpy(&value, &values[j], sizeof(value));
+                view.add(OscValue::float32Value(value));
+            }
+        }
+        return true;
+    }
+
+    // walks the whole bundle, nested ones included, without handing out
+    // anything, so a malformed bundle isn't half applied
+    static bool checkBundle(const char* data, int size, DecodeArena* arena = nullptr)
+    {
+        Reader reader(data, size);
+        if (! reader.skip(16))
+            return false;
+
+        const char* element;
+        int elementSize;
+        while (! reader.atEnd())
+        {
+            if (! reader.readElement(element, elementSize))
+                return false;
+
+            DecodeArena::Scope scope(arena);
+            OscMessageView message(arena);
+            Reader elementReader(element, elementSize);
+            if (isBundle(element, elementSize) ? ! checkBundle(element, elementSize, arena)
+                                               : ! readMessage(elementReader, message))
+                return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,115 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "OscMessageView.h"
+#include <tuple>
+#include <utility>
+
+//==============================================================================
+// A blob argument as the schemas hand it out, pointing into the message
+struct OscBlob
+{
+    const char* data;
+    int size;
+};
+
+// How each C++ type a schema can hold is tagged and read from an argument
+template <typename Type> struct OscSchemaType;
+
+template <> struct OscSchemaType<int32>
+{
+    static const char tag = 'i';
+    static int32 read(const OscValue& value)        { return value.getInt32(); }
+};
+
+template <> struct OscSchemaType<float>
+{
+    static const char tag = 'f';
+    static float read(const OscValue& value)        { return value.getFloat32(); }
+};
+
+template <> struct OscSchemaType<StringRef>
+{
+    static const char tag = 's';
+    static StringRef read(const OscValue& value)    { return value.getStringRef(); }
+};
+
+template <> struct OscSchemaType<OscBlob>
+{
+    static const char tag = 'b';
+    static OscBlob read(const OscValue& value)      { return { value.getBlobData(), value.getBlobSize() }; }
+};
+
+//==============================================================================
+// The arguments a handler expects, e.g. OscSchema<int32, StringRef, float>.
+// The type tags are put together at compile time, so checking a message is
+// one comparison of its type tag string against them, after which every
+// argument is read without looking at its type again. Arguments after the
+// schema's are ignored. Strings and blobs point into the message.
+template <typename... Types>
+struct OscSchema
+{
+    typedef std::tuple<Types...> Values;
+    static const int numArguments = (int)sizeof...(Types);
+    static constexpr char typeTags[numArguments + 1] = { OscSchemaType<Types>::tag..., 0 };
+
+    static bool matches(const OscMessageView& message)
+    {
+        return message.size() >= numArguments
+            && memcmp(message.getTypeTags().text.getAddress(), typeTags, (size_t)numArguments) == 0;
+    }
+
+    static bool decode(const OscMessageView& message, Values& values)
+    {
+        if (! matches(message))
+            return false;
+
+        values = read(message, std::index_sequence_for<Types...>());
+        return true;
+    }
+
+    // calls handler with the arguments if the message matches
+    template <typename Handler>
+    static bool apply(const OscMessageView& message, Handler&& handler)
+    {
+        if (! matches(message))
+            return false;
+
+        call(message, handler, std::index_sequence_for<Types...>());
+        return true;
+    }
+
+private:
+    template <size_t... Indices>
+    static Values read(const OscMessageView& message, std::index_sequence<Indices...>)
+    {
+        return Values(OscSchemaType<Types>::read(message[(int)Indices])...);
+    }
+
+    template <typename Handler, size_t... Indices>
+    static void call(const OscMessageView& message, Handler& handler, std::index_sequence<Indices...>)
+    {
+        handler(OscSchemaType<Types>::read(message[(int)Indices])...);
+    }
+};
+
+template <typename... Types>
+constexpr char OscSchema<Types...>::typeTags[];
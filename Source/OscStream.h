@@ -0,0 +1,444 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "OscInput.h"
+#include "Reconnector.h"
+#include <functional>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <poll.h>
+
+//==============================================================================
+// OSC 1.1 over a stream: every packet SLIP encoded (RFC 1055) with an END
+// byte on either side, so a frame garbled on the way ends at the next END and
+// the ones after it are still read
+namespace Slip
+{
+    static const uint8 end = 0xc0;
+    static const uint8 esc = 0xdb;
+    static const uint8 escEnd = 0xdc;
+    static const uint8 escEsc = 0xdd;
+
+    static void encode(const void* data, size_t size, MemoryOutputStream& out)
+    {
+        auto* bytes = (const uint8*)data;
+        out.writeByte((char)end);
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (bytes[i] == end || bytes[i] == esc)
+            {
+                out.writeByte((char)esc);
+                out.writeByte((char)(bytes[i] == end ? escEnd : escEsc));
+            }
+            else
+            {
+                out.writeByte((char)bytes[i]);
+            }
+        }
+        out.writeByte((char)end);
+    }
+}
+
+//==============================================================================
+// One looper's OSC both ways over a TCP connection of our own, for loopers
+// on the far side of a lossy link where UDP losses would keep the bridge
+// refetching LEDs. A thread of its own connects, reads and decodes the
+// frames, handing them to the listener as the receiver does its datagrams,
+// and connects again with a backoff whenever the connection drops.
+//
+// Sends don't block: with TCP_NODELAY every send() or sendQueued() is one
+// write of everything encoded since the last, and what the socket doesn't
+// take waits for the thread to write once it drains. A connection that
+// falls too far behind is dropped, the reconnect fetches everything again.
+class OscStream : private Thread
+{
+public:
+    typedef std::function<void(bool connected)> StateCallback;
+
+    OscStream(OscInput::Listener& listener, int source)
+        : Thread("loop4r OSC tcp"),
+          listener_(listener),
+          source_(source)
+    {
+    }
+
+    ~OscStream()
+    {
+        stop();
+    }
+
+    // called on the stream's thread each time it connects or loses the
+    // connection; only before start()
+    void setStateCallback(StateCallback callback)
+    {
+        stateChanged_ = callback;
+    }
+
+    // frames longer than this are dropped and counted, as the receiver does
+    // datagrams
+    void setMaxPacketSize(int bytes)
+    {
+        packetSize_ = jlimit(16, maxPacketSize, bytes);
+    }
+
+    // as OscOutput::setTrafficClass(), from the next connection on
+    void setTrafficClass(int tos)
+    {
+        tos_ = tos;
+    }
+
+    // connects to host:port and keeps doing so, a call for the address it
+    // already has does nothing
+    void start(const String& host, int port)
+    {
+        if (isThreadRunning() && host == host_ && port == port_)
+            return;
+
+        stop();
+        host_ = host;
+        port_ = port;
+        link_.lost();
+        startThread();
+    }
+
+    void stop()
+    {
+        signalThreadShouldExit();
+        reconnect();
+        stopThread(connectTimeoutMs + 1000);
+    }
+
+    // drops the connection, the thread connects again right away
+    void reconnect()
+    {
+        const ScopedLock sl(writeLock_);
+        if (socket_ != nullptr)
+            ::shutdown(socket_->getRawSocketHandle(), SHUT_RDWR);
+    }
+
+    bool isConnected() const
+    {
+        return connected_.get() != 0;
+    }
+
+    // our side of the connection, empty while there is none
+    String getLocalAddress() const
+    {
+        const ScopedLock sl(writeLock_);
+        sockaddr_storage address;
+        socklen_t length = sizeof(address);
+        char text[INET6_ADDRSTRLEN] = { 0 };
+        if (socket_ == nullptr || getsockname(socket_->getRawSocketHandle(), (sockaddr*)&address, &length) != 0)
+            return {};
+
+        if (address.ss_family == AF_INET6)
+            inet_ntop(AF_INET6, &((sockaddr_in6*)&address)->sin6_addr, text, sizeof(text));
+        else
+            inet_ntop(AF_INET, &((sockaddr_in*)&address)->sin_addr, text, sizeof(text));
+        return String(text);
+    }
+
+    // goes out with whatever was queued before it
+    bool send(const void* data, size_t size)
+    {
+        const ScopedLock sl(writeLock_);
+        Slip::encode(data, size, pending_);
+        return writePending();
+    }
+
+    bool send(const MemoryBlock& packet)
+    {
+        return send(packet.getData(), packet.getSize());
+    }
+
+    // encoded right away, unlike OscOutput's queue the packet needn't stay
+    // valid until sendQueued()
+    void queue(const MemoryBlock& packet)
+    {
+        const ScopedLock sl(writeLock_);
+        Slip::encode(packet.getData(), packet.getSize(), pending_);
+    }
+
+    bool sendQueued()
+    {
+        const ScopedLock sl(writeLock_);
+        return writePending();
+    }
+
+    int64 getConnects() const           { return connects_.get(); }
+    int64 getWrites() const             { return writes_.get(); }
+    int64 getOversizePackets() const    { return oversize_.get(); }
+
+private:
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            double nowMs = Time::getMillisecondCounterHiRes();
+            if (! link_.shouldAttempt(nowMs))
+            {
+                wait(jlimit(1, 1000, (int)link_.getDelayMs(nowMs)));
+                continue;
+            }
+
+            if (! open())
+            {
+                link_.failed(nowMs);
+                continue;
+            }
+
+            link_.connected();
+            ++connects_;
+            if (stateChanged_ != nullptr)
+                stateChanged_(true);
+
+            receive();
+            close();
+
+            // a peer that takes the connection only to close it is backed
+            // off from like one that refuses it
+            if (Time::getMillisecondCounterHiRes() - nowMs < minConnectionMs)
+                link_.failed(Time::getMillisecondCounterHiRes());
+            else
+                link_.lost();
+            if (stateChanged_ != nullptr)
+                stateChanged_(false);
+        }
+    }
+
+    bool open()
+    {
+        std::unique_ptr<StreamingSocket> socket(new StreamingSocket());
+        if (! socket->connect(host_, port_, connectTimeoutMs))
+            return false;
+
+        // a message is a few dozen bytes that shouldn't wait for more, and
+        // a peer gone without closing, as on Wi-Fi, is found out eventually
+        const int handle = socket->getRawSocketHandle();
+        int one = 1;
+        setsockopt(handle, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(handle, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+        if (tos_ >= 0)
+        {
+            int tos = tos_;
+            setsockopt(handle, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+        }
+
+        frameStart_ = frameSize_ = 0;
+        escaped_ = tooLong_ = false;
+
+        const ScopedLock sl(writeLock_);
+        socket_ = std::move(socket);
+        pending_.reset();
+        written_ = 0;
+        connected_ = 1;
+        return true;
+    }
+
+    void close()
+    {
+        const ScopedLock sl(writeLock_);
+        connected_ = 0;
+        socket_ = nullptr;
+        pending_.reset();
+        written_ = 0;
+    }
+
+    // until the connection drops or the thread is stopped
+    void receive()
+    {
+        const int handle = socket_->getRawSocketHandle();
+        uint8 buffer[readSize];
+        while (! threadShouldExit())
+        {
+            pollfd fd = { handle, POLLIN, 0 };
+            {
+                const ScopedLock sl(writeLock_);
+                if (written_ < pending_.getDataSize())
+                    fd.events |= POLLOUT;
+            }
+
+            // stop() shuts the socket down, which wakes this up
+            int ready = ::poll(&fd, 1, pollMs);
+            if (ready < 0 && errno != EINTR)
+                return;
+            if (ready <= 0)
+                continue;
+
+            if ((fd.revents & POLLOUT) != 0)
+            {
+                const ScopedLock sl(writeLock_);
+                writePending();
+            }
+
+            if ((fd.revents & (POLLIN | POLLHUP | POLLERR)) != 0)
+            {
+                ssize_t size = ::recv(handle, buffer, sizeof(buffer), MSG_DONTWAIT);
+                if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                    return;
+                if (size > 0)
+                    decode(buffer, (int)size);
+            }
+        }
+    }
+
+    // with writeLock_ held; false if the connection is gone or was dropped
+    // for falling behind
+    bool writePending()
+    {
+        if (socket_ == nullptr)
+        {
+            pending_.reset();
+            return false;
+        }
+
+        const char* data = (const char*)pending_.getData();
+        const size_t size = pending_.getDataSize();
+        while (written_ < size)
+        {
+            ssize_t wrote = ::send(socket_->getRawSocketHandle(), data + written_, size - written_, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (wrote < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                ::shutdown(socket_->getRawSocketHandle(), SHUT_RDWR);
+                return false;
+            }
+            written_ += (size_t)wrote;
+            ++writes_;
+        }
+
+        if (written_ == size)
+        {
+            pending_.reset();
+            written_ = 0;
+            return true;
+        }
+
+        if (size - written_ > maxUnwritten)
+        {
+            ::shutdown(socket_->getRawSocketHandle(), SHUT_RDWR);
+            return false;
+        }
+        return true;
+    }
+
+    // the frames complete in what was read go to the listener together,
+    // one still coming in stays at the front of the buffer
+    void decode(const uint8* data, int size)
+    {
+        int numPackets = 0;
+        for (int i = 0; i < size; ++i)
+        {
+            uint8 byte = data[i];
+            if (byte == Slip::end)
+            {
+                if (tooLong_)
+                    ++oversize_;
+                else if (frameSize_ >= 4)
+                {
+                    packets_[numPackets++] = { frame_ + frameStart_, frameSize_, 0.0, source_ };
+                    frameStart_ += frameSize_;
+                    if (numPackets == maxBatch)
+                        dispatch(numPackets);
+                }
+
+                frameSize_ = 0;
+                escaped_ = tooLong_ = false;
+                continue;
+            }
+
+            if (escaped_)
+            {
+                byte = byte == Slip::escEnd ? Slip::end : byte == Slip::escEsc ? Slip::esc : byte;
+                escaped_ = false;
+            }
+            else if (byte == Slip::esc)
+            {
+                escaped_ = true;
+                continue;
+            }
+
+            if (frameSize_ >= packetSize_.get())
+                tooLong_ = true;
+            else
+                frame_[frameStart_ + frameSize_++] = (char)byte;
+        }
+        dispatch(numPackets);
+    }
+
+    void dispatch(int& numPackets)
+    {
+        if (numPackets > 0)
+        {
+            const double nowMs = Time::getMillisecondCounterHiRes();
+            for (int i = 0; i < numPackets; ++i)
+                packets_[i].receivedMs = nowMs;
+            listener_.oscPacketsReceived(packets_, numPackets);
+            numPackets = 0;
+        }
+
+        if (frameStart_ > 0)
+        {
+            memmove(frame_, frame_ + frameStart_, (size_t)frameSize_);
+            frameStart_ = 0;
+        }
+    }
+
+    static const int readSize = 16384;
+    static const int maxPacketSize = 65536;
+    static const int maxBatch = 64;
+    static const int pollMs = 50;
+    static const int connectTimeoutMs = 2000;
+    static const size_t maxUnwritten = 65536;
+    static constexpr double minConnectionMs = 1000.0;
+
+    OscInput::Listener& listener_;
+    const int source_;
+    StateCallback stateChanged_;
+    String host_;
+    int port_ = 0;
+    Atomic<int> packetSize_ { OscInput::defaultPacketSize };
+    int tos_ = -1;
+    Reconnector link_ { 250, 5000 };
+
+    CriticalSection writeLock_;
+    std::unique_ptr<StreamingSocket> socket_;
+    MemoryOutputStream pending_;
+    size_t written_ = 0;
+    Atomic<int> connected_ { 0 };
+
+    // the thread's own, with room for the frames of a whole read after one
+    // still coming in
+    HeapBlock<char> frame_ { (size_t)(readSize + maxPacketSize) };
+    OscInput::Packet packets_[maxBatch];
+    int frameStart_ = 0;
+    int frameSize_ = 0;
+    bool escaped_ = false;
+    bool tooLong_ = false;
+
+    Atomic<int64> connects_ { 0 };
+    Atomic<int64> writes_ { 0 };
+    Atomic<int64> oversize_ { 0 };
+};
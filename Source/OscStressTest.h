@@ -0,0 +1,166 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "LatencyHistogram.h"
+
+//==============================================================================
+// Finds out how much the vendored juce_osc takes over loopback: an
+// OSCSender sends to an OSCReceiver with a realtime listener at rates
+// doubling from minRate, for each message size, and a step is sustained if
+// nearly everything sent arrived at nearly the rate it was sent. The first
+// step that isn't ends that size. A message is /stress with its sequence
+// number followed by int32s up to the size, so latency is from the send
+// to the receiver's callback. The sender paces itself on the calling
+// thread, so this blocks for a while.
+class OscStressTest : private OSCReceiver::Listener<OSCReceiver::RealtimeCallback>
+{
+public:
+    OscStressTest(int port = 9959, int stepMs = 500)
+        : port_(port),
+          stepMs_(jmax(50, stepMs))
+    {
+    }
+
+    String run()
+    {
+        var sizes;
+        if (! receiver_.connect(port_) || ! sender_.connect("127.0.0.1", port_))
+        {
+            std::cerr << "Error: could not connect the OSC sender and receiver on port " << port_ << std::endl;
+            return "{}";
+        }
+        receiver_.addListener(this);
+        sentMs_.calloc((size_t)maxRate * (size_t)stepMs_ / 1000 + 1);
+
+        for (int numArgs : { 1, 16, 64 })
+        {
+            var steps;
+            int sustained = 0;
+            for (int rate = minRate; rate <= maxRate; rate *= 2)
+            {
+                auto step = runStep(numArgs, rate);
+                const bool ok = (bool)step.getProperty("sustained", false);
+                steps.append(step);
+                if (! ok)
+                    break;
+                sustained = rate;
+            }
+
+            auto* size = new DynamicObject();
+            size->setProperty("arguments", numArgs);
+            size->setProperty("max_sustained_per_s", sustained);
+            size->setProperty("steps", steps);
+            sizes.append(var(size));
+        }
+
+        receiver_.removeListener(this);
+        receiver_.disconnect();
+        sender_.disconnect();
+
+        auto* root = new DynamicObject();
+        root->setProperty("version", ProjectInfo::versionString);
+        root->setProperty("step_ms", stepMs_);
+        root->setProperty("sizes", sizes);
+        return JSON::toString(var(root));
+    }
+
+private:
+    static const int minRate = 1000;
+    static const int maxRate = 1 << 20;
+
+    var runStep(int numArgs, int rate)
+    {
+        // stragglers of the last step are ignored while it starts
+        count_ = 0;
+        Thread::sleep(20);
+        const int count = (int)((int64)rate * stepMs_ / 1000);
+        received_ = 0;
+        latency_.reset();
+        count_ = count;
+
+        OSCMessage message("/stress");
+        for (int i = 0; i < numArgs; ++i)
+            message.addInt32(0);
+
+        int64 sendFailures = 0;
+        const double startMs = Time::getMillisecondCounterHiRes();
+        for (int i = 0; i < count; ++i)
+        {
+            // on schedule, sleeping only while more than a ms ahead
+            const double dueMs = startMs + (double)i * 1000.0 / rate;
+            double now;
+            while ((now = Time::getMillisecondCounterHiRes()) < dueMs)
+                if (dueMs - now > 1.0)
+                    Thread::sleep(1);
+
+            message[0] = OSCArgument((int32)i);
+            sentMs_[i] = Time::getMillisecondCounterHiRes();
+            if (! sender_.send(message))
+                ++sendFailures;
+        }
+        const double sendMs = Time::getMillisecondCounterHiRes() - startMs;
+
+        // what is still on its way
+        for (int64 before = -1; received_.get() != before && received_.get() < count;)
+        {
+            before = received_.get();
+            Thread::sleep(50);
+        }
+
+        const int64 received = received_.get();
+        const double achieved = (double)count * 1000.0 / jmax(0.001, sendMs);
+        auto* step = new DynamicObject();
+        step->setProperty("rate", rate);
+        step->setProperty("sent_per_s", achieved);
+        step->setProperty("received", received);
+        step->setProperty("dropped", (int64)count - received);
+        step->setProperty("send_failures", sendFailures);
+        step->setProperty("p50_us", latency_.getPercentile(0.5));
+        step->setProperty("p99_us", latency_.getPercentile(0.99));
+        step->setProperty("max_us", latency_.getMax());
+        step->setProperty("sustained", achieved >= 0.95 * rate && received >= count - count / 1000);
+        return var(step);
+    }
+
+    // on the receiver's thread
+    void oscMessageReceived(const OSCMessage& message) override
+    {
+        if (message.isEmpty() || ! message[0].isInt32())
+            return;
+
+        const int sequence = message[0].getInt32();
+        if (isPositiveAndBelow(sequence, count_.get()))
+        {
+            latency_.record(Time::getMillisecondCounterHiRes() - sentMs_[sequence]);
+            ++received_;
+        }
+    }
+
+    int port_;
+    int stepMs_;
+    OSCSender sender_;
+    OSCReceiver receiver_;
+    HeapBlock<double> sentMs_;
+    Atomic<int> count_ { 0 };
+    Atomic<int64> received_ { 0 };
+    LatencyHistogram latency_ { "osc stress" };
+};
@@ -0,0 +1,118 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "MidiLoopback.h"
+#include "WirePacer.h"
+
+//==============================================================================
+// Output settings for an interface from a loopback run, written as the lines
+// of a program file to include in the session, each with the numbers it
+// came from as a comment. The round trips of the batches that came back
+// whole are fitted as a fixed cost per write plus a cost per byte:
+//
+//  - cw holds changes for half the fixed cost, so a burst arriving within
+//    it saves a whole write while a lone change waits no longer than half
+//    of what that write costs;
+//  - pace is only set when the bytes go at about the DIN line rate or
+//    slower, i.e. the wire is what holds them back, at 95% of the measured
+//    rate with the largest batch that never lost a byte as the burst;
+//  - wt moves the writes to their own thread when the largest batch blocks
+//    the writer for a ms or more.
+class OutputCalibration
+{
+public:
+    struct Settings
+    {
+        double fixedUs = 0.0;       // the fit the rest is derived from
+        double perByteUs = 0.0;
+        double coalesceMs = 0.0;
+        int pacePercent = 0;        // 0 to leave the output unpaced
+        int paceBurst = 64;
+        int64 writeP99Us = 0;
+        bool writerThread = false;
+    };
+
+    // false if fewer than two batch sizes came back whole
+    static bool recommend(const Array<MidiLoopback::BatchResult>& results, Settings& settings)
+    {
+        double n = 0.0, sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0;
+        bool whole = true;
+        for (auto& batch : results)
+        {
+            // once a batch size lost bytes the larger ones overflow as well
+            whole = whole && batch.lost == 0;
+            if (! whole)
+                break;
+
+            const double bytes = batch.messages * 3.0;
+            n += 1.0;
+            sumX += bytes;
+            sumY += (double)batch.roundTripP50Us;
+            sumXX += bytes * bytes;
+            sumXY += bytes * (double)batch.roundTripP50Us;
+            settings.paceBurst = batch.messages * 3;
+            settings.writeP99Us = batch.writeP99Us;
+        }
+
+        const double denominator = n * sumXX - sumX * sumX;
+        if (n < 2.0 || denominator <= 0.0)
+            return false;
+
+        settings.perByteUs = jmax(0.0, (n * sumXY - sumX * sumY) / denominator);
+        settings.fixedUs = jmax(0.0, (sumY - settings.perByteUs * sumX) / n);
+
+        // tenths of a ms, nothing below one
+        settings.coalesceMs = jmin(2.0, std::floor(settings.fixedUs / 2.0 / 100.0) / 10.0);
+
+        const double lineBytesPerMs = WirePacer::lineBytesPerSecond / 1000.0;
+        const double bytesPerMs = settings.perByteUs > 0.0 ? 1000.0 / settings.perByteUs : 0.0;
+        settings.pacePercent = bytesPerMs > 0.0 && bytesPerMs < lineBytesPerMs * 1.5
+            ? jlimit(1, 100, (int)(bytesPerMs / lineBytesPerMs * 95.0))
+            : 0;
+
+        settings.writerThread = settings.writeP99Us >= 1000;
+        return true;
+    }
+
+    static String toProgram(const Settings& settings, const String& output)
+    {
+        String text;
+        text << "# output settings from calib for " << output << ", " << Time::getCurrentTime().toISO8601(true) << "\n"
+             << "# round trip " << String(settings.fixedUs / 1000.0, 2) << " ms + " << String(settings.perByteUs, 1) << " us per byte\n";
+
+        if (settings.coalesceMs > 0.0)
+            text << "cw " << String(settings.coalesceMs, 1) << "\n";
+        else
+            text << "# no coalescing window, a write costs too little to wait for\n";
+
+        if (settings.pacePercent > 0)
+            text << "# the interface takes " << String(1000.0 / settings.perByteUs, 2) << " bytes per ms, paced 5% below that, and "
+                 << settings.paceBurst << " bytes at once never overflowed\n"
+                 << "pace " << settings.pacePercent << " " << settings.paceBurst << "\n";
+        else
+            text << "# no pacing, the interface takes bytes faster than the DIN line\n";
+
+        if (settings.writerThread)
+            text << "# a write blocked for " << settings.writeP99Us << " us (p99)\n"
+                 << "wt 0\n";
+        return text;
+    }
+};
@@ -0,0 +1,99 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+ #include <arm_neon.h>
+ #define LOOP4R_NEON 1
+#endif
+
+//==============================================================================
+// Compares two packed arrays of per-LED state and lists the indices that
+// differ, lowest first, so an encoder only touches what changed. On ARM the
+// comparison takes 16 bytes or 4 words per NEON instruction and the result
+// is narrowed into a bit mask that is walked with ctz, so long runs without
+// a change cost next to nothing; elsewhere a scalar loop skips unchanged
+// stretches 8 bytes at a time. The arrays hold at most 256 entries so an
+// index fits a byte; both functions return how many were written to changed.
+namespace PackedDiff
+{
+    static const int maxEntries = 256;
+
+    inline int changedBytes(const uint8* current, const uint8* previous, int size, uint8* changed)
+    {
+        jassert(size <= maxEntries);
+        int numChanged = 0;
+        int i = 0;
+
+       #if LOOP4R_NEON
+        for (; i + 16 <= size; i += 16)
+        {
+            // one nibble per byte, set where they are equal
+            uint8x16_t equal = vceqq_u8(vld1q_u8(current + i), vld1q_u8(previous + i));
+            uint64 mask = ~vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+            for (mask &= 0x1111111111111111ull; mask != 0; mask &= mask - 1)
+                changed[numChanged++] = (uint8)(i + __builtin_ctzll(mask) / 4);
+        }
+       #else
+        for (; i + 8 <= size; i += 8)
+        {
+            uint64 a, b;
+            memcpy(&a, current + i, 8);
+            memcpy(&b, previous + i, 8);
+            if (a == b)
+                continue;
+
+            for (int j = i; j < i + 8; ++j)
+                if (current[j] != previous[j])
+                    changed[numChanged++] = (uint8)j;
+        }
+       #endif
+
+        for (; i < size; ++i)
+            if (current[i] != previous[i])
+                changed[numChanged++] = (uint8)i;
+        return numChanged;
+    }
+
+    inline int changedWords(const uint32* current, const uint32* previous, int size, uint8* changed)
+    {
+        jassert(size <= maxEntries);
+        int numChanged = 0;
+        int i = 0;
+
+       #if LOOP4R_NEON
+        for (; i + 4 <= size; i += 4)
+        {
+            // sixteen bits per word, set where they are equal
+            uint32x4_t equal = vceqq_u32(vld1q_u32(current + i), vld1q_u32(previous + i));
+            uint64 mask = ~vget_lane_u64(vreinterpret_u64_u16(vshrn_n_u32(equal, 16)), 0);
+            for (mask &= 0x0001000100010001ull; mask != 0; mask &= mask - 1)
+                changed[numChanged++] = (uint8)(i + __builtin_ctzll(mask) / 16);
+        }
+       #endif
+
+        for (; i < size; ++i)
+            if (current[i] != previous[i])
+                changed[numChanged++] = (uint8)i;
+        return numChanged;
+    }
+}
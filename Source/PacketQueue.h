@@ -0,0 +1,159 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "OscInput.h"
+
+//==============================================================================
+// Hands received packets to the message thread without a lock or an
+// allocation: a bounded multi-producer, single-consumer ring (Vyukov's, with
+// a sequence number per slot) holding copies of the datagrams. Producers ask
+// for a wakeup only when the queue goes from drained to not, so a burst costs
+// one message posted to the message thread however many packets it holds.
+class PacketQueue
+{
+public:
+    static const int capacity = 128;
+
+    PacketQueue()
+    {
+        setPacketSize(OscInput::defaultPacketSize);
+    }
+
+    // the room each slot has for a packet; only while nothing is queued and
+    // no producer is running
+    void setPacketSize(int bytes)
+    {
+        packetSize_ = bytes;
+        storage_.malloc((size_t)capacity * (size_t)bytes);
+        for (int i = 0; i < capacity; ++i)
+        {
+            slots_[i].sequence = (uint32)i;
+            slots_[i].data = storage_ + i * bytes;
+        }
+        enqueuePos_ = 0;
+        dequeuePos_ = 0;
+    }
+
+    int getPacketSize() const
+    {
+        return packetSize_;
+    }
+
+    // any thread; returns false if the queue is full
+    bool push(const OscInput::Packet& packet)
+    {
+        uint32 pos = enqueuePos_.get();
+        Slot* slot;
+        for (;;)
+        {
+            slot = slots_ + (pos & mask);
+            int32 diff = (int32)(slot->sequence.get() - pos);
+            if (diff == 0)
+            {
+                if (enqueuePos_.compareAndSetBool(pos + 1, pos))
+                    break;
+                pos = enqueuePos_.get();
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos_.get();
+            }
+        }
+
+        slot->size = jmin(packet.size, packetSize_);
+        memcpy(slot->data, packet.data, (size_t)slot->size);
+        slot->receivedMs = packet.receivedMs;
+        slot->source = packet.source;
+        slot->socketMs = packet.socketMs;
+        slot->sequence = pos + 1;
+        return true;
+    }
+
+    // after pushing: true for the one producer that has to wake the consumer
+    bool claimWakeup()
+    {
+        return wakeupPending_.exchange(1) == 0;
+    }
+
+    // the consumer, before draining; packets pushed from now on ask for a
+    // wakeup again
+    void beginDrain()
+    {
+        wakeupPending_ = 0;
+    }
+
+    // the consumer: up to max packets pointing into the queue, valid until
+    // release() gives back that many
+    int peek(OscInput::Packet* packets, int max)
+    {
+        int count = 0;
+        for (; count < max; ++count)
+        {
+            uint32 pos = dequeuePos_ + (uint32)count;
+            const Slot& slot = slots_[pos & mask];
+            if ((int32)(slot.sequence.get() - (pos + 1)) < 0)
+                break;
+            packets[count] = { slot.data, slot.size, slot.receivedMs, slot.source, slot.socketMs };
+        }
+        return count;
+    }
+
+    // the consumer: the packets claimed by producers and not yet released,
+    // some of them possibly still being copied in
+    int getNumQueued() const
+    {
+        return (int)(enqueuePos_.get() - dequeuePos_);
+    }
+
+    void release(int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            slots_[dequeuePos_ & mask].sequence = dequeuePos_ + (uint32)capacity;
+            ++dequeuePos_;
+        }
+    }
+
+private:
+    static const uint32 mask = capacity - 1;
+    static_assert((capacity & (capacity - 1)) == 0, "the capacity must be a power of two");
+
+    struct Slot
+    {
+        Atomic<uint32> sequence;
+        int size = 0;
+        int source = 0;
+        double receivedMs = 0.0;
+        double socketMs = 0.0;
+        char* data = nullptr;     // into storage_
+    };
+
+    Slot slots_[capacity];
+    HeapBlock<char> storage_;
+    int packetSize_ = 0;
+    Atomic<uint32> enqueuePos_ { 0 };
+    uint32 dequeuePos_ = 0;
+    Atomic<int> wakeupPending_ { 0 };
+};
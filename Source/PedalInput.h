@@ -0,0 +1,179 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "RawMidiDevices.h"
+#include <functional>
+#include <poll.h>
+
+//==============================================================================
+// The pedalboard's rawmidi input, read in-process so a press reaches the
+// looper without going through loop4r_read first. Channel messages are
+// handed to the callback whole, running status resolved; realtime bytes and
+// SysEx are skipped. Either an event loop watches getPollHandle() and calls
+// readAvailable(), or start() reads on a thread of its own that also reopens
+// the port after the device went away.
+class PedalInput : private Thread
+{
+public:
+    typedef std::function<void(uint8 status, uint8 data1, uint8 data2)> Callback;
+
+    PedalInput(const String& name, Callback callback, RawMidiResolver* resolver = nullptr)
+        : Thread("loop4r pedals"),
+          name_(name),
+          resolver_(resolver),
+          callback_(callback)
+    {
+    }
+
+    ~PedalInput()
+    {
+        stop();
+        close();
+    }
+
+    const String& getName() const
+    {
+        return name_;
+    }
+
+    bool open()
+    {
+        String device = resolver_ != nullptr ? resolver_->resolve(name_, SND_RAWMIDI_STREAM_INPUT) : name_;
+        snd_rawmidi_t* handle = nullptr;
+        if (device.isEmpty() || snd_rawmidi_open(&handle, NULL, device.toRawUTF8(), SND_RAWMIDI_NONBLOCK) < 0)
+            return false;
+
+        status_ = 0;
+        expected_ = 0;
+        handle_ = handle;
+        return true;
+    }
+
+    void close()
+    {
+        snd_rawmidi_t* handle = handle_.exchange(nullptr);
+        if (handle != nullptr)
+            snd_rawmidi_close(handle);
+    }
+
+    bool isOpen() const
+    {
+        return handle_.get() != nullptr;
+    }
+
+    int getPollHandle() const
+    {
+        snd_rawmidi_t* handle = handle_.get();
+        pollfd pfd;
+        if (handle == nullptr || snd_rawmidi_poll_descriptors(handle, &pfd, 1) != 1)
+            return -1;
+        return pfd.fd;
+    }
+
+    void start()
+    {
+        startThread();
+    }
+
+    void stop()
+    {
+        stopThread(1000);
+    }
+
+    // calls back for every message complete so far; returns false and closes
+    // the port once the device is gone
+    bool readAvailable()
+    {
+        snd_rawmidi_t* handle = handle_.get();
+        if (handle == nullptr)
+            return false;
+
+        uint8 buffer[256];
+        for (;;)
+        {
+            ssize_t size = snd_rawmidi_read(handle, buffer, sizeof(buffer));
+            if (size == -EAGAIN || size == -EINTR)
+                return true;
+            if (size <= 0)
+            {
+                close();
+                return false;
+            }
+
+            for (ssize_t i = 0; i < size; ++i)
+                parse(buffer[i]);
+        }
+    }
+
+private:
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            if (! isOpen() && ! open())
+            {
+                wait(500);
+                continue;
+            }
+
+            pollfd pfd = { getPollHandle(), POLLIN, 0 };
+            int ready = poll(&pfd, 1, 500);
+            if (ready > 0 && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0)
+                close();
+            else if (ready > 0)
+                readAvailable();
+        }
+    }
+
+    void parse(uint8 byte)
+    {
+        if (byte >= 0xf8)
+            return;                 // realtime, may come anywhere
+
+        if (byte >= 0x80)
+        {
+            // system common and SysEx cancel running status
+            status_ = byte < 0xf0 ? byte : 0;
+            const uint8 type = byte & 0xf0;
+            expected_ = (type == 0xc0 || type == 0xd0) ? 1 : 2;
+            received_ = 0;
+            return;
+        }
+
+        if (status_ == 0)
+            return;
+
+        data_[received_++] = byte;
+        if (received_ == expected_)
+        {
+            callback_(status_, data_[0], expected_ > 1 ? data_[1] : (uint8)0);
+            received_ = 0;
+        }
+    }
+
+    String name_;
+    RawMidiResolver* resolver_;
+    Callback callback_;
+    Atomic<snd_rawmidi_t*> handle_ { nullptr };
+    uint8 status_ = 0;
+    int expected_ = 0;
+    int received_ = 0;
+    uint8 data_[2];
+};
@@ -0,0 +1,135 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//==============================================================================
+// The CPU's own counts of cycles, instructions, branch misses and cache
+// misses for the calling thread, between start() and stop(), through
+// perf_event_open. Only user space is counted, which perf_event_paranoid 2
+// (the usual default) still allows. Each counter is opened on its own, so
+// one the CPU or a VM lacks only reads as -1; when the kernel has to share
+// the counters out, the counts are scaled up by the time each one ran.
+class PerfCounters
+{
+public:
+    enum Counter
+    {
+        Cycles,
+        Instructions,
+        BranchMisses,
+        CacheMisses,
+        numCounters
+    };
+
+    static const char* getName(int counter)
+    {
+        static const char* const names[numCounters] = { "cycles", "instructions", "branch_misses", "cache_misses" };
+        return names[counter];
+    }
+
+    ~PerfCounters()
+    {
+        close();
+    }
+
+    // returns false if none of the counters could be opened
+    bool open()
+    {
+        close();
+
+        static const uint64 configs[numCounters] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                     PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES };
+        bool any = false;
+        for (int counter = 0; counter < numCounters; ++counter)
+        {
+            perf_event_attr attr;
+            zerostruct(attr);
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[counter];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            fds_[counter] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+            any = any || fds_[counter] >= 0;
+        }
+        return any;
+    }
+
+    void close()
+    {
+        for (auto& fd : fds_)
+        {
+            if (fd >= 0)
+                ::close(fd);
+            fd = -1;
+        }
+    }
+
+    bool isOpen() const
+    {
+        for (auto fd : fds_)
+            if (fd >= 0)
+                return true;
+        return false;
+    }
+
+    void start()
+    {
+        for (auto fd : fds_)
+        {
+            if (fd >= 0)
+            {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    void stop()
+    {
+        for (auto fd : fds_)
+            if (fd >= 0)
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    // since start(), or -1 for a counter that isn't there or never ran
+    int64 read(int counter) const
+    {
+        uint64 values[3];   // count, time enabled, time running
+        if (fds_[counter] < 0 || ::read(fds_[counter], values, sizeof(values)) != (ssize_t)sizeof(values) || values[2] == 0)
+            return -1;
+
+        if (values[2] == values[1])
+            return (int64)values[0];
+        return (int64)((double)values[0] * (double)values[1] / (double)values[2]);
+    }
+
+private:
+    int fds_[numCounters] = { -1, -1, -1, -1 };
+};
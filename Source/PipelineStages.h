@@ -0,0 +1,127 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "LatencyHistogram.h"
+
+//==============================================================================
+// The stages an update goes through from the OSC socket to the MIDI port,
+// each counting what passed through it, how much waits in front of it and
+// how long it took there:
+//
+//   ingest    packets from the receiver thread to the one handling them,
+//             waiting in the packet queue
+//   decode    a batch parsed and dispatched, the handlers included
+//   state     LED changes in the boards' shadows, waiting for a commit
+//   coalesce  changes held until the coalescing window closes
+//   encode    a shadow's difference turned into a MIDI batch
+//   pace      a batch held back while the wire is estimated to be busy
+//   write     a batch handed to the port or the writer thread
+//
+// Stages on the same thread are direct calls and those across threads are
+// bounded queues, as the threading mode has them; here they only report.
+// Counting is atomic, from any thread.
+class PipelineStages
+{
+public:
+    enum Stage
+    {
+        Ingest,
+        Decode,
+        State,
+        Coalesce,
+        Encode,
+        Pace,
+        Write,
+        numStages
+    };
+
+    static const char* getName(int stage)
+    {
+        static const char* const names[numStages] = { "ingest", "decode", "state", "coalesce", "encode", "pace", "write" };
+        return isPositiveAndBelow(stage, (int)numStages) ? names[stage] : "other";
+    }
+
+    struct Metrics
+    {
+        Metrics() : latency("stage") {}
+
+        Atomic<int64> items { 0 };
+        Atomic<int> depth { 0 };
+        Atomic<int> maxDepth { 0 };
+        LatencyHistogram latency;
+    };
+
+    // items through a stage that took ms there; a negative ms has no
+    // latency of its own
+    void passed(Stage stage, int items, double ms = -1.0)
+    {
+        auto& metrics = metrics_[stage];
+        metrics.items += items;
+        if (ms >= 0.0)
+            metrics.latency.record(ms);
+    }
+
+    void setDepth(Stage stage, int depth)
+    {
+        auto& metrics = metrics_[stage];
+        metrics.depth = depth;
+        int max = metrics.maxDepth.get();
+        while (depth > max && ! metrics.maxDepth.compareAndSetBool(depth, max))
+            max = metrics.maxDepth.get();
+    }
+
+    const Metrics& get(int stage) const
+    {
+        return metrics_[stage];
+    }
+
+    StringArray getReport() const
+    {
+        StringArray lines;
+        for (int stage = 0; stage < numStages; ++stage)
+        {
+            auto& metrics = metrics_[stage];
+            if (metrics.items.get() == 0)
+                continue;
+
+            String line = String(getName(stage)).paddedRight(' ', 10) + String(metrics.items.get())
+                + ", depth " + String(metrics.depth.get()) + " (max " + String(metrics.maxDepth.get()) + ")";
+            if (metrics.latency.getCount() > 0)
+                line << ", p50 " << metrics.latency.getPercentile(0.5) << " us, p99 " << metrics.latency.getPercentile(0.99) << " us";
+            lines.add(line);
+        }
+        return lines;
+    }
+
+    // not atomic as a whole, like LatencyHistogram::reset()
+    void reset()
+    {
+        for (auto& metrics : metrics_)
+        {
+            metrics.items = 0;
+            metrics.maxDepth = metrics.depth.get();
+            metrics.latency.reset();
+        }
+    }
+
+private:
+    Metrics metrics_[numStages];
+};
@@ -0,0 +1,289 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "ThreadTuning.h"
+#include "LoopClock.h"
+#include "TimingWheel.h"
+#include <functional>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+//==============================================================================
+// Timers calling back on a thread of their own, in place of juce's Timer,
+// whose thread counts down in whole milliseconds and then still has to get
+// the callback through the message queue. Every timer keeps an absolute
+// deadline on CLOCK_MONOTONIC and moves it on by exactly its interval, so
+// late callbacks don't add up to drift; the thread sleeps on one timerfd
+// armed for the earliest deadline. The deadlines are kept on a timing wheel
+// in microseconds, so however many timers there are, arming one and finding
+// the next wakeup don't go through all of them, and every timer falling due
+// in the same microsecond is served by one wakeup, their callbacks run as a
+// batch once the lock is released. Same interface as EventLoop's timers, and
+// safe to use from any thread including the callbacks. On a simulated clock
+// there is no thread, advanceTo() fires the timers instead.
+class PreciseTimers : private Thread
+{
+public:
+    typedef std::function<void()> Callback;
+
+    PreciseTimers(const String& threadName = "loop4r timers")
+        : Thread(threadName)
+    {
+    }
+
+    ~PreciseTimers()
+    {
+        stop();
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    // takes effect on the next start()
+    void setThreadTuning(const ThreadTuning& tuning)
+    {
+        tuning_ = tuning;
+    }
+
+    // only before start()
+    void setClock(LoopClock* clock)
+    {
+        clock_ = clock;
+    }
+
+    bool start()
+    {
+        if (isSimulated())
+            return true;
+
+        if (fd_ < 0)
+            fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (fd_ < 0)
+            return false;
+
+        startThread();
+        rearm();
+        return true;
+    }
+
+    void stop()
+    {
+        signalThreadShouldExit();
+        if (fd_ >= 0)
+            arm(1);     // wakes the thread up to see it should exit
+        stopThread(2000);
+    }
+
+    // returns the timer's id for setTimer()
+    int addTimer(Callback callback)
+    {
+        const ScopedLock sl(lock_);
+        timers_.add({ callback });
+        wheel_.add();
+        return timers_.size() - 1;
+    }
+
+    // every intervalMs from now, or once after it; 0 disarms the timer
+    void setTimer(int id, double intervalMs, bool oneShot = false)
+    {
+        const ScopedLock sl(lock_);
+        if (! isPositiveAndBelow(id, timers_.size()))
+            return;
+
+        auto& timer = timers_.getReference(id);
+        timer.intervalNs = (int64)(jmax(0.0, intervalMs) * 1000000.0);
+        timer.dueNs = timer.intervalNs > 0 ? now() + timer.intervalNs : 0;
+        timer.oneShot = oneShot;
+        schedule(id);
+        rearm();
+    }
+
+    // a one shot timer counts as armed until it fired
+    bool isTimerArmed(int id) const
+    {
+        const ScopedLock sl(lock_);
+        return isPositiveAndBelow(id, timers_.size()) && timers_.getReference(id).dueNs > 0;
+    }
+
+    // on a simulated clock, moves it on to ns and fires every timer due
+    // until then in the order they fall due, the clock showing each one's
+    // deadline while it runs
+    void advanceTo(int64 ns)
+    {
+        jassert(isSimulated());
+        Array<int> due;
+        for (;;)
+        {
+            // one microsecond of the wheel at a time, the timers due in it
+            // in the order of their deadlines
+            {
+                const ScopedLock sl(lock_);
+                const int64 next = wheel_.getNextTick();
+                if (next == TimingWheel::noDeadline || next * 1000 > ns)
+                    break;
+
+                due.clearQuick();
+                wheel_.advance(next, [&due] (int id) { due.add(id); });
+                std::sort(due.begin(), due.end(), [this] (int a, int b)
+                {
+                    const int64 aNs = timers_.getReference(a).dueNs, bNs = timers_.getReference(b).dueNs;
+                    return aNs < bNs || (aNs == bNs && a < b);
+                });
+            }
+
+            for (auto id : due)
+            {
+                Callback callback;
+                {
+                    // a callback before it may have set the timer again
+                    const ScopedLock sl(lock_);
+                    auto& timer = timers_.getReference(id);
+                    if (timer.dueNs == 0 || wheel_.isScheduled(id))
+                        continue;
+
+                    clock_->setNs(timer.dueNs);
+                    callback = timer.callback;
+                    if (timer.oneShot)
+                        timer.dueNs = 0;
+                    else
+                        timer.dueNs += timer.intervalNs;
+                    schedule(id);
+                }
+                callback();
+            }
+        }
+        clock_->setNs(ns);
+    }
+
+private:
+    struct PreciseTimer
+    {
+        Callback callback;
+        int64 intervalNs = 0;
+        int64 dueNs = 0;            // 0 when disarmed
+        bool oneShot = false;
+    };
+
+    void run() override
+    {
+        if (! tuning_.applyToCurrentThread())
+            std::cerr << "Could not set SCHED_FIFO priority " << tuning_.realtimePriority << " for the timers" << std::endl;
+
+        Array<Callback> due;
+        while (! threadShouldExit())
+        {
+            uint64 expirations;
+            if (::read(fd_, &expirations, sizeof(expirations)) < 0 || threadShouldExit())
+                continue;
+
+            {
+                const ScopedLock sl(lock_);
+                int64 nowNs = now();
+                wheel_.advance(nowNs / 1000, [&] (int id)
+                {
+                    auto& timer = timers_.getReference(id);
+                    due.add(timer.callback);
+                    if (timer.oneShot)
+                    {
+                        timer.dueNs = 0;
+                    }
+                    else
+                    {
+                        // on the original cadence, skipping ticks missed
+                        // altogether rather than running them back to back
+                        timer.dueNs += timer.intervalNs;
+                        if (timer.dueNs <= nowNs)
+                            timer.dueNs += ((nowNs - timer.dueNs) / timer.intervalNs + 1) * timer.intervalNs;
+                        schedule(id);
+                    }
+                });
+                rearm();
+            }
+
+            for (auto& callback : due)
+                callback();
+            due.clearQuick();
+        }
+    }
+
+    bool isSimulated() const
+    {
+        return clock_ != nullptr && clock_->isSimulated();
+    }
+
+    int64 now() const
+    {
+        if (clock_ != nullptr)
+            return clock_->nowNs();
+
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return (int64)time.tv_sec * 1000000000 + time.tv_nsec;
+    }
+
+    // files the timer on the wheel for the microsecond its deadline falls
+    // in, or takes it off when disarmed, with the lock held
+    void schedule(int id)
+    {
+        auto& timer = timers_.getReference(id);
+        if (timer.dueNs == 0)
+        {
+            wheel_.cancel(id);
+            return;
+        }
+
+        // an empty wheel catches up first, so it doesn't step through
+        // everything since it last ran
+        const int64 tick = (timer.dueNs + 999) / 1000;
+        wheel_.cancel(id);
+        if (wheel_.getNextTick() == TimingWheel::noDeadline)
+            wheel_.advance(now() / 1000, [] (int) {});
+        wheel_.schedule(id, tick);
+    }
+
+    // for the wheel's next tick, with the lock held. That may be a slot
+    // coming down a level rather than a deadline, then the thread wakes
+    // up once for nothing.
+    void rearm()
+    {
+        const int64 next = wheel_.getNextTick();
+        if (fd_ >= 0)
+            arm(next == TimingWheel::noDeadline ? 0 : jmax((int64)1, next * 1000));
+    }
+
+    // an absolute deadline, 0 disarms
+    void arm(int64 dueNs)
+    {
+        itimerspec spec;
+        zerostruct(spec);
+        spec.it_value.tv_sec = (time_t)(dueNs / 1000000000);
+        spec.it_value.tv_nsec = (long)(dueNs % 1000000000);
+        timerfd_settime(fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    CriticalSection lock_;
+    Array<PreciseTimer> timers_;
+    TimingWheel wheel_;
+    int fd_ = -1;
+    ThreadTuning tuning_;
+    LoopClock* clock_ = nullptr;
+};
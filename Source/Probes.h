@@ -0,0 +1,49 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+//==============================================================================
+// Statically defined probes on the way from an OSC packet to the MIDI port,
+// for perf and bpftrace to attach to on a running bridge, e.g.
+//
+//     bpftrace -e 'usdt:./loop4r_leds:loop4r_leds:led_state { @[arg0] = count(); }'
+//
+// Each is a nop in the code plus a note in the ELF file until a tracer arms
+// it, so they cost nothing otherwise. Without systemtap's <sys/sdt.h> (the
+// systemtap-sdt-dev package) or with LOOP4R_NO_PROBES defined they compile
+// to nothing at all.
+#if ! defined(LOOP4R_NO_PROBES) && defined(__has_include)
+ #if __has_include(<sys/sdt.h>)
+  #include <sys/sdt.h>
+  #define LOOP4R_HAS_PROBES 1
+ #endif
+#endif
+
+#ifdef LOOP4R_HAS_PROBES
+ #define LOOP4R_PROBE1(name, a)                 DTRACE_PROBE1(loop4r_leds, name, a)
+ #define LOOP4R_PROBE2(name, a, b)              DTRACE_PROBE2(loop4r_leds, name, a, b)
+ #define LOOP4R_PROBE3(name, a, b, c)           DTRACE_PROBE3(loop4r_leds, name, a, b, c)
+ #define LOOP4R_PROBE4(name, a, b, c, d)        DTRACE_PROBE4(loop4r_leds, name, a, b, c, d)
+#else
+ #define LOOP4R_PROBE1(name, a)
+ #define LOOP4R_PROBE2(name, a, b)
+ #define LOOP4R_PROBE3(name, a, b, c)
+ #define LOOP4R_PROBE4(name, a, b, c, d)
+#endif
@@ -0,0 +1,171 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <alsa/asoundlib.h>
+
+//==============================================================================
+// Lists the rawmidi devices straight from each card's control interface, by
+// the same hw:card,device[,subdevice] names dout and min take, so listing
+// doesn't need juce_audio_devices or the sequencer.
+namespace RawMidiDevices
+{
+    struct Device
+    {
+        String name;
+        String description;
+    };
+
+    // with a device per subdevice when a device has more than one
+    inline Array<Device> list(snd_rawmidi_stream_t stream)
+    {
+        Array<Device> devices;
+        snd_rawmidi_info_t* info = nullptr;
+        if (snd_rawmidi_info_malloc(&info) < 0)
+            return devices;
+
+        int card = -1;
+        while (snd_card_next(&card) == 0 && card >= 0)
+        {
+            snd_ctl_t* ctl = nullptr;
+            String cardName = "hw:" + String(card);
+            if (snd_ctl_open(&ctl, cardName.toRawUTF8(), 0) < 0)
+                continue;
+
+            int device = -1;
+            while (snd_ctl_rawmidi_next_device(ctl, &device) == 0 && device >= 0)
+            {
+                snd_rawmidi_info_set_device(info, (unsigned int)device);
+                snd_rawmidi_info_set_stream(info, stream);
+                snd_rawmidi_info_set_subdevice(info, 0);
+
+                // fails for a device that doesn't go this way
+                if (snd_ctl_rawmidi_info(ctl, info) < 0)
+                    continue;
+
+                String deviceName = cardName + "," + String(device);
+                const int numSubdevices = (int)snd_rawmidi_info_get_subdevices_count(info);
+                if (numSubdevices <= 1)
+                {
+                    devices.add({ deviceName, String(snd_rawmidi_info_get_name(info)) });
+                    continue;
+                }
+
+                for (int sub = 0; sub < numSubdevices; ++sub)
+                {
+                    snd_rawmidi_info_set_subdevice(info, (unsigned int)sub);
+                    if (snd_ctl_rawmidi_info(ctl, info) == 0)
+                        devices.add({ deviceName + "," + String(sub), String(snd_rawmidi_info_get_subdevice_name(info)) });
+                }
+            }
+
+            snd_ctl_close(ctl);
+        }
+
+        snd_rawmidi_info_free(info);
+        return devices;
+    }
+}
+
+//==============================================================================
+// Turns the device names given to dout, dadd and min into hw: names. Anything
+// ALSA parses itself ("hw:1,0", "virtual", ...) passes through; any other
+// name is the first device whose description matches it exactly, or else
+// contains it, irrespective of case. The devices are enumerated once and
+// again only after invalidate(), which hotplug events call, so a reopen
+// retrying a name that matches nothing doesn't go through every card each
+// time. Without hotplug events setRefreshOnMiss() has a miss enumerate again.
+// Safe from any thread.
+class RawMidiResolver
+{
+public:
+    // an empty string if no device matches
+    String resolve(const String& name, snd_rawmidi_stream_t stream)
+    {
+        if (name.containsChar(':') || name == "default" || name == "virtual")
+            return name;
+
+        const ScopedLock sl(lock_);
+        if (! isValid_)
+            refresh();
+
+        String device = find(name, stream);
+        if (device.isEmpty() && refreshOnMiss_)
+        {
+            refresh();
+            device = find(name, stream);
+        }
+        return device;
+    }
+
+    Array<RawMidiDevices::Device> getDevices(snd_rawmidi_stream_t stream)
+    {
+        const ScopedLock sl(lock_);
+        if (! isValid_)
+            refresh();
+        return stream == SND_RAWMIDI_STREAM_INPUT ? inputs_ : outputs_;
+    }
+
+    void invalidate()
+    {
+        const ScopedLock sl(lock_);
+        isValid_ = false;
+    }
+
+    void setRefreshOnMiss(bool refreshOnMiss)
+    {
+        const ScopedLock sl(lock_);
+        refreshOnMiss_ = refreshOnMiss;
+    }
+
+    int getNumRefreshes() const
+    {
+        return numRefreshes_.get();
+    }
+
+private:
+    void refresh()
+    {
+        inputs_ = RawMidiDevices::list(SND_RAWMIDI_STREAM_INPUT);
+        outputs_ = RawMidiDevices::list(SND_RAWMIDI_STREAM_OUTPUT);
+        isValid_ = true;
+        ++numRefreshes_;
+    }
+
+    String find(const String& name, snd_rawmidi_stream_t stream) const
+    {
+        const auto& devices = stream == SND_RAWMIDI_STREAM_INPUT ? inputs_ : outputs_;
+        for (auto& device : devices)
+            if (device.description.equalsIgnoreCase(name))
+                return device.name;
+
+        for (auto& device : devices)
+            if (device.description.containsIgnoreCase(name))
+                return device.name;
+        return {};
+    }
+
+    CriticalSection lock_;
+    Array<RawMidiDevices::Device> inputs_, outputs_;
+    bool isValid_ = false;
+    bool refreshOnMiss_ = true;
+    Atomic<int> numRefreshes_ { 0 };
+};
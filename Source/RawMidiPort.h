@@ -0,0 +1,306 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "MidiSink.h"
+#include "RawMidiDevices.h"
+#include <alsa/asoundlib.h>
+#include <poll.h>
+
+//==============================================================================
+// The rawmidi output port. In non-blocking mode whatever the device does not
+// take right away is kept in a bounded pending queue and retried later, in
+// front of any newer bytes, instead of stalling the caller. The kernel
+// buffer can be made large enough for a full resync to go in at once, and
+// avail_min raised so a writer waiting for room only wakes once a useful
+// amount of it is free. Active sensing is never sent on close, the
+// pedalboard doesn't expect it from us.
+class RawMidiPort : public MidiSink
+{
+public:
+    RawMidiPort(const String& name, RawMidiResolver* resolver = nullptr, int maxPending = 1024)
+        : name_(name),
+          resolver_(resolver),
+          maxPending_(maxPending)
+    {
+        pending_.ensureStorageAllocated(maxPending);
+    }
+
+    ~RawMidiPort()
+    {
+        close();
+    }
+
+    bool open() override
+    {
+        String device = resolver_ != nullptr ? resolver_->resolve(name_, SND_RAWMIDI_STREAM_OUTPUT) : name_;
+        if (device.isEmpty())
+            return false;
+
+        snd_rawmidi_t* handle = nullptr;
+        int err = snd_rawmidi_open(NULL, &handle, device.toRawUTF8(), nonBlocking_ ? SND_RAWMIDI_NONBLOCK : 0);
+        if (err)
+        {
+            return false;
+        }
+
+        applyParams(handle);
+        handle_ = handle;
+        return true;
+    }
+
+    void close() override
+    {
+        snd_rawmidi_t* handle = handle_.exchange(nullptr);
+        if (handle != nullptr)
+            snd_rawmidi_close(handle);
+    }
+
+    bool isOpen() const override
+    {
+        return handle_.get() != nullptr;
+    }
+
+    void setNonBlocking(bool nonBlocking) override
+    {
+        nonBlocking_ = nonBlocking;
+        snd_rawmidi_t* handle = handle_.get();
+        if (handle != nullptr)
+            snd_rawmidi_nonblock(handle, nonBlocking ? 1 : 0);
+    }
+
+    bool isNonBlocking() const
+    {
+        return nonBlocking_;
+    }
+
+    // takes effect right away if the port is open
+    void setBufferParams(const BufferParams& params) override
+    {
+        params_ = params;
+        snd_rawmidi_t* handle = handle_.get();
+        if (handle != nullptr)
+            applyParams(handle);
+    }
+
+    int getBufferSize() const override
+    {
+        return bufferSize_.get();
+    }
+
+    // returns false if any of the bytes were lost
+    bool write(const uint8* data, int size) override
+    {
+        snd_rawmidi_t* handle = currentHandle();
+        if (handle == nullptr)
+        {
+            bytesDropped_ += size;
+            return false;
+        }
+
+        if (! nonBlocking_)
+        {
+            ssize_t wrote = snd_rawmidi_write(handle, data, (size_t)size);
+            if (wrote != (ssize_t)size)
+            {
+                std::cerr << "Could not write " << size << " MIDI bytes (wrote " << (int)wrote << ")" << std::endl;
+                ++shortWrites_;
+                bytesDropped_ += size - jmax(0, (int)wrote);
+                return false;
+            }
+            bytesWritten_ += size;
+            return true;
+        }
+
+        // keep the byte order, anything already waiting goes first
+        if (! pending_.isEmpty())
+        {
+            bool ok = addPending(data, size);
+            writePending();
+            return ok;
+        }
+
+        int wrote = writeSome(handle, data, size);
+        if (wrote < 0)
+        {
+            bytesDropped_ += size;
+            return false;
+        }
+        return addPending(data + wrote, size - wrote);
+    }
+
+    // retries the bytes the device did not take earlier, returns true once
+    // nothing is left pending
+    bool writePending() override
+    {
+        snd_rawmidi_t* handle = currentHandle();
+        if (pending_.isEmpty() || handle == nullptr)
+            return pending_.isEmpty();
+
+        int wrote = writeSome(handle, pending_.begin(), pending_.size());
+        if (wrote < 0)
+        {
+            bytesDropped_ += pending_.size();
+            pending_.clearQuick();
+            return true;
+        }
+        pending_.removeRange(0, wrote);
+        return pending_.isEmpty();
+    }
+
+    bool hasPending() const override
+    {
+        return ! pending_.isEmpty();
+    }
+
+    // the data bytes in front of the first status byte, and the F7 ending a
+    // SysEx, finish a message the device has already taken the start of
+    int dropPending() override
+    {
+        int keep = 0;
+        while (keep < pending_.size() && pending_.getUnchecked(keep) < 0x80)
+            ++keep;
+        if (keep < pending_.size() && pending_.getUnchecked(keep) == 0xf7)
+            ++keep;
+
+        const int numDropped = pending_.size() - keep;
+        pending_.removeLast(numDropped);
+        bytesDropped_ += numDropped;
+        return numDropped;
+    }
+
+    // waits for the device to accept more bytes, returns false on timeout
+    bool waitUntilWritable(int timeoutMs) override
+    {
+        snd_rawmidi_t* handle = handle_.get();
+        if (handle == nullptr)
+            return false;
+
+        struct pollfd fds[4];
+        int count = jmin(4, snd_rawmidi_poll_descriptors_count(handle));
+        count = snd_rawmidi_poll_descriptors(handle, fds, (unsigned int)count);
+        if (count <= 0)
+            return false;
+
+        return poll(fds, (nfds_t)count, timeoutMs) > 0;
+    }
+
+    int getPollHandle() const override
+    {
+        snd_rawmidi_t* handle = handle_.get();
+        struct pollfd fd;
+        if (handle == nullptr || snd_rawmidi_poll_descriptors(handle, &fd, 1) != 1)
+            return -1;
+        return fd.fd;
+    }
+
+    void drain() override
+    {
+        // draining waits for the wire, which is what non-blocking mode avoids
+        snd_rawmidi_t* handle = handle_.get();
+        if (handle != nullptr && ! nonBlocking_)
+            snd_rawmidi_drain(handle);
+    }
+
+private:
+    void applyParams(snd_rawmidi_t* handle)
+    {
+        snd_rawmidi_params_t* params = nullptr;
+        if (snd_rawmidi_params_malloc(&params) < 0)
+            return;
+
+        if (snd_rawmidi_params_current(handle, params) >= 0)
+        {
+            if (params_.size > 0)
+                snd_rawmidi_params_set_buffer_size(handle, params, (size_t)params_.size);
+            if (params_.availMin > 0)
+                snd_rawmidi_params_set_avail_min(handle, params, (size_t)params_.availMin);
+            snd_rawmidi_params_set_no_active_sensing(handle, params, 1);
+            if (snd_rawmidi_params(handle, params) < 0)
+                std::cerr << "Could not set the rawmidi buffer of " << name_ << " to " << params_.size
+                          << " bytes, waking at " << params_.availMin << std::endl;
+
+            // what the driver made of it
+            snd_rawmidi_params_current(handle, params);
+            bufferSize_ = (int)snd_rawmidi_params_get_buffer_size(params);
+        }
+        snd_rawmidi_params_free(params);
+    }
+
+    // bytes left over for a port that has since been replaced are lost, this
+    // is done by the writing thread so it alone touches the pending queue
+    snd_rawmidi_t* currentHandle()
+    {
+        snd_rawmidi_t* handle = handle_.get();
+        if (handle != pendingFor_)
+        {
+            bytesDropped_ += pending_.size();
+            pending_.clearQuick();
+            pendingFor_ = handle;
+        }
+        return handle;
+    }
+
+    // returns how many bytes the device took, or -1 on a real error
+    int writeSome(snd_rawmidi_t* handle, const uint8* data, int size)
+    {
+        ssize_t wrote = snd_rawmidi_write(handle, data, (size_t)size);
+        if (wrote == -EAGAIN)
+        {
+            wrote = 0;
+        }
+        else if (wrote < 0)
+        {
+            std::cerr << "Could not write " << size << " MIDI bytes: " << snd_strerror((int)wrote) << std::endl;
+            ++shortWrites_;
+            return -1;
+        }
+
+        bytesWritten_ += (int64)wrote;
+        if (wrote < size)
+            ++shortWrites_;
+        return (int)wrote;
+    }
+
+    bool addPending(const uint8* data, int size)
+    {
+        if (size <= 0)
+            return true;
+
+        if (pending_.size() + size > maxPending_)
+        {
+            bytesDropped_ += size;
+            return false;
+        }
+
+        pending_.addArray(data, size);
+        bytesDeferred_ += size;
+        return true;
+    }
+
+    String name_;
+    RawMidiResolver* resolver_;
+    Atomic<snd_rawmidi_t*> handle_ { nullptr };
+    snd_rawmidi_t* pendingFor_ = nullptr;
+    bool nonBlocking_ = false;
+    BufferParams params_;
+    Atomic<int> bufferSize_ { 0 };
+    int maxPending_;
+    Array<uint8> pending_;
+};
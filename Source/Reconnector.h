@@ -0,0 +1,104 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// When to retry a connection that keeps failing: right away after it is
+// lost, then after a delay that doubles with every failure up to a cap, with
+// up to a quarter of it randomised either way so that several clients don't
+// retry in lockstep. Only worth-logging failures are reported, the first one
+// and then each time the number of failures reaches a power of two.
+class Reconnector
+{
+public:
+    enum State
+    {
+        Disconnected,       // try at the next chance
+        WaitingToRetry,     // failed, try again at nextAttemptMs_
+        Connected
+    };
+
+    Reconnector(int initialDelayMs = 200, int maxDelayMs = 10000)
+        : initialDelayMs_(initialDelayMs),
+          maxDelayMs_(maxDelayMs)
+    {
+    }
+
+    State getState() const
+    {
+        return state_;
+    }
+
+    bool isConnected() const
+    {
+        return state_ == Connected;
+    }
+
+    bool shouldAttempt(double nowMs) const
+    {
+        return state_ == Disconnected || (state_ == WaitingToRetry && nowMs >= nextAttemptMs_);
+    }
+
+    void connected()
+    {
+        state_ = Connected;
+        failures_ = 0;
+    }
+
+    // the connection went away, the next attempt isn't delayed
+    void lost()
+    {
+        state_ = Disconnected;
+        failures_ = 0;
+    }
+
+    // returns true if this failure should be logged
+    bool failed(double nowMs)
+    {
+        ++failures_;
+        int shift = jmin(failures_ - 1, 16);
+        double delayMs = jmin((double)maxDelayMs_, (double)initialDelayMs_ * (double)(1 << shift));
+        delayMs *= 0.75 + 0.5 * random_.nextDouble();
+
+        state_ = WaitingToRetry;
+        nextAttemptMs_ = nowMs + delayMs;
+        return isPowerOfTwo(failures_);
+    }
+
+    int getFailures() const
+    {
+        return failures_;
+    }
+
+    // until the next attempt, for logging
+    int getDelayMs(double nowMs) const
+    {
+        return state_ == WaitingToRetry ? jmax(0, roundToInt(nextAttemptMs_ - nowMs)) : 0;
+    }
+
+private:
+    int initialDelayMs_;
+    int maxDelayMs_;
+    State state_ = Disconnected;
+    int failures_ = 0;
+    double nextAttemptMs_ = 0.0;
+    Random random_;
+};
@@ -0,0 +1,114 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "LatencyHistogram.h"
+
+//==============================================================================
+// How long the pedals were wrong: from the OSC link being found lost, or a
+// looper turning up as a different instance with its /pingack, until the
+// pedalboard again shows the state the looper has, with the MIDI bytes and
+// OSC packets that took. A recovery starting while one is under way is
+// folded into it, from the first start on, and only ends once every looper
+// either of them concerns has sent all its state and that has been flushed.
+// Only touched with stateLock_ held.
+class RecoveryMeter
+{
+public:
+    enum Cause
+    {
+        LinkLost,
+        EngineChange,
+        numCauses
+    };
+
+    static const char* getName(int cause)
+    {
+        static const char* const names[numCauses] = { "link_lost", "engine_change" };
+        return names[cause];
+    }
+
+    // engines is a bit per looper, by its index
+    void begin(Cause cause, uint32 engines, double nowMs, int64 midiBytes, int64 oscPackets)
+    {
+        if (! isRecovering())
+        {
+            startMs_ = nowMs;
+            cause_ = cause;
+            midiBytesAtStart_ = midiBytes;
+            oscPacketsAtStart_ = oscPackets;
+        }
+        engines_ |= engines;
+    }
+
+    bool isRecovering() const
+    {
+        return startMs_ > 0.0;
+    }
+
+    // the loopers that still have to be in sync for it to end
+    uint32 getEngines() const
+    {
+        return engines_;
+    }
+
+    // what was flushed matches the loopers' state, returns true if that
+    // ended a recovery
+    bool consistent(double nowMs, int64 midiBytes, int64 oscPackets)
+    {
+        if (! isRecovering())
+            return false;
+
+        lastMs_ = nowMs - startMs_;
+        lastMidiBytes_ = midiBytes - midiBytesAtStart_;
+        lastOscPackets_ = oscPackets - oscPacketsAtStart_;
+        histogram_.record(lastMs_);
+        ++counts_[cause_];
+        midiBytes_ += lastMidiBytes_;
+        oscPackets_ += lastOscPackets_;
+        startMs_ = 0.0;
+        engines_ = 0;
+        return true;
+    }
+
+    const LatencyHistogram& getHistogram() const    { return histogram_; }
+    Cause getLastCause() const                      { return cause_; }
+    double getLastMs() const                        { return lastMs_; }
+    int64 getLastMidiBytes() const                  { return lastMidiBytes_; }
+    int64 getLastOscPackets() const                 { return lastOscPackets_; }
+    int64 getCount(int cause) const                 { return counts_[cause]; }
+    int64 getMidiBytes() const                      { return midiBytes_; }
+    int64 getOscPackets() const                     { return oscPackets_; }
+
+private:
+    LatencyHistogram histogram_ { "recovery" };
+    double startMs_ = 0.0;
+    Cause cause_ = LinkLost;
+    uint32 engines_ = 0;
+    int64 midiBytesAtStart_ = 0;
+    int64 oscPacketsAtStart_ = 0;
+
+    double lastMs_ = 0.0;
+    int64 lastMidiBytes_ = 0;
+    int64 lastOscPackets_ = 0;
+    int64 counts_[numCauses] = {};
+    int64 midiBytes_ = 0;
+    int64 oscPackets_ = 0;
+};
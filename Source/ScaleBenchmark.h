@@ -0,0 +1,356 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "OscInput.h"
+#include "OscOutput.h"
+#include "OscPacket.h"
+#include "LedCore.h"
+#include "LatencyHistogram.h"
+#include "ThreadCpu.h"
+
+//==============================================================================
+// How the bridge scales past one looper and one FCB1010: up to 64 engines
+// of 16 loops each send /led traffic over UDP loopback, each to a port of
+// its own, into receivers sharded over those ports the way the bridge
+// shards them, and from there into 8 boards of 128 LEDs with a writer
+// thread each on a null sink. The engines are added in doublings; every
+// step reports the updates a second that made it, the latency from the
+// send to the board's writer having the bytes, what was lost on the way,
+// and what each core and each thread was busy with meanwhile. The senders
+// run in the same process, on threads of their own that are reported apart.
+class ScaleBenchmark : private OscInput::Listener
+{
+public:
+    static const int maxEngines = 64;
+    static const int loopsPerEngine = 16;
+    static const int numBoards = 8;
+    static const int ledsPerBoard = maxEngines * loopsPerEngine / numBoards;
+    static const int numReceivers = 4;
+    static const int numSenders = 8;
+
+    ScaleBenchmark(int firstPort = 9960)
+        : firstPort_(firstPort)
+    {
+        for (int board = 0; board < numBoards; ++board)
+            core_.addBoard("null", board * ledsPerBoard)->startWriter(ThreadTuning(), nullptr);
+        core_.open();
+
+        pendingUs_.ensureStorageAllocated(batchSize);
+        for (int receiver = 0; receiver < numReceivers; ++receiver)
+        {
+            receivers_.add(new OscInput(*this));
+            receivers_.getLast()->setBatchSize(batchSize);
+        }
+    }
+
+    ~ScaleBenchmark()
+    {
+        for (auto* receiver : receivers_)
+            receiver->disconnect();
+    }
+
+    // rate /led messages a second from each engine, for seconds at each
+    // number of engines, the results as JSON
+    String run(int rate, int seconds)
+    {
+        rate_ = jlimit(1, 10000, rate);
+        seconds = jmax(1, seconds);
+
+        var steps;
+        if (! connect())
+        {
+            auto* root = new DynamicObject();
+            root->setProperty("error", "could not connect");
+            return JSON::toString(var(root));
+        }
+
+        startMs_ = Time::getMillisecondCounterHiRes();
+        OwnedArray<Sender> senders;
+        for (int i = 0; i < numSenders; ++i)
+        {
+            senders.add(new Sender(*this, i * maxEngines / numSenders, (i + 1) * maxEngines / numSenders));
+            senders.getLast()->startThread();
+        }
+
+        for (int engines = 1; engines <= maxEngines; engines *= 2)
+            steps.append(measure(engines, seconds));
+
+        for (auto* sender : senders)
+            sender->stopThread(1000);
+        for (auto* receiver : receivers_)
+            receiver->disconnect();
+
+        auto* root = new DynamicObject();
+        root->setProperty("version", ProjectInfo::versionString);
+        root->setProperty("rate_per_engine", rate_);
+        root->setProperty("loops_per_engine", loopsPerEngine);
+        root->setProperty("boards", numBoards);
+        root->setProperty("receivers", numReceivers);
+        root->setProperty("seconds_per_step", seconds);
+        root->setProperty("steps", steps);
+        return JSON::toString(var(root));
+    }
+
+private:
+    static const int batchSize = 32;
+
+    // receiver r listens on the r-th share of the engines' ports, each
+    // packet's source being its engine
+    bool connect()
+    {
+        for (int receiver = 0; receiver < numReceivers; ++receiver)
+        {
+            const int first = receiver * maxEngines / numReceivers;
+            const int end = (receiver + 1) * maxEngines / numReceivers;
+            Array<int> ports;
+            for (int engine = first; engine < end; ++engine)
+                ports.add(firstPort_ + engine);
+
+            receivers_[receiver]->setFirstSource(first);
+            if (! receivers_[receiver]->connect(ports))
+                return false;
+        }
+
+        for (int engine = 0; engine < maxEngines; ++engine)
+            if (! outputs_.add(new OscOutput())->connect("127.0.0.1", firstPort_ + engine))
+                return false;
+        return true;
+    }
+
+    // sends for a share of the engines, the ones below activeEngines_
+    struct Sender : public Thread
+    {
+        Sender(ScaleBenchmark& owner, int first, int end)
+            : Thread("loop4r sbnch tx"),
+              owner_(owner),
+              first_(first),
+              end_(end)
+        {
+        }
+
+        void run() override
+        {
+            MemoryOutputStream packet;
+            LedBits on[maxEngines / numSenders];
+            const double intervalMs = 1000.0 / owner_.rate_;
+            double nextMs = Time::getMillisecondCounterHiRes();
+            for (int tick = 0; ! threadShouldExit(); ++tick)
+            {
+                const int end = jmin(end_, owner_.activeEngines_.get());
+                for (int engine = first_; engine < end; ++engine)
+                {
+                    // every loop in turn, each changing every time
+                    const int loop = (tick + engine) % loopsPerEngine;
+                    LedBits& engineOn = on[engine - first_];
+                    engineOn.set(loop, ! engineOn.test(loop));
+
+                    packet.reset();
+                    OscPacket::encode(packet, "/led", (int32)loop, (int32)(engineOn.test(loop) ? 1 : 0), (int32)0, (int32)0,
+                                      (int32)owner_.elapsedUs());
+                    if (owner_.outputs_[engine]->send(packet.getData(), packet.getDataSize()))
+                        ++owner_.sent_;
+                    else
+                        ++owner_.sendFailures_;
+                }
+
+                nextMs += intervalMs;
+                const double now = Time::getMillisecondCounterHiRes();
+                if (nextMs > now)
+                    Thread::sleep((int)(nextMs - now));
+            }
+        }
+
+        ScaleBenchmark& owner_;
+        int first_, end_;
+    };
+
+    var measure(int engines, int seconds)
+    {
+        const ScopedLock sl(lock_);
+        sent_ = 0;
+        sendFailures_ = 0;
+        received_ = 0;
+        latency_.reset();
+        for (auto* board : core_.getBoards())
+            board->getShadow().invalidate();
+
+        const CpuTimes before = readCpuTimes();
+        const int64 bytesBefore = getBytesWritten();
+        double sendingMs;
+        {
+            const ScopedUnlock su(lock_);
+            activeEngines_ = engines;
+            Thread::sleep(seconds * 1000);
+            activeEngines_ = 0;
+            sendingMs = Time::getMillisecondCounterHiRes() - before.wallMs;
+
+            // what is still on the way
+            Thread::sleep(200);
+        }
+        const CpuTimes after = readCpuTimes();
+
+        auto* result = new DynamicObject();
+        const double elapsedMs = after.wallMs - before.wallMs;
+        result->setProperty("engines", engines);
+        result->setProperty("leds", engines * loopsPerEngine);
+        result->setProperty("sent", sent_.get());
+        result->setProperty("received", received_.get());
+        result->setProperty("lost", sent_.get() - received_.get());
+        result->setProperty("send_failures", sendFailures_.get());
+        result->setProperty("updates_per_s", (double)received_.get() * 1000.0 / jmax(0.001, sendingMs));
+        result->setProperty("midi_bytes", getBytesWritten() - bytesBefore);
+        result->setProperty("p50_us", latency_.getPercentile(0.5));
+        result->setProperty("p99_us", latency_.getPercentile(0.99));
+        result->setProperty("max_us", latency_.getMax());
+
+        var cores;
+        for (int core = 0; core < jmin(before.busy.size(), after.busy.size()); ++core)
+        {
+            const int64 total = after.total[core] - before.total[core];
+            cores.append(total > 0 ? 100.0 * (double)(after.busy[core] - before.busy[core]) / (double)total : 0.0);
+        }
+        result->setProperty("core_busy_percent", cores);
+
+        // the bridge's side and the senders' apart
+        auto* threads = new DynamicObject();
+        int64 bridgeUs = 0, senderUs = 0;
+        for (auto& thread : after.threads)
+        {
+            const int64 us = thread.cpuUs - before.threadUs(thread.name);
+            if (thread.name.startsWith("sbnch tx"))
+                senderUs += us;
+            else
+                bridgeUs += us;
+            if (us > 0)
+                threads->setProperty(thread.name, 100.0 * (double)us / (elapsedMs * 1000.0));
+        }
+        result->setProperty("bridge_cpu_percent", 100.0 * (double)bridgeUs / (elapsedMs * 1000.0));
+        result->setProperty("sender_cpu_percent", 100.0 * (double)senderUs / (elapsedMs * 1000.0));
+        result->setProperty("thread_cpu_percent", var(threads));
+        return var(result);
+    }
+
+    struct CpuTimes
+    {
+        double wallMs = 0.0;
+        Array<int64> busy, total;           // per core, in clock ticks
+        Array<ThreadCpu::Usage> threads;
+
+        int64 threadUs(const String& name) const
+        {
+            for (auto& thread : threads)
+                if (thread.name == name)
+                    return thread.cpuUs;
+            return 0;
+        }
+    };
+
+    // the cpuN lines of /proc/stat: user nice system idle iowait irq
+    // softirq steal, with idle and iowait not busy
+    static CpuTimes readCpuTimes()
+    {
+        CpuTimes times;
+        times.wallMs = Time::getMillisecondCounterHiRes();
+
+        StringArray lines;
+        lines.addLines(File("/proc/stat").loadFileAsString());
+        for (auto& line : lines)
+        {
+            if (! line.startsWith("cpu") || ! CharacterFunctions::isDigit(line[3]))
+                continue;
+
+            StringArray fields;
+            fields.addTokens(line, " ", "");
+            fields.removeEmptyStrings();
+            int64 total = 0, idle = 0;
+            for (int i = 1; i < jmin(9, fields.size()); ++i)
+            {
+                const int64 value = fields[i].getLargeIntValue();
+                total += value;
+                if (i == 4 || i == 5)
+                    idle += value;
+            }
+            times.busy.add(total - idle);
+            times.total.add(total);
+        }
+
+        ThreadCpu::forEachThread([&times] (const ThreadCpu::Usage& usage) { times.threads.add(usage); });
+        return times;
+    }
+
+    int64 getBytesWritten()
+    {
+        int64 bytes = 0;
+        for (auto* board : core_.getBoards())
+            bytes += board->getSink().getBytesWritten();
+        return bytes;
+    }
+
+    int32 elapsedUs() const
+    {
+        return (int32)((Time::getMillisecondCounterHiRes() - startMs_) * 1000.0);
+    }
+
+    // on any of the receiver threads, which take turns at the boards as
+    // they do at the bridge's state
+    void oscPacketsReceived(const OscInput::Packet* packets, int numPackets) override
+    {
+        const ScopedLock sl(lock_);
+        uint32 touched = 0;
+        LedEvent event;
+        pendingUs_.clearQuick();
+        for (int i = 0; i < numPackets; ++i)
+        {
+            if (! OscPacket::decodeLedEvent(packets[i].data, packets[i].size, event) || event.type != LedEvent::SequencedLed
+                || ! isPositiveAndBelow(packets[i].source, maxEngines) || ! isPositiveAndBelow(event.args[0], loopsPerEngine))
+                continue;
+
+            const int led = packets[i].source * loopsPerEngine + event.args[0];
+            const int board = led / ledsPerBoard;
+            core_.getBoards()[board]->getShadow().setLed((uint8)(led % ledsPerBoard), event.args[1] != 0);
+            touched |= (uint32)1 << board;
+            pendingUs_.add(event.args[4]);
+        }
+
+        for (int board = 0; board < numBoards; ++board)
+            if ((touched >> board) & 1)
+                core_.getBoards()[board]->flush(packets[0].receivedMs);
+
+        const double doneUs = (Time::getMillisecondCounterHiRes() - startMs_) * 1000.0;
+        for (auto us : pendingUs_)
+            latency_.record((doneUs - (double)us) / 1000.0);
+        received_ += pendingUs_.size();
+    }
+
+    int firstPort_;
+    int rate_ = 100;
+    double startMs_ = 0.0;
+    LedCore core_;
+    OwnedArray<OscInput> receivers_;
+    OwnedArray<OscOutput> outputs_;
+    CriticalSection lock_;
+    Array<int32> pendingUs_;
+    Atomic<int> activeEngines_ { 0 };
+    Atomic<int64> sent_ { 0 };
+    Atomic<int64> sendFailures_ { 0 };
+    Atomic<int64> received_ { 0 };
+    LatencyHistogram latency_ { "scale" };
+};
@@ -0,0 +1,319 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "MidiSink.h"
+#include "ThreadTuning.h"
+#include <sys/timerfd.h>
+#include <time.h>
+
+//==============================================================================
+// Gives a sink without a queue of its own, such as a rawmidi port, one in
+// user space: bytes written with a delay wait in a binary heap ordered by
+// their deadline on CLOCK_MONOTONIC, in ns, and a thread sleeping on a
+// timerfd armed for the earliest writes them when due. The events come from
+// a pool allocated up front and queueing one is O(log n), so neither the
+// number queued nor the time between them degrades the timing. Writes from
+// that thread and everyone else's are kept apart by a lock of our own.
+class ScheduledMidiSink : public MidiSink,
+                          private Thread
+{
+public:
+    ScheduledMidiSink(MidiSink* sink, const ThreadTuning& tuning)
+        : Thread("loop4r sched"),
+          sink_(sink),
+          tuning_(tuning)
+    {
+        for (int i = 0; i < capacity; ++i)
+            free_[i] = capacity - 1 - i;
+        numFree_ = capacity;
+    }
+
+    ~ScheduledMidiSink()
+    {
+        signalThreadShouldExit();
+        if (fd_ >= 0)
+            arm(1);     // wakes the thread up to see it should exit
+        stopThread(2000);
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    bool open() override
+    {
+        const ScopedLock sl(writeLock_);
+        return sink_->open();
+    }
+
+    // whatever is still queued goes, as it would with a queue in the device
+    void close() override
+    {
+        cancelScheduled(-1);
+        const ScopedLock sl(writeLock_);
+        sink_->close();
+        updateCounters();
+    }
+
+    bool isOpen() const override                    { return sink_->isOpen(); }
+
+    bool write(const uint8* data, int size) override
+    {
+        const ScopedLock sl(writeLock_);
+        bool ok = sink_->write(data, size);
+        updateCounters();
+        return ok;
+    }
+
+    bool writePending() override
+    {
+        const ScopedLock sl(writeLock_);
+        bool ok = sink_->writePending();
+        updateCounters();
+        return ok;
+    }
+
+    bool hasPending() const override                { return sink_->hasPending(); }
+
+    int dropPending() override
+    {
+        const ScopedLock sl(writeLock_);
+        int numDropped = sink_->dropPending();
+        updateCounters();
+        return numDropped;
+    }
+
+    bool waitUntilWritable(int timeoutMs) override  { return sink_->waitUntilWritable(timeoutMs); }
+    void drain() override                           { const ScopedLock sl(writeLock_); sink_->drain(); }
+    int getPollHandle() const override              { return sink_->getPollHandle(); }
+    void setNonBlocking(bool nonBlocking) override  { const ScopedLock sl(writeLock_); sink_->setNonBlocking(nonBlocking); }
+    void setBufferParams(const BufferParams& params) override { const ScopedLock sl(writeLock_); sink_->setBufferParams(params); }
+    int getBufferSize() const override              { return sink_->getBufferSize(); }
+
+    bool canSchedule() const override
+    {
+        return isOpen();
+    }
+
+    // bytes that don't fit into one event are split over several due at the
+    // same time, which the sequence numbers keep in order
+    bool writeScheduled(const uint8* data, int size, double delayMs, int tag) override
+    {
+        if (delayMs <= 0.0)
+            return write(data, size);
+
+        if (! startThreadIfNeeded())
+        {
+            dropQueued(size);
+            return false;
+        }
+
+        const int64 dueNs = now() + (int64)(delayMs * 1000000.0);
+        const ScopedLock sl(queueLock_);
+        if (numFree_ < (size + maxEventSize - 1) / maxEventSize)
+        {
+            dropQueued(size);
+            return false;
+        }
+
+        for (int pos = 0; pos < size; pos += maxEventSize)
+        {
+            int index = free_[--numFree_];
+            Event& event = events_[index];
+            event.dueNs = dueNs;
+            event.sequence = nextSequence_++;
+            event.tag = tag;
+            event.size = jmin(maxEventSize, size - pos);
+            memcpy(event.data, data + pos, (size_t)event.size);
+            push(index);
+        }
+
+        if (events_[heap_[0]].dueNs == dueNs)
+            arm(dueNs);
+        return true;
+    }
+
+    void cancelScheduled(int tag) override
+    {
+        const ScopedLock sl(queueLock_);
+        int kept = 0;
+        for (int i = 0; i < heapSize_; ++i)
+        {
+            if (tag < 0 || events_[heap_[i]].tag == tag)
+                free_[numFree_++] = heap_[i];
+            else
+                heap_[kept++] = heap_[i];
+        }
+
+        heapSize_ = kept;
+        for (int i = heapSize_ / 2 - 1; i >= 0; --i)
+            siftDown(i);
+        arm(heapSize_ > 0 ? events_[heap_[0]].dueNs : 0);
+    }
+
+private:
+    static const int capacity = 1024;
+    static const int maxEventSize = 32;
+
+    struct Event
+    {
+        int64 dueNs;
+        uint32 sequence;
+        int tag;
+        int size;
+        uint8 data[maxEventSize];
+    };
+
+    void run() override
+    {
+        if (! tuning_.applyToCurrentThread())
+            std::cerr << "Could not set SCHED_FIFO priority " << tuning_.realtimePriority << " for the MIDI scheduler" << std::endl;
+
+        while (! threadShouldExit())
+        {
+            uint64 expirations;
+            if (::read(fd_, &expirations, sizeof(expirations)) < 0 || threadShouldExit())
+                continue;
+
+            // everything due goes out in one write, in order
+            int size = 0;
+            {
+                const ScopedLock sl(queueLock_);
+                const int64 nowNs = now();
+                while (heapSize_ > 0 && events_[heap_[0]].dueNs <= nowNs)
+                {
+                    int index = pop();
+                    memcpy(output_ + size, events_[index].data, (size_t)events_[index].size);
+                    size += events_[index].size;
+                    free_[numFree_++] = index;
+                }
+                arm(heapSize_ > 0 ? events_[heap_[0]].dueNs : 0);
+            }
+
+            if (size > 0)
+                write(output_, size);
+        }
+    }
+
+    bool startThreadIfNeeded()
+    {
+        const ScopedLock sl(queueLock_);
+        if (fd_ < 0)
+        {
+            fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+            if (fd_ < 0)
+                return false;
+            startThread();
+        }
+        return true;
+    }
+
+    // no room in the queue, or no thread to empty it
+    void dropQueued(int size)
+    {
+        queueDropped_ += size;
+        bytesDropped_ += size;
+    }
+
+    // the sink does the counting, our counters only mirror it
+    void updateCounters()
+    {
+        bytesWritten_ = sink_->getBytesWritten();
+        bytesDeferred_ = sink_->getBytesDeferred();
+        bytesDropped_ = sink_->getBytesDropped() + queueDropped_.get();
+        shortWrites_ = sink_->getShortWrites();
+    }
+
+    bool isEarlier(int a, int b) const
+    {
+        const Event& x = events_[a];
+        const Event& y = events_[b];
+        return x.dueNs < y.dueNs || (x.dueNs == y.dueNs && (int32)(x.sequence - y.sequence) < 0);
+    }
+
+    void push(int index)
+    {
+        int i = heapSize_++;
+        heap_[i] = index;
+        while (i > 0 && isEarlier(heap_[i], heap_[(i - 1) / 2]))
+        {
+            std::swap(heap_[i], heap_[(i - 1) / 2]);
+            i = (i - 1) / 2;
+        }
+    }
+
+    int pop()
+    {
+        int top = heap_[0];
+        heap_[0] = heap_[--heapSize_];
+        siftDown(0);
+        return top;
+    }
+
+    void siftDown(int i)
+    {
+        for (;;)
+        {
+            int earliest = i;
+            for (int child = 2 * i + 1; child <= 2 * i + 2 && child < heapSize_; ++child)
+                if (isEarlier(heap_[child], heap_[earliest]))
+                    earliest = child;
+
+            if (earliest == i)
+                return;
+            std::swap(heap_[i], heap_[earliest]);
+            i = earliest;
+        }
+    }
+
+    static int64 now()
+    {
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return (int64)time.tv_sec * 1000000000 + time.tv_nsec;
+    }
+
+    // an absolute deadline, 0 disarms
+    void arm(int64 dueNs)
+    {
+        if (fd_ < 0)
+            return;
+
+        itimerspec spec;
+        zerostruct(spec);
+        spec.it_value.tv_sec = (time_t)(dueNs / 1000000000);
+        spec.it_value.tv_nsec = (long)(dueNs % 1000000000);
+        timerfd_settime(fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    std::unique_ptr<MidiSink> sink_;
+    ThreadTuning tuning_;
+    CriticalSection writeLock_;
+    CriticalSection queueLock_;
+
+    Event events_[capacity];
+    int heap_[capacity];
+    int heapSize_ = 0;
+    int free_[capacity];
+    int numFree_ = 0;
+    uint32 nextSequence_ = 0;
+    uint8 output_[capacity * maxEventSize];     // only touched by our thread
+    int fd_ = -1;
+    Atomic<int64> queueDropped_ { 0 };
+};
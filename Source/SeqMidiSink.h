@@ -0,0 +1,215 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "MidiSink.h"
+#include <alsa/asoundlib.h>
+
+//==============================================================================
+// Sends through the ALSA sequencer from a port of our own, connected to the
+// destination given as "client:port" (or a client name). Unlike rawmidi this
+// shares the device with other sequencer clients such as loop4r_read, and
+// events can be queued in the kernel to go out at a given time, so their
+// timing doesn't depend on when one of our threads wakes up. Events are
+// buffered in the client and handed to the kernel with one drain per write,
+// or for scheduled writes one per commitScheduled(), so a full resync or a
+// tick's worth of toggles is a single transition into the kernel.
+class SeqMidiSink : public MidiSink
+{
+public:
+    SeqMidiSink(const String& destination)
+        : destination_(destination)
+    {
+    }
+
+    ~SeqMidiSink()
+    {
+        close();
+    }
+
+    bool open() override
+    {
+        close();
+
+        snd_seq_t* seq = nullptr;
+        if (snd_seq_open(&seq, "default", SND_SEQ_OPEN_OUTPUT, 0) < 0)
+            return false;
+
+        snd_seq_set_client_name(seq, "loop4r_leds");
+        port_ = snd_seq_create_simple_port(seq, "loop4r_leds out",
+                                           SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+                                           SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+
+        snd_seq_addr_t address;
+        if (port_ < 0
+            || snd_seq_parse_address(seq, &address, destination_.toRawUTF8()) < 0
+            || snd_seq_connect_to(seq, port_, address.client, address.port) < 0
+            || snd_midi_event_new(256, &encoder_) < 0)
+        {
+            snd_seq_close(seq);
+            return false;
+        }
+
+        // without a queue everything still goes out directly
+        queue_ = snd_seq_alloc_named_queue(seq, "loop4r_leds");
+        if (queue_ >= 0)
+        {
+            snd_seq_start_queue(seq, queue_, nullptr);
+            snd_seq_drain_output(seq);
+        }
+
+        seq_ = seq;
+        return true;
+    }
+
+    void close() override
+    {
+        // closing the client frees its queue and whatever is still in it
+        snd_seq_t* seq = seq_.exchange(nullptr);
+        if (seq != nullptr)
+            snd_seq_close(seq);
+        queue_ = -1;
+
+        if (encoder_ != nullptr)
+        {
+            snd_midi_event_free(encoder_);
+            encoder_ = nullptr;
+        }
+    }
+
+    bool isOpen() const override
+    {
+        return seq_.get() != nullptr;
+    }
+
+    bool write(const uint8* data, int size) override
+    {
+        return output(data, size, -1.0, 0) && drainOutput();
+    }
+
+    bool canSchedule() const override
+    {
+        return isOpen() && queue_ >= 0;
+    }
+
+    bool writeScheduled(const uint8* data, int size, double delayMs, int tag) override
+    {
+        if (! output(data, size, queue_ >= 0 ? jmax(0.0, delayMs) : -1.0, tag))
+            return false;
+        undrained_ = true;
+        return true;
+    }
+
+    void commitScheduled() override
+    {
+        if (undrained_)
+            drainOutput();
+    }
+
+    void cancelScheduled(int tag) override
+    {
+        snd_seq_t* seq = seq_.get();
+        snd_seq_remove_events_t* remove = nullptr;
+        if (seq == nullptr || queue_ < 0 || snd_seq_remove_events_malloc(&remove) < 0)
+            return;
+
+        unsigned int condition = SND_SEQ_REMOVE_OUTPUT;
+        if (tag >= 0)
+        {
+            condition |= SND_SEQ_REMOVE_TAG_MATCH;
+            snd_seq_remove_events_set_tag(remove, tag);
+        }
+
+        commitScheduled();
+        snd_seq_remove_events_set_condition(remove, condition);
+        snd_seq_remove_events_set_queue(remove, queue_);
+        snd_seq_remove_events(seq, remove);
+        snd_seq_remove_events_free(remove);
+    }
+
+private:
+    // a negative delay sends the events directly, bypassing the queue
+    bool output(const uint8* data, int size, double delayMs, int tag)
+    {
+        snd_seq_t* seq = seq_.get();
+        if (seq == nullptr)
+        {
+            bytesDropped_ += size;
+            return false;
+        }
+
+        // the encoder turns the byte stream, running status included, back
+        // into sequencer events
+        for (int i = 0; i < size; ++i)
+        {
+            snd_seq_event_t event;
+            if (snd_midi_event_encode_byte(encoder_, data[i], &event) != 1)
+                continue;
+
+            prepareEvent(event, delayMs, tag);
+            if (snd_seq_event_output(seq, &event) < 0)
+            {
+                ++shortWrites_;
+                bytesDropped_ += size - i;
+                return false;
+            }
+        }
+
+        bytesWritten_ += size;
+        return true;
+    }
+
+    bool drainOutput()
+    {
+        undrained_ = false;
+        snd_seq_t* seq = seq_.get();
+        if (seq == nullptr || snd_seq_drain_output(seq) >= 0)
+            return true;
+
+        ++shortWrites_;
+        return false;
+    }
+
+    // from our port to its subscribers, right away or delayMs from now on
+    // the queue's real time clock
+    void prepareEvent(snd_seq_event_t& event, double delayMs, int tag)
+    {
+        snd_seq_ev_set_source(&event, port_);
+        snd_seq_ev_set_subs(&event);
+        if (delayMs < 0.0)
+        {
+            snd_seq_ev_set_direct(&event);
+            return;
+        }
+
+        int64 ns = (int64)(delayMs * 1000000.0);
+        snd_seq_real_time_t time;
+        time.tv_sec = (unsigned int)(ns / 1000000000);
+        time.tv_nsec = (unsigned int)(ns % 1000000000);
+        snd_seq_ev_schedule_real(&event, queue_, 1, &time);
+        event.tag = (unsigned char)tag;
+    }
+
+    String destination_;
+    Atomic<snd_seq_t*> seq_ { nullptr };
+    snd_midi_event_t* encoder_ = nullptr;
+    int port_ = -1;
+    int queue_ = -1;
+    bool undrained_ = false;
+};
@@ -0,0 +1,137 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// A compiled session file is the magic below, the fingerprint of the command
+// table it was compiled against (uint32) and the number of commands (uint32),
+// followed by one record per command: its index in the table (uint16), the
+// number of options (uint8) and each option as a length (uint16) and its
+// UTF-8 bytes, all little endian. Loading it skips the tokenizing and the
+// command lookups of a program file.
+static const char SESSION_FILE_MAGIC[8] = { 'L', '4', 'R', 'S', 'E', 'S', '0', '1' };
+
+//==============================================================================
+class SessionWriter
+{
+public:
+    void add(int command, const StringArray& options)
+    {
+        records_.writeShort((short)command);
+        records_.writeByte((char)jmin(255, options.size()));
+        for (int i = 0; i < jmin(255, options.size()); ++i)
+        {
+            const char* utf8 = options[i].toRawUTF8();
+            int length = jmin(65535, (int)strlen(utf8));
+            records_.writeShort((short)length);
+            records_.write(utf8, (size_t)length);
+        }
+        ++count_;
+    }
+
+    bool writeTo(const File& file, uint32 fingerprint) const
+    {
+        file.deleteFile();
+        FileOutputStream out(file);
+        return out.openedOk()
+            && out.write(SESSION_FILE_MAGIC, sizeof(SESSION_FILE_MAGIC))
+            && out.writeInt((int)fingerprint)
+            && out.writeInt(count_)
+            && out.write(records_.getData(), records_.getDataSize());
+    }
+
+    int size() const
+    {
+        return count_;
+    }
+
+private:
+    MemoryOutputStream records_;
+    int count_ = 0;
+};
+
+//==============================================================================
+// Walks the commands of a compiled session file, mapped into memory rather
+// than read, staying inside the mapping whatever the file holds
+class SessionReader
+{
+public:
+    static bool isSessionFile(const File& file)
+    {
+        char magic[sizeof(SESSION_FILE_MAGIC)];
+        FileInputStream in(file);
+        return in.openedOk() && in.read(magic, sizeof(magic)) == (int)sizeof(magic)
+            && memcmp(magic, SESSION_FILE_MAGIC, sizeof(magic)) == 0;
+    }
+
+    // fails for a file compiled against another command table
+    bool open(const File& file, uint32 fingerprint)
+    {
+        map_.reset(new MemoryMappedFile(file, MemoryMappedFile::readOnly));
+        data_ = (const uint8*)map_->getData();
+        size_ = (int)map_->getSize();
+        pos_ = (int)sizeof(SESSION_FILE_MAGIC) + 8;
+        if (data_ == nullptr || size_ < pos_ || memcmp(data_, SESSION_FILE_MAGIC, sizeof(SESSION_FILE_MAGIC)) != 0
+            || ByteOrder::littleEndianInt(data_ + sizeof(SESSION_FILE_MAGIC)) != fingerprint)
+        {
+            map_ = nullptr;
+            data_ = nullptr;
+            return false;
+        }
+
+        remaining_ = (int)ByteOrder::littleEndianInt(data_ + sizeof(SESSION_FILE_MAGIC) + 4);
+        return true;
+    }
+
+    // false at the end, or at a record cut short
+    bool next(int& command, StringArray& options)
+    {
+        if (data_ == nullptr || remaining_ <= 0 || size_ - pos_ < 3)
+            return false;
+
+        command = ByteOrder::littleEndianShort(data_ + pos_);
+        int numOptions = data_[pos_ + 2];
+        pos_ += 3;
+
+        options.clearQuick();
+        for (int i = 0; i < numOptions; ++i)
+        {
+            if (size_ - pos_ < 2)
+                return false;
+            int length = ByteOrder::littleEndianShort(data_ + pos_);
+            if (size_ - pos_ - 2 < length)
+                return false;
+            options.add(String::fromUTF8((const char*)data_ + pos_ + 2, length));
+            pos_ += 2 + length;
+        }
+
+        --remaining_;
+        return true;
+    }
+
+private:
+    std::unique_ptr<MemoryMappedFile> map_;
+    const uint8* data_ = nullptr;
+    int size_ = 0;
+    int pos_ = 0;
+    int remaining_ = 0;
+};
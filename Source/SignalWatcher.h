@@ -0,0 +1,80 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <functional>
+#include <pthread.h>
+#include <signal.h>
+
+//==============================================================================
+// Takes a signal such as SIGHUP on a thread of its own and calls back there,
+// so nothing has to be done from a signal handler. The signal is blocked in
+// the thread calling block() and every thread it starts afterwards, so
+// block() has to come before any other thread is started.
+class SignalWatcher : private Thread
+{
+public:
+    typedef std::function<void(int signal)> Callback;
+
+    SignalWatcher(Callback callback)
+        : Thread("loop4r signals"),
+          callback_(callback)
+    {
+        sigemptyset(&signals_);
+    }
+
+    ~SignalWatcher()
+    {
+        stop();
+    }
+
+    bool block(int signal)
+    {
+        sigaddset(&signals_, signal);
+        return pthread_sigmask(SIG_BLOCK, &signals_, nullptr) == 0;
+    }
+
+    void start()
+    {
+        startThread();
+    }
+
+    void stop()
+    {
+        stopThread(1000);
+    }
+
+private:
+    void run() override
+    {
+        // waking now and then to see whether to stop
+        const timespec timeout = { 0, 250 * 1000000 };
+        while (! threadShouldExit())
+        {
+            int signal = sigtimedwait(&signals_, nullptr, &timeout);
+            if (signal > 0)
+                callback_(signal);
+        }
+    }
+
+    Callback callback_;
+    sigset_t signals_;
+};
@@ -0,0 +1,126 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <malloc.h>
+
+//==============================================================================
+// For soak runs: one line of comma separated values per interval with what
+// would show a leak or a slow drift, the resident size and heap, the sizes
+// of the lists that only ever grow, how deep the queues got and the
+// latencies of the interval, and on close a line comparing the last sample
+// with the first.
+class SoakReport
+{
+public:
+    struct Sample
+    {
+        double seconds = 0.0;
+        int64 rssKb = 0;
+        int64 heapKb = 0;           // in use on the heap, mmapped blocks included
+        int64 allocations = 0;      // handling OSC during the interval
+        int filterCommands = 0;
+        int predictions = 0;
+        int bundlesPending = 0;
+        int writerQueued = 0;       // bytes, all boards
+        int batchPeak = 0;          // the largest batch of packets handled
+        int64 totalP50Us = 0;
+        int64 totalP99Us = 0;
+        int64 dispatchP99Us = 0;
+    };
+
+    bool open(const File& file, double intervalMs)
+    {
+        file.deleteFile();
+        out_.reset(new FileOutputStream(file));
+        if (out_->failedToOpen()
+            || ! out_->writeText("s,rss_kb,heap_kb,allocs,filters,predictions,bundles,writer_bytes,batch_peak,"
+                                 "total_p50_us,total_p99_us,dispatch_p99_us\n", false, false))
+        {
+            out_ = nullptr;
+            return false;
+        }
+
+        intervalMs_ = jmax(1000.0, intervalMs);
+        numSamples_ = 0;
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return out_ != nullptr;
+    }
+
+    double getIntervalMs() const
+    {
+        return intervalMs_;
+    }
+
+    void write(const Sample& sample)
+    {
+        if (numSamples_++ == 0)
+            first_ = sample;
+        last_ = sample;
+
+        *out_ << String(sample.seconds, 1) << ',' << sample.rssKb << ',' << sample.heapKb << ','
+              << sample.allocations << ',' << sample.filterCommands << ',' << sample.predictions << ','
+              << sample.bundlesPending << ',' << sample.writerQueued << ',' << sample.batchPeak << ','
+              << sample.totalP50Us << ',' << sample.totalP99Us << ',' << sample.dispatchP99Us << '\n';
+        out_->flush();
+    }
+
+    // what changed between the first sample and the last, empty without two
+    String close()
+    {
+        out_ = nullptr;
+        if (numSamples_ < 2)
+            return {};
+
+        return "Soak: " + String(numSamples_) + " samples over " + String(last_.seconds - first_.seconds, 0) + " s"
+            + ", rss " + signedDelta(last_.rssKb - first_.rssKb) + " kB"
+            + ", heap " + signedDelta(last_.heapKb - first_.heapKb) + " kB"
+            + ", filters " + signedDelta(last_.filterCommands - first_.filterCommands)
+            + ", predictions " + signedDelta(last_.predictions - first_.predictions)
+            + ", total p99 " + String(first_.totalP99Us) + " -> " + String(last_.totalP99Us) + " us";
+    }
+
+    static int64 getHeapKb()
+    {
+       #if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+        struct mallinfo2 info = mallinfo2();
+        return (int64)((info.uordblks + info.hblkhd) / 1024);
+       #else
+        struct mallinfo info = mallinfo();
+        return ((int64)(unsigned int)info.uordblks + (int64)(unsigned int)info.hblkhd) / 1024;
+       #endif
+    }
+
+private:
+    static String signedDelta(int64 delta)
+    {
+        return (delta >= 0 ? "+" : "") + String(delta);
+    }
+
+    std::unique_ptr<FileOutputStream> out_;
+    double intervalMs_ = 10000.0;
+    int numSamples_ = 0;
+    Sample first_, last_;
+};
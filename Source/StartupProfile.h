@@ -0,0 +1,121 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <time.h>
+#include <unistd.h>
+
+//==============================================================================
+// When each step of starting up was first reached, from the kernel starting
+// the process to the first write of the pedalboard's LEDs as the looper has
+// them. Times are kept on CLOCK_BOOTTIME, which counts from power on, so the
+// report also says how long after boot the pedalboard was right. The process
+// start comes from /proc/self/stat in clock ticks, 10 ms on most kernels.
+// Each phase is marked once, from whichever thread gets there first.
+class StartupProfile
+{
+public:
+    enum Phase
+    {
+        ProcessStart,
+        Initialise,         // JUCE and the message manager are up
+        Parameters,         // the command line applied
+        MidiOpen,           // a board's port is open
+        OscConnected,       // the sockets to and from the loopers
+        FirstPingAck,       // a looper answered
+        LooperState,        // and sent what its LEDs show
+        FirstFrame,         // which went out to the pedalboard
+        numPhases
+    };
+
+    StartupProfile()
+    {
+        marks_[ProcessStart] = readProcessStartUs();
+    }
+
+    static const char* getName(int phase)
+    {
+        static const char* const names[numPhases] = { "process", "initialise", "parameters", "midi_open",
+                                                      "osc_connected", "first_pingack", "looper_state", "first_frame" };
+        return names[phase];
+    }
+
+    // returns true the first time the phase is reached
+    bool mark(Phase phase)
+    {
+        return marks_[phase].compareAndSetBool(nowUs(), 0);
+    }
+
+    bool isMarked(Phase phase) const
+    {
+        return marks_[phase].get() != 0;
+    }
+
+    // ms since the process started, -1 until the phase is reached
+    int64 getMsSinceStart(int phase) const
+    {
+        const int64 us = marks_[phase].get();
+        return us != 0 ? (us - marks_[ProcessStart].get()) / 1000 : -1;
+    }
+
+    // each phase reached, after boot and after the one before
+    String getReport() const
+    {
+        String report = "Startup: process started " + String(marks_[ProcessStart].get() / 1000) + " ms after boot";
+        int64 lastUs = marks_[ProcessStart].get();
+        for (int phase = Initialise; phase < numPhases; ++phase)
+        {
+            const int64 us = marks_[phase].get();
+            if (us == 0)
+                continue;
+            report << ", " << getName(phase) << " +" << String((us - lastUs) / 1000) << " ms";
+            lastUs = us;
+        }
+        if (isMarked(FirstFrame))
+            report << ", right " << String(marks_[FirstFrame].get() / 1000) << " ms after boot";
+        return report;
+    }
+
+private:
+    static int64 nowUs()
+    {
+        timespec time;
+        clock_gettime(CLOCK_BOOTTIME, &time);
+        return jmax((int64)1, (int64)time.tv_sec * 1000000 + time.tv_nsec / 1000);
+    }
+
+    // field 22 of /proc/self/stat, after the command name in parentheses,
+    // which may hold spaces itself
+    static int64 readProcessStartUs()
+    {
+        String stat = File("/proc/self/stat").loadFileAsString();
+        StringArray fields;
+        fields.addTokens(stat.fromLastOccurrenceOf(")", false, false), " ", "");
+        fields.removeEmptyStrings();
+        // the state is field 3, the first after the name
+        if (fields.size() < 20)
+            return nowUs();
+        const int64 ticks = fields[19].getLargeIntValue();
+        return jmax((int64)1, ticks * 1000000 / jmax((int64)1, (int64)sysconf(_SC_CLK_TCK)));
+    }
+
+    Atomic<int64> marks_[numPhases];
+};
@@ -0,0 +1,137 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <atomic>
+
+//==============================================================================
+// Counters bumped on the hot paths of several threads at once. Each thread
+// gets a block of all of them to itself, aligned to a cache line, and only
+// ever writes its own with a plain load and store instead of a locked add,
+// so counting never bounces a line between cores. Reading sums the blocks
+// and is for the stats, not the hot path. A thread keeps its block for
+// good, so its counts outlive it; once they are all taken the threads after
+// share the last one, adding atomically.
+template <int numCounters>
+class StatCounters
+{
+public:
+    static const int maxBlocks = 32;
+
+    StatCounters()
+        : id_(++nextId())
+    {
+        // operator new before C++17 doesn't honour alignas
+        storage_.calloc(sizeof(Block) * maxBlocks + cacheLine);
+        blocks_ = reinterpret_cast<Block*>(((pointer_sized_int)storage_.getData() + cacheLine - 1) & ~(pointer_sized_int)(cacheLine - 1));
+        for (int i = 0; i < maxBlocks; ++i)
+            new (blocks_ + i) Block();
+    }
+
+    struct Counter
+    {
+        void operator++()               { owner.add(index, 1); }
+        void operator+= (int64 amount)  { owner.add(index, amount); }
+        int64 get() const               { return owner.get(index); }
+
+        StatCounters& owner;
+        int index;
+    };
+
+    Counter operator[] (int counter)    { return { *this, counter }; }
+
+    void add(int counter, int64 amount)
+    {
+        const int block = getBlock();
+        std::atomic<int64>& value = blocks_[block].values[counter];
+        if (block == maxBlocks - 1)
+            value.fetch_add(amount, std::memory_order_relaxed);
+        else
+            value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    int64 get(int counter) const
+    {
+        int64 sum = 0;
+        const int numBlocks = jmin(numBlocks_.load(std::memory_order_acquire), maxBlocks);
+        for (int i = 0; i < numBlocks; ++i)
+            sum += blocks_[i].values[counter].load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    // the threads that have counted so far
+    int getNumThreads() const
+    {
+        return numBlocks_.load(std::memory_order_relaxed);
+    }
+
+private:
+    static const int cacheLine = 64;
+
+    struct Block
+    {
+        Block()
+        {
+            for (auto& value : values)
+                value.store(0, std::memory_order_relaxed);
+        }
+
+        std::atomic<int64> values[numCounters];
+        char padding[cacheLine - (numCounters * sizeof(int64)) % cacheLine];
+    };
+
+    static std::atomic<uint32>& nextId()
+    {
+        static std::atomic<uint32> id { 0 };
+        return id;
+    }
+
+    // the blocks a thread has in the last few sets of counters it used,
+    // by their ids; an id is never reused, so one of a set since deleted
+    // can't be mistaken for a new one
+    int getBlock()
+    {
+        struct Claim
+        {
+            uint32 id;
+            int block;
+        };
+        static thread_local Claim claims[4] = {};
+        static thread_local int nextClaim = 0;
+
+        for (auto& claim : claims)
+            if (claim.id == id_)
+                return claim.block;
+
+        Claim& claim = claims[nextClaim];
+        nextClaim = (nextClaim + 1) % (int)numElementsInArray(claims);
+        claim.id = id_;
+        claim.block = jmin(numBlocks_.fetch_add(1, std::memory_order_acq_rel), maxBlocks - 1);
+        return claim.block;
+    }
+
+    const uint32 id_;
+    HeapBlock<char> storage_;
+    Block* blocks_;
+    std::atomic<int> numBlocks_ { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE (StatCounters)
+};
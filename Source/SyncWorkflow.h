@@ -0,0 +1,149 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "LatencyHistogram.h"
+
+//==============================================================================
+// The steps from greeting a looper to showing its state, as a state machine
+// the heartbeat tick drives: the /pingack ping goes out on connecting, and
+// once it is answered the registration and the state request go out
+// together. A step that isn't over by its timeout is sent again, the timeout
+// doubling each time, until it has been tried maxAttempts times. A lost link
+// or a looper switched under us cancels the run, the next greeting begins
+// another. How long each step took goes into a histogram of its own.
+class SyncWorkflow
+{
+public:
+    enum Step
+    {
+        Idle,
+        Greeting,       // waiting for the /pingack
+        Syncing,        // waiting for the display, which comes last
+        Ready
+    };
+
+    enum Action
+    {
+        Nothing,
+        ResendGreeting,
+        ResendStateRequest,
+        GiveUp
+    };
+
+    // the greeting was sent
+    void begin(double nowMs)
+    {
+        cancel();
+        beganMs_ = nowMs;
+        enter(Greeting, nowMs);
+    }
+
+    // the /pingack came back, with the state asked for unless there is none
+    // to wait for
+    void greeted(double nowMs, bool awaitingState)
+    {
+        if (step_ == Greeting)
+            greeting.record(nowMs - stepMs_);
+        else if (step_ != Syncing)
+            beganMs_ = nowMs;   // unasked for, a looper that came up by itself
+
+        if (awaitingState)
+            enter(Syncing, nowMs);
+        else
+            finish(nowMs);
+    }
+
+    // the display ending the state arrived
+    void synced(double nowMs)
+    {
+        if (step_ != Syncing)
+            return;
+
+        syncing.record(nowMs - stepMs_);
+        finish(nowMs);
+    }
+
+    void cancel()
+    {
+        if (step_ == Greeting || step_ == Syncing)
+            ++cancels_;
+        step_ = Idle;
+    }
+
+    Action poll(double nowMs)
+    {
+        if ((step_ != Greeting && step_ != Syncing) || nowMs < getNextPollMs())
+            return Nothing;
+
+        if (attempts_ >= maxAttempts)
+        {
+            ++giveUps_;
+            step_ = Idle;
+            return GiveUp;
+        }
+
+        ++attempts_;
+        attemptMs_ = nowMs;
+        return step_ == Greeting ? ResendGreeting : ResendStateRequest;
+    }
+
+    // when the current attempt times out, or never
+    double getNextPollMs() const
+    {
+        if (step_ != Greeting && step_ != Syncing)
+            return std::numeric_limits<double>::max();
+        return attemptMs_ + (double)stepTimeoutMs * (1 << jmin(attempts_ - 1, 16));
+    }
+
+    Step getStep() const                { return step_; }
+    int getMaxAttempts() const          { return maxAttempts; }
+    int64 getCancels() const            { return cancels_; }
+    int64 getGiveUps() const            { return giveUps_; }
+
+    LatencyHistogram greeting { "sync_greeting" };  // ping to /pingack
+    LatencyHistogram syncing { "sync_state" };      // state asked for to the display
+    LatencyHistogram total { "sync" };              // greeting to ready
+
+private:
+    void enter(Step step, double nowMs)
+    {
+        step_ = step;
+        stepMs_ = nowMs;
+        attemptMs_ = nowMs;
+        attempts_ = 1;
+    }
+
+    void finish(double nowMs)
+    {
+        total.record(nowMs - beganMs_);
+        step_ = Ready;
+    }
+
+    static const int stepTimeoutMs = 250;
+    static const int maxAttempts = 4;
+    Step step_ = Idle;
+    double beganMs_ = 0.0;
+    double stepMs_ = 0.0;
+    double attemptMs_ = 0.0;
+    int attempts_ = 0;
+    int64 cancels_ = 0;
+    int64 giveUps_ = 0;
+};
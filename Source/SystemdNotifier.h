@@ -0,0 +1,145 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "UnixDatagram.h"
+#include <functional>
+#include <stddef.h>
+#include <stdlib.h>
+
+//==============================================================================
+// Tells systemd when the bridge is ready and, if the unit has WatchdogSec=,
+// keeps feeding its watchdog from a thread of its own for as long as the
+// health check passes. A check that fails, or can't get an answer because
+// the bridge is stuck, stops the pings and systemd restarts us once the
+// watchdog runs out. Speaks the sd_notify() protocol itself, a datagram to
+// $NOTIFY_SOCKET, so there is no libsystemd to link; without the variable,
+// i.e. not under systemd, it does nothing.
+class SystemdNotifier : private Thread
+{
+public:
+    // returns false and says why in problem when the bridge isn't healthy
+    typedef std::function<bool(String& problem)> HealthCheck;
+
+    SystemdNotifier()
+        : Thread("loop4r watchdog")
+    {
+    }
+
+    ~SystemdNotifier()
+    {
+        stop();
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    static bool isUnderSystemd()
+    {
+        return getenv("NOTIFY_SOCKET") != nullptr;
+    }
+
+    // "READY=1", "STOPPING=1", "STATUS=..." and so on
+    bool notify(const String& state)
+    {
+        const ScopedLock sl(lock_);
+        const char* socketPath = getenv("NOTIFY_SOCKET");
+        if (socketPath == nullptr)
+            return false;
+
+        sockaddr_un address;
+        if (! UnixDatagram::makeAddress(socketPath, address))
+            return false;
+
+        // a leading @ is an abstract socket, named without the @ and any null
+        socklen_t length = sizeof(address);
+        if (address.sun_path[0] == '@')
+        {
+            address.sun_path[0] = 0;
+            length = (socklen_t)(offsetof(sockaddr_un, sun_path) + strlen(socketPath));
+        }
+
+        if (fd_ < 0)
+            fd_ = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        return fd_ >= 0
+            && ::sendto(fd_, state.toRawUTF8(), (size_t)state.getNumBytesAsUTF8(), MSG_NOSIGNAL, (sockaddr*)&address, length) >= 0;
+    }
+
+    // pings at half the watchdog's interval; false if systemd wants none
+    bool startWatchdog(HealthCheck check)
+    {
+        const char* usec = getenv("WATCHDOG_USEC");
+        const char* pid = getenv("WATCHDOG_PID");
+        if (usec == nullptr || (pid != nullptr && String(pid).getIntValue() != (int)getpid()))
+            return false;
+
+        intervalMs_ = jmax(1, (int)(String(usec).getLargeIntValue() / 2000));
+        check_ = check;
+        startThread();
+        return true;
+    }
+
+    void stop()
+    {
+        signalThreadShouldExit();
+        notifyThread();
+        stopThread(1000);
+    }
+
+    int64 getPings() const              { return pings_.get(); }
+    int64 getMissedPings() const        { return missed_.get(); }
+
+private:
+    void notifyThread()
+    {
+        Thread::notify();
+    }
+
+    void run() override
+    {
+        String shownProblem;
+        while (! threadShouldExit())
+        {
+            wait(intervalMs_);
+            if (threadShouldExit())
+                break;
+
+            String problem;
+            if (check_(problem))
+            {
+                notify("WATCHDOG=1");
+                ++pings_;
+            }
+            else
+                ++missed_;
+
+            // systemctl status shows why the pings stopped
+            if (problem != shownProblem)
+                notify("STATUS=" + (problem.isEmpty() ? String("running") : problem));
+            shownProblem = problem;
+        }
+    }
+
+    CriticalSection lock_;
+    int fd_ = -1;
+    int intervalMs_ = 0;
+    HealthCheck check_;
+    Atomic<int64> pings_ { 0 };
+    Atomic<int64> missed_ { 0 };
+};
@@ -0,0 +1,107 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// Follows the loop position and cycle length that SooperLooper reports through
+// its auto updates, and predicts where in the cycle the loop will be at any
+// moment so blinking can be phase locked to it. The prediction is ahead by the
+// configured output latency plus the measured time it takes us to get a
+// toggle out of the door.
+class TempoSync
+{
+public:
+    void setOutputLatencyMs(double ms)
+    {
+        outputLatencyMs_ = jmax(0.0, ms);
+    }
+
+    void setCycleLength(float seconds)
+    {
+        cycleLength_ = seconds;
+    }
+
+    void setLoopPosition(float seconds, double receivedMs)
+    {
+        loopPosition_ = seconds;
+        positionMs_ = receivedMs;
+    }
+
+    // feeds the time from a blink tick firing to its MIDI being written
+    void addMeasuredLatency(double ms)
+    {
+        measuredLatencyMs_ += (ms - measuredLatencyMs_) * 0.1;
+    }
+
+    // positions older than this are not trusted for prediction
+    bool isLocked(double nowMs) const
+    {
+        return cycleLength_ > 0.0f && positionMs_ > 0.0 && nowMs - positionMs_ < 2000.0;
+    }
+
+    float getCycleLength() const
+    {
+        return cycleLength_;
+    }
+
+    // where the loop is at nowMs in seconds, as last reported and moved on
+    double getLoopPosition(double nowMs) const
+    {
+        return loopPosition_ + (nowMs - positionMs_) / 1000.0;
+    }
+
+    // 0..1 position within the cycle the pedalboard will be showing when a
+    // toggle written at nowMs lands
+    double getCyclePhase(double nowMs) const
+    {
+        double at = nowMs + outputLatencyMs_ + measuredLatencyMs_;
+        double position = loopPosition_ + (at - positionMs_) / 1000.0;
+        double phase = std::fmod(position, (double)cycleLength_) / cycleLength_;
+        return phase < 0.0 ? phase + 1.0 : phase;
+    }
+
+    // Blink is lit for the first half of each cycle, FastBlink for the first
+    // half of each half cycle
+    bool isLit(bool fast, double nowMs) const
+    {
+        double phase = getCyclePhase(nowMs);
+        if (fast)
+            phase = std::fmod(phase * 2.0, 1.0);
+        return phase < 0.5;
+    }
+
+    // how long from nowMs until isLit() changes, for scheduling the toggle
+    double getMsUntilFlip(bool fast, double nowMs) const
+    {
+        double blinkMs = cycleLength_ * (fast ? 500.0 : 1000.0);
+        double phase = getCyclePhase(nowMs);
+        if (fast)
+            phase = std::fmod(phase * 2.0, 1.0);
+        return (0.5 - std::fmod(phase, 0.5)) * blinkMs;
+    }
+
+private:
+    float cycleLength_ = 0.0f;
+    float loopPosition_ = 0.0f;
+    double positionMs_ = 0.0;
+    double outputLatencyMs_ = 0.0;
+    double measuredLatencyMs_ = 0.0;
+};
@@ -0,0 +1,111 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <functional>
+#include <time.h>
+#include <unistd.h>
+
+//==============================================================================
+// What each of the bridge's threads has cost so far, for budgeting cores on a
+// Pi shared with JACK. The threads are found in /proc/self/task, by the
+// names JUCE gave them without the "loop4r " in front; the main thread,
+// which runs the message loop, is "message". The kernel refuses names of
+// more than 15 characters, so ours are kept shorter than that. CPU time is read from each thread's CLOCK_THREAD_CPUTIME_ID,
+// which a thread can only ask for itself, so through the clock id the
+// kernel derives from the thread id, as pthread_getcpuclockid() does. The
+// context switches come from the thread's status file. Only for reporting:
+// it reads a few files per thread.
+namespace ThreadCpu
+{
+    struct Usage
+    {
+        String name;
+        int64 cpuUs = 0;
+        int64 voluntarySwitches = 0;
+        int64 involuntarySwitches = 0;
+    };
+
+    typedef std::function<void(const Usage& usage)> Callback;
+
+    // the kernel's MAKE_THREAD_CPUCLOCK(tid, CPUCLOCK_SCHED)
+    inline clockid_t cpuClockFor(int tid)
+    {
+        return (clockid_t)((~(unsigned int)tid) << 3) | 6;
+    }
+
+    inline String nameFor(int tid, const File& task)
+    {
+        if (tid == (int)getpid())
+            return "message";
+
+        String name = task.getChildFile("comm").loadFileAsString().trim();
+        if (name.startsWith("loop4r "))
+            name = name.substring(7);
+        return name.isEmpty() ? String(tid) : name;
+    }
+
+    inline int64 readSwitches(const StringArray& status, const char* field)
+    {
+        for (auto& line : status)
+            if (line.startsWith(field))
+                return line.fromFirstOccurrenceOf(":", false, false).trim().getLargeIntValue();
+        return 0;
+    }
+
+    // threads of the same name get " 2", " 3" and so on after the first
+    inline void forEachThread(Callback callback)
+    {
+        Array<File> tasks;
+        File("/proc/self/task").findChildFiles(tasks, File::findDirectories, false);
+
+        Array<int> tids;
+        for (auto& task : tasks)
+            tids.add(task.getFileName().getIntValue());
+        tids.sort();
+
+        StringArray seen;
+        for (int tid : tids)
+        {
+            const File task = File("/proc/self/task").getChildFile(String(tid));
+            timespec time;
+            if (clock_gettime(cpuClockFor(tid), &time) != 0)
+                continue;   // already gone
+
+            Usage usage;
+            usage.name = nameFor(tid, task);
+            int same = 1;
+            for (auto& name : seen)
+                if (name == usage.name)
+                    ++same;
+            seen.add(usage.name);
+            if (same > 1)
+                usage.name << " " << same;
+
+            StringArray status;
+            status.addLines(task.getChildFile("status").loadFileAsString());
+            usage.cpuUs = (int64)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+            usage.voluntarySwitches = readSwitches(status, "voluntary_ctxt_switches");
+            usage.involuntarySwitches = readSwitches(status, "nonvoluntary_ctxt_switches");
+            callback(usage);
+        }
+    }
+}
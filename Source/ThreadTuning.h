@@ -0,0 +1,82 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <pthread.h>
+#include <sched.h>
+
+//==============================================================================
+// Which cores one of the bridge's threads may run on and whether it runs
+// SCHED_FIFO, so it can be kept off the cores JACK uses. The thread applies it
+// to itself when it starts. The affinity goes through JUCE. The priority is
+// set directly, because Thread::setPriority() only gives SCHED_RR on Linux.
+struct ThreadTuning
+{
+    int realtimePriority = 0;       // 0 keeps the normal scheduler
+    uint32 affinityMask = 0;        // 0 for any core
+
+    bool isEmpty() const
+    {
+        return realtimePriority <= 0 && affinityMask == 0;
+    }
+
+    // returns false if we weren't permitted the priority, e.g. without
+    // CAP_SYS_NICE or an rtprio limit
+    bool applyToCurrentThread() const
+    {
+        if (affinityMask != 0)
+            Thread::setCurrentThreadAffinityMask(affinityMask);
+
+        if (realtimePriority <= 0)
+            return true;
+
+        sched_param param;
+        param.sched_priority = jlimit(sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO), realtimePriority);
+        return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+    }
+
+    // the nth core set in a mask, wrapping around, for threads that each
+    // want one of them; 0 for an empty mask
+    static uint32 nthCore(uint32 mask, int n)
+    {
+        int numCores = __builtin_popcount(mask);
+        if (numCores == 0)
+            return 0;
+
+        for (int skip = n % numCores; ; mask &= mask - 1)
+            if (skip-- == 0)
+                return mask & ~(mask - 1);
+    }
+
+    // "3", "2-3" or "0,2-3" as a mask, 0 if no core in 0..31 is named
+    static uint32 parseCores(const String& cores)
+    {
+        uint32 mask = 0;
+        for (auto& range : StringArray::fromTokens(cores, ",", ""))
+        {
+            int first = range.upToFirstOccurrenceOf("-", false, false).getIntValue();
+            int last = range.containsChar('-') ? range.fromFirstOccurrenceOf("-", false, false).getIntValue() : first;
+            for (int core = jmax(0, first); core <= jmin(31, last); ++core)
+                mask |= (uint32)1 << core;
+        }
+        return mask;
+    }
+};
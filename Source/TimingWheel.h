@@ -0,0 +1,231 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// Deadlines in microsecond ticks on a hierarchical timing wheel: four levels
+// of 256 slots, each slot of a level spanning a whole turn of the one below,
+// so anything up to 2^32 ticks (over an hour) ahead is filed in constant
+// time. When time reaches a slot of an upper level its deadlines cascade
+// down to where they now belong; level 0 holds those due within 256 ticks,
+// one slot per tick. Finding the next instant anything happens only looks
+// at a bitmap of occupied slots per level, so one wakeup serves every
+// deadline that falls on it however many there are. Entries are the
+// caller's ids, linked through an array grown by add(). Not thread safe.
+class TimingWheel
+{
+public:
+    static const int64 noDeadline = -1;
+
+    TimingWheel()
+    {
+        reset(0);
+    }
+
+    // the wheel starts at tick, nothing scheduled
+    void reset(int64 tick)
+    {
+        current_ = tick;
+        for (auto& node : nodes_)
+            node.slot = -1;
+        for (auto& head : heads_)
+            head = -1;
+        zerostruct(occupied_);
+    }
+
+    // a new entry, not scheduled, returning its id
+    int add()
+    {
+        nodes_.add(Node());
+        return nodes_.size() - 1;
+    }
+
+    int64 getCurrentTick() const        { return current_; }
+
+    bool isScheduled(int id) const
+    {
+        return isPositiveAndBelow(id, nodes_.size()) && nodes_.getReference(id).slot >= 0;
+    }
+
+    // files the entry for tick, at once if it is already due
+    void schedule(int id, int64 tick)
+    {
+        if (! isPositiveAndBelow(id, nodes_.size()))
+            return;
+
+        cancel(id);
+        nodes_.getReference(id).tick = tick;
+        file(id);
+    }
+
+    void cancel(int id)
+    {
+        if (! isPositiveAndBelow(id, nodes_.size()) || nodes_.getReference(id).slot < 0)
+            return;
+
+        auto& node = nodes_.getReference(id);
+        if (node.prev >= 0)
+            nodes_.getReference(node.prev).next = node.next;
+        else
+            heads_[node.slot] = node.next;
+        if (node.next >= 0)
+            nodes_.getReference(node.next).prev = node.prev;
+        if (heads_[node.slot] < 0)
+            occupied_[node.slot >> 6] &= ~((uint64)1 << (node.slot & 63));
+        node.slot = -1;
+    }
+
+    // the next tick at which a deadline falls due or a slot cascades, or
+    // noDeadline with nothing scheduled
+    int64 getNextTick() const
+    {
+        int64 next = noDeadline;
+        for (int level = 0; level < numLevels; ++level)
+        {
+            const int shift = level * slotBits;
+            const int index = (int)((current_ >> shift) & slotMask);
+
+            // the first occupied slot from the current one on, or failing
+            // that the first one of the next turn
+            int slot = findOccupied(level, level == 0 ? index : index + 1);
+            bool nextTurn = false;
+            if (slot < 0)
+            {
+                slot = findOccupied(level, 0);
+                nextTurn = true;
+            }
+            if (slot < 0)
+                continue;
+
+            int64 start = (((current_ >> shift) & ~(int64)slotMask) | slot) << shift;
+            if (nextTurn)
+                start += (int64)numSlots << shift;
+            if (level == 0 && start < current_)
+                start = current_;
+            if (next == noDeadline || start < next)
+                next = start;
+        }
+        return next;
+    }
+
+    // moves on to tick, calling expired(id) for every entry due until then
+    // in the order they fall due, unscheduled before the call; the callback
+    // may schedule entries again
+    template <typename Callback>
+    void advance(int64 tick, Callback&& expired)
+    {
+        for (;;)
+        {
+            const int64 next = getNextTick();
+            if (next == noDeadline || next > tick)
+                break;
+
+            current_ = next;
+
+            // from the top, so what comes down lands in the slots below
+            // before they are looked at
+            for (int level = numLevels; --level > 0;)
+            {
+                const int shift = level * slotBits;
+                if ((current_ & (((int64)1 << shift) - 1)) == 0)
+                    cascade(level * numSlots + (int)((current_ >> shift) & slotMask));
+            }
+
+            const int slot = (int)(current_ & slotMask);
+            while (heads_[slot] >= 0)
+            {
+                const int id = heads_[slot];
+                cancel(id);
+                expired(id);
+            }
+        }
+
+        if (tick > current_)
+            current_ = tick;
+    }
+
+private:
+    static const int numLevels = 4;
+    static const int slotBits = 8;
+    static const int numSlots = 1 << slotBits;
+    static const int slotMask = numSlots - 1;
+
+    struct Node
+    {
+        int64 tick = 0;
+        int slot = -1;      // -1 when not scheduled
+        int prev = -1;
+        int next = -1;
+    };
+
+    // the level is the one whose slots are as wide as the distance to go,
+    // past the top one the entry waits in the furthest slot and is filed
+    // again when that comes round
+    void file(int id)
+    {
+        auto& node = nodes_.getReference(id);
+        const int64 delta = jlimit((int64)0, ((int64)1 << (numLevels * slotBits)) - 1, node.tick - current_);
+        const int64 tick = current_ + delta;
+
+        int level = 0;
+        while (level < numLevels - 1 && delta >= ((int64)numSlots << (level * slotBits)))
+            ++level;
+
+        const int slot = level * numSlots + (int)((tick >> (level * slotBits)) & slotMask);
+        node.slot = slot;
+        node.prev = -1;
+        node.next = heads_[slot];
+        if (node.next >= 0)
+            nodes_.getReference(node.next).prev = id;
+        heads_[slot] = id;
+        occupied_[slot >> 6] |= (uint64)1 << (slot & 63);
+    }
+
+    void cascade(int slot)
+    {
+        while (heads_[slot] >= 0)
+        {
+            const int id = heads_[slot];
+            cancel(id);
+            file(id);
+        }
+    }
+
+    // the first occupied slot of a level from index on, or -1
+    int findOccupied(int level, int index) const
+    {
+        for (int slot = index; slot < numSlots;)
+        {
+            const int bit = level * numSlots + slot;
+            const uint64 word = occupied_[bit >> 6] >> (bit & 63);
+            if (word != 0)
+                return slot + __builtin_ctzll(word);
+            slot = (slot | 63) + 1;
+        }
+        return -1;
+    }
+
+    Array<Node> nodes_;
+    int heads_[numLevels * numSlots];
+    uint64 occupied_[numLevels * numSlots / 64];
+    int64 current_ = 0;
+};
@@ -0,0 +1,205 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//==============================================================================
+// Spans on the way from a datagram to the MIDI port, for looking at a burst
+// in Perfetto or chrome://tracing. Each thread records into a ring of its
+// own, allocated the first time it records, so recording takes no lock and
+// costs a clock read and a few stores; until enable() it is a single load.
+// toJson() can run on any thread while the others go on recording, a span
+// overwritten meanwhile is left out.
+class TraceSpans
+{
+public:
+    static void enable(int spansPerThread)
+    {
+        auto& spans = get();
+        if (spans.enabled_.get() != 0)
+            return;
+
+        spans.capacity_ = jmax(1024, spansPerThread);
+        spans.enabled_ = 1;
+    }
+
+    static bool isEnabled()
+    {
+        return get().enabled_.get() != 0;
+    }
+
+    // on the Time::getMillisecondCounterHiRes() clock, name a literal
+    static void record(const char* name, double startMs, double endMs)
+    {
+        auto& spans = get();
+        if (spans.enabled_.get() == 0)
+            return;
+
+        Buffer* buffer = spans.getThreadBuffer();
+        if (buffer == nullptr)
+            return;
+
+        uint32 pos = buffer->written.get();
+        buffer->spans[pos % (uint32)buffer->capacity] = { name, startMs, endMs };
+        buffer->written = pos + 1;
+    }
+
+    // records from construction to destruction, nothing for a null name
+    struct Scope
+    {
+        Scope(const char* name)
+            : name_(name),
+              startMs_(name != nullptr && isEnabled() ? Time::getMillisecondCounterHiRes() : 0.0)
+        {
+        }
+
+        ~Scope()
+        {
+            if (startMs_ > 0.0)
+                record(name_, startMs_, Time::getMillisecondCounterHiRes());
+        }
+
+        const char* name_;
+        double startMs_;
+    };
+
+    // the Chrome trace-event format: a complete event per span, in us, and
+    // the threads' names
+    static String toJson()
+    {
+        auto& spans = get();
+        const int pid = (int)getpid();
+        Array<var> events;
+        for (int i = 0; i < jmin(spans.numBuffers_.get(), (int)maxThreads); ++i)
+        {
+            const Buffer* buffer = spans.buffers_[i].get();
+            if (buffer == nullptr)
+                continue;
+
+            auto* name = new DynamicObject();
+            name->setProperty("name", buffer->threadName);
+            auto* meta = new DynamicObject();
+            meta->setProperty("name", "thread_name");
+            meta->setProperty("ph", "M");
+            meta->setProperty("pid", pid);
+            meta->setProperty("tid", buffer->tid);
+            meta->setProperty("args", var(name));
+            events.add(var(meta));
+
+            const uint32 capacity = (uint32)buffer->capacity;
+            const uint32 end = buffer->written.get();
+            const uint32 begin = end > capacity ? end - capacity : 0;
+            Array<Span> copy;
+            for (uint32 pos = begin; pos < end; ++pos)
+                copy.add(buffer->spans[pos % capacity]);
+
+            // what the thread wrote while we copied may have replaced some,
+            // and the span it may be writing now replaces the oldest
+            const uint32 after = buffer->written.get();
+            const uint32 valid = after >= capacity ? after - capacity + 1 : 0;
+            for (uint32 pos = jmax(begin, valid); pos < end; ++pos)
+            {
+                const Span& span = copy.getReference((int)(pos - begin));
+                auto* event = new DynamicObject();
+                event->setProperty("name", span.name);
+                event->setProperty("ph", "X");
+                event->setProperty("ts", span.startMs * 1000.0);
+                event->setProperty("dur", jmax(0.0, span.endMs - span.startMs) * 1000.0);
+                event->setProperty("pid", pid);
+                event->setProperty("tid", buffer->tid);
+                events.add(var(event));
+            }
+        }
+
+        auto* trace = new DynamicObject();
+        trace->setProperty("traceEvents", events);
+        trace->setProperty("displayTimeUnit", "ms");
+        return JSON::toString(var(trace), true);
+    }
+
+private:
+    static const int maxThreads = 32;
+
+    struct Span
+    {
+        const char* name;
+        double startMs;
+        double endMs;
+    };
+
+    struct Buffer
+    {
+        int tid;
+        String threadName;
+        int capacity;
+        Atomic<uint32> written { 0 };
+        HeapBlock<Span> spans;
+    };
+
+    ~TraceSpans()
+    {
+        for (auto& buffer : buffers_)
+            delete buffer.get();
+    }
+
+    static TraceSpans& get()
+    {
+        static TraceSpans spans;
+        return spans;
+    }
+
+    Buffer* getThreadBuffer()
+    {
+        static thread_local Buffer* buffer = nullptr;
+        static thread_local bool full = false;
+        if (buffer != nullptr || full)
+            return buffer;
+
+        const int index = ++numBuffers_ - 1;
+        if (index >= maxThreads)
+        {
+            full = true;
+            return nullptr;
+        }
+
+        auto* thread = Thread::getCurrentThread();
+        auto* messageManager = MessageManager::getInstanceWithoutCreating();
+        buffer = new Buffer();
+        buffer->tid = (int)syscall(SYS_gettid);
+        if (thread != nullptr)
+            buffer->threadName = thread->getThreadName();
+        else if (messageManager != nullptr && messageManager->isThisTheMessageThread())
+            buffer->threadName = "message";
+        else
+            buffer->threadName = "thread " + String(buffer->tid);
+        buffer->capacity = capacity_;
+        buffer->spans.calloc((size_t)capacity_);
+        buffers_[index] = buffer;
+        return buffer;
+    }
+
+    Atomic<int> enabled_ { 0 };
+    int capacity_ = 0;
+    Atomic<int> numBuffers_ { 0 };
+    Atomic<Buffer*> buffers_[maxThreads];
+};
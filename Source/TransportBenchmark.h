@@ -0,0 +1,223 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#pragma once
+
+#include "OscInput.h"
+#include "OscOutput.h"
+#include "OscPacket.h"
+#include "PacketQueue.h"
+#include "LedCore.h"
+#include "LatencyHistogram.h"
+#include "FutexEvent.h"
+
+//==============================================================================
+// The same LED traffic through each way a looper can reach the LEDs: OSC
+// over UDP loopback, OSC over an AF_UNIX datagram socket, and an in-process
+// queue into the embedded LedCore, as a host linking the core library would
+// have it. Every packet is a sequenced /led, decoded on the receiving side
+// and applied to a core with a null board, so only the transport differs.
+// The sender keeps at most window packets in flight, so a transport that
+// drops under load shows up as lost packets rather than as a queue growing
+// without bound; latency runs from the send to the LED being written.
+class TransportBenchmark : private OscInput::Listener
+{
+public:
+    static const int window = 64;
+
+    TransportBenchmark(int udpPort = 9958, const String& unixPath = "/tmp/loop4r_leds_tbench.sock")
+        : udpPort_(udpPort),
+          unixPath_(unixPath)
+    {
+        core_.addBoard("null");
+        core_.open();
+    }
+
+    // count packets through each transport, the results as JSON
+    String run(int count)
+    {
+        count = jmax(1, count);
+        var results;
+        results.append(runUdp(count));
+        results.append(runUnix(count));
+        results.append(runInProcess(count));
+
+        auto* root = new DynamicObject();
+        root->setProperty("version", ProjectInfo::versionString);
+        root->setProperty("packets", count);
+        root->setProperty("window", window);
+        root->setProperty("transports", results);
+        return JSON::toString(var(root));
+    }
+
+private:
+    var runUdp(int count)
+    {
+        OscInput input(*this);
+        OscOutput output;
+        if (! input.connect({ udpPort_ }) || ! output.connect("127.0.0.1", udpPort_))
+            return failed("udp_loopback");
+        return measure("udp_loopback", count, [&output] (const void* data, size_t size) { return output.send(data, size); });
+    }
+
+    var runUnix(int count)
+    {
+        OscInput input(*this);
+        OscOutput output;
+        if (! input.connect({ 0 }, StringArray(unixPath_)) || ! output.connectUnix(unixPath_))
+            return failed("unix_datagram");
+        return measure("unix_datagram", count, [&output] (const void* data, size_t size) { return output.send(data, size); });
+    }
+
+    // the packets go through the queue the bridge hands them to its
+    // message thread with, to a thread of our own applying them
+    var runInProcess(int count)
+    {
+        InProcessConsumer consumer(*this);
+        consumer.startThread();
+        var result = measure("in_process", count, [&consumer] (const void* data, size_t size)
+        {
+            if (! consumer.queue_.push({ (const char*)data, (int)size, 0.0 }))
+                return false;
+            if (consumer.queue_.claimWakeup())
+                consumer.wakeup_.signal();
+            return true;
+        });
+        consumer.signalThreadShouldExit();
+        consumer.wakeup_.signal();
+        consumer.stopThread(1000);
+        return result;
+    }
+
+    struct InProcessConsumer : public Thread
+    {
+        InProcessConsumer(TransportBenchmark& owner)
+            : Thread("loop4r tbench"),
+              owner_(owner)
+        {
+        }
+
+        void run() override
+        {
+            OscInput::Packet batch[64];
+            while (! threadShouldExit())
+            {
+                queue_.beginDrain();
+                int numPackets;
+                while ((numPackets = queue_.peek(batch, numElementsInArray(batch))) > 0)
+                {
+                    owner_.oscPacketsReceived(batch, numPackets);
+                    queue_.release(numPackets);
+                }
+                wakeup_.wait(100);
+            }
+        }
+
+        TransportBenchmark& owner_;
+        PacketQueue queue_;
+        FutexEvent wakeup_;
+    };
+
+    template <typename Send>
+    var measure(const String& name, int count, Send&& send)
+    {
+        sentMs_.calloc((size_t)count);
+        count_ = count;
+        received_ = 0;
+        latency_.reset();
+        core_.invalidate();
+
+        int64 sent = 0, sendFailures = 0, lost = 0;
+        MemoryOutputStream packet;
+        const double startMs = Time::getMillisecondCounterHiRes();
+        for (int i = 0; i < count; ++i)
+        {
+            // nothing coming back for a while means the rest of the window
+            // was dropped on the way
+            while (sent - lost - received_.get() >= window)
+            {
+                const int64 before = received_.get();
+                if (! progress_.wait(200) && received_.get() == before)
+                    lost = sent - received_.get();
+            }
+
+            packet.reset();
+            OscPacket::encode(packet, "/led", (int32)(i % 10), (int32)(i & 1), (int32)0, (int32)(i & 1), (int32)i);
+            sentMs_[i] = Time::getMillisecondCounterHiRes();
+            if (send(packet.getData(), packet.getDataSize()))
+                ++sent;
+            else
+                ++sendFailures;
+        }
+
+        while (received_.get() < sent - lost)
+        {
+            const int64 before = received_.get();
+            if (! progress_.wait(200) && received_.get() == before)
+                break;
+        }
+        const double elapsedMs = Time::getMillisecondCounterHiRes() - startMs;
+
+        auto* result = new DynamicObject();
+        result->setProperty("name", name);
+        result->setProperty("received", received_.get());
+        result->setProperty("lost", sent - received_.get());
+        result->setProperty("send_failures", sendFailures);
+        result->setProperty("packets_per_s", (double)received_.get() * 1000.0 / jmax(0.001, elapsedMs));
+        result->setProperty("p50_us", latency_.getPercentile(0.5));
+        result->setProperty("p99_us", latency_.getPercentile(0.99));
+        result->setProperty("max_us", latency_.getMax());
+        return var(result);
+    }
+
+    static var failed(const String& name)
+    {
+        auto* result = new DynamicObject();
+        result->setProperty("name", name);
+        result->setProperty("error", "could not connect");
+        return var(result);
+    }
+
+    // on the receiving thread of whichever transport runs
+    void oscPacketsReceived(const OscInput::Packet* packets, int numPackets) override
+    {
+        LedEvent event;
+        for (int i = 0; i < numPackets; ++i)
+        {
+            if (! OscPacket::decodeLedEvent(packets[i].data, packets[i].size, event)
+                || event.type != LedEvent::SequencedLed || ! isPositiveAndBelow(event.args[4], count_))
+                continue;
+
+            core_.setLed(event.args[0], event.args[1] != 0);
+            core_.flush();
+            latency_.record(Time::getMillisecondCounterHiRes() - sentMs_[event.args[4]]);
+            ++received_;
+        }
+        progress_.signal();
+    }
+
+    int udpPort_;
+    String unixPath_;
+    LedCore core_;
+    HeapBlock<double> sentMs_;
+    int count_ = 0;
+    Atomic<int64> received_ { 0 };
+    LatencyHistogram latency_ { "transport" };
+    FutexEvent progress_;
+};
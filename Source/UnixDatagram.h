@@ -0,0 +1,86 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+//==============================================================================
+// AF_UNIX datagram sockets for OSC between processes on the same host, named
+// by a path in place of a UDP port. A datagram goes from one socket buffer
+// to the other without the IP stack, and paths don't clash with ports other
+// programs happen to use.
+struct UnixDatagram
+{
+    // what oin, oout and eng take for a path rather than a port number
+    static bool isPath(const String& text)
+    {
+        return text.containsChar('/');
+    }
+
+    static bool makeAddress(const String& path, sockaddr_un& address)
+    {
+        zerostruct(address);
+        address.sun_family = AF_UNIX;
+        if (path.isEmpty() || (size_t)path.getNumBytesAsUTF8() >= sizeof(address.sun_path))
+            return false;
+
+        path.copyToUTF8(address.sun_path, sizeof(address.sun_path));
+        return true;
+    }
+
+    // a socket receiving on path, replacing one left behind by an earlier
+    // run; -1 on failure
+    static int bind(const String& path)
+    {
+        sockaddr_un address;
+        if (! makeAddress(path, address))
+            return -1;
+
+        int handle = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (handle < 0)
+            return -1;
+
+        ::unlink(address.sun_path);
+        if (::bind(handle, (sockaddr*)&address, sizeof(address)) != 0)
+        {
+            ::close(handle);
+            return -1;
+        }
+        return handle;
+    }
+
+    // a socket sending to path, -1 if nothing is bound there yet
+    static int connect(const String& path)
+    {
+        sockaddr_un address;
+        if (! makeAddress(path, address))
+            return -1;
+
+        int handle = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (handle >= 0 && ::connect(handle, (sockaddr*)&address, sizeof(address)) != 0)
+        {
+            ::close(handle);
+            return -1;
+        }
+        return handle;
+    }
+};
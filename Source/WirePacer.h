@@ -0,0 +1,110 @@
+/*
+ * This file is part of loop4r_control.
+ * Copyright (C) 2018 Atin Malaviya.  https://www.github.com/atinm
+ *
+ * loop4r_control is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * loop4r_control is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+//==============================================================================
+// Models the 5-pin DIN wire behind the port: 31250 baud at 10 bits a byte is
+// 3125 bytes a second, however fast the USB side takes them. A token bucket
+// refilled slightly below that rate, holding as much as the interface and
+// the pedalboard buffer, tells whether a write would only queue up behind
+// what is still on its way. Bytes beyond the bucket count as queued on the
+// wire until the rate has drained them. Used from whichever thread flushes
+// the board, under the application's stateLock_.
+class WirePacer
+{
+public:
+    static constexpr double lineBytesPerSecond = 31250.0 / 10.0;
+
+    // percent of the line rate, 0 to pace nothing
+    void setRate(int percent, int burstBytes)
+    {
+        bytesPerMs_ = lineBytesPerSecond * jlimit(0, 100, percent) / 100.0 / 1000.0;
+        burstBytes_ = jmax(1, burstBytes);
+        tokens_ = burstBytes_;
+        updatedMs_ = 0.0;
+    }
+
+    bool isEnabled() const
+    {
+        return bytesPerMs_ > 0.0;
+    }
+
+    // true if bytes written now would go out without waiting on the wire
+    bool isReady(double nowMs)
+    {
+        refill(nowMs);
+        return ! isEnabled() || tokens_ > 0.0;
+    }
+
+    void consume(int bytes, double nowMs)
+    {
+        if (! isEnabled())
+            return;
+
+        refill(nowMs);
+        tokens_ -= bytes;
+    }
+
+    // how long until isReady()
+    double getMsUntilReady(double nowMs)
+    {
+        refill(nowMs);
+        return isEnabled() && tokens_ <= 0.0 ? (1.0 - tokens_) / bytesPerMs_ : 0.0;
+    }
+
+    // the bytes written but estimated not to have left yet, and how long
+    // until they have
+    int getQueuedBytes(double nowMs)
+    {
+        refill(nowMs);
+        return isEnabled() ? (int)std::ceil(burstBytes_ - tokens_) : 0;
+    }
+
+    double getMsToDrain(double nowMs)
+    {
+        return isEnabled() ? getQueuedBytes(nowMs) / bytesPerMs_ : 0.0;
+    }
+
+    // flushes held back for the wire to catch up
+    void heldBack()
+    {
+        ++heldBack_;
+    }
+
+    int64 getHeldBack() const
+    {
+        return heldBack_;
+    }
+
+private:
+    void refill(double nowMs)
+    {
+        if (updatedMs_ > 0.0)
+            tokens_ = jmin((double)burstBytes_, tokens_ + (nowMs - updatedMs_) * bytesPerMs_);
+        updatedMs_ = nowMs;
+    }
+
+    double bytesPerMs_ = 0.0;
+    int burstBytes_ = 64;
+    double tokens_ = 64.0;
+    double updatedMs_ = 0.0;
+    int64 heldBack_ = 0;
+};